@@ -0,0 +1,275 @@
+classdef LoggerTestCase < matlab.unittest.TestCase
+    % Tests of ws.logger, which writes data files in each of its formats,
+    % and of reading those files back.  Needs the MEX files built, but no
+    % daq.  The sweeps logged include ones of odd lengths, and ones of
+    % random ADC counts, which can't be compressed.
+
+    properties (Constant)
+        SampleRate = 20000  % Hz
+        DigitalChannelCount = 3
+        BlockScanCount = 999  % scans per AppendScans, odd so blocks straddle chunks
+    end
+
+    properties
+        FolderName  % a fresh folder for each test's files
+        FileName  % the data file, in FolderName
+    end
+
+    methods (TestMethodSetup)
+        function setup(self)
+            self.FolderName = tempname() ;
+            mkdir(self.FolderName) ;
+            self.FileName = fullfile(self.FolderName, 'logged_0001.h5') ;
+        end
+    end
+
+    methods (TestMethodTeardown)
+        function teardown(self)
+            rmdir(self.FolderName, 's') ;
+        end
+    end
+
+    methods (Test)
+        function testSynchronousHDF5(self)
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 0, 'hdf5', 'adaptive', false) ;
+            self.verifySweeps(sweeps) ;
+        end
+
+        function testAsynchronousHDF5(self)
+            % The queue is smaller than a sweep, so AppendScans has to wait on
+            % the writer thread at times
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 2^16, 'hdf5', 'adaptive', false) ;
+            self.verifySweeps(sweeps) ;
+        end
+
+        function testFixedLayout(self)
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 0, 'hdf5', 'fixed', false) ;
+            self.verifySweeps(sweeps) ;
+        end
+
+        function testCompressed(self)
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 0, 'compressed', 'adaptive', false) ;
+            self.verifyTrue(self.isCompressed('/sweep_0001/analogScans')) ;
+            self.verifyTrue(self.isCompressed('/sweep_0001/digitalScans')) ;
+            self.verifySweeps(sweeps) ;
+        end
+
+        function testAsynchronousCompressed(self)
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 2^16, 'compressed', 'adaptive', false) ;
+            self.verifySweeps(sweeps) ;
+        end
+
+        function testCompressedWithFixedLayout(self)
+            % Whole-sweep chunks, so each sweep is one chunk of an odd size
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 0, 'compressed', 'fixed', false) ;
+            self.verifySweeps(sweeps) ;
+        end
+
+        function testCompressedTimeSubset(self)
+            % Subsets in time of a compressed file are read through ws.reader
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 0, 'compressed', 'adaptive', false) ;
+            dataFileAsStruct = ws.loadDataFile(self.FileName, 'raw', 0.01, 0.1, 1, 1) ;
+            scanIndices = 201:2000 ;
+            self.verifyEqual(dataFileAsStruct.sweep_0001.analogScans, sweeps(1).analogScans(scanIndices,:)) ;
+            self.verifyEqual(dataFileAsStruct.sweep_0001.digitalScans, sweeps(1).digitalScans(scanIndices,:)) ;
+            self.verifyFalse(isfield(dataFileAsStruct, 'sweep_0002')) ;
+        end
+
+        function testRaw(self)
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 0, 'raw', 'adaptive', false) ;
+            self.verifyTrue(ws.isRawDataFile(self.FileName)) ;
+            self.verifyError(@()(ws.loadDataFile(self.FileName, 'raw')), ?MException) ;
+            wasRaw = ws.convertRawDataFile(self.FileName) ;
+            self.verifyTrue(wasRaw) ;
+            self.verifyFalse(ws.isRawDataFile(self.FileName)) ;
+            self.verifySweeps(sweeps) ;
+            % Converting again does nothing
+            wasRaw = ws.convertRawDataFile(self.FileName) ;
+            self.verifyFalse(wasRaw) ;
+            self.verifySweeps(sweeps) ;
+        end
+
+        function testRawConvertedCompressed(self)
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 2^16, 'raw', 'adaptive', false) ;
+            wasRaw = ws.convertRawDataFile(self.FileName, true) ;
+            self.verifyTrue(wasRaw) ;
+            self.verifyTrue(self.isCompressed('/sweep_0003/analogScans')) ;
+            self.verifySweeps(sweeps) ;
+        end
+
+        function testJournal(self)
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 0, 'journal', 'adaptive', false) ;
+            self.verifyTrue(ws.isJournaledDataFile(self.FileName)) ;
+            self.verifyError(@()(ws.loadDataFile(self.FileName, 'raw')), ?MException) ;
+            [wasJournaled, sweepCount, wasComplete] = ws.recoverDataFile(self.FileName) ;
+            self.verifyTrue(wasJournaled) ;
+            self.verifyEqual(sweepCount, length(sweeps)) ;
+            self.verifyTrue(wasComplete) ;
+            self.verifyFalse(ws.isJournaledDataFile(self.FileName)) ;
+            self.verifySweeps(sweeps) ;
+        end
+
+        function testRecoveringTruncatedJournal(self)
+            % As if WaveSurfer died partway through the last sweep: the journal
+            % ends in the middle of one of its records of scans
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 0, 'journal', 'adaptive', false) ;
+            journalFileName = fullfile(self.FolderName, 'logged_0001.journal') ;
+            fid = fopen(journalFileName, 'r') ;
+            journal = fread(fid, inf, '*uint8') ;
+            fclose(fid) ;
+            fid = fopen(journalFileName, 'w') ;
+            fwrite(fid, journal(1:end-10001)) ;
+            fclose(fid) ;
+
+            [wasJournaled, sweepCount, wasComplete] = ws.recoverDataFile(self.FileName) ;
+            self.verifyTrue(wasJournaled) ;
+            self.verifyEqual(sweepCount, length(sweeps)) ;
+            self.verifyFalse(wasComplete) ;
+            self.verifyFalse(ws.isJournaledDataFile(self.FileName)) ;
+
+            % The last sweep should be all its scans up to the last intact
+            % record, and the sweeps before it whole
+            dataFileAsStruct = ws.loadDataFile(self.FileName, 'raw') ;
+            recoveredScanCount = size(dataFileAsStruct.sweep_0003.analogScans, 1) ;
+            self.verifyGreaterThan(recoveredScanCount, 30000) ;
+            self.verifyLessThan(recoveredScanCount, size(sweeps(3).analogScans, 1)) ;
+            sweeps(3).analogScans = sweeps(3).analogScans(1:recoveredScanCount,:) ;
+            sweeps(3).digitalScans = sweeps(3).digitalScans(1:recoveredScanCount,:) ;
+            self.verifySweeps(sweeps) ;
+
+            % Recovering again does nothing
+            [wasJournaled, sweepCount] = ws.recoverDataFile(self.FileName) ;
+            self.verifyFalse(wasJournaled) ;
+            self.verifyEqual(sweepCount, 0) ;
+            self.verifySweeps(sweeps) ;
+        end
+
+        function testOverviews(self)
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 0, 'hdf5', 'adaptive', true) ;
+            self.verifyOverviews(sweeps) ;
+            % ws.loadDataFile() leaves the overviews out
+            dataFileAsStruct = ws.loadDataFile(self.FileName, 'raw') ;
+            self.verifyEqual(sort(fieldnames(dataFileAsStruct.sweep_0001)), {'analogScans' ; 'digitalScans' ; 'timestamp'}) ;
+            self.verifySweeps(sweeps) ;
+        end
+
+        function testOverviewsOfRecoveredJournal(self)
+            sweeps = self.makeSweeps() ;
+            self.logSweeps(sweeps, 2^16, 'journal', 'adaptive', true) ;
+            ws.recoverDataFile(self.FileName, true, true) ;
+            self.verifyOverviews(sweeps) ;
+            self.verifySweeps(sweeps) ;
+        end
+    end  % test methods
+
+    methods
+        function sweeps = makeSweeps(self)
+            % Three sweeps of three AI channels: one of random ADC counts, over
+            % the whole range, one of only seven scans, and one of a slow sine
+            % wave, with the digital lines mostly still, which compresses well.
+            stream = RandStream('mt19937ar', 'Seed', 45) ;
+            digitalValueCount = 2^self.DigitalChannelCount ;
+            sweeps = struct('timestamp', {}, 'analogScans', {}, 'digitalScans', {}) ;
+
+            nScans = 12345 ;
+            sweeps(1).timestamp = 1.5 ;
+            sweeps(1).analogScans = int16(randi(stream, [-32768 32767], nScans, 3)) ;
+            sweeps(1).digitalScans = uint8(randi(stream, [0 digitalValueCount-1], nScans, 1)) ;
+
+            nScans = 7 ;
+            sweeps(2).timestamp = 4.25 ;
+            sweeps(2).analogScans = int16(reshape(-10:10, [nScans 3])) ;
+            sweeps(2).digitalScans = uint8(mod((0:nScans-1)', digitalValueCount)) ;
+
+            nScans = 40001 ;
+            t = (0:nScans-1)'/self.SampleRate ;
+            sweeps(3).timestamp = 7 ;
+            sweeps(3).analogScans = int16(round(10000*sin(bsxfun(@plus, 2*pi*5*t, [0 1 2])))) ;
+            sweeps(3).digitalScans = uint8(mod(floor(t/0.1), digitalValueCount)) ;
+        end
+
+        function logSweeps(self, sweeps, queueByteCapacity, format, layoutPolicy, doWriteOverviews)
+            % Log the sweeps to FileName, as ws.Logging does, appending
+            % BlockScanCount scans at a time
+            header = struct('VersionString', ws.versionString(), ...
+                            'Acquisition', struct('SampleRate', self.SampleRate)) ;
+            ws.h5save(self.FileName, '/header', header, true) ;
+            logFile = ws.logger('OpenFile', self.FileName, queueByteCapacity, format, layoutPolicy, doWriteOverviews) ;
+            for sweepIndex = 1:length(sweeps) ,
+                sweep = sweeps(sweepIndex) ;
+                [nScans, analogChannelCount] = size(sweep.analogScans) ;
+                ws.logger('StartSweep', logFile, sweepIndex, sweep.timestamp, analogChannelCount, self.DigitalChannelCount, nScans, self.SampleRate) ;
+                for firstScanIndex = 1:self.BlockScanCount:nScans ,
+                    scanIndices = firstScanIndex:min(nScans, firstScanIndex+self.BlockScanCount-1) ;
+                    ws.logger('AppendScans', logFile, sweep.analogScans(scanIndices,:), sweep.digitalScans(scanIndices,:)) ;
+                end
+                ws.logger('EndSweep', logFile) ;
+            end
+            ws.logger('CloseFile', logFile) ;
+        end
+
+        function verifySweeps(self, sweeps)
+            % Check that FileName holds the sweeps, exactly, both through
+            % ws.loadDataFile() and through ws.DataFileReader
+            dataFileAsStruct = ws.loadDataFile(self.FileName, 'raw') ;
+            self.verifyEqual(dataFileAsStruct.header.Acquisition.SampleRate, self.SampleRate) ;
+            for sweepIndex = 1:length(sweeps) ,
+                sweep = sweeps(sweepIndex) ;
+                sweepAsStruct = dataFileAsStruct.(sprintf('sweep_%04d', sweepIndex)) ;
+                self.verifyEqual(sweepAsStruct.timestamp, sweep.timestamp) ;
+                self.verifyEqual(sweepAsStruct.analogScans, sweep.analogScans) ;
+                self.verifyEqual(sweepAsStruct.digitalScans, sweep.digitalScans) ;
+            end
+
+            reader = ws.DataFileReader(self.FileName) ;
+            self.verifyEqual(reader.SweepIndices, 1:length(sweeps)) ;
+            for sweepIndex = 1:length(sweeps) ,
+                sweep = sweeps(sweepIndex) ;
+                [scanCount, analogChannelCount, timestamp] = reader.sweepSize(sweepIndex) ;
+                self.verifyEqual(scanCount, size(sweep.analogScans,1)) ;
+                self.verifyEqual(analogChannelCount, size(sweep.analogScans,2)) ;
+                self.verifyEqual(timestamp, sweep.timestamp) ;
+                self.verifyEqual(reader.rawAnalogScans(sweepIndex), sweep.analogScans) ;
+                self.verifyEqual(reader.digitalScans(sweepIndex), sweep.digitalScans) ;
+                % A slice, of some channels, out of order, starting and ending mid-chunk
+                scanRange = [ceil(scanCount/3) scanCount-1] ;
+                scanIndices = scanRange(1):scanRange(2) ;
+                self.verifyEqual(reader.rawAnalogScans(sweepIndex, [3 1], scanRange), sweep.analogScans(scanIndices,[3 1])) ;
+                self.verifyEqual(reader.digitalScans(sweepIndex, scanRange), sweep.digitalScans(scanIndices,:)) ;
+            end
+            delete(reader) ;
+        end
+
+        function verifyOverviews(self, sweeps)
+            % Check the finest overview of each sweep against
+            % ws.minMaxDownsampleMex(), whose y output it's laid out like.
+            % Overviews are never compressed, so Matlab can read them.
+            r = 32 ;
+            for sweepIndex = 1:length(sweeps) ,
+                analogScans = sweeps(sweepIndex).analogScans ;
+                t = (0:size(analogScans,1)-1)'/self.SampleRate ;
+                [~, yOverview] = ws.minMaxDownsampleMex(t, double(analogScans), r) ;
+                overview = h5read(self.FileName, sprintf('/sweep_%04d/analogScansOverview_%d', sweepIndex, r)) ;
+                self.verifyEqual(overview, int16(yOverview)) ;
+            end
+        end
+
+        function result = isCompressed(self, pathToDataset)
+            info = h5info(self.FileName, pathToDataset) ;
+            result = ~isempty(info.Filters) && any(strncmp({info.Filters.Name}, 'ws.scanFilter', length('ws.scanFilter'))) ;
+        end
+    end  % helper methods
+
+end  % classdef
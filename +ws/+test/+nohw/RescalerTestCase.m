@@ -0,0 +1,94 @@
+classdef RescalerTestCase < matlab.unittest.TestCase
+    % Tests of ws.rescaler, which adds scaling coefficients to a tree of data
+    % files, and verifies them.  Needs the MEX files built, but no daq.
+
+    properties
+        TargetFolderName  % where each test puts the files with coefficients added
+    end
+
+    methods (TestMethodSetup)
+        function setup(self)
+            self.TargetFolderName = tempname() ;
+        end
+    end
+
+    methods (TestMethodTeardown)
+        function teardown(self)
+            if exist(self.TargetFolderName, 'dir') ,
+                rmdir(self.TargetFolderName, 's') ;
+            end
+        end
+    end
+
+    methods (Test)
+        function testAddingThenVerifying(self)
+            thisDirName = fileparts(mfilename('fullpath')) ;
+            sourceFolderName = fullfile(thisDirName, 'folder_without_scaling_coeffs') ;
+            fakeCoefficients = [ 0 1 0 0 ; ...
+                                 0 2 0 0 ; ...
+                                 0 3 0 0 ; ...
+                                 0 4 0 0 ; ...
+                                 0 5 0 0 ; ...
+                                 0 6 0 0 ; ...
+                                 0 7 0 0 ]' ;
+            sourceFileNames = { 'acq.h5', ...
+                                'acquired_without_scaling_coeffs_0002.h5', ...
+                                'acquired_without_scaling_coeffs_0003.h5', ...
+                                'acquired_without_scaling_coeffs_0005.h5', ...
+                                'acquired_without_scaling_coeffs_bleep_blorp.h5', ...
+                                fullfile('foo', 'acquired_without_scaling_coeffs_0003.h5') } ;
+
+            % A dry run writes nothing
+            isDryRun = true ;
+            [problems, fileCount] = ws.rescaler('AddScaling', sourceFolderName, fakeCoefficients, self.TargetFolderName, isDryRun) ;
+            self.verifyEmpty(problems) ;
+            self.verifyEqual(fileCount, length(sourceFileNames)) ;
+            self.verifyFalse(logical(exist(self.TargetFolderName, 'dir'))) ;
+
+            % Add them, two files at a time
+            isDryRun = false ;
+            [problems, fileCount, skippedFileCount] = ws.rescaler('AddScaling', sourceFolderName, fakeCoefficients, self.TargetFolderName, isDryRun, 2) ;
+            self.verifyEmpty(problems) ;
+            self.verifyEqual(fileCount, length(sourceFileNames)) ;
+            self.verifyEqual(skippedFileCount, 0) ;
+
+            % Each target file should be its source file, plus the coefficients
+            % of the terminals it used, unless it had coefficients already
+            for i = 1:length(sourceFileNames) ,
+                sourceFileName = fullfile(sourceFolderName, sourceFileNames{i}) ;
+                targetFileName = fullfile(self.TargetFolderName, sourceFileNames{i}) ;
+                source = ws.loadDataFile(sourceFileName, 'raw') ;
+                target = ws.loadDataFile(targetFileName, 'raw') ;
+                if isfield(source.header.Acquisition, 'AnalogScalingCoefficients') ,
+                    coefficientsAsTheyShouldBe = source.header.Acquisition.AnalogScalingCoefficients ;
+                else
+                    terminalIDs = source.header.Acquisition.AnalogTerminalIDs ;
+                    coefficientsAsTheyShouldBe = fakeCoefficients(:, terminalIDs+1) ;
+                end
+                self.verifyEqual(target.header.Acquisition.AnalogScalingCoefficients, coefficientsAsTheyShouldBe) ;
+                target.header.Acquisition = rmfield(target.header.Acquisition, 'AnalogScalingCoefficients') ;
+                if isfield(source.header.Acquisition, 'AnalogScalingCoefficients') ,
+                    source.header.Acquisition = rmfield(source.header.Acquisition, 'AnalogScalingCoefficients') ;
+                end
+                self.verifyEqual(target, source) ;
+            end
+
+            % Verify them
+            [isAllWell, problems, fileCount] = ws.rescaler('VerifyScaling', sourceFolderName, fakeCoefficients, self.TargetFolderName) ;
+            self.verifyTrue(isAllWell) ;
+            self.verifyEmpty(problems) ;
+            self.verifyEqual(fileCount, length(sourceFileNames)) ;
+
+            % Adding again skips every file
+            [problems, ~, skippedFileCount] = ws.rescaler('AddScaling', sourceFolderName, fakeCoefficients, self.TargetFolderName, isDryRun) ;
+            self.verifyEmpty(problems) ;
+            self.verifyEqual(skippedFileCount, length(sourceFileNames)) ;
+
+            % Verifying against other coefficients fails
+            [isAllWell, problems] = ws.rescaler('VerifyScaling', sourceFolderName, 2*fakeCoefficients, self.TargetFolderName) ;
+            self.verifyFalse(isAllWell) ;
+            self.verifyNotEmpty(problems) ;
+        end
+    end  % test methods
+
+end  % classdef
@@ -37,6 +37,9 @@ classdef AITask < handle
         NScansReadSoFar_  % only accurate if DAQmxTaskHandles_ is empty, and task has been started
         NScansExpectedCache_  % only accurate if DAQmxTaskHandles_ is empty, and task has been started
         CachedFinalScanTime_  % used when self.DAQmxTaskHandles_ is empty
+        ConstructorArguments_ = cell(1,0)  % the arguments the task was made with, for canBeReusedFor()
+        ConfigurationFingerprints_ = zeros(1,0,'uint64')  % the native configuration fingerprint of each DAQmx task, once fully configured
+        IsClosedLoopRunning_ = false  % true between startClosedLoop() and stopClosedLoop()
         %KeystoneTask_
         %TriggerDeviceName_
         %TriggerPFIID_
@@ -49,6 +52,12 @@ classdef AITask < handle
                                keystoneTaskType, keystoneTaskDeviceName, ...
                                triggerDeviceNameIfKeystone, triggerPFIIDIfKeystone, triggerEdgeIfKeystone)
                            
+            % Remember the arguments, so we can tell later if the task can be reused
+            self.ConstructorArguments_ = {taskName, primaryDeviceName, isPrimaryDeviceAPXIDevice, deviceNamePerChannel, terminalIDPerChannel, ...
+                                          sampleRate, desiredSweepDuration, ...
+                                          keystoneTaskType, keystoneTaskDeviceName, ...
+                                          triggerDeviceNameIfKeystone, triggerPFIIDIfKeystone, triggerEdgeIfKeystone} ;
+                                      
             % Group the channels by device, with the primary device first
             [deviceNamePerDevice, terminalIDsPerDevice, channelIndicesPerDevice] = ...
                 ws.collectTerminalsByDevice(deviceNamePerChannel, terminalIDPerChannel, primaryDeviceName) ;
@@ -193,6 +202,14 @@ classdef AITask < handle
                         ws.ni('DAQmxCfgDigEdgeStartTrig', daqmxTaskHandle, triggerTerminalName, daqmxTriggerEdge);
                     end
                 end
+                
+                % Commit the tasks, so that starting them for each sweep is
+                % quick, and note their configuration fingerprints
+                self.commit() ;
+                self.ConfigurationFingerprints_ = zeros(1, deviceCount, 'uint64') ;
+                for deviceIndex = 1:deviceCount ,
+                    self.ConfigurationFingerprints_(deviceIndex) = ws.ni('GetTaskConfigurationFingerprint', self.DAQmxTaskHandles_{deviceIndex}) ;
+                end
             end
         end  % function
         
@@ -251,6 +268,50 @@ classdef AITask < handle
             end
         end
         
+        function result = canBeReusedFor(self, varargin)
+            % True iff the task was made with the given constructor
+            % arguments, and its DAQmx tasks are stopped and still configured
+            % as they were then, so that it can be used for another run
+            % after a call to commit(), instead of making a new task.
+            result = isequal(self.ConstructorArguments_, varargin) ;
+            if ~result ,
+                return
+            end
+            deviceCount = length(self.DAQmxTaskHandles_) ;
+            for deviceIndex = 1:deviceCount ,
+                daqmxTaskHandle = self.DAQmxTaskHandles_{deviceIndex} ;
+                if ~ws.ni('DAQmxIsTaskDone', daqmxTaskHandle) || ...
+                   ws.ni('GetTaskConfigurationFingerprint', daqmxTaskHandle) ~= self.ConfigurationFingerprints_(deviceIndex) ,
+                    result = false ;
+                    return
+                end
+            end
+        end
+        
+        function commit(self)
+            % Commit the DAQmx tasks.  This is quick if they're committed as
+            % configured already.
+            deviceCount = length(self.DAQmxTaskHandles_) ;
+            for deviceIndex = 1:deviceCount ,
+                ws.ni('DAQmxTaskControl', self.DAQmxTaskHandles_{deviceIndex}, 'DAQmx_Val_Task_Commit') ;
+            end
+        end
+        
+        function stopAndUnreserve(self)
+            % Stop the closed loop and the DAQmx tasks, and free up the
+            % hardware they reserved, but keep the tasks configured, so the
+            % task can be reused for the next run.
+            self.stopClosedLoop() ;
+            deviceCount = length(self.DAQmxTaskHandles_) ;
+            for deviceIndex = 1:deviceCount ,
+                daqmxTaskHandle = self.DAQmxTaskHandles_{deviceIndex} ;
+                % Stop even if done, since a finite task that's done can't be
+                % started again until it's been stopped
+                ws.ni('DAQmxStopTask', daqmxTaskHandle) ;
+                ws.ni('DAQmxTaskControl', daqmxTaskHandle, 'DAQmx_Val_Task_Unreserve') ;
+            end
+        end
+        
         function result = isDone(self)
             if isempty(self.DAQmxTaskHandles_) ,
                 if isinf(self.DesiredSweepDuration_) ,  % don't want to bother with toc() if we already know the answer...
@@ -274,6 +335,42 @@ classdef AITask < handle
             end            
         end
         
+        function startClosedLoop(self, doBinding, rules)
+            % Start a native closed loop on the primary-device task, which
+            % sets the lines of doBinding (from
+            % ws.OnDemandDOTask.getOnDemandDOBinding()) from threshold rules
+            % applied to the raw AI samples, without going through Matlab.
+            % rules is nRules x 5, as for ws.ni('StartClosedLoop', ...),
+            % except that the channel indices are AI channel indices, which
+            % must all be on the primary device.  Reading data works as
+            % usual while the loop runs.  Clearing the task stops it.
+            if isempty(self.DAQmxTaskHandles_) ,
+                error('ws:noAIChannels', 'There are no AI channels for a closed loop to use') ;
+            end
+            [isOnPrimaryDevice, channelIndexWithinTask] = ismember(rules(:,1), self.ChannelIndicesPerDevice_{1}) ;
+            if ~all(isOnPrimaryDevice) ,
+                error('ws:badClosedLoopRules', 'Closed-loop rules can only use AI channels on the primary device') ;
+            end
+            rulesForTask = rules ;
+            rulesForTask(:,1) = channelIndexWithinTask ;
+            ringScanCount = ws.nScansFromScanRateAndDesiredDuration(self.SampleRate_, min(self.DesiredSweepDuration_, 10)) ;
+            ws.ni('StartClosedLoop', self.DAQmxTaskHandles_{1}, doBinding, rulesForTask, ringScanCount) ;
+            self.IsClosedLoopRunning_ = true ;
+        end
+        
+        function stopClosedLoop(self)
+            if ~isempty(self.DAQmxTaskHandles_) ,
+                ws.ni('StopClosedLoop', self.DAQmxTaskHandles_{1}) ;
+            end
+            self.IsClosedLoopRunning_ = false ;
+        end
+        
+        function [scanIndex, ruleIndex, isLineHigh] = getClosedLoopEvents(self)
+            % The rule state changes since the last call, each with the
+            % (zero-based) index of the scan that caused it
+            [scanIndex, ruleIndex, isLineHigh] = ws.ni('GetClosedLoopEvents', self.DAQmxTaskHandles_{1}) ;
+        end
+        
         function value = get.ScalingCoefficients(self)
             value = self.ScalingCoefficients_ ;
         end  % function
@@ -314,6 +411,27 @@ classdef AITask < handle
             timeSinceRunStartAtStartOfData = timeSinceRunStartNow - nScans/self.SampleRate_ ;
         end  % function
     
+        function [data, isDone, timeSinceRunStartAtStartOfData] = waitForData(self, waitDuration, timeSinceSweepStart, fromRunStartTicId)
+            % Like readData([], ...) followed by isDone(), except that if
+            % fewer than waitDuration seconds' worth of scans are available,
+            % this first waits natively for that many, until the task is
+            % done, or for at most twice that long.  So a loop calling this
+            % paces itself, without spinning.  Reads from the closed-loop
+            % ring don't wait.
+            if isempty(self.DAQmxTaskHandles_) || self.IsClosedLoopRunning_ ,
+                [data, timeSinceRunStartAtStartOfData] = self.readData([], timeSinceSweepStart, fromRunStartTicId) ;
+                isDone = self.isDone() ;
+            else
+                nScansAvailable = ws.AITask.getScanCountAvailable(self.DAQmxTaskHandles_) ;
+                nScansWanted = max(nScansAvailable, ws.nScansFromScanRateAndDesiredDuration(self.SampleRate_, waitDuration)) ;
+                [data, isDone] = ws.AITask.waitForScanCountFromDAQmxTasks(nScansWanted, 2*waitDuration, self.DAQmxTaskHandles_, ...
+                                                                          self.ChannelCount_, self.ChannelIndicesPerDevice_) ;
+                self.TimeAtLastRead_ = toc(self.TicId_) ;
+                nScans = size(data,1) ;
+                timeSinceRunStartAtStartOfData = toc(fromRunStartTicId) - nScans/self.SampleRate_ ;
+            end
+        end  % function
+        
         function debug(self) %#ok<MANU>
             keyboard
         end  % function        
@@ -545,6 +663,27 @@ classdef AITask < handle
                 data(:, channelIndicesForDevice) = dataForDevice ;
             end
         end
+        
+        function [data, isDone] = waitForScanCountFromDAQmxTasks(scanCount, timeout, daqmxTaskHandles, channelCount, channelIndicesPerDevice)
+            % Wait for up to scanCount scans from the primary-device task,
+            % then read as many from the others, which share its clock.  If
+            % the tasks are done, any scans left over are read too, since
+            % they'll be stopped next.
+            primaryTaskHandle = daqmxTaskHandles{1} ;
+            [dataForPrimaryDevice, isDone] = ws.ni('WaitForScans', primaryTaskHandle, scanCount, timeout) ;
+            if isDone ,
+                dataForPrimaryDevice = vertcat(dataForPrimaryDevice, ws.ni('WaitForScans', primaryTaskHandle, double(intmax('int32')), 0)) ;
+            end
+            nScans = size(dataForPrimaryDevice,1) ;
+            data = zeros(nScans, channelCount, 'int16') ;
+            data(:, channelIndicesPerDevice{1}) = dataForPrimaryDevice ;
+            deviceCount = length(daqmxTaskHandles) ;
+            for deviceIndex = 2:deviceCount ,
+                [dataForDevice, isDoneForDevice] = ws.ni('WaitForScans', daqmxTaskHandles{deviceIndex}, nScans, -1) ;
+                data(:, channelIndicesPerDevice{deviceIndex}) = dataForDevice ;
+                isDone = isDone && isDoneForDevice ;
+            end
+        end
     end
 end
 
@@ -6,6 +6,19 @@ classdef AOTask < handle
         DAQmxTaskHandles_ = []  % Can be empty if there are zero channels
         ChannelCount_ = 0
         ChannelIndicesPerDevice_ = cell(1,0)
+        CalculateStreamedScans_ = []  % when streaming, a function that calculates the output scans with the given indices, otherwise empty
+        StreamedScanCount_ = 0  % when streaming, the number of scans in the whole output
+        NScansQueuedPerDevice_ = zeros(1,0)  % when streaming, how many scans of the output have been queued on each device's stream
+    end
+    
+    properties (Constant, Access = protected)
+        % Outputs longer than this many scans are streamed, through a native
+        % refill thread, so the driver's output buffer only ever holds
+        % StreamBufferScanCount_ scans of them, instead of all of them.
+        % Each chunk of a streamed output is calculated just before it's
+        % queued, so the whole output is never held in memory.
+        MaximumUnstreamedScanCount_ = 2^21
+        StreamBufferScanCount_ = 2^18
     end
     
     methods
@@ -186,6 +199,35 @@ classdef AOTask < handle
                 %daqmxTaskHandle.stop() ;
                 ws.ni('DAQmxStopTask', daqmxTaskHandle) ;
             end
+            self.stopOutputStreams_() ;
+        end  % function
+        
+        function refillOutputStreams(self)
+            % If the output is being streamed, queue as much more of it as
+            % there's room for on each device's stream, without waiting.
+            % Call this regularly while the task runs.  Errors if a stream
+            % ran dry.
+            if isempty(self.CalculateStreamedScans_) ,
+                return
+            end
+            nScans = self.StreamedScanCount_ ;
+            deviceCount = length(self.DAQmxTaskHandles_) ;
+            lastScanIndices = [] ;  % the devices usually need the same chunk, so only calculate it once
+            lastChunk = [] ;
+            for deviceIndex = 1:deviceCount ,
+                nScansQueued = self.NScansQueuedPerDevice_(deviceIndex) ;
+                if nScansQueued < nScans ,
+                    scanIndices = (nScansQueued+1) : min(nScans, nScansQueued+ws.AOTask.StreamBufferScanCount_) ;
+                    if ~isequal(scanIndices, lastScanIndices) ,
+                        lastChunk = self.calculateStreamedScans_(scanIndices) ;
+                        lastScanIndices = scanIndices ;
+                    end
+                    channelIndices = self.ChannelIndicesPerDevice_{deviceIndex} ;
+                    nScansQueuedNow = ws.ni('WriteToOutputStream', self.DAQmxTaskHandles_{deviceIndex}, 0, ...
+                                            lastChunk(:, channelIndices)) ;
+                    self.NScansQueuedPerDevice_(deviceIndex) = nScansQueued + nScansQueuedNow ;
+                end
+            end
         end  % function
 
         function disableTrigger(self)
@@ -228,13 +270,28 @@ classdef AOTask < handle
             if isa(newValue,requiredType) && ismatrix(newValue) && (size(newValue,2)==nChannels) ,
                 %self.ChannelData_ = newValue;
                 %self.IsOutputBufferSyncedToChannelData_ = false ;
-                self.setOutputBuffer_(newValue) ;
+                self.setOutputBuffer_(size(newValue,1), @(scanIndices)(newValue(scanIndices,:))) ;
             else
                 error('ws:invalidPropertyValue', ...
                       'ChannelData must be an NxR matrix, R the number of channels, of the appropriate type.');
             end
         end  % function        
         
+        function setChannelDataFromFunction(self, nScans, calculateScans)
+            % Like setChannelData(), but the channel data has nScans scans,
+            % and calculateScans(scanIndices) returns the ones with the
+            % given indices, as a length(scanIndices) x R double matrix.  A
+            % long output is then calculated a chunk at a time as it's
+            % streamed, instead of all at once.
+            if isnumeric(nScans) && isscalar(nScans) && isreal(nScans) && nScans>=0 && round(nScans)==nScans && ...
+               isa(calculateScans, 'function_handle') ,
+                self.setOutputBuffer_(double(nScans), calculateScans) ;
+            else
+                error('ws:invalidPropertyValue', ...
+                      'nScans must be a nonnegative integer, and calculateScans a function handle.');
+            end
+        end  % function        
+        
 %         function value = get.OutputDuration(self)
 %             value = size(self.ChannelData_,1) * self.SampleRate ;
 %         end  % function        
@@ -265,38 +322,74 @@ classdef AOTask < handle
     end  % public methods
     
     methods (Access = protected)
-        function setOutputBuffer_(self, channelData)
-            % Actually set up the task, if present
+        function setOutputBuffer_(self, nScansInChannelData, calculateChannelScans)
+            % Actually set up the task, if present.  The channel data has
+            % nScansInChannelData scans, and calculateChannelScans(scanIndices)
+            % returns the ones with the given indices.
             if isempty(self.DAQmxTaskHandles_) ,
                 % do nothing
             else            
-                % Get the channel data into a local
-                %channelData = self.ChannelData_ ;
-
-                % The outputData is the channelData, unless the channelData is
-                % very short, in which case the outputData is just long
-                % enough, and all zeros
-                nScansInChannelData = size(channelData,1) ;            
-                if nScansInChannelData<2 ,
-                    nChannels = self.ChannelCount_ ;
-                    outputData = zeros(2, nChannels) ;
-                else
-                    outputData = channelData ;
-                end
-
-                % Put the right data to each task
+                % Put the right data to each task, streaming it if it's long
+                self.stopOutputStreams_() ;
                 sampleRate = self.SampleRate_ ;
                 channelIndicesPerDevice = self.ChannelIndicesPerDevice_ ;
                 daqmxTaskHandles = self.DAQmxTaskHandles_ ;
                 deviceCount = length(daqmxTaskHandles) ;
+                if nScansInChannelData > ws.AOTask.MaximumUnstreamedScanCount_ ,
+                    self.CalculateStreamedScans_ = calculateChannelScans ;
+                    self.StreamedScanCount_ = nScansInChannelData ;
+                    self.NScansQueuedPerDevice_ = zeros(1, deviceCount) ;
+                    % Fill the output buffer and the stream's ring, before the task starts
+                    primingScanIndices = 1:(2*ws.AOTask.StreamBufferScanCount_) ;
+                    primingData = self.calculateStreamedScans_(primingScanIndices) ;
+                    for deviceIndex = 1:deviceCount ,
+                        ws.AOTask.setOutputStreamForOneTaskBang_(daqmxTaskHandles{deviceIndex}, sampleRate, nScansInChannelData) ;
+                        channelIndices = channelIndicesPerDevice{deviceIndex} ;
+                        self.NScansQueuedPerDevice_(deviceIndex) = ...
+                            ws.ni('WriteToOutputStream', daqmxTaskHandles{deviceIndex}, -1, primingData(:, channelIndices)) ;
+                    end
+                else
+                    % The outputData is the channelData, unless the channelData is
+                    % very short, in which case the outputData is just long
+                    % enough, and all zeros
+                    if nScansInChannelData<2 ,
+                        nChannels = self.ChannelCount_ ;
+                        outputData = zeros(2, nChannels) ;
+                    else
+                        outputData = feval(calculateChannelScans, 1:nScansInChannelData) ;
+                    end
+                    for deviceIndex = 1:deviceCount ,
+                        daqmxTaskHandle = daqmxTaskHandles{deviceIndex} ;
+                        channelIndices = channelIndicesPerDevice{deviceIndex} ;
+                        outputDataForDevice = outputData(:, channelIndices) ;
+                        ws.AOTask.setOutputBufferForOneTaskBang_(daqmxTaskHandle, sampleRate, outputDataForDevice) ;
+                    end
+                end
+            end
+        end  % function
+        
+        function stopOutputStreams_(self)
+            % Stop streaming, if we are, and let go of the output.  The
+            % tasks must be stopped already, since this puts back their
+            % regeneration mode.
+            if ~isempty(self.CalculateStreamedScans_) ,
+                deviceCount = length(self.DAQmxTaskHandles_) ;
                 for deviceIndex = 1:deviceCount ,
-                    daqmxTaskHandle = daqmxTaskHandles{deviceIndex} ;
-                    channelIndices = channelIndicesPerDevice{deviceIndex} ;
-                    outputDataForDevice = outputData(:, channelIndices) ;
-                    ws.AOTask.setOutputBufferForOneTaskBang_(daqmxTaskHandle, sampleRate, outputDataForDevice) ;
+                    ws.ni('StopOutputStream', self.DAQmxTaskHandles_{deviceIndex}) ;
                 end
+                self.CalculateStreamedScans_ = [] ;
+                self.StreamedScanCount_ = 0 ;
+                self.NScansQueuedPerDevice_ = zeros(1,0) ;
             end
         end  % function
+        
+        function outputData = calculateStreamedScans_(self, scanIndices)
+            % The scans of the streamed output with the given indices, with
+            % the last scan of the output zeroed, since we don't want to
+            % end on a nonzero value
+            outputData = feval(self.CalculateStreamedScans_, scanIndices) ;
+            outputData(scanIndices==self.StreamedScanCount_,:) = 0 ;
+        end  % function
     end  % protected methods block
     
     methods (Static)
@@ -332,7 +425,26 @@ classdef AOTask < handle
             %daqmxTaskHandle.writeAnalogData(outputData) ;
             autoStart = false ;  % Don't automatically start the task.  This is typically what you want for a timed task.
             timeout = -1 ;  % wait indefinitely
-            ws.ni('DAQmxWriteAnalogF64', daqmxTaskHandle, autoStart, timeout, outputData) ;
+            ws.ni('WriteAnalogF64AsBinaryI16', daqmxTaskHandle, autoStart, timeout, outputData) ;
+              % Converts to DAC codes in the mex function, so the driver gets a quarter of the bytes
+        end
+        
+        function setOutputStreamForOneTaskBang_(daqmxTaskHandle, sampleRate, nScans)
+            % Like setOutputBufferForOneTaskBang_(), but for an output of
+            % nScans scans that's streamed: the output buffer only holds
+            % StreamBufferScanCount_ scans, and the stream's ring as many
+            % again.  The caller queues the scans.
+            bufferScanCount = ws.AOTask.StreamBufferScanCount_ ;
+            if ws.ni('DAQmxGetBufOutputBufSize', daqmxTaskHandle) ~= bufferScanCount ,
+                ws.ni('DAQmxCfgOutputBuffer', daqmxTaskHandle, bufferScanCount) ;
+            end
+            ws.ni('DAQmxCfgSampClkTiming', daqmxTaskHandle, '', sampleRate, 'DAQmx_Val_Rising', 'DAQmx_Val_FiniteSamps', nScans);
+            if ws.ni('DAQmxGetSampClkRate', daqmxTaskHandle) ~= sampleRate ,
+                error('The DAQmx task sample rate is not equal to the desired sampling rate');
+            end
+            ws.ni('DAQmxResetWriteRelativeTo', daqmxTaskHandle) ;
+            ws.ni('DAQmxResetWriteOffset', daqmxTaskHandle) ;            
+            ws.ni('StartOutputStream', daqmxTaskHandle, bufferScanCount) ;
         end
     end  % Static methods
     
@@ -8,6 +8,8 @@ classdef CounterTriggerTask < handle
         RepeatCount_ = 1
         PFIID_
         TriggerTerminalName_
+        ReferenceClockSource_
+        ReferenceClockRate_
         DAQmxTaskHandle_ = []        
     end
 
@@ -21,6 +23,8 @@ classdef CounterTriggerTask < handle
             self.RepeatCount_ = repeatCount ;
             self.PFIID_ = pfiID ;
             self.TriggerTerminalName_ = triggerTerminalName ;
+            self.ReferenceClockSource_ = referenceClockSource ;
+            self.ReferenceClockRate_ = referenceClockRate ;
                         
             %self.DAQmxTaskHandle_ = ws.dabs.ni.daqmx.Task(self.TaskName_) ;
             self.DAQmxTaskHandle_ = ws.ni('DAQmxCreateTask', taskName) ;
@@ -72,7 +76,7 @@ classdef CounterTriggerTask < handle
         
         function stop(self)
             %fprintf('CounterTriggerTask::stop(), CTR %d\n', self.CounterID_);
-            if ~isempty(self.DAQmxTaskHandle_) && isvalid(self.DAQmxTaskHandle_) ,
+            if ~isempty(self.DAQmxTaskHandle_) ,
                 %self.DAQmxTaskHandle_.stop() ;
                 ws.ni('DAQmxStopTask', self.DAQmxTaskHandle_) ;
 %                 if self.DAQmxTaskHandle_.isTaskDoneQuiet() ,
@@ -83,6 +87,40 @@ classdef CounterTriggerTask < handle
             end
         end
         
+        function result = canBeReconfiguredFor(self, referenceClockSource, referenceClockRate, deviceName, counterID, pfiID, triggerTerminalName)
+            % True iff the task uses the same counter, clock, and routing as
+            % a task made with these arguments would, so that calling
+            % reconfigure() on it can stand in for making a new one.
+            result = ~isempty(self.DAQmxTaskHandle_) && ...
+                     isequal(self.ReferenceClockSource_, referenceClockSource) && ...
+                     isequal(self.ReferenceClockRate_, referenceClockRate) && ...
+                     isequal(self.DeviceName_, deviceName) && ...
+                     isequal(self.CounterID_, counterID) && ...
+                     isequal(self.PFIID_, pfiID) && ...
+                     isequal(self.TriggerTerminalName_, triggerTerminalName) ;
+        end  % function
+        
+        function reconfigure(self, repeatFrequency, repeatCount)
+            % Change the pulse frequency and count without clearing and
+            % remaking the DAQmx task.  Only what changed gets set on the
+            % task, which is then committed, so it starts quickly.  The
+            % task gets stopped first, if it isn't already.
+            if ~isempty(self.DAQmxTaskHandle_) ,
+                ws.ni('ReconfigureCOPulseTrain', self.DAQmxTaskHandle_, repeatFrequency, 0.5, repeatCount) ;
+                self.RepeatFrequency_ = repeatFrequency ;
+                self.RepeatCount_ = repeatCount ;
+            end
+        end  % function
+        
+        function unreserve(self)
+            % Free up the counter and terminals for use by other tasks,
+            % without clearing the task.  The next reconfigure() will
+            % reserve them again.
+            if ~isempty(self.DAQmxTaskHandle_) ,
+                ws.ni('DAQmxTaskControl', self.DAQmxTaskHandle_, 'DAQmx_Val_Task_Unreserve') ;
+            end
+        end  % function
+        
         function result = isDone(self)
             if isempty(self.DAQmxTaskHandle_) ,
                 % This means there is no assigned CTR device, so just
@@ -10,6 +10,8 @@ classdef DITask < handle
         SampleRate_ = 20000
         DesiredSweepDuration_ = 1     % Seconds
         TerminalIDs_
+        ConstructorArguments_ = cell(1,0)  % the arguments the task was made with, for canBeReusedFor()
+        ConfigurationFingerprint_ = uint64(0)  % the native configuration fingerprint of the DAQmx task, once fully configured
     end
     
     methods
@@ -17,6 +19,11 @@ classdef DITask < handle
                                sampleRate, desiredSweepDuration, ...
                                keystoneTaskType, keystoneTaskDeviceName, ...
                                triggerDeviceNameIfKeystone, triggerPFIIDIfKeystone, triggerEdgeIfKeystone)
+            % Remember the arguments, so we can tell later if the task can be reused
+            self.ConstructorArguments_ = {taskName, primaryDeviceName, isPrimaryDeviceAPXIDevice, terminalIDs, ...
+                                          sampleRate, desiredSweepDuration, ...
+                                          keystoneTaskType, keystoneTaskDeviceName, ...
+                                          triggerDeviceNameIfKeystone, triggerPFIIDIfKeystone, triggerEdgeIfKeystone} ;
             nChannels=length(terminalIDs) ;            
             if nChannels>0 ,
                 % Create the task itself
@@ -134,6 +141,11 @@ classdef DITask < handle
                     daqmxTriggerEdge = ws.daqmxEdgeTypeFromEdgeType(triggerEdge) ;
                     ws.ni('DAQmxCfgDigEdgeStartTrig', self.DAQmxTaskHandle_, triggerTerminalName, daqmxTriggerEdge);
                 end
+                
+                % Commit the task, so that starting it for each sweep is
+                % quick, and note its configuration fingerprint
+                self.commit() ;
+                self.ConfigurationFingerprint_ = ws.ni('GetTaskConfigurationFingerprint', self.DAQmxTaskHandle_) ;
             end
             
             % Create a tic id for timing stuff
@@ -186,6 +198,36 @@ classdef DITask < handle
             end
         end
         
+        function result = canBeReusedFor(self, varargin)
+            % True iff the task was made with the given constructor
+            % arguments, and its DAQmx task is stopped and still configured
+            % as it was then, so that it can be used for another run after a
+            % call to commit(), instead of making a new task.
+            result = isequal(self.ConstructorArguments_, varargin) && ...
+                     ( isempty(self.DAQmxTaskHandle_) || ...
+                       ( ws.ni('DAQmxIsTaskDone', self.DAQmxTaskHandle_) && ...
+                         ws.ni('GetTaskConfigurationFingerprint', self.DAQmxTaskHandle_) == self.ConfigurationFingerprint_ ) ) ;
+        end
+        
+        function commit(self)
+            % Commit the DAQmx task.  This is quick if it's committed as
+            % configured already.
+            if ~isempty(self.DAQmxTaskHandle_) ,
+                ws.ni('DAQmxTaskControl', self.DAQmxTaskHandle_, 'DAQmx_Val_Task_Commit') ;
+            end
+        end
+        
+        function stopAndUnreserve(self)
+            % Stop the DAQmx task, and free up the hardware it reserved, but
+            % keep it configured, so the task can be reused for the next run.
+            if ~isempty(self.DAQmxTaskHandle_) ,
+                % Stop even if done, since a finite task that's done can't be
+                % started again until it's been stopped
+                ws.ni('DAQmxStopTask', self.DAQmxTaskHandle_) ;
+                ws.ni('DAQmxTaskControl', self.DAQmxTaskHandle_, 'DAQmx_Val_Task_Unreserve') ;
+            end
+        end
+        
         function result = isDone(self)
             if isempty(self.DAQmxTaskHandle_) ,
                 if isinf(self.DesiredSweepDuration_) ,  % don't want to bother with toc() if we already know the answer...
@@ -222,25 +264,48 @@ classdef DITask < handle
                     dataAsUint32 = zeros(nScansToRead,0,'uint32');
                     self.TimeAtLastRead_ = timeNow ;
                 end
+                nLines = length(self.TerminalIDs_) ;
+                data = ws.dropExtraBits(dataAsUint32, nLines) ;
             else       
+                % The mex function reorders the lines and packs them into the smallest 
+                % integer type that will hold them, like ws.reorderDIData() followed by 
+                % ws.dropExtraBits(), but in one pass.
+                terminalIDPerLine = double(self.TerminalIDs_) ;
                 if isempty(nScansToRead) ,
-                    %dataAsRead = self.DAQmxTaskHandle_.readDigitalUn('uint32', []) ;
-                    dataAsRead = ws.ni('DAQmxReadDigitalU32', self.DAQmxTaskHandle_, -1, -1) ;
+                    data = ws.ni('ReadPackedDigitalLines', self.DAQmxTaskHandle_, -1, -1, terminalIDPerLine) ;
                     self.TimeAtLastRead_ = toc(self.TicId_) ;
                 else
-                    %dataAsRead = self.DAQmxTaskHandle_.readDigitalUn('uint32', nScansToRead) ;
-                    dataAsRead = ws.ni('DAQmxReadDigitalU32', self.DAQmxTaskHandle_, nScansToRead, -1) ;
+                    data = ws.ni('ReadPackedDigitalLines', self.DAQmxTaskHandle_, nScansToRead, -1, terminalIDPerLine) ;
                 end
-                % readData is nScans x nLines 
-                terminalIDPerLine = self.TerminalIDs_ ;
-                dataAsUint32 = ws.reorderDIData(dataAsRead, terminalIDPerLine) ;
             end
-            nLines = length(self.TerminalIDs_) ;
-            data = ws.dropExtraBits(dataAsUint32, nLines) ;
             nScans = size(data,1) ;
             timeSinceRunStartAtStartOfData = timeSinceRunStartNow - nScans/self.SampleRate_ ;
         end  % function
     
+        function [data, isDone, timeSinceRunStartAtStartOfData] = waitForData(self, waitDuration, timeSinceSweepStart, fromRunStartTicId)
+            % Like readData([], ...) followed by isDone(), except that if
+            % fewer than waitDuration seconds' worth of scans are available,
+            % this first waits natively for that many, until the task is
+            % done, or for at most twice that long.  See
+            % ws.AITask.waitForData().
+            if isempty(self.DAQmxTaskHandle_) ,
+                [data, timeSinceRunStartAtStartOfData] = self.readData([], timeSinceSweepStart, fromRunStartTicId) ;
+                isDone = self.isDone() ;
+            else
+                terminalIDPerLine = double(self.TerminalIDs_) ;
+                nScansAvailable = ws.ni('DAQmxGetReadAvailSampPerChan', self.DAQmxTaskHandle_) ;
+                nScansWanted = max(nScansAvailable, ws.nScansFromScanRateAndDesiredDuration(self.SampleRate_, waitDuration)) ;
+                [data, isDone] = ws.ni('WaitForPackedDigitalLines', self.DAQmxTaskHandle_, nScansWanted, 2*waitDuration, terminalIDPerLine) ;
+                if isDone ,
+                    % Read any scans left over, since the task will be stopped next
+                    data = vertcat(data, ws.ni('WaitForPackedDigitalLines', self.DAQmxTaskHandle_, double(intmax('int32')), 0, terminalIDPerLine)) ;
+                end
+                self.TimeAtLastRead_ = toc(self.TicId_) ;
+                nScans = size(data,1) ;
+                timeSinceRunStartAtStartOfData = toc(fromRunStartTicId) - nScans/self.SampleRate_ ;
+            end
+        end  % function
+    
         function debug(self) %#ok<MANU>
             keyboard
         end  % function        
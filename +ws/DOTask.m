@@ -2,6 +2,7 @@ classdef DOTask < handle
     properties (Access = protected)
         SampleRate_ = 20000
         ChannelCount_ = 0
+        TerminalIDs_ = zeros(1,0)
         ChannelData_
         IsOutputBufferSyncedToChannelData_ = false
         DAQmxTaskHandle_ = []  % Can be empty if there are zero channels
@@ -19,14 +20,11 @@ classdef DOTask < handle
             if nChannels>0 ,
                 %self.DAQmxTaskHandle_ = ws.dabs.ni.daqmx.Task(taskName);
                 self.DAQmxTaskHandle_ = ws.ni('DAQmxCreateTask', taskName) ;
-                for i=1:nChannels ,
-                    deviceName = primaryDeviceName ;
-                    terminalID = terminalIDs(i) ;                    
-                    %lineName = sprintf('line%d',terminalID) ;                        
-                    %self.DAQmxTaskHandle_.createDOChan(deviceName, lineName) ;
-                    lineSpecification = sprintf('%s/line%d', deviceName, terminalID) ;
-                    ws.ni('DAQmxCreateDOChan', self.DAQmxTaskHandle_, lineSpecification, 'DAQmx_Val_ChanForAllLines')
-                end
+                linesSpecification = ws.diChannelLineSpecificationFromTerminalIDs(primaryDeviceName, terminalIDs) ;
+                ws.ni('DAQmxCreateDOChan', self.DAQmxTaskHandle_, linesSpecification, 'DAQmx_Val_ChanForAllLines')
+                  % Create one DAQmx DO channel, with all the DO lines on it.
+                  % This way, we can write a uint32 col vector with all the lines
+                  % multiplexed on it, in the bits indicated by terminalIDs.
                 [referenceClockSource, referenceClockRate] = ...
                     ws.getReferenceClockSourceAndRate(primaryDeviceName, primaryDeviceName, isPrimaryDeviceAPXIDevice) ;                
                 %set(self.DAQmxTaskHandle_, 'refClkSrc', referenceClockSource) ;                
@@ -102,6 +100,7 @@ classdef DOTask < handle
             % Store stuff
             %self.PrimaryDeviceName_ = primaryDeviceName ;
             self.ChannelCount_ = nChannels ;
+            self.TerminalIDs_ = terminalIDs ;
             self.SampleRate_ = sampleRate ;
             
             % Init the buffer
@@ -245,7 +244,9 @@ classdef DOTask < handle
                 %self.DAQmxTaskHandle_.writeDigitalData(outputData) ;
                 autoStart = false ;  % Don't automatically start the task.  This is typically what you want for a timed task.
                 timeout = -1 ;  % wait indefinitely
-                ws.ni('DAQmxWriteDigitalLines', self.DAQmxTaskHandle_, autoStart, timeout, outputData) ;
+                packedOutputData = ws.ni('PackDigitalLines', outputData, double(self.TerminalIDs_)) ;
+                  % One uint32 per scan, rather than one byte per line per scan
+                ws.ni('DAQmxWriteDigitalU32', self.DAQmxTaskHandle_, autoStart, timeout, packedOutputData) ;
             end
             
             % Note that we are now synched
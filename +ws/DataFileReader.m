@@ -0,0 +1,154 @@
+classdef DataFileReader < handle
+    % DataFileReader  Lazy, read-only access to the scans in a WaveSurfer data file.
+    %
+    %   reader = ws.DataFileReader(fileName) opens the WaveSurfer .h5 file
+    %   fileName, without reading any scans.  Slices of a sweep are then read
+    %   only when asked for, and only the slice asked for is read, so a quick
+    %   look at a multi-GB file doesn't have to load it all, as
+    %   ws.loadDataFile() does.  For example,
+    %
+    %     reader = ws.DataFileReader('foo.h5') ;
+    %     data = reader.analogScans(3, [1 4], [1 20000]) ;
+    %
+    %   gets the first 20000 scans of AI channels 1 and 4 of sweep 3, scaled
+    %   to the channels' units.  Channel indices count the active AI channels,
+    %   in the order they're stored in the file, as the columns of
+    %   analogScans are in ws.loadDataFile()'s output.  The file is closed
+    %   when the reader is deleted.
+
+    properties (SetAccess = immutable)
+        FileName  % the name of the data file, as given
+        SweepIndices  % row vector of the indices of the sweeps in the file
+    end
+
+    properties (Access = protected)
+        DataFile_  % the file, as opened by ws.reader(), or empty if it's closed
+        AnalogChannelScales_  % 1 x nActiveAIChannels, read the first time scaled scans are asked for
+        AnalogScalingCoefficients_  % nCoefficients x nActiveAIChannels
+    end
+
+    methods
+        function self = DataFileReader(fileName)
+            if ws.isJournaledDataFile(fileName) ,
+                error('The scans for %s are still in a journal.  Recover the file first, using ws.recoverDataFile().', fileName) ;
+            end
+            if ~exist(fileName, 'file') ,
+                error('The file %s does not exist.', fileName) ;
+            end
+            if ws.isRawDataFile(fileName) ,
+                error('The scans for %s are still in raw format.  Convert the file first, using ws.convertRawDataFile().', fileName) ;
+            end
+            self.FileName = fileName ;
+            self.DataFile_ = ws.reader('OpenFile', fileName) ;
+            self.SweepIndices = ws.reader('GetSweepIndices', self.DataFile_) ;
+        end
+
+        function delete(self)
+            if ~isempty(self.DataFile_) ,
+                dataFile = self.DataFile_ ;
+                self.DataFile_ = [] ;
+                ws.reader('CloseFile', dataFile) ;
+            end
+        end
+
+        function [scanCount, analogChannelCount, timestamp] = sweepSize(self, sweepIndex)
+            % The number of scans and AI channels in the sweep, and the
+            % sweep's timestamp (NaN if the file predates them)
+            [scanCount, analogChannelCount, ~, timestamp] = ws.reader('GetSweepInfo', self.DataFile_, sweepIndex) ;
+        end
+
+        function data = rawAnalogScans(self, sweepIndex, channelIndices, scanRange)
+            % The given slice of the sweep's AI scans, as int16 ADC counts,
+            % nScans x nChannels.  channelIndices defaults to all the channels,
+            % and scanRange, [firstScanIndex lastScanIndex], one-based and
+            % inclusive, to all the scans.  Either can be empty, to mean all.
+            if ~exist('channelIndices', 'var') ,
+                channelIndices = [] ;
+            end
+            if ~exist('scanRange', 'var') ,
+                scanRange = [] ;
+            end
+            [firstScanIndex, scanCount] = self.scanRangeArguments_(sweepIndex, scanRange) ;
+            data = ws.reader('ReadAnalogScans', self.DataFile_, sweepIndex, double(channelIndices), firstScanIndex, scanCount) ;
+        end
+
+        function data = analogScans(self, sweepIndex, channelIndices, scanRange)
+            % Like rawAnalogScans(), but scaled to the units of each channel,
+            % as doubles, as ws.loadDataFile() scales them
+            if ~exist('channelIndices', 'var') ,
+                channelIndices = [] ;
+            end
+            if ~exist('scanRange', 'var') ,
+                scanRange = [] ;
+            end
+            rawData = self.rawAnalogScans(sweepIndex, channelIndices, scanRange) ;
+            if isempty(self.AnalogChannelScales_) ,
+                self.readScalingInfo_() ;
+            end
+            if isempty(channelIndices) ,
+                channelIndices = 1:size(rawData,2) ;
+            end
+            channelScales = self.AnalogChannelScales_(channelIndices) ;
+            scalingCoefficients = self.AnalogScalingCoefficients_(:,channelIndices) ;
+            if ispc() ,
+                data = ws.scaledDoubleAnalogDataFromRawMex(rawData, channelScales, scalingCoefficients) ;
+            else
+                data = ws.scaledDoubleAnalogDataFromRaw(rawData, channelScales, scalingCoefficients) ;
+            end
+        end
+
+        function data = digitalScans(self, sweepIndex, scanRange)
+            % The given slice of the sweep's packed DI scans, nScans x 1, of
+            % the unsigned integer class they're stored as, or nScans x 0 if
+            % the sweep has no DI channels.  scanRange is as for
+            % rawAnalogScans().
+            if ~exist('scanRange', 'var') ,
+                scanRange = [] ;
+            end
+            [firstScanIndex, scanCount] = self.scanRangeArguments_(sweepIndex, scanRange) ;
+            data = ws.reader('ReadDigitalScans', self.DataFile_, sweepIndex, firstScanIndex, scanCount) ;
+        end
+    end  % public methods
+
+    methods (Access = protected)
+        function [firstScanIndex, scanCount] = scanRangeArguments_(self, sweepIndex, scanRange)
+            % Convert a [firstScanIndex lastScanIndex] scan range, or empty
+            % for all the scans, to a first scan index and a scan count
+            if isempty(scanRange) ,
+                firstScanIndex = 1 ;
+                scanCount = ws.reader('GetSweepInfo', self.DataFile_, sweepIndex) ;
+            else
+                firstScanIndex = scanRange(1) ;
+                scanCount = max(0, scanRange(2)-scanRange(1)+1) ;
+            end
+        end
+
+        function readScalingInfo_(self)
+            % Read the channel scales and scaling coefficients of the active
+            % AI channels from the header, as ws.loadDataFile() does
+            fileName = self.FileName ;
+            allAnalogChannelScales = ws.DataFileReader.readHeaderField_(fileName, 'AIChannelScales', 'Acquisition/AnalogChannelScales') ;
+            isActive = logical(ws.DataFileReader.readHeaderField_(fileName, 'IsAIChannelActive', 'Acquisition/IsAnalogChannelActive')) ;
+            analogScalingCoefficients = ws.DataFileReader.readHeaderField_(fileName, 'AIScalingCoefficients', 'Acquisition/AnalogScalingCoefficients') ;
+            analogChannelScales = allAnalogChannelScales(isActive) ;
+            self.AnalogChannelScales_ = reshape(analogChannelScales, [1 numel(analogChannelScales)]) ;
+            self.AnalogScalingCoefficients_ = analogScalingCoefficients ;
+        end
+    end  % protected methods
+
+    methods (Static = true, Access = protected)
+        function value = readHeaderField_(fileName, fieldName, oldFieldName)
+            % Read /header/<fieldName>, or /header/<oldFieldName> in files
+            % from older versions, which lack it
+            try
+                value = h5read(fileName, ['/header/' fieldName]) ;
+            catch me1 %#ok<NASGU>
+                try
+                    value = h5read(fileName, ['/header/' oldFieldName]) ;
+                catch me2 %#ok<NASGU>
+                    error('Unable to read %s from the header of file %s.', fieldName, fileName) ;
+                end
+            end
+        end
+    end  % static methods
+end  % classdef
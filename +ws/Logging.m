@@ -17,6 +17,10 @@ classdef Logging < ws.Model
         SessionIndex
         NextSweepIndex  % the index of the next sweep (one-based).  (This gets reset if you change the FileBaseName.)
         IsOKToOverwrite  % logical, whether it's OK to overwrite data files without warning
+        DoUseRawFormat  % logical, whether to log scans to a flat binary .dat file during the run, converted to .h5 at the end of the run
+        DoCompress  % logical, whether to compress the scans in the data file, losslessly, with ws.logger's filter
+        DoUseJournal  % logical, whether to log scans to a crash-safe .journal file during the run, replayed into the .h5 at the end of the run
+        DoWriteOverviews  % logical, whether to write min/max overviews of each sweep's analog scans alongside them, for drawing zoomed-out views
     end
     
     properties (Dependent=true, SetAccess=immutable)
@@ -34,10 +38,22 @@ classdef Logging < ws.Model
         SessionIndex_
         NextSweepIndex_
         IsOKToOverwrite_
+        DoUseRawFormat_
+        DoCompress_
+        DoUseJournal_
+        DoWriteOverviews_
     end
 
     properties (Access = protected, Transient = true)
         DateAsString_
+        LastWriteQueueStatus_  % the write queue status at the end of the last run, or empty
+    end
+    
+    properties (Constant = true, Access = protected)
+        WriteQueueByteCapacity_ = 256*2^20
+          % The data file is written by a background thread, so that disk stalls
+          % don't stall acquisition.  This is the most bytes of scans that can be
+          % waiting to be written before dataAvailable() has to wait.
     end
 
     % These are all properties that are only used when acquisition is
@@ -51,13 +67,19 @@ classdef Logging < ws.Model
             % single time stamp
         ExpectedSweepSizeForWritingHDF5_
         WriteToSweepId_  % During the acquisition of a run, the current sweep index being written to
-        ChunkSize_
+        ExpectedSweepScanCount_  % the number of scans in each sweep, or Inf for continuous runs
+        AcquisitionSampleRate_
         FirstSweepIndex_  % index of the first sweep in the ongoing run
         DidCreateCurrentDataFile_  % whether the data file for the current run has been created
         LastSweepIndexForWhichDatasetCreated_  
           % For the current file/sweepset, the sweep index of the most-recently dataset in the data file.
           % Empty if the no dataset has yet been created for the current file.
         DidWriteSomeDataForThisSweep_        
+        LogFile_  % the data file, as opened by ws.logger(), or empty if it's not open
+        IsLogFileRaw_  % whether LogFile_ was opened in the raw format, and so needs converting when closed
+        IsLogFileJournaled_  % whether LogFile_ was opened in the journal format, and so needs replaying when closed
+        IsLogFileCompressed_  % whether the scans in LogFile_ are, or will be once converted, compressed
+        IsLogFileWithOverviews_  % whether the sweeps in LogFile_ get, or will get once converted, overviews
         %CurrentSweepIndex_
     end
 
@@ -72,6 +94,10 @@ classdef Logging < ws.Model
             self.NextSweepIndex_ = 1 ; % Number of sweeps acquired since value was reset + 1 (reset occurs automatically on FileBaseName change).
             %self.FirstSweepIndexInNextFile_ = 1 ; % Number of sweeps acquired since value was reset + 1 (reset occurs automatically on FileBaseName change).
             self.IsOKToOverwrite_ = false ;
+            self.DoUseRawFormat_ = false ;
+            self.DoCompress_ = false ;
+            self.DoUseJournal_ = false ;
+            self.DoWriteOverviews_ = false ;
             self.DateAsString_ = datestr(now(),'yyyy-mm-dd') ;  % Determine this now, don't want it to change in mid-run
         end
         
@@ -128,6 +154,38 @@ classdef Logging < ws.Model
             result=self.IsOKToOverwrite_;
         end
         
+        function set.DoUseRawFormat(self, newValue)
+            self.DoUseRawFormat_ = logical(newValue) ;
+        end
+        
+        function result=get.DoUseRawFormat(self)
+            result=self.DoUseRawFormat_;
+        end
+        
+        function set.DoCompress(self, newValue)
+            self.DoCompress_ = logical(newValue) ;
+        end
+        
+        function result=get.DoCompress(self)
+            result=self.DoCompress_;
+        end
+        
+        function set.DoUseJournal(self, newValue)
+            self.DoUseJournal_ = logical(newValue) ;
+        end
+        
+        function result=get.DoUseJournal(self)
+            result=self.DoUseJournal_;
+        end
+        
+        function set.DoWriteOverviews(self, newValue)
+            self.DoWriteOverviews_ = logical(newValue) ;
+        end
+        
+        function result=get.DoWriteOverviews(self)
+            result=self.DoWriteOverviews_;
+        end
+        
         function set.DoIncludeDate(self, newValue)
             self.DoIncludeDate_ = logical(newValue);
         end
@@ -181,7 +239,7 @@ classdef Logging < ws.Model
             value = self.CurrentRunAbsoluteFileName_ ;
         end  % function
         
-        function startingRun(self, nextRunAbsoluteFileName, isAIChannelActive, expectedSweepScanCount, acquisitionSampleRate, areSweepsFiniteDuration, headerStruct)
+        function startingRun(self, nextRunAbsoluteFileName, isAIChannelActive, nActiveDigitalChannels, expectedSweepScanCount, acquisitionSampleRate, areSweepsFiniteDuration, headerStruct)
             if isempty(self.FileBaseName) ,
                 error('wavesurfer:saveddatasystem:emptyfilename', 'Data logging can not be enabled with an empty filename.');
             end
@@ -192,7 +250,9 @@ classdef Logging < ws.Model
             self.DidCreateCurrentDataFile_ = false ;
             %fprintf('Just did self.DidCreateCurrentDataFile_ = false\n') ;
             
-            % Set the chunk size for writing data to disk
+            % ws.logger picks the chunk size for writing data to disk, and how
+            % to grow the datasets, from the sweep length, the sample rate, the
+            % channel counts, and the file system's block size
             nActiveAnalogChannels = sum(isAIChannelActive) ;
             
             % For h5create() it is useful to set
@@ -202,10 +262,11 @@ classdef Logging < ws.Model
             % wavesurferModel.Acquisition.SampleRate * wavesurferModel.Acquisiton.Duration)
             self.ExpectedSweepSizeForWritingHDF5_ = [Inf nActiveAnalogChannels];
             if areSweepsFiniteDuration ,
-                self.ChunkSize_ = [expectedSweepScanCount nActiveAnalogChannels];
+                self.ExpectedSweepScanCount_ = expectedSweepScanCount ;
             else
-                self.ChunkSize_ = [acquisitionSampleRate nActiveAnalogChannels];
+                self.ExpectedSweepScanCount_ = Inf ;
             end
+            self.AcquisitionSampleRate_ = acquisitionSampleRate ;
                 
             % Determine the absolute file names
             %self.CurrentRunAbsoluteFileName_ = fullfile(self.FileLocation, [trueLogFileName '.h5']);
@@ -256,6 +317,32 @@ classdef Logging < ws.Model
             %ws.h5savestr(self.CurrentRunAbsoluteFileName_, '/headerstr', stringOfAssignmentStatements, doCreateFile);
             ws.h5save(self.CurrentRunAbsoluteFileName_, '/header', headerStruct, doCreateFile);
             self.DidCreateCurrentDataFile_ = true ;
+            
+            % Keep the file open for the rest of the run, so it doesn't
+            % have to be opened for each write.  In the raw format, scans go to a
+            % flat .dat file next to the .h5, which is converted when the file is closed.
+            % Compressed scans are compressed on the writer thread, or during that
+            % conversion.  In the journal format, the whole file goes to a .journal
+            % file that survives a crash, and is replayed into the .h5 when the file
+            % is closed, or by ws.recoverDataFile() after a crash.  Overviews,
+            % if wanted, are written as the scans are, or during the conversion or
+            % replay.
+            if self.DoUseJournal_ ,
+                logFileFormat = 'journal' ;
+            elseif self.DoUseRawFormat_ ,
+                logFileFormat = 'raw' ;
+            elseif self.DoCompress_ ,
+                logFileFormat = 'compressed' ;
+            else
+                logFileFormat = 'hdf5' ;
+            end
+            self.LogFile_ = ws.logger('OpenFile', self.CurrentRunAbsoluteFileName_, self.WriteQueueByteCapacity_, logFileFormat, ...
+                                      'adaptive', self.DoWriteOverviews_) ;
+            self.IsLogFileJournaled_ = self.DoUseJournal_ ;
+            self.IsLogFileRaw_ = self.DoUseRawFormat_ && ~self.DoUseJournal_ ;
+            self.IsLogFileCompressed_ = self.DoCompress_ ;
+            self.IsLogFileWithOverviews_ = self.DoWriteOverviews_ ;
+            self.LastWriteQueueStatus_ = [] ;
             %fprintf('Just did self.DidCreateCurrentDataFile_ = true\n') ;
             
 %             % Save the "header" information to a sidecar file instead.
@@ -267,11 +354,18 @@ classdef Logging < ws.Model
             % be written
             self.WriteToSweepId_ = self.NextSweepIndex;
             
-            % Add an HDF "dataset" for each active AI channel, for each
-            % sweep.
-            % TODO: Try moving the dataset creation for each sweep to
-            % startingSweep() --- This is the cause of slowness at sweep
-            % set start for Justin Little, possibly others.
+            % Have ws.logger create the first sweep's group and datasets now, in
+            % the background, so the first tick of the sweep doesn't have to.
+            % (Creating all the sweeps' datasets here used to be the cause of
+            % slowness at sweep set start for Justin Little, possibly others.)
+            % Each sweep after that is prepared during the sweep before it.
+            ws.logger('PrepareSweep', ...
+                      self.LogFile_, ...
+                      self.NextSweepIndex, ...
+                      nActiveAnalogChannels, ...
+                      nActiveDigitalChannels, ...
+                      self.ExpectedSweepScanCount_, ...
+                      self.AcquisitionSampleRate_) ;
 %             if ~isempty(wavesurferModel.Acquisition) ,
 %                 for indexOfSweepWithinSet = 1:wavesurferModel.NSweepsPerRun ,
 %                     h5create(self.CurrentRunAbsoluteFileName_, ...
@@ -300,6 +394,10 @@ classdef Logging < ws.Model
         end
         
         function completingSweep(self)
+            % Close the sweep's datasets and flush them to disk
+            if ~isempty(self.LogFile_) ,
+                ws.logger('EndSweep', self.LogFile_) ;
+            end
             self.NextSweepIndex = self.NextSweepIndex + 1;
         end
         
@@ -312,6 +410,7 @@ classdef Logging < ws.Model
         end
         
         function completingRun(self)
+            self.closeLogFile_() ;
             self.nullOutTransients_();
         end
         
@@ -345,10 +444,30 @@ classdef Logging < ws.Model
             %fprintf('Logging::stoppingOrAbortingRun_()\n');
         
             %dbstop if caught
+            %
+            % Have to close the data file before we can rename or delete it
+            try
+                self.closeLogFile_() ;
+                didFinishLogFile = true ;
+            catch exception ,
+                didFinishLogFile = false ;
+                wsModel.logWarning('ws:unableToCloseLogFile', ...
+                                   'Unable to finish writing the data file after stop/abort', ...
+                                   exception) ;
+            end
+            
             %
             % Want to rename the data file to reflect the actual number of sweeps acquired
             %            
-            if self.DidCreateCurrentDataFile_ ,
+            if self.DidCreateCurrentDataFile_ && ~didFinishLogFile && (self.IsLogFileJournaled_ || self.IsLogFileRaw_) ,
+                % The journal or .dat file that goes with the data file is still there, 
+                % and is found from the data file's name, so leave the data file as it
+                % is, so that ws.recoverDataFile() or ws.convertRawDataFile() can finish it.
+                wsModel.logWarning('ws:unableToRenameLogFile', ...
+                                   sprintf(horzcat('Leaving data file %s as it is, with its journal or raw scans file, so that it ', ...
+                                                   'can be finished with ws.recoverDataFile() or ws.convertRawDataFile()'), ...
+                                           ws.leafFileName(self.CurrentRunAbsoluteFileName_)) ) ;
+            elseif self.DidCreateCurrentDataFile_ ,
                 %fprintf('self.DidCreateCurrentDataFile_ is true\n') ;
                 % A data file was created.  Might need to rename it, or delete it.
                 originalAbsoluteLogFileName = self.CurrentRunAbsoluteFileName_ ;
@@ -450,18 +569,47 @@ classdef Logging < ws.Model
             % the run
             %fprintf('At top of ws.Logging.nullOutTransients...\n') ;
             %dbstack
+            try
+                self.closeLogFile_() ;
+            catch me %#ok<NASGU>
+                % Nothing to be done about it at this point
+                self.LogFile_ = [] ;
+            end
             self.CurrentRunAbsoluteFileName_ = [];
             self.FirstSweepIndex_ = [] ;
             self.CurrentDatasetOffset_ = [];
   %          self.ExpectedSweepSizeActual_ = [];
             self.ExpectedSweepSizeForWritingHDF5_ = [];
             self.WriteToSweepId_ = [];
-            self.ChunkSize_ = [];
+            self.ExpectedSweepScanCount_ = [] ;
+            self.AcquisitionSampleRate_ = [] ;
             self.DidCreateCurrentDataFile_ = [] ;
             self.LastSweepIndexForWhichDatasetCreated_ = [] ;
             self.DidWriteSomeDataForThisSweep_ = [] ;
             %self.CurrentSweepIndex_ = [];
         end  % function
+        
+        function closeLogFile_(self)
+            % Close the data file, if it's open, which ends the sweep being
+            % written, if any
+            if ~isempty(self.LogFile_) ,
+                logFile = self.LogFile_ ;
+                self.LogFile_ = [] ;  % so we don't try to close it twice, even if this errors
+                try
+                    self.LastWriteQueueStatus_ = ws.Logging.writeQueueStatusFromLogFile_(logFile) ;
+                catch me %#ok<NASGU>
+                    % CloseFile will report the writer's error
+                end
+                ws.logger('CloseFile', logFile) ;
+                if self.IsLogFileJournaled_ ,
+                    % Rebuild the data file from the journal
+                    ws.logger('ReplayJournal', self.CurrentRunAbsoluteFileName_, self.IsLogFileCompressed_, self.IsLogFileWithOverviews_) ;
+                elseif self.IsLogFileRaw_ ,
+                    % Turn the .dat file and its index into an ordinary data file
+                    ws.logger('ConvertRawFile', self.CurrentRunAbsoluteFileName_, self.IsLogFileCompressed_, self.IsLogFileWithOverviews_) ;
+                end
+            end
+        end  % function
     end
 
     methods
@@ -480,59 +628,44 @@ classdef Logging < ws.Model
                 % Moved creation of h5 Group "sweep_%04d" from
                 % startingSweep() to here, preventing a sweep Group from
                 % being created until it has data.
+                % This creates the timestamp dataset, the analogScans
+                % dataset (int16), and the digitalScans dataset (uint8,
+                % uint16, or uint32, depending on the number of digital
+                % channels), and writes the timestamp.
                 thisSweepIndex = self.NextSweepIndex ;
-                timestampDatasetName = sprintf('/sweep_%04d/timestamp',thisSweepIndex) ;
-                h5create(self.CurrentRunAbsoluteFileName_, timestampDatasetName, [1 1]);  % will consist of one double
-                %nActiveAnalogChannels = self.Parent.Acquisition.NActiveAnalogChannels ;
-                if nActiveAnalogChannels>0 ,
-                    analogScansDatasetName = sprintf('/sweep_%04d/analogScans',thisSweepIndex) ;
-                    h5create(self.CurrentRunAbsoluteFileName_, ...
-                        analogScansDatasetName, ...
-                        self.ExpectedSweepSizeForWritingHDF5_, ...
-                        'ChunkSize', self.ChunkSize_, ...
-                        'DataType','int16');
-                end
-                %nActiveDigitalChannels = self.Parent.Acquisition.NActiveDigitalChannels ;
-                if nActiveDigitalChannels>0 ,
-                    if nActiveDigitalChannels<=8
-                        dataType = 'uint8';
-                    elseif nActiveDigitalChannels<=16
-                        dataType = 'uint16';
-                    else %NActiveDigitalChannels<=32
-                        dataType = 'uint32';
-                    end
-                    digitalScansDatasetName = sprintf('/sweep_%04d/digitalScans',thisSweepIndex) ;
-                    h5create(self.CurrentRunAbsoluteFileName_, ...
-                        digitalScansDatasetName, ...
-                        [self.ExpectedSweepSizeForWritingHDF5_(1) 1], ...
-                        'ChunkSize', [self.ChunkSize_(1) 1], ...
-                        'DataType',dataType);
-                end
+                ws.logger('StartSweep', ...
+                          self.LogFile_, ...
+                          thisSweepIndex, ...
+                          timeSinceRunStartAtStartOfData, ...
+                          nActiveAnalogChannels, ...
+                          nActiveDigitalChannels, ...
+                          self.ExpectedSweepScanCount_, ...
+                          self.AcquisitionSampleRate_) ;
                 self.LastSweepIndexForWhichDatasetCreated_ =  thisSweepIndex;           
-                
-                timestampDatasetName = sprintf('/sweep_%04d/timestamp',self.WriteToSweepId_) ;
-                h5write(self.CurrentRunAbsoluteFileName_, timestampDatasetName, timeSinceRunStartAtStartOfData);
                 self.DidWriteSomeDataForThisSweep_ = true ;  % will be true momentarily...
+                didStartSweep = true ;
+            else
+                didStartSweep = false ;
             end
             
             if ~isempty(self.FileBaseName) ,
-                if ~isempty(rawAnalogData) ,
-                    %currentRunAbsoluteFileName = self.CurrentRunAbsoluteFileName_ ;
-                    h5write(self.CurrentRunAbsoluteFileName_, ...
-                            sprintf('/sweep_%04d/analogScans', ...
-                                    self.WriteToSweepId_), ...
-                            rawAnalogData, ...
-                            [self.CurrentDatasetOffset_ 1], ...
-                            size(rawAnalogData));
-                end
-                if ~isempty(rawDigitalData) ,
-                    h5write(self.CurrentRunAbsoluteFileName_, ...
-                            sprintf('/sweep_%04d/digitalScans', ...
-                                    self.WriteToSweepId_), ...
-                            rawDigitalData, ...
-                            [self.CurrentDatasetOffset_ 1], ...
-                            size(rawDigitalData));
-                end
+                % Appends to the datasets of the current sweep, at
+                % self.CurrentDatasetOffset_
+                ws.logger('AppendScans', self.LogFile_, rawAnalogData, rawDigitalData) ;
+            end
+            
+            % Have ws.logger create the next sweep's group and datasets in the
+            % background, while this one is acquired.  This is done after the
+            % append, so the two don't contend.  If there turns out not to be a
+            % next sweep, ws.logger throws it away when the file is closed.
+            if didStartSweep && isfinite(self.ExpectedSweepScanCount_) ,
+                ws.logger('PrepareSweep', ...
+                          self.LogFile_, ...
+                          thisSweepIndex+1, ...
+                          nActiveAnalogChannels, ...
+                          nActiveDigitalChannels, ...
+                          self.ExpectedSweepScanCount_, ...
+                          self.AcquisitionSampleRate_) ;
             end
             
             self.CurrentDatasetOffset_ = self.CurrentDatasetOffset_ + size(scaledAnalogData, 1);
@@ -585,8 +718,35 @@ classdef Logging < ws.Model
                 end
             end            
         end  % function        
+        
+        function result = writeQueueStatus(self)
+            % The state of the queue of scans waiting to be written to the
+            % data file, for the ongoing run, or for the last run if there's
+            % none ongoing.  A struct with fields QueuedByteCount,
+            % HighWaterByteCount, BackPressureCount (the number of times
+            % dataAvailable() had to wait for the queue to have space),
+            % BackPressureTime, and MaxBackPressureTime (in seconds).  Empty if
+            % there have been no runs.
+            if isempty(self.LogFile_) ,
+                result = self.LastWriteQueueStatus_ ;
+            else
+                result = ws.Logging.writeQueueStatusFromLogFile_(self.LogFile_) ;
+            end
+        end  % function
     end  % public methods block
     
+    methods (Static, Access=protected)
+        function result = writeQueueStatusFromLogFile_(logFile)
+            [queuedByteCount, highWaterByteCount, backPressureCount, backPressureTime, maxBackPressureTime] = ...
+                ws.logger('GetQueueStatus', logFile) ;
+            result = struct('QueuedByteCount', queuedByteCount, ...
+                            'HighWaterByteCount', highWaterByteCount, ...
+                            'BackPressureCount', backPressureCount, ...
+                            'BackPressureTime', backPressureTime, ...
+                            'MaxBackPressureTime', maxBackPressureTime) ;
+        end  % function
+    end
+    
     methods 
         function out = getPropertyValue_(self, name)
             out = self.(name);
@@ -41,6 +41,10 @@ classdef Looper < handle
         TimedDigitalInputTask_ = []        
     end
     
+    properties (Constant, Access = protected)
+        AcquisitionWaitDuration_ = 0.02  % s, how much data pollAcquisition() waits natively for during a sweep
+    end
+    
     properties (Access = protected, Transient=true)
         %LatestRawAnalogData_
         %LatestRawDigitalData_
@@ -230,9 +234,50 @@ classdef Looper < handle
                             acquisitionTriggerEdge, ...
                             diChannelTerminalIDs)
                         
-            % release the the timed hardware resources, so that we can
-            % reacquire the ones we really need.
-            self.releaseTimedHardwareResources_() ;           
+            % Work out the arguments for the timed input tasks.  Only the
+            % active channels get handed to the tasks.
+            activeAIDeviceNames = aiChannelDeviceNames(isAIChannelActive) ;
+            activeAITerminalIDs = aiChannelTerminalIDs(isAIChannelActive) ;
+            aiTaskArguments = {'WaveSurfer AI Task', ...
+                               primaryDeviceName , ...
+                               isPrimaryDeviceAPXIDevice , ...
+                               activeAIDeviceNames, ...
+                               activeAITerminalIDs, ...
+                               acquisitionSampleRate, ...
+                               sweepDuration, ...
+                               acquisitionKeystoneTaskType, ...
+                               acquisitionKeystoneTaskDeviceName, ...
+                               acquisitionTriggerDeviceName, ...
+                               acquisitionTriggerPFIID, ...
+                               acquisitionTriggerEdge} ;
+            activeDITerminalIDs = diChannelTerminalIDs(isDIChannelActive) ;
+            diTaskArguments = {'WaveSurfer DI Task', ...
+                               primaryDeviceName , ...
+                               isPrimaryDeviceAPXIDevice , ...
+                               activeDITerminalIDs, ...
+                               acquisitionSampleRate, ...
+                               sweepDuration, ...
+                               acquisitionKeystoneTaskType, ...
+                               acquisitionKeystoneTaskDeviceName, ...
+                               acquisitionTriggerDeviceName, ...
+                               acquisitionTriggerPFIID, ...
+                               acquisitionTriggerEdge} ;
+                           
+            % If the timed input tasks from the last run are set up just as
+            % they would be for this one, keep them, since recommitting
+            % them is much quicker than making them anew.  Otherwise release
+            % the timed hardware resources, so that we can reacquire the ones
+            % we really need.
+            try
+                areTimedInputTasksReusable = ...
+                    ~isempty(self.TimedAnalogInputTask_) && self.TimedAnalogInputTask_.canBeReusedFor(aiTaskArguments{:}) && ...
+                    ~isempty(self.TimedDigitalInputTask_) && self.TimedDigitalInputTask_.canBeReusedFor(diTaskArguments{:}) ;
+            catch exception  %#ok<NASGU>
+                areTimedInputTasksReusable = false ;
+            end
+            if ~areTimedInputTasksReusable ,
+                self.releaseTimedHardwareResources_() ;           
+            end
             
             % Cache the keystone task for the run
             %self.AcquisitionKeystoneTaskTypeCache_ = acquisitionKeystoneTaskType ;
@@ -247,45 +292,14 @@ classdef Looper < handle
                 %acquisitionTriggerPFIID = self.Frontend_.acquisitionTriggerProperty('PFIID') ;
                 %acquisitionTriggerEdge = self.Frontend_.acquisitionTriggerProperty('Edge') ;
                 if isempty(self.TimedAnalogInputTask_) ,  % && self.NAIChannels>0 ,
-                    % Only hand the active channels to the AnalogInputTask
-                    %isAIChannelActive = self.Frontend_.IsAIChannelActive ;
-                    %aiDeviceNames = repmat({self.DeviceName_}, size(isAIChannelActive)) ;
-                    %aiChannelDeviceNames = self.Frontend_.AIChannelDeviceNames ;                
-                    activeAIDeviceNames = aiChannelDeviceNames(isAIChannelActive) ;
-                    %aiChannelTerminalIDs = self.Frontend_.AIChannelTerminalIDs ; 
-                    activeAITerminalIDs = aiChannelTerminalIDs(isAIChannelActive) ;
-                    %[referenceClockSource, referenceClockRate] = ...
-                    %    ws.getReferenceClockSourceAndRate(primaryDeviceName, primaryDeviceName, isPrimaryDeviceAPXIDevice) ;                
-                    self.TimedAnalogInputTask_ = ...
-                        ws.AITask('WaveSurfer AI Task', ...
-                                  primaryDeviceName , ...
-                                  isPrimaryDeviceAPXIDevice , ...
-                                  activeAIDeviceNames, ...
-                                  activeAITerminalIDs, ...
-                                  acquisitionSampleRate, ...
-                                  sweepDuration, ...
-                                  acquisitionKeystoneTaskType, ...
-                                  acquisitionKeystoneTaskDeviceName, ...
-                                  acquisitionTriggerDeviceName, ...
-                                  acquisitionTriggerPFIID, ...
-                                  acquisitionTriggerEdge) ;
+                    self.TimedAnalogInputTask_ = ws.AITask(aiTaskArguments{:}) ;
+                else
+                    self.TimedAnalogInputTask_.commit() ;
                 end
                 if isempty(self.TimedDigitalInputTask_) , % && self.NDIChannels>0,
-                    %isDIChannelActive = self.Frontend_.IsDIChannelActive ;
-                    %diChannelTerminalIDs = self.Frontend_.DIChannelTerminalIDs ;
-                    activeDITerminalIDs = diChannelTerminalIDs(isDIChannelActive) ;
-                    self.TimedDigitalInputTask_ = ...
-                        ws.DITask('WaveSurfer DI Task', ...
-                                  primaryDeviceName , ...
-                                  isPrimaryDeviceAPXIDevice , ...
-                                  activeDITerminalIDs, ...
-                                  acquisitionSampleRate, ...
-                                  sweepDuration, ...
-                                  acquisitionKeystoneTaskType, ...
-                                  acquisitionKeystoneTaskDeviceName, ...
-                                  acquisitionTriggerDeviceName, ...
-                                  acquisitionTriggerPFIID, ...
-                                  acquisitionTriggerEdge) ;
+                    self.TimedDigitalInputTask_ = ws.DITask(diTaskArguments{:}) ;
+                else
+                    self.TimedDigitalInputTask_.commit() ;
                 end
 
                 % Dimension the cache that will hold acquired data in main
@@ -589,6 +603,27 @@ classdef Looper < handle
             % This method does no error checking, for minimum latency
             self.UntimedDigitalOutputTask_.setChannelDataQuicklyAndDirtily(newValue) ;
         end        
+        
+        function [countPerBin, binEdges, meanLatency, maxLatency] = getUntimedDigitalOutputLatencyHistogram(self)
+            % Histogram of the latencies of the untimed DO writes, in
+            % seconds, as measured inside ws.ni
+            [countPerBin, binEdges, meanLatency, maxLatency] = self.UntimedDigitalOutputTask_.getWriteLatencyHistogram() ;
+        end
+        
+        function startClosedLoopFromAIToUntimedDigitalOutput(self, rules)
+            % For the current run, set untimed DO lines from threshold
+            % rules applied to the acquired AI data, natively, for
+            % millisecond-scale feedback.  rules is nRules x 5, one rule per
+            % row: [aiChannelIndex untimedDOChannelIndex upperThreshold
+            % lowerThreshold isInverted], thresholds in ADC counts.  See
+            % ws.ni('StartClosedLoop', ...).
+            doBinding = self.UntimedDigitalOutputTask_.getOnDemandDOBinding() ;
+            self.TimedAnalogInputTask_.startClosedLoop(doBinding, rules) ;
+        end
+        
+        function [scanIndex, ruleIndex, isLineHigh] = getClosedLoopEvents(self)
+            [scanIndex, ruleIndex, isLineHigh] = self.TimedAnalogInputTask_.getClosedLoopEvents() ;
+        end
     end
     
     methods (Access=protected)
@@ -982,7 +1017,19 @@ classdef Looper < handle
         end  % function
         
         function completingOrStoppingOrAbortingRun_(self)
-            self.TimedAnalogInputTask_ = [] ;
+            % Stop the timed input tasks, and free up the hardware, but keep
+            % the tasks, in case the next run can reuse them.  If
+            % there's a problem, just delete them.
+            try
+                if ~isempty(self.TimedAnalogInputTask_) ,
+                    self.TimedAnalogInputTask_.stopAndUnreserve() ;
+                end
+                if ~isempty(self.TimedDigitalInputTask_) ,
+                    self.TimedDigitalInputTask_.stopAndUnreserve() ;
+                end
+            catch exception  %#ok<NASGU>
+                self.releaseTimedHardwareResources_() ;
+            end
 %             if ~isempty(self.TimedAnalogInputTask_) ,
 %                 if isvalid(self.TimedAnalogInputTask_) ,
 %                     %self.TimedAnalogInputTask_.disarm();
@@ -990,7 +1037,6 @@ classdef Looper < handle
 %                     self.TimedAnalogInputTask_ = [] ;
 %                 end
 %             end
-            self.TimedDigitalInputTask_ = [] ;
 %             if ~isempty(self.TimedDigitalInputTask_) ,
 %                 if isvalid(self.TimedDigitalInputTask_) ,
 %                     %self.TimedDigitalInputTask_.disarm();
@@ -1153,25 +1199,22 @@ classdef Looper < handle
             % Call the task to do the real work
             if self.IsArmedOrAcquiring_ ,
                 %fprintf('LooperAcquisition::poll(): In self.IsArmedOrAcquiring_==true branch\n') ;
-                % Check for task doneness
                 if ~isfinite(sweepDuration) ,  
-                    % if doing continuous acq, no need to check.  This is
+                    % if doing continuous acq, no need to check for task doneness.  This is
                     % an important optimization, b/c the checks can take
                     % 10-20 ms.
                     areTasksDone = false;
-                else                    
-                    areTasksDone = ( self.TimedAnalogInputTask_.isDone() && self.TimedDigitalInputTask_.isDone() ) ;
+                    [rawAnalogData,rawDigitalData,timeSinceRunStartAtStartOfData] = ...
+                        self.readDataFromTasks_(timeSinceSweepStart, fromRunStartTicId, areTasksDone) ;
+                else
+                    % Wait natively for the next batch of scans, rather than
+                    % spinning, which also tells us whether the tasks are done
+                    [rawAnalogData,rawDigitalData,timeSinceRunStartAtStartOfData,areTasksDone] = ...
+                        self.waitForDataFromTasks_(timeSinceSweepStart, fromRunStartTicId) ;
                 end
 %                 if areTasksDone ,
 %                     fprintf('Acquisition tasks are done.\n')
 %                 end
-                
-                % Get data
-                %if areTasksDone ,
-                %    fprintf('About to readDataFromTasks_, even though acquisition tasks are done.\n')
-                %end
-                [rawAnalogData,rawDigitalData,timeSinceRunStartAtStartOfData] = ...
-                    self.readDataFromTasks_(timeSinceSweepStart, fromRunStartTicId, areTasksDone) ;
                 %nScans = size(rawAnalogData,1) ;
                 %fprintf('Read acq data. nScans: %d\n',nScans)
 
@@ -1230,6 +1273,34 @@ classdef Looper < handle
             end
             %self.NScansReadThisSweep_ = self.NScansReadThisSweep_ + nScans ;
         end  % function
+        
+        function [rawAnalogData, rawDigitalData, timeSinceRunStartAtStartOfData, areTasksDone] = ...
+                waitForDataFromTasks_(self, timeSinceSweepStart, fromRunStartTicId)
+            % Like readDataFromTasks_(), but the task that sets the pace
+            % waits natively for up to AcquisitionWaitDuration_'s worth of
+            % scans.  Any scans left once the tasks are done are read too.
+            waitDuration = ws.Looper.AcquisitionWaitDuration_ ;
+            if self.IsAtLeastOneActiveAIChannelCached_ ,
+                [rawAnalogData, isAITaskDone, timeSinceRunStartAtStartOfData] = ...
+                    self.TimedAnalogInputTask_.waitForData(waitDuration, timeSinceSweepStart, fromRunStartTicId) ;
+                nScans = size(rawAnalogData,1) ;
+                rawDigitalData = ...
+                    self.TimedDigitalInputTask_.readData(nScans, timeSinceSweepStart, fromRunStartTicId);
+                areTasksDone = isAITaskDone && self.TimedDigitalInputTask_.isDone() ;
+            elseif self.IsAtLeastOneActiveDIChannelCached_ ,
+                % The digital task sets the pace, as in readDataFromTasks_()
+                [rawDigitalData, isDITaskDone, timeSinceRunStartAtStartOfData] = ...
+                    self.TimedDigitalInputTask_.waitForData(waitDuration, timeSinceSweepStart, fromRunStartTicId) ;
+                nScans = size(rawDigitalData,1) ;
+                rawAnalogData = zeros(nScans, 0, 'int16') ;
+                areTasksDone = isDITaskDone && self.TimedAnalogInputTask_.isDone() ;
+            else
+                % If we get here, we've made a programming error --- this
+                % should have been caught when the run was started.
+                error('wavesurfer:ZeroActiveInputChannelsWhileReadingDataFromTasks', ...
+                      'Internal error: No active input channels while reading data from tasks') ;
+            end
+        end  % function
     end
     
 %     methods
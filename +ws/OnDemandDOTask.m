@@ -11,6 +11,7 @@ classdef OnDemandDOTask < handle
     
     properties (Access = protected, Transient = true)
         DAQmxTaskHandle_ = [];
+        OnDemandDOBinding_ = [];  % for fast writes, see ws.ni('BindOnDemandDO', ...)
     end
     
     properties (Access = protected)
@@ -56,6 +57,7 @@ classdef OnDemandDOTask < handle
                 %set(self.DAQmxTaskHandle_, 'refClkRate', referenceClockRate) ;                
                 ws.ni('DAQmxSetRefClkSrc', self.DAQmxTaskHandle_, referenceClockSource) ;
                 ws.ni('DAQmxSetRefClkRate', self.DAQmxTaskHandle_, referenceClockRate) ;
+                self.OnDemandDOBinding_ = ws.ni('BindOnDemandDO', self.DAQmxTaskHandle_, double(terminalIDs)) ;
             end            
             
             % Store this stuff
@@ -76,9 +78,10 @@ classdef OnDemandDOTask < handle
                 if ~ws.ni('DAQmxIsTaskDone', self.DAQmxTaskHandle_) ,
                     ws.ni('DAQmxStopTask', self.DAQmxTaskHandle_) ;
                 end
-                ws.ni('DAQmxClearTask', self.DAQmxTaskHandle_) ;
+                ws.ni('DAQmxClearTask', self.DAQmxTaskHandle_) ;  % releases the binding, too
             end
             self.DAQmxTaskHandle_=[];
+            self.OnDemandDOBinding_=[];
         end  % function
         
         function start(self)
@@ -99,7 +102,9 @@ classdef OnDemandDOTask < handle
             %if ~isempty(self.DAQmxTaskHandle_) && ~self.DAQmxTaskHandle_.isTaskDoneQuiet()
             %    self.DAQmxTaskHandle_.stop();
             %end
-            if ~isempty(self.DAQmxTaskHandle_) && ~ws.ni('DAQmxIsTaskDone', self.DAQmxTaskHandle_) ,
+            if ~isempty(self.DAQmxTaskHandle_) ,
+                % Stopping a task that's done is harmless, and it has to be
+                % stopped before it can be started again
                 ws.ni('DAQmxStopTask', self.DAQmxTaskHandle_) ;
             end            
         end  % function
@@ -141,7 +146,32 @@ classdef OnDemandDOTask < handle
             % newValue is a bad value, that's on you.  No free lunch, etc.
             self.ChannelData_ = newValue ;
             %self.DAQmxTaskHandle_.writeDigitalData(newValue);
-            ws.ni('DAQmxWriteDigitalLines', self.DAQmxTaskHandle_, true, -1, newValue);
+            ws.ni(self.OnDemandDOBinding_, newValue);
+        end
+        
+        function [countPerBin, binEdges, meanLatency, maxLatency] = getWriteLatencyHistogram(self)
+            % Histogram of the latencies of the writes to the lines, in
+            % seconds.  See ws.ni('GetOnDemandDOLatencyHistogram', ...).
+            if isempty(self.OnDemandDOBinding_) ,
+                countPerBin = zeros(1,0) ;
+                binEdges = zeros(1,0) ;
+                meanLatency = nan ;
+                maxLatency = 0 ;
+            else
+                [countPerBin, binEdges, meanLatency, maxLatency] = ws.ni('GetOnDemandDOLatencyHistogram', self.OnDemandDOBinding_) ;
+            end
+        end
+        
+        function resetWriteLatencyHistogram(self)
+            if ~isempty(self.OnDemandDOBinding_) ,
+                ws.ni('ResetOnDemandDOLatencyHistogram', self.OnDemandDOBinding_) ;
+            end
+        end
+        
+        function result = getOnDemandDOBinding(self)
+            % The binding for fast writes, e.g. for a closed loop to drive
+            % the lines.  Empty if the task has no channels.
+            result = self.OnDemandDOBinding_ ;
         end
         
         function debug(self) %#ok<MANU>
@@ -190,7 +220,7 @@ classdef OnDemandDOTask < handle
                 % Write the data to the output buffer
                 outputData = self.ChannelData ;
                 %self.DAQmxTaskHandle_.writeDigitalData(outputData) ;
-                ws.ni('DAQmxWriteDigitalLines', self.DAQmxTaskHandle_, true, -1, outputData);
+                ws.ni(self.OnDemandDOBinding_, outputData);
             end
         end  % function
     end  % Static methods
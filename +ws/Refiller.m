@@ -228,6 +228,10 @@ classdef Refiller < handle
 %         end  % function        
         
         function didCompleteEpisode = checkIfTasksAreDoneAndEndEpisodeIfSo(self)
+            % Keep a long AO stimulus flowing, if it's being streamed
+            if self.AreTasksStarted_ ,
+                self.TheFiniteAnalogOutputTask_.refillOutputStreams() ;
+            end
             areTasksDone = self.areTasksDone_() ;
             if areTasksDone ,
                 %fprintf('Tasks are done\n') ;
@@ -462,7 +466,11 @@ classdef Refiller < handle
             self.abortTheOngoingRun_() ;
         end  % function        
         
-        function startEpisode(self, aoData, doData)
+        function startEpisode(self, aoScanCount, calculateAOScans, doData)
+            % aoScanCount is the number of scans in the AO data for the
+            % episode, and calculateAOScans(scanIndices) returns the scans
+            % with the given indices, so that a long stimulus can be
+            % calculated a chunk at a time.
             self.IsPerformingEpisode_ = true ;
             %fprintf('Just set self.IsPerformingEpisode_ to %s\n', ws.fif(self.IsPerformingEpisode_, 'true', 'false') ) ;
             %frontend.callUserMethod_('startingEpisode') ;
@@ -480,7 +488,7 @@ classdef Refiller < handle
             
             % Set the channel data in the tasks
             %[aoData, doData] = frontend.getStimulationData(indexOfEpisodeWithinRun) ;
-            self.setAnalogChannelData_(aoData) ;
+            self.setAnalogChannelData_(aoScanCount, calculateAOScans) ;
             self.setDigitalChannelData_(doData) ;
             
             % Note that the tasks have been started, which will be true
@@ -1295,13 +1303,13 @@ classdef Refiller < handle
 %             end
 %         end  % function
         
-        function setAnalogChannelData_(self, aoDataScaledAndLimited)
+        function setAnalogChannelData_(self, aoScanCount, calculateAOScans)
             % Finally, assign the stimulation data to the the relevant part
             % of the output task
             if isempty(self.TheFiniteAnalogOutputTask_) ,
                 error('Adam is dumb');
             else
-                self.TheFiniteAnalogOutputTask_.setChannelData(aoDataScaledAndLimited) ;
+                self.TheFiniteAnalogOutputTask_.setChannelDataFromFunction(aoScanCount, calculateAOScans) ;
             end
         end  % function
 
@@ -854,9 +854,14 @@ classdef Stimulation < ws.Model
         end        
         
         function data = ...
-                calculateSignalsForMap(self, mapIndex, sampleRate, channelNames, isChannelAnalog, sweepIndexWithinSet)
+                calculateSignalsForMap(self, mapIndex, sampleRate, channelNames, isChannelAnalog, sweepIndexWithinSet, varargin)
+            % varargin can hold the indices of the scans to calculate
             data = ...
-                self.StimulusLibrary_.calculateSignalsForMap(mapIndex, sampleRate, channelNames, isChannelAnalog, sweepIndexWithinSet) ;
+                self.StimulusLibrary_.calculateSignalsForMap(mapIndex, sampleRate, channelNames, isChannelAnalog, sweepIndexWithinSet, varargin{:}) ;
+        end
+        
+        function result = scanCountForMap(self, mapIndex, sampleRate)
+            result = self.StimulusLibrary_.scanCountForMap(mapIndex, sampleRate) ;
         end
         
     end  % public methods block    
@@ -1472,9 +1472,23 @@ classdef StimulusLibrary < ws.Model    %  & ws.ValueComparable   % & ws.Mimic  %
             end
         end
         
-        function data = calculateSignalsForMap(self, mapIndex, sampleRate, channelNames, isChannelAnalog, sweepIndexWithinSet)
+        function result = scanCountForMap(self, mapIndex, sampleRate)
+            % The number of scans in the signals calculateSignalsForMap()
+            % returns for the map.  Zero if mapIndex is empty.
+            if isempty(mapIndex) ,
+                result = 0 ;
+            else
+                duration = self.itemProperty('ws.StimulusMap', mapIndex, 'Duration') ;  % This takes proper account of an external override, if any
+                result = ws.nScansFromScanRateAndDesiredDuration(sampleRate, duration) ;
+            end
+        end  % function
+        
+        function data = calculateSignalsForMap(self, mapIndex, sampleRate, channelNames, isChannelAnalog, sweepIndexWithinSet, scanIndices)
             % nBoundChannels is the number of channels *in channelNames* for which
             % a non-empty binding was found.
+            % If scanIndices is given, only the scans with those (one-based)
+            % indices are calculated, so a long stimulus can be calculated a
+            % chunk at a time.
             if ~exist('sweepIndexWithinSet','var') || isempty(sweepIndexWithinSet) ,
                 sweepIndexWithinSet=1;
             end
@@ -1488,20 +1502,28 @@ classdef StimulusLibrary < ws.Model    %  & ws.ValueComparable   % & ws.Mimic  %
                 return
             end
             
-            % Create a timeline
-            duration = self.itemProperty('ws.StimulusMap', mapIndex, 'Duration') ;  % This takes proper account of an external override, if any
-            sampleCount = ws.nScansFromScanRateAndDesiredDuration(sampleRate, duration) ;
+            % Create a timeline.  Each stimulus zeros the last sample of
+            % the timeline it's given, so we give it one sample more than
+            % we want, and zero the last sample of the whole stimulus
+            % ourselves, if it's one of the ones we want.
+            sampleCount = self.scanCountForMap(mapIndex, sampleRate) ;
+            if ~exist('scanIndices','var') ,
+                scanIndices = (1:sampleCount)' ;
+            end
+            scanIndices = scanIndices(:) ;
+            nScans = length(scanIndices) ;
             dt=1/sampleRate;
-            t = dt*(0:(sampleCount-1))' ;  % s
+            t = dt*([scanIndices ; sampleCount+1]-1) ;  % s
             tOffsetByHalfSample = t + dt/2 ;            
               % + dt/2 is somewhat controversial, but in the common case
               % that pulse durations are integer multiples of dt, it
               % ensures that each pulse is exactly (pulseDuration/dt)
               % samples long, and avoids other unpleasant pseudorandomness
               % when stimulus discontinuities occur right at sample times
+            isLastSample = (scanIndices==sampleCount) ;
             
             % Create the data array  
-            data = zeros(sampleCount, nChannels);
+            data = zeros(nScans, nChannels);
             
             % For each named channel, overwrite a col of data
             map = self.Maps_{mapIndex} ;  % get the map
@@ -1526,6 +1548,8 @@ classdef StimulusLibrary < ws.Model    %  & ws.ValueComparable   % & ws.Mimic  %
                             % data
                             %nChannelsWithStimulus = nChannelsWithStimulus + 1 ;
                             rawSignal = thisStimulus.calculateSignal(tOffsetByHalfSample, sweepIndexWithinSet);
+                            rawSignal = rawSignal(1:nScans) ;  % drop the extra sample
+                            rawSignal(isLastSample) = 0 ;  % don't want to leave the DACs on when we're done
                             multiplier = map.Multiplier(bindingIndex) ;
                             if isChannelAnalog(iChannel) ,
                                 data(:, iChannel) = multiplier*rawSignal ;
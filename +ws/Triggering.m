@@ -58,14 +58,8 @@ classdef Triggering < ws.Model
 
         function releaseTimedHardwareResources(self)
             % Delete the built-in trigger task
-            %ws.deleteIfValidHandle(self.BuiltinTriggerDAQmxTaskHandle_);  % have to explicitly delete b/c DABS task
-            if ~isempty(self.BuiltinTriggerDAQmxTaskHandle_) ,
-                if ~ws.ni('DAQmxIsTaskDone', self.BuiltinTriggerDAQmxTaskHandle_) ,
-                    ws.ni('DAQmxStopTask', self.BuiltinTriggerDAQmxTaskHandle_) ;
-                end
-                ws.ni('DAQmxClearTask', self.BuiltinTriggerDAQmxTaskHandle_) ;
-                self.BuiltinTriggerDAQmxTaskHandle_ = [] ;
-            end
+            self.releaseBuiltinTriggerTask_() ;
+            % Delete the counter tasks
 %             if ~isempty(self.AcquisitionCounterTask_) ,
 %                 self.AcquisitionCounterTask_.stop();
 %             end
@@ -86,8 +80,11 @@ classdef Triggering < ws.Model
         end  % function
                 
         function startingRun(self, primaryDeviceName, isPrimaryDeviceAPXIDevice)
-            % All of the tasks should be empty at this point.  This is an object
-            % invariant, that the tasks are all empty when WS is not running.
+            % The built-in trigger task should be empty at this point.  This is an object
+            % invariant, that it is empty when WS is not running.  The
+            % counter tasks from the last run may still be around, stopped,
+            % in which case we reuse them if they're routed the same way,
+            % since reconfiguring one is much quicker than making it anew.
             
             % Set up the built-in trigger task
 %             self.BuiltinTriggerDAQmxTaskHandle_ = ws.dabs.ni.daqmx.Task('WaveSurfer Built-in Trigger Task');  % on-demand DO task
@@ -123,15 +120,18 @@ classdef Triggering < ws.Model
                 % trigger pulses.
                 acquisitionTriggerTerminalName = sprintf('/%s/PFI%d', self.BuiltinTrigger_.DeviceName, self.BuiltinTrigger_.PFIID) ;
                 self.AcquisitionCounterTask_ = ...
-                    ws.CounterTriggerTask(taskName, ...
-                                          referenceClockSource, ...
-                                          referenceClockRate, ...
-                                          deviceName, ...
-                                          counterID, ...
-                                          1/acquisitionTrigger.Interval, ...
-                                          acquisitionTrigger.RepeatCount, ...
-                                          acquisitionTrigger.PFIID, ...
-                                          acquisitionTriggerTerminalName );
+                    self.reconfiguredOrNewCounterTask_(self.AcquisitionCounterTask_, ...
+                                                       taskName, ...
+                                                       referenceClockSource, ...
+                                                       referenceClockRate, ...
+                                                       deviceName, ...
+                                                       counterID, ...
+                                                       1/acquisitionTrigger.Interval, ...
+                                                       acquisitionTrigger.RepeatCount, ...
+                                                       acquisitionTrigger.PFIID, ...
+                                                       acquisitionTriggerTerminalName );
+            else
+                self.AcquisitionCounterTask_ = [] ;
             end            
             
             % If needed, set up the stimulation counter task
@@ -152,15 +152,18 @@ classdef Triggering < ws.Model
                 % trigger pulses.
                 stimulationTriggerTerminalName = sprintf('/%s/PFI%d', self.BuiltinTrigger_.DeviceName, self.BuiltinTrigger_.PFIID) ;
                 self.StimulationCounterTask_ = ...
-                    ws.CounterTriggerTask(taskName, ...
-                                          referenceClockSource, ...
-                                          referenceClockRate, ...
-                                          deviceName, ...
-                                          counterID, ...
-                                          1/stimulationTrigger.Interval, ...
-                                          stimulationTrigger.RepeatCount, ...
-                                          stimulationTrigger.PFIID, ...
-                                          stimulationTriggerTerminalName );
+                    self.reconfiguredOrNewCounterTask_(self.StimulationCounterTask_, ...
+                                                       taskName, ...
+                                                       referenceClockSource, ...
+                                                       referenceClockRate, ...
+                                                       deviceName, ...
+                                                       counterID, ...
+                                                       1/stimulationTrigger.Interval, ...
+                                                       stimulationTrigger.RepeatCount, ...
+                                                       stimulationTrigger.PFIID, ...
+                                                       stimulationTriggerTerminalName );
+            else
+                self.StimulationCounterTask_ = [] ;
             end        
             
             % Start the counter tasks, which will wait for the built-in
@@ -194,7 +197,30 @@ classdef Triggering < ws.Model
     
     methods (Access=protected)        
         function completingOrStoppingOrAbortingRun_(self)
-            self.releaseTimedHardwareResources() ;
+            % Delete the built-in trigger task, but just stop the counter
+            % tasks, so they can be reconfigured for the next run instead
+            % of being made anew.  They get deleted in
+            % releaseTimedHardwareResources().  A finite counter task that
+            % is done still has to be stopped before it can be changed or
+            % started again, so stop them whether they're done or not.
+            self.releaseBuiltinTriggerTask_() ;
+            counterTasks = {self.AcquisitionCounterTask_ self.StimulationCounterTask_} ;
+            for i = 1:length(counterTasks) ,
+                counterTask = counterTasks{i} ;
+                if ~isempty(counterTask) ,
+                    try
+                        counterTask.stop() ;
+                    catch exception  %#ok<NASGU>
+                        % If there's a problem, delete the task, and
+                        % keep ploughing ahead with wrapping things up
+                        if i==1 ,
+                            self.AcquisitionCounterTask_ = [] ;
+                        else
+                            self.StimulationCounterTask_ = [] ;
+                        end
+                    end
+                end
+            end
 %             if ~isempty(self.AcquisitionCounterTask_) ,
 %                 try
 %                     self.AcquisitionCounterTask_.stop() ;
@@ -213,6 +239,54 @@ classdef Triggering < ws.Model
 %             end
         end  % method
         
+        function releaseBuiltinTriggerTask_(self)
+            %ws.deleteIfValidHandle(self.BuiltinTriggerDAQmxTaskHandle_);  % have to explicitly delete b/c DABS task
+            if ~isempty(self.BuiltinTriggerDAQmxTaskHandle_) ,
+                if ~ws.ni('DAQmxIsTaskDone', self.BuiltinTriggerDAQmxTaskHandle_) ,
+                    ws.ni('DAQmxStopTask', self.BuiltinTriggerDAQmxTaskHandle_) ;
+                end
+                ws.ni('DAQmxClearTask', self.BuiltinTriggerDAQmxTaskHandle_) ;
+                self.BuiltinTriggerDAQmxTaskHandle_ = [] ;
+            end
+        end  % method
+        
+        function result = reconfiguredOrNewCounterTask_(self, existingTask, taskName, referenceClockSource, referenceClockRate, deviceName, counterID, ...
+                                                        repeatFrequency, repeatCount, pfiID, triggerTerminalName)
+            % Returns existingTask reconfigured for the given frequency and
+            % count if it can be, otherwise deletes it and returns a new
+            % counter trigger task
+            if ~isempty(existingTask) && ...
+               existingTask.canBeReconfiguredFor(referenceClockSource, referenceClockRate, deviceName, counterID, pfiID, triggerTerminalName) ,
+                try
+                    existingTask.reconfigure(repeatFrequency, repeatCount) ;
+                    result = existingTask ;
+                    return
+                catch exception  %#ok<NASGU>
+                    % Fall through to making a new one
+                end
+            end
+            % Free up the counters before making a new task, in case the
+            % other counter task holds the counter the new one needs
+            if ~isempty(existingTask) ,
+                delete(existingTask) ;
+            end
+            if ~isempty(self.AcquisitionCounterTask_) && isvalid(self.AcquisitionCounterTask_) ,
+                self.AcquisitionCounterTask_.unreserve() ;
+            end
+            if ~isempty(self.StimulationCounterTask_) && isvalid(self.StimulationCounterTask_) ,
+                self.StimulationCounterTask_.unreserve() ;
+            end
+            result = ws.CounterTriggerTask(taskName, ...
+                                           referenceClockSource, ...
+                                           referenceClockRate, ...
+                                           deviceName, ...
+                                           counterID, ...
+                                           repeatFrequency, ...
+                                           repeatCount, ...
+                                           pfiID, ...
+                                           triggerTerminalName );
+        end  % method
+        
 %         function result = areTasksDoneTriggering_(self)
 %             % Check if the tasks are done.  This doesn't change the object
 %             % state at all.
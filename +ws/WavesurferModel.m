@@ -1450,8 +1450,8 @@ classdef WavesurferModel < ws.Model & ws.EventBroadcaster
                 if self.Refiller_.NEpisodesPerRun > 0 ,
                     if ~isStimulationTriggerIdenticalToAcquisitionTrigger ,
                         self.callUserMethod_('startingEpisode') ;
-                        [aoData, doData] = self.getStimulationData(self.Refiller_.NEpisodesCompletedSoFarThisRun+1) ;                        
-                        self.Refiller_.startEpisode(aoData, doData) ;
+                        [aoScanCount, calculateAOScans, doData] = self.getStimulationData(self.Refiller_.NEpisodesCompletedSoFarThisRun+1) ;                        
+                        self.Refiller_.startEpisode(aoScanCount, calculateAOScans, doData) ;
                     end
                 end
             catch err
@@ -1481,7 +1481,7 @@ classdef WavesurferModel < ws.Model & ws.EventBroadcaster
                 logging = self.Logging_ ;
                 if logging.IsEnabled ,
                     headerStruct = ws.encodeForHeader(self) ;
-                    logging.startingRun(self.NextRunAbsoluteFileName, self.IsAIChannelActive, self.ExpectedSweepScanCount, ...
+                    logging.startingRun(self.NextRunAbsoluteFileName, self.IsAIChannelActive, self.Acquisition_.NActiveDigitalChannels, self.ExpectedSweepScanCount, ...
                                         self.AcquisitionSampleRate, self.AreSweepsFiniteDuration, headerStruct);
                 end
             catch me
@@ -1588,8 +1588,8 @@ classdef WavesurferModel < ws.Model & ws.EventBroadcaster
             if self.Stimulation_.IsEnabled && (self.StimulationTriggerIndex==self.AcquisitionTriggerIndex) ,
                 try
                     self.callUserMethod_('startingEpisode') ;
-                    [aoData, doData] = self.getStimulationData(self.Refiller_.NEpisodesCompletedSoFarThisRun+1) ;
-                    self.Refiller_.startEpisode(aoData, doData) ;
+                    [aoScanCount, calculateAOScans, doData] = self.getStimulationData(self.Refiller_.NEpisodesCompletedSoFarThisRun+1) ;
+                    self.Refiller_.startEpisode(aoScanCount, calculateAOScans, doData) ;
                     err = [] ;
                 catch err
                 end
@@ -6847,13 +6847,17 @@ classdef WavesurferModel < ws.Model & ws.EventBroadcaster
             end               
         end        
 
-        function [aoData, doData] = getStimulationData(self, indexOfEpisodeWithinRun)
+        function [aoScanCount, calculateAOScans, doData] = getStimulationData(self, indexOfEpisodeWithinRun)
+            % The AO data is returned as a scan count, and a function that
+            % calculates the scans with the given indices, so that a long
+            % stimulus needn't be calculated all at once.
+            
             % Get the current stimulus map
             stimulusMapIndex = self.Stimulation_.getCurrentStimulusMapIndex(indexOfEpisodeWithinRun) ;
             %stimulusMap = self.getCurrentStimulusMap_(indexOfEpisodeWithinSweep);
 
             % Set the channel data in the tasks
-            aoData = self.getAnalogChannelData_(stimulusMapIndex, indexOfEpisodeWithinRun) ;
+            [aoScanCount, calculateAOScans] = self.getAnalogChannelData_(stimulusMapIndex, indexOfEpisodeWithinRun) ;
             doData = self.getDigitalChannelData_(stimulusMapIndex, indexOfEpisodeWithinRun) ;
         end
         
@@ -6893,44 +6897,63 @@ classdef WavesurferModel < ws.Model & ws.EventBroadcaster
             end            
         end  % function                
         
-        function aoDataScaledAndLimited = getAnalogChannelData_(self, stimulusMapIndex, episodeIndexWithinSweep)
+        function [nScans, calculateScans] = getAnalogChannelData_(self, stimulusMapIndex, episodeIndexWithinSweep)
+            % The number of scans in the AO data for the episode, and a
+            % function that calculates the scans with the given indices,
+            % scaled to V and limited to [-10 V, +10 V].  The channel
+            % names and scales are fixed when this is called.
+            
             % Get info about which analog channels are in the task
             isInTaskForEachAOChannel = ~self.IsAOChannelTerminalOvercommitted ;
             %isInTaskForEachAnalogChannel = self.TheFiniteAnalogOutputTask_.IsChannelInTask ;
-            nAnalogChannelsInTask = sum(isInTaskForEachAOChannel) ;
+            channelNamesInTask = self.AOChannelNames(isInTaskForEachAOChannel) ;
+            sampleRate = self.StimulationSampleRate ;
+            nScans = self.Stimulation_.scanCountForMap(stimulusMapIndex, sampleRate) ;
+            
+            % If any channel scales are problematic, deal with this
+            analogChannelScales = self.AOChannelScales(isInTaskForEachAOChannel) ;  % (native units)/V
+            inverseAnalogChannelScales=1./analogChannelScales;  % e.g. V/(native unit)
+            sanitizedInverseAnalogChannelScales = ...
+                ws.fif(isfinite(inverseAnalogChannelScales), inverseAnalogChannelScales, zeros(size(inverseAnalogChannelScales)));            
+
+            calculateScans = ...
+                @(scanIndices)(self.calculateAnalogChannelScans_(stimulusMapIndex, ...
+                                                                 sampleRate, ...
+                                                                 channelNamesInTask, ...
+                                                                 sanitizedInverseAnalogChannelScales, ...
+                                                                 episodeIndexWithinSweep, ...
+                                                                 scanIndices)) ;
+        end  % function
+        
+        function aoDataScaledAndLimited = calculateAnalogChannelScans_(self, stimulusMapIndex, sampleRate, channelNamesInTask, ...
+                                                                       inverseAnalogChannelScales, episodeIndexWithinSweep, scanIndices)
+            % Calculate the scans with the given indices of the AO data for
+            % an episode, scaled to V and limited to [-10 V, +10 V]
+            nAnalogChannelsInTask = length(channelNamesInTask) ;
 
             % Calculate the signals
             if isempty(stimulusMapIndex) ,
                 aoData = zeros(0,nAnalogChannelsInTask) ;
                 %nChannelsWithStimulus = 0 ;
             else
-                channelNamesInTask = self.AOChannelNames(isInTaskForEachAOChannel) ;
                 isChannelAnalog = true(1,nAnalogChannelsInTask) ;
 %                 [aoData, nChannelsWithStimulus] = ...
 %                     stimulusMap.calculateSignals(self.StimulationSampleRate_, channelNamesInTask, isChannelAnalog, episodeIndexWithinSweep) ;  
                 aoData = ...
                     self.Stimulation_.calculateSignalsForMap(stimulusMapIndex, ...
-                                                             self.StimulationSampleRate, ...
+                                                             sampleRate, ...
                                                              channelNamesInTask, ...
                                                              isChannelAnalog, ...
-                                                             episodeIndexWithinSweep) ;
+                                                             episodeIndexWithinSweep, ...
+                                                             scanIndices) ;
                   % each signal of aoData is in native units
             end
             
-            % % Want to return the number of scans in the stimulus data
-            % nScans = size(aoData,1);
-            
-            % If any channel scales are problematic, deal with this
-            analogChannelScales = self.AOChannelScales(isInTaskForEachAOChannel) ;  % (native units)/V
-            inverseAnalogChannelScales=1./analogChannelScales;  % e.g. V/(native unit)
-            sanitizedInverseAnalogChannelScales = ...
-                ws.fif(isfinite(inverseAnalogChannelScales), inverseAnalogChannelScales, zeros(size(inverseAnalogChannelScales)));            
-
             % scale the data by the channel scales
             if isempty(aoData) ,
                 aoDataScaled=aoData;
             else
-                aoDataScaled=bsxfun(@times,aoData,sanitizedInverseAnalogChannelScales);
+                aoDataScaled=bsxfun(@times,aoData,inverseAnalogChannelScales);
             end
             % all signals in aoDataScaled are in V
             
@@ -7048,8 +7071,8 @@ classdef WavesurferModel < ws.Model & ws.EventBroadcaster
                     else
                         try
                             self.callUserMethod_('startingEpisode') ;
-                            [aoData, doData] = self.getStimulationData(self.Refiller_.NEpisodesCompletedSoFarThisRun+1) ;
-                            self.Refiller_.startEpisode(aoData, doData) ;
+                            [aoScanCount, calculateAOScans, doData] = self.getStimulationData(self.Refiller_.NEpisodesCompletedSoFarThisRun+1) ;
+                            self.Refiller_.startEpisode(aoScanCount, calculateAOScans, doData) ;
                         catch err
                             % Something went wrong
                             self.abortOngoingRun_();
@@ -1,4 +1,12 @@
 function addScalingToHDF5FilesRecursivelyGivenCoeffs(sourceFolderPath, scalingCoefficients, targetFolderPath, isDryRun)
+    % If ws.rescaler has been built, use it: it does the whole tree, several
+    % files at a time, and skips files that were done by an earlier run that
+    % got interrupted.
+    if exist('ws.rescaler','file')==3 ,
+        ws.rescaler('AddScaling', sourceFolderPath, scalingCoefficients, targetFolderPath, isDryRun) ;
+        return
+    end
+    
     % Create the target folder, if it doesn't exist
     if exist(targetFolderPath,'dir') ,
         % nothing to do
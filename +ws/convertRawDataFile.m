@@ -0,0 +1,19 @@
+function wasRaw = convertRawDataFile(fileName, doCompress)
+    % Converts a WaveSurfer data file logged in the raw format into the usual
+    % HDF5 layout, copying the scans from the .dat file next to it into the
+    % per-sweep datasets, then deleting the .dat file.  WaveSurfer does this
+    % itself at the end of each run, so this is only needed for files left
+    % over from a run that didn't finish normally.  Returns true iff the file
+    % was in the raw format; files already in the usual layout are left as-is.
+    % If doCompress is true, the scans are compressed with ws.logger's
+    % lossless filter as they're copied, in which case they're read back
+    % with ws.loadDataFile() or ws.DataFileReader.  doCompress defaults to
+    % false.
+    if ~exist('doCompress', 'var') || isempty(doCompress) ,
+        doCompress = false ;
+    end
+    if ~exist(fileName, 'file') ,
+        error('The file %s does not exist.', fileName) ;
+    end
+    wasRaw = ws.logger('ConvertRawFile', fileName, logical(doCompress)) ;
+end
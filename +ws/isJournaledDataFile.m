@@ -0,0 +1,8 @@
+function result = isJournaledDataFile(fileName)
+    % Returns true iff the given WaveSurfer data file was logged in the
+    % journal format and not yet recovered, i.e. there's a .journal file next
+    % to it holding its scans.  Until it's recovered, the .h5 file itself may
+    % be missing, or hold only the header.
+    [path, baseName] = fileparts(fileName) ;
+    result = logical(exist(fullfile(path, [baseName '.journal']), 'file')) ;
+end
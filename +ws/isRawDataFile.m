@@ -0,0 +1,11 @@
+function result = isRawDataFile(fileName)
+    % Returns true iff the given WaveSurfer data file was logged in the raw
+    % format and not yet converted, i.e. its scans are still in the .dat file
+    % next to it, and it has a /rawScans group indexing them.
+    try
+        h5readatt(fileName, '/rawScans', 'dataFileName') ;
+        result = true ;
+    catch me %#ok<NASGU>
+        result = false ;
+    end
+end
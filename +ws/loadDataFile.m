@@ -23,6 +23,9 @@ function dataFileAsStruct = loadDataFile(filename, formatString, tMin, tMax, min
     %   loadDataFile(filename, formatString, tMin, tMax, minSweepIndex, maxSweepIndex)
     %       Limits the sweeps returned to those between minSweepIndex and
     %       maxSweepIndex, inclusive.
+    %
+    %   To read slices of a few sweeps of a big file, without loading the
+    %   whole file, use ws.DataFileReader.
     
     % Deal with optional args
     if ~exist('formatString','var') || isempty(formatString) ,
@@ -47,6 +50,12 @@ function dataFileAsStruct = loadDataFile(filename, formatString, tMin, tMax, min
     end
     do_subset_in_time = isscalar(tMin) && isscalar(tMax) && isfinite(tMin) && isfinite(tMax) ;   
     
+    % Check that the scans aren't still in a journal, in which case the file
+    % may not exist yet
+    if ws.isJournaledDataFile(filename) ,
+        error('The scans for %s are still in a journal.  Recover the file first, using ws.recoverDataFile().', filename) ;
+    end
+
     % Check that file exists
     if ~exist(filename, 'file') , 
         error('The file %s does not exist.', filename)
@@ -58,6 +67,11 @@ function dataFileAsStruct = loadDataFile(filename, formatString, tMin, tMax, min
         error('File must be a WaveSurfer-generated HDF5 (.h5) file.');
     end
 
+    % Check that the scans aren't still in a raw-format .dat file
+    if ws.isRawDataFile(filename) ,
+        error('The scans for %s are still in raw format.  Convert the file first, using ws.convertRawDataFile().', filename) ;
+    end
+
     if do_subset_in_time ,
         % Read the sampling rate, so we can convert the tMin and tMax to a start
         % and a count
@@ -233,9 +247,13 @@ function s = crawl_h5_tree(pathToGroup, filename, do_subset_in_time, firstScanIn
         end            
     end
     
-    % Add a field for each of the datasets
+    % Add a field for each of the datasets, except for the min/max overviews
+    % ws.logger can write alongside the scans, which are for viewers
     for idx = 1:length(datasetNames) ,
         datasetName = datasetNames{idx} ;
+        if strncmp(datasetName, 'analogScansOverview_', length('analogScansOverview_')) ,
+            continue
+        end
         pathToDataset = sprintf('%s%s',pathToGroup,datasetName) ;
         if isequal(datasetName, 'analogScans') || isequal(datasetName, 'digitalScans') ,
             if do_subset_in_time ,
@@ -246,9 +264,9 @@ function s = crawl_h5_tree(pathToGroup, filename, do_subset_in_time, firstScanIn
                 else
                     channelCount = info.Dataspace.Size(2) ;
                 end
-                dataset = h5read(filename, pathToDataset, [firstScanIndex 1], [scanCount channelCount], [1 1]) ;
+                dataset = read_scans(filename, pathToDataset, firstScanIndex, scanCount, channelCount) ;
             else
-                dataset = h5read(filename, pathToDataset) ;
+                dataset = read_scans(filename, pathToDataset) ;
             end                
         else
             dataset = h5read(filename, pathToDataset) ;
@@ -264,6 +282,59 @@ end  % function
 
 
 
+% ------------------------------------------------------------------------------
+% read_scans
+% ------------------------------------------------------------------------------
+function dataset = read_scans(filename, pathToDataset, firstScanIndex, scanCount, channelCount)
+    % Read an analogScans or digitalScans dataset, or just scanCount scans of it
+    % starting at firstScanIndex, if those are given.  Datasets that ws.logger
+    % compressed can't be read by Matlab's HDF5 library, which lacks
+    % WaveSurfer's filter, so those are read through ws.reader instead.
+    doReadAll = (nargin<3) ;
+    try
+        if doReadAll ,
+            dataset = h5read(filename, pathToDataset) ;
+        else
+            dataset = h5read(filename, pathToDataset, [firstScanIndex 1], [scanCount channelCount], [1 1]) ;
+        end
+    catch me
+        if ~is_compressed_by_wavesurfer(filename, pathToDataset) ,
+            rethrow(me) ;
+        end
+        tokens = regexp(pathToDataset, '^/(sweep|trial)_(\d+)/(\w+)$', 'tokens', 'once') ;
+        sweepIndex = str2double(tokens{2}) ;
+        datasetName = tokens{3} ;
+        if doReadAll ,
+            scanRange = [] ;
+        else
+            scanRange = [firstScanIndex firstScanIndex+scanCount-1] ;
+        end
+        reader = ws.DataFileReader(filename) ;
+        if isequal(datasetName, 'analogScans') ,
+            dataset = reader.rawAnalogScans(sweepIndex, [], scanRange) ;
+        else
+            dataset = reader.digitalScans(sweepIndex, scanRange) ;
+        end
+    end
+end  % function
+
+
+
+% ------------------------------------------------------------------------------
+% is_compressed_by_wavesurfer
+% ------------------------------------------------------------------------------
+function result = is_compressed_by_wavesurfer(filename, pathToDataset)
+    % Whether the dataset uses the filter ws.logger compresses scans with
+    info = h5info(filename, pathToDataset) ;
+    if isempty(info.Filters) ,
+        result = false ;
+    else
+        result = any(strncmp({info.Filters.Name}, 'ws.scanFilter', length('ws.scanFilter'))) ;
+    end
+end  % function
+
+
+
 % ------------------------------------------------------------------------------
 % get_group_info
 % ------------------------------------------------------------------------------
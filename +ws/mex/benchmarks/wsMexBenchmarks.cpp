@@ -0,0 +1,1077 @@
+// Throughput benchmarks for the MEX kernels, built against the mex shim (see
+// ../CMakeLists.txt).  The ws.ni benchmarks run against the simulated DAQmx, with the
+// simulated clock running as fast as the reads consume samples, so they measure the
+// cost of ws.ni and the driver calls, not the sample rate, except for the ones that
+// measure latency, which run the simulated clock in real time.
+//
+// Each benchmark reports items_per_second as samples per second, counting all channels,
+// along with the channel count, so throughput can be compared across channel counts.
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <benchmark/benchmark.h>
+#include "mex.h"
+#include "simulatedDAQmx.h"
+#ifdef WS_HAVE_LOGGER
+#include <cstdio>
+#include "hdf5.h"
+#include "scanFilter.h"
+#include "batchScaling.h"
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif
+
+void mexFunction_minMaxDownsampleMex(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) ;
+void mexFunction_scaledDoubleAnalogDataFromRawMex(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) ;
+void mexFunction_ni(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) ;
+#ifdef WS_HAVE_LOGGER
+void mexFunction_logger(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) ;
+void mexFunction_reader(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) ;
+#endif
+
+
+
+//
+// Helpers
+//
+
+// Call a kernel, destroy the args, and return the first output (or null)
+static mxArray * callKernel(void (*kernel)(int, mxArray **, int, const mxArray **), int nlhs, std::vector<mxArray *> args)  {
+    mxArray * plhs[4] = { NULL, NULL, NULL, NULL } ;
+    try  {
+        kernel(nlhs, plhs, (int)args.size(), (const mxArray **)(args.data())) ;
+    }
+    catch (...)  {
+        for (size_t i=0; i<args.size(); ++i)  {
+            mxDestroyArray(args[i]) ;
+        }
+        throw ;
+    }
+    for (size_t i=0; i<args.size(); ++i)  {
+        mxDestroyArray(args[i]) ;
+    }
+    for (int i=1; i<4; ++i)  {
+        mxDestroyArray(plhs[i]) ;
+    }
+    return plhs[0] ;
+}
+
+static mxArray * callNi(std::vector<mxArray *> args)  {
+    return callKernel(&mexFunction_ni, 1, args) ;
+}
+
+static mxArray * taskHandleArray(uint64_t taskHandle)  {
+    mxArray * result = mxCreateNumericMatrix(1, 1, mxUINT64_CLASS, mxREAL) ;
+    *((uint64_t *)mxGetData(result)) = taskHandle ;
+    return result ;
+}
+
+static uint64_t createTask(const char * taskName)  {
+    mxArray * taskHandleAsMxArray = callNi({ mxCreateString("DAQmxCreateTask"), mxCreateString(taskName) }) ;
+    uint64_t result = *((uint64_t *)mxGetData(taskHandleAsMxArray)) ;
+    mxDestroyArray(taskHandleAsMxArray) ;
+    return result ;
+}
+
+static void startContinuousTask(uint64_t taskHandle, double sampleRate, double bufferSizeInScans)  {
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCfgSampClkTiming"), taskHandleArray(taskHandle), mxCreateString(""), mxCreateDoubleScalar(sampleRate),
+                            mxCreateString("DAQmx_Val_Rising"), mxCreateString("DAQmx_Val_ContSamps"), mxCreateDoubleScalar(bufferSizeInScans) })) ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) })) ;
+}
+
+// DAQmx won't start a task again until it's been stopped, even a finite one that's done, 
+// so every task that gets started gets stopped
+static void stopTask(uint64_t taskHandle)  {
+    mxDestroyArray(callNi({ mxCreateString("DAQmxStopTask"), taskHandleArray(taskHandle) })) ;
+}
+
+static void clearTask(uint64_t taskHandle)  {
+    mxDestroyArray(callNi({ mxCreateString("DAQmxClearTask"), taskHandleArray(taskHandle) })) ;
+}
+
+static void setSamplesProcessed(benchmark::State & state, int64_t scansPerIteration, int64_t channelCount)  {
+    state.SetItemsProcessed(state.iterations() * scansPerIteration * channelCount) ;
+    state.counters["channels"] = (double)channelCount ;
+    state.counters["scansPerSecond"] =
+        benchmark::Counter((double)(state.iterations() * scansPerIteration), benchmark::Counter::kIsRate) ;
+}
+
+
+
+//
+// scaledDoubleAnalogDataFromRawMex
+//
+
+static void BM_scaledDoubleAnalogDataFromRaw(benchmark::State & state)  {
+    const mwSize nScans = 25000 ;
+    const mwSize nChannels = (mwSize)state.range(0) ;
+    const mwSize nCoefficients = 4 ;
+    mxArray * data = mxCreateNumericMatrix(nScans, nChannels, mxINT16_CLASS, mxREAL) ;
+    int16_t * dataPtr = (int16_t *)mxGetData(data) ;
+    for (mwSize i=0; i<nScans*nChannels; ++i)  {
+        dataPtr[i] = (int16_t)((i*7919) % 65536 - 32768) ;
+    }
+    mxArray * channelScales = mxCreateDoubleMatrix(1, nChannels, mxREAL) ;
+    mxArray * coefficients = mxCreateDoubleMatrix(nCoefficients, nChannels, mxREAL) ;
+    for (mwSize j=0; j<nChannels; ++j)  {
+        mxGetPr(channelScales)[j] = 0.1 * (j+1) ;
+        double * c = mxGetPr(coefficients) + j*nCoefficients ;
+        c[0] = 1e-3 ; c[1] = 3.0e-4 ; c[2] = 1e-12 ; c[3] = 1e-18 ;
+    }
+    for (auto _ : state)  {
+        mxArray * result = callKernel(&mexFunction_scaledDoubleAnalogDataFromRawMex, 1,
+                                      { mxDuplicateArray(data), mxDuplicateArray(channelScales), mxDuplicateArray(coefficients) }) ;
+        benchmark::DoNotOptimize(mxGetPr(result)) ;
+        mxDestroyArray(result) ;
+    }
+    setSamplesProcessed(state, nScans, nChannels) ;
+    mxDestroyArray(data) ;
+    mxDestroyArray(channelScales) ;
+    mxDestroyArray(coefficients) ;
+}
+BENCHMARK(BM_scaledDoubleAnalogDataFromRaw)->Arg(1)->Arg(4)->Arg(16)->Arg(32)->Unit(benchmark::kMicrosecond) ;
+
+
+
+//
+// minMaxDownsampleMex
+//
+
+static void BM_minMaxDownsample(benchmark::State & state)  {
+    const mwSize nScans = 250000 ;
+    const mwSize nChannels = (mwSize)state.range(0) ;
+    mxArray * t = mxCreateDoubleMatrix(nScans, 1, mxREAL) ;
+    mxArray * y = mxCreateDoubleMatrix(nScans, nChannels, mxREAL) ;
+    for (mwSize i=0; i<nScans; ++i)  {
+        mxGetPr(t)[i] = i / 20000.0 ;
+        for (mwSize j=0; j<nChannels; ++j)  {
+            mxGetPr(y)[i+j*nScans] = sin(0.001*i*(j+1)) ;
+        }
+    }
+    mxArray * r = mxCreateDoubleScalar(100.0) ;
+    for (auto _ : state)  {
+        mxArray * plhs[2] = { NULL, NULL } ;
+        const mxArray * prhs[3] = { t, y, r } ;
+        mexFunction_minMaxDownsampleMex(2, plhs, 3, prhs) ;
+        benchmark::DoNotOptimize(mxGetPr(plhs[1])) ;
+        mxDestroyArray(plhs[0]) ;
+        mxDestroyArray(plhs[1]) ;
+    }
+    setSamplesProcessed(state, nScans, nChannels) ;
+    mxDestroyArray(t) ;
+    mxDestroyArray(y) ;
+    mxDestroyArray(r) ;
+}
+BENCHMARK(BM_minMaxDownsample)->Arg(1)->Arg(4)->Arg(16)->Arg(32)->Unit(benchmark::kMicrosecond) ;
+
+
+
+//
+// ws.ni, against the simulated DAQmx
+//
+
+// Read int16 AI data, as AITask does each time through the acquisition loop
+static void BM_niReadBinaryI16(benchmark::State & state)  {
+    const int64_t nChannels = state.range(0) ;
+    const double nScansPerRead = 25000 ;
+    WSSimulatedDAQmxSetTimeScale(0.0) ;
+    uint64_t taskHandle = createTask("BM_niReadBinaryI16") ;
+    std::string channels = "Dev1/ai0:" + std::to_string(nChannels-1) ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCreateAIVoltageChan"), taskHandleArray(taskHandle), mxCreateString(channels.c_str()),
+                            mxCreateString("DAQmx_Val_Diff") })) ;
+    startContinuousTask(taskHandle, 250000.0, 4*nScansPerRead) ;
+    for (auto _ : state)  {
+        mxArray * data = callNi({ mxCreateString("DAQmxReadBinaryI16"), taskHandleArray(taskHandle), mxCreateDoubleScalar(nScansPerRead),
+                                  mxCreateDoubleScalar(-1.0) }) ;
+        benchmark::DoNotOptimize(mxGetData(data)) ;
+        mxDestroyArray(data) ;
+    }
+    setSamplesProcessed(state, (int64_t)nScansPerRead, nChannels) ;
+    stopTask(taskHandle) ;
+    clearTask(taskHandle) ;
+}
+BENCHMARK(BM_niReadBinaryI16)->Arg(1)->Arg(8)->Arg(32)->Unit(benchmark::kMicrosecond) ;
+
+// Read 32 channels at 250 kHz with the simulated clock running in real time, as AITask 
+// does during a sweep, with the reading thread busy for some percentage of each read's 
+// worth of time after each read, standing in for the rest of the Looper.  The buffer 
+// holds four reads' worth of scans, so above 100% the buffer overruns, after which the 
+// task is restarted, as a new sweep would be.  Reports the overruns, and the latency of 
+// each read, from the time its last scan was acquired to the time the read returned.
+static void BM_niReadBinaryI16RealTime(benchmark::State & state)  {
+    const int64_t nChannels = 32 ;
+    const double sampleRate = 250000.0 ;
+    const double nScansPerRead = (double)(state.range(0)) ;
+    const double busyFraction = state.range(1)/100.0 ;
+    WSSimulatedDAQmxSetTimeScale(1.0) ;
+    uint64_t taskHandle = createTask("BM_niReadBinaryI16RealTime") ;
+    std::string channels = "Dev1/ai0:" + std::to_string(nChannels-1) ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCreateAIVoltageChan"), taskHandleArray(taskHandle), mxCreateString(channels.c_str()),
+                            mxCreateString("DAQmx_Val_Diff") })) ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCfgInputBuffer"), taskHandleArray(taskHandle), mxCreateDoubleScalar(4*nScansPerRead) })) ;
+    startContinuousTask(taskHandle, sampleRate, 4*nScansPerRead) ;
+    double timeOfStart = WSSimulatedDAQmxGetTime() ;
+    double scanCountSinceStart = 0.0 ;
+    int64_t overrunCount = 0 ;
+    int64_t readCount = 0 ;
+    int64_t scanCount = 0 ;
+    double latencySum = 0.0 ;
+    double maxLatency = 0.0 ;
+    const std::chrono::duration<double> busyTime(busyFraction*nScansPerRead/sampleRate) ;
+    for (auto _ : state)  {
+        mxArray * data = NULL ;
+        try  {
+            data = callNi({ mxCreateString("DAQmxReadBinaryI16"), taskHandleArray(taskHandle), mxCreateDoubleScalar(nScansPerRead),
+                            mxCreateDoubleScalar(1.0) }) ;
+        }
+        catch (const MexShimError & error)  {
+            if (error.identifier() != "ws:ni:DAQmxError:n200279")  {  // DAQmxErrorSamplesNoLongerAvailable
+                throw ;
+            }
+            ++overrunCount ;
+            stopTask(taskHandle) ;
+            mxDestroyArray(callNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) })) ;
+            timeOfStart = WSSimulatedDAQmxGetTime() ;
+            scanCountSinceStart = 0.0 ;
+            continue ;
+        }
+        scanCountSinceStart += (double)(mxGetM(data)) ;
+        scanCount += (int64_t)(mxGetM(data)) ;
+        double latency = WSSimulatedDAQmxGetTime() - (timeOfStart + scanCountSinceStart/sampleRate) ;
+        latencySum += latency ;
+        maxLatency = std::max(maxLatency, latency) ;
+        ++readCount ;
+        benchmark::DoNotOptimize(mxGetData(data)) ;
+        mxDestroyArray(data) ;
+        std::this_thread::sleep_for(busyTime) ;
+    }
+    // Only reads that didn't overrun count
+    state.SetItemsProcessed(scanCount * nChannels) ;
+    state.counters["channels"] = (double)nChannels ;
+    state.counters["scansPerSecond"] = benchmark::Counter((double)scanCount, benchmark::Counter::kIsRate) ;
+    state.counters["overruns"] = (double)overrunCount ;
+    state.counters["meanLatencyInUs"] = (readCount > 0) ? 1e6*latencySum/readCount : 0.0 ;
+    state.counters["maxLatencyInUs"] = 1e6*maxLatency ;
+    state.SetLabel(std::to_string(state.range(1)) + "% busy") ;
+    stopTask(taskHandle) ;
+    clearTask(taskHandle) ;
+}
+BENCHMARK(BM_niReadBinaryI16RealTime)->ArgsProduct({ {250, 2500}, {0, 50, 150} })->UseRealTime()->Unit(benchmark::kMicrosecond) ;
+
+// Read DI data packed down to one bit per line, with the lines either in the same order
+// as on the port (so the PEXT path can be used) or scrambled (so the table path is used)
+static void BM_niReadPackedDigitalLines(benchmark::State & state)  {
+    const int64_t nLines = 8 ;
+    const bool isScrambled = (state.range(0) != 0) ;
+    const double nScansPerRead = 25000 ;
+    WSSimulatedDAQmxSetTimeScale(0.0) ;
+    uint64_t taskHandle = createTask("BM_niReadPackedDigitalLines") ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCreateDIChan"), taskHandleArray(taskHandle), mxCreateString("Dev1/port0"),
+                            mxCreateString("DAQmx_Val_ChanForAllLines") })) ;
+    startContinuousTask(taskHandle, 250000.0, 4*nScansPerRead) ;
+    const double ascendingIDs[nLines] = { 0, 2, 3, 5, 8, 13, 21, 30 } ;
+    const double scrambledIDs[nLines] = { 21, 3, 30, 0, 13, 5, 8, 2 } ;
+    mxArray * terminalIDs = mxCreateDoubleMatrix(1, nLines, mxREAL) ;
+    memcpy(mxGetPr(terminalIDs), isScrambled ? scrambledIDs : ascendingIDs, sizeof(ascendingIDs)) ;
+    for (auto _ : state)  {
+        mxArray * data = callNi({ mxCreateString("ReadPackedDigitalLines"), taskHandleArray(taskHandle), mxCreateDoubleScalar(nScansPerRead),
+                                  mxCreateDoubleScalar(-1.0), mxDuplicateArray(terminalIDs) }) ;
+        benchmark::DoNotOptimize(mxGetData(data)) ;
+        mxDestroyArray(data) ;
+    }
+    setSamplesProcessed(state, (int64_t)nScansPerRead, nLines) ;
+    state.SetLabel(isScrambled ? "scrambled" : "ascending") ;
+    mxDestroyArray(terminalIDs) ;
+    stopTask(taskHandle) ;
+    clearTask(taskHandle) ;
+}
+BENCHMARK(BM_niReadPackedDigitalLines)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond) ;
+
+
+// Upload a finite AO stimulus, as AOTask does at the start of each sweep, either as 
+// doubles (DAQmxWriteAnalogF64) or converted to DAC codes first (WriteAnalogF64AsBinaryI16).  
+// Each upload makes the same calls AOTask.setOutputBufferForOneTaskBang_() does, setting 
+// the timing again before the write.  The stimulus either changes every sweep, or is 
+// repeated, in which case ws.ni sees the buffer already holds it and skips the upload.
+static void BM_niWriteAnalog(benchmark::State & state)  {
+    const int64_t nChannels = state.range(0) ;
+    const bool isBinary = (state.range(1) != 0) ;
+    const bool isRepeated = (state.range(2) != 0) ;
+    const mwSize nScans = 200000 ;
+    WSSimulatedDAQmxSetTimeScale(0.0) ;
+    uint64_t taskHandle = createTask("BM_niWriteAnalog") ;
+    std::string channels = "Dev1/ao0:" + std::to_string(nChannels-1) ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCreateAOVoltageChan"), taskHandleArray(taskHandle), mxCreateString(channels.c_str()) })) ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCfgOutputBuffer"), taskHandleArray(taskHandle), mxCreateDoubleScalar(nScans) })) ;
+    mxArray * writeArray = mxCreateDoubleMatrix(nScans, nChannels, mxREAL) ;
+    for (mwSize i=0; i<nScans*nChannels; ++i)  {
+        mxGetPr(writeArray)[i] = 9.0*sin(0.001*i) ;
+    }
+    const char * action = isBinary ? "WriteAnalogF64AsBinaryI16" : "DAQmxWriteAnalogF64" ;
+    for (auto _ : state)  {
+        if (!isRepeated)  {
+            mxGetPr(writeArray)[0] = -mxGetPr(writeArray)[0] + 0.5 ;
+        }
+        mxDestroyArray(callNi({ mxCreateString("DAQmxCfgSampClkTiming"), taskHandleArray(taskHandle), mxCreateString(""), mxCreateDoubleScalar(20000.0),
+                                mxCreateString("DAQmx_Val_Rising"), mxCreateString("DAQmx_Val_FiniteSamps"), mxCreateDoubleScalar(nScans) })) ;
+        mxDestroyArray(callNi({ mxCreateString("DAQmxGetSampClkRate"), taskHandleArray(taskHandle) })) ;
+        mxDestroyArray(callNi({ mxCreateString("DAQmxResetWriteRelativeTo"), taskHandleArray(taskHandle) })) ;
+        mxDestroyArray(callNi({ mxCreateString("DAQmxResetWriteOffset"), taskHandleArray(taskHandle) })) ;
+        mxDestroyArray(callNi({ mxCreateString(action), taskHandleArray(taskHandle), mxCreateDoubleScalar(0.0), mxCreateDoubleScalar(-1.0),
+                                mxDuplicateArray(writeArray) })) ;
+    }
+    setSamplesProcessed(state, (int64_t)nScans, nChannels) ;
+    state.SetLabel(std::string(action) + (isRepeated ? " repeated" : " changing")) ;
+    mxDestroyArray(writeArray) ;
+    clearTask(taskHandle) ;
+}
+BENCHMARK(BM_niWriteAnalog)->ArgsProduct({ {1, 4}, {0, 1}, {0, 1} })->Unit(benchmark::kMicrosecond) ;
+
+// Upload a finite DO stimulus, either as a logical matrix with one channel per line 
+// (DAQmxWriteDigitalLines), or packed into one word per scan, for a task with a single 
+// channel holding all the lines (PackDigitalLines + DAQmxWriteDigitalU32)
+static void BM_niWriteDigital(benchmark::State & state)  {
+    const int64_t nLines = state.range(0) ;
+    const bool isPacked = (state.range(1) != 0) ;
+    const mwSize nScans = 200000 ;
+    WSSimulatedDAQmxSetTimeScale(0.0) ;
+    uint64_t taskHandle = createTask("BM_niWriteDigital") ;
+    mxArray * terminalIDs = mxCreateDoubleMatrix(1, nLines, mxREAL) ;
+    std::string lines ;
+    for (int64_t j=0; j<nLines; ++j)  {
+        mxGetPr(terminalIDs)[j] = (double)j ;
+        std::string line = "Dev1/port0/line" + std::to_string(j) ;
+        if (isPacked)  {
+            lines += (j>0 ? ", " : "") + line ;
+        }
+        else  {
+            mxDestroyArray(callNi({ mxCreateString("DAQmxCreateDOChan"), taskHandleArray(taskHandle), mxCreateString(line.c_str()),
+                                    mxCreateString("DAQmx_Val_ChanForAllLines") })) ;
+        }
+    }
+    if (isPacked)  {
+        mxDestroyArray(callNi({ mxCreateString("DAQmxCreateDOChan"), taskHandleArray(taskHandle), mxCreateString(lines.c_str()),
+                                mxCreateString("DAQmx_Val_ChanForAllLines") })) ;
+    }
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCfgSampClkTiming"), taskHandleArray(taskHandle), mxCreateString(""), mxCreateDoubleScalar(20000.0),
+                            mxCreateString("DAQmx_Val_Rising"), mxCreateString("DAQmx_Val_FiniteSamps"), mxCreateDoubleScalar(nScans) })) ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCfgOutputBuffer"), taskHandleArray(taskHandle), mxCreateDoubleScalar(nScans) })) ;
+    mxArray * lineData = mxCreateLogicalMatrix(nScans, nLines) ;
+    for (mwSize i=0; i<nScans*nLines; ++i)  {
+        mxGetLogicals(lineData)[i] = ((i/37 + i/1000) % 3) == 0 ;
+    }
+    for (auto _ : state)  {
+        mxGetLogicals(lineData)[0] = !mxGetLogicals(lineData)[0] ;  // so each upload is a new stimulus
+        if (isPacked)  {
+            mxArray * packedData = callNi({ mxCreateString("PackDigitalLines"), mxDuplicateArray(lineData), mxDuplicateArray(terminalIDs) }) ;
+            mxDestroyArray(callNi({ mxCreateString("DAQmxWriteDigitalU32"), taskHandleArray(taskHandle), mxCreateDoubleScalar(0.0),
+                                    mxCreateDoubleScalar(-1.0), packedData })) ;
+        }
+        else  {
+            mxDestroyArray(callNi({ mxCreateString("DAQmxWriteDigitalLines"), taskHandleArray(taskHandle), mxCreateDoubleScalar(0.0),
+                                    mxCreateDoubleScalar(-1.0), mxDuplicateArray(lineData) })) ;
+        }
+    }
+    setSamplesProcessed(state, (int64_t)nScans, nLines) ;
+    state.SetLabel(isPacked ? "packed" : "lines") ;
+    mxDestroyArray(lineData) ;
+    mxDestroyArray(terminalIDs) ;
+    clearTask(taskHandle) ;
+}
+BENCHMARK(BM_niWriteDigital)->ArgsProduct({ {4, 16}, {0, 1} })->Unit(benchmark::kMicrosecond) ;
+
+// Stream AO data through the ring buffer of an output stream, with the refill thread 
+// feeding the task's output buffer
+static void BM_niOutputStream(benchmark::State & state)  {
+    const int64_t nChannels = state.range(0) ;
+    const mwSize nScansPerWrite = 25000 ;
+    WSSimulatedDAQmxSetTimeScale(0.0) ;
+    uint64_t taskHandle = createTask("BM_niOutputStream") ;
+    std::string channels = "Dev1/ao0:" + std::to_string(nChannels-1) ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCreateAOVoltageChan"), taskHandleArray(taskHandle), mxCreateString(channels.c_str()) })) ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCfgSampClkTiming"), taskHandleArray(taskHandle), mxCreateString(""), mxCreateDoubleScalar(250000.0),
+                            mxCreateString("DAQmx_Val_Rising"), mxCreateString("DAQmx_Val_ContSamps"), mxCreateDoubleScalar(nScansPerWrite) })) ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCfgOutputBuffer"), taskHandleArray(taskHandle), mxCreateDoubleScalar(nScansPerWrite) })) ;
+    mxDestroyArray(callNi({ mxCreateString("StartOutputStream"), taskHandleArray(taskHandle), mxCreateDoubleScalar(4.0*nScansPerWrite) })) ;
+    mxArray * writeArray = mxCreateDoubleMatrix(nScansPerWrite, nChannels, mxREAL) ;
+    for (mwSize i=0; i<nScansPerWrite*nChannels; ++i)  {
+        mxGetPr(writeArray)[i] = 5.0*sin(0.01*i) ;
+    }
+    // Prime the output buffer before starting
+    mxDestroyArray(callNi({ mxCreateString("WriteToOutputStream"), taskHandleArray(taskHandle), mxCreateDoubleScalar(-1.0), mxDuplicateArray(writeArray) })) ;
+    mxDestroyArray(callNi({ mxCreateString("WriteToOutputStream"), taskHandleArray(taskHandle), mxCreateDoubleScalar(-1.0), mxDuplicateArray(writeArray) })) ;
+    while (true)  {
+        mxArray * scanCountInRing = callNi({ mxCreateString("GetOutputStreamStatus"), taskHandleArray(taskHandle) }) ;
+        double nScansInRing = mxGetScalar(scanCountInRing) ;
+        mxDestroyArray(scanCountInRing) ;
+        if (nScansInRing <= nScansPerWrite)  {
+            break ;
+        }
+        WSSimulatedDAQmxProcessEvents() ;
+    }
+    mxDestroyArray(callNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) })) ;
+    for (auto _ : state)  {
+        mxDestroyArray(callNi({ mxCreateString("WriteToOutputStream"), taskHandleArray(taskHandle), mxCreateDoubleScalar(-1.0),
+                                mxDuplicateArray(writeArray) })) ;
+    }
+    setSamplesProcessed(state, (int64_t)nScansPerWrite, nChannels) ;
+    mxDestroyArray(writeArray) ;
+    stopTask(taskHandle) ;
+    mxDestroyArray(callNi({ mxCreateString("StopOutputStream"), taskHandleArray(taskHandle) })) ;
+    clearTask(taskHandle) ;
+}
+BENCHMARK(BM_niOutputStream)->Arg(1)->Arg(4)->UseRealTime()->Unit(benchmark::kMicrosecond) ;
+
+// Set the lines of an on-demand DO task, as Looper does in closed-loop experiments, either 
+// through DAQmxWriteDigitalLines, or through the fast path of a bound task.  The arguments 
+// are made once, as Matlab would hold them, so only the call itself is timed.
+static void BM_niOnDemandDO(benchmark::State & state)  {
+    const int64_t nLines = 8 ;
+    const bool isBound = (state.range(0) != 0) ;
+    WSSimulatedDAQmxSetTimeScale(0.0) ;
+    uint64_t taskHandle = createTask("BM_niOnDemandDO") ;
+    mxArray * terminalIDs = mxCreateDoubleMatrix(1, nLines, mxREAL) ;
+    for (int64_t j=0; j<nLines; ++j)  {
+        mxGetPr(terminalIDs)[j] = (double)j ;
+        std::string line = "Dev1/port0/line" + std::to_string(j) ;
+        mxDestroyArray(callNi({ mxCreateString("DAQmxCreateDOChan"), taskHandleArray(taskHandle), mxCreateString(line.c_str()),
+                                mxCreateString("DAQmx_Val_ChanForAllLines") })) ;
+    }
+    mxArray * binding = callNi({ mxCreateString("BindOnDemandDO"), taskHandleArray(taskHandle), terminalIDs }) ;
+    std::vector<mxArray *> args ;
+    if (isBound)  {
+        args = { binding, mxCreateNumericMatrix(1, 1, mxUINT32_CLASS, mxREAL) } ;
+    }
+    else  {
+        args = { mxCreateString("DAQmxWriteDigitalLines"), taskHandleArray(taskHandle), mxCreateLogicalScalar(true), mxCreateDoubleScalar(-1.0),
+                 mxCreateLogicalMatrix(1, nLines) } ;
+    }
+    uint32_t i = 0 ;
+    for (auto _ : state)  {
+        // Toggle one line per call
+        if (isBound)  {
+            *((uint32_t *)mxGetData(args[1])) = (++i) & 1 ;
+        }
+        else  {
+            mxGetLogicals(args[4])[0] = (++i) & 1 ;
+        }
+        mxArray * plhs[1] = { NULL } ;
+        mexFunction_ni(0, plhs, (int)args.size(), (const mxArray **)(args.data())) ;
+        mxDestroyArray(plhs[0]) ;
+    }
+    state.SetItemsProcessed(state.iterations()) ;
+    state.SetLabel(isBound ? "bound" : "DAQmxWriteDigitalLines") ;
+    if (isBound)  {
+        mxArray * plhs[4] = { NULL, NULL, NULL, NULL } ;
+        std::vector<mxArray *> queryArgs = { mxCreateString("GetOnDemandDOLatencyHistogram"), binding } ;
+        mexFunction_ni(4, plhs, 2, (const mxArray **)(queryArgs.data())) ;
+        state.counters["meanLatencyInUs"] = 1e6*mxGetScalar(plhs[2]) ;
+        state.counters["maxLatencyInUs"] = 1e6*mxGetScalar(plhs[3]) ;
+        mxDestroyArray(queryArgs[0]) ;
+        for (int k=0; k<4; ++k)  {
+            mxDestroyArray(plhs[k]) ;
+        }
+    }
+    else  {
+        mxDestroyArray(binding) ;
+    }
+    for (size_t k=0; k<args.size(); ++k)  {
+        mxDestroyArray(args[k]) ;
+    }
+    stopTask(taskHandle) ;
+    clearTask(taskHandle) ;
+}
+BENCHMARK(BM_niOnDemandDO)->Arg(0)->Arg(1)->Unit(benchmark::kNanosecond) ;
+
+// The latency of a closed-loop engine, from the time a scan is acquired to the time the 
+// line its rule sets changes, with the simulated clock running in real time.  The rule 
+// watches a 61 Hz sine acquired at 250 kHz, so each iteration waits for the next crossing, 
+// about 8 ms, and the latency of that crossing is what's reported.
+static void BM_niClosedLoopLatency(benchmark::State & state)  {
+    const double sampleRate = 250000.0 ;
+    WSSimulatedDAQmxSetTimeScale(1.0) ;
+    uint64_t aiTaskHandle = createTask("BM_niClosedLoopLatencyAI") ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCreateAIVoltageChan"), taskHandleArray(aiTaskHandle), mxCreateString("Dev1/ai0"),
+                            mxCreateString("DAQmx_Val_Diff") })) ;
+    uint64_t doTaskHandle = createTask("BM_niClosedLoopLatencyDO") ;
+    mxDestroyArray(callNi({ mxCreateString("DAQmxCreateDOChan"), taskHandleArray(doTaskHandle), mxCreateString("Dev1/port0/line0"),
+                            mxCreateString("DAQmx_Val_ChanForAllLines") })) ;
+    mxArray * binding = callNi({ mxCreateString("BindOnDemandDO"), taskHandleArray(doTaskHandle), mxCreateDoubleScalar(0.0) }) ;
+    mxArray * rule = mxCreateDoubleMatrix(1, 5, mxREAL) ;
+    const double ruleAsDouble[5] = { 1, 1, 8192, -8192, 0 } ;  // channel, line, upper and lower thresholds, isInverted
+    memcpy(mxGetPr(rule), ruleAsDouble, sizeof(ruleAsDouble)) ;
+    mxDestroyArray(callNi({ mxCreateString("StartClosedLoop"), taskHandleArray(aiTaskHandle), mxDuplicateArray(binding), rule,
+                            mxCreateDoubleScalar(sampleRate) })) ;
+    startContinuousTask(aiTaskHandle, sampleRate, sampleRate) ;
+    // Scan i is acquired 1/sampleRate after scan i-1, the first one 1/sampleRate after the start
+    double timeOfStart = WSSimulatedDAQmxGetTime() ;
+    double latencySum = 0.0 ;
+    double maxLatency = 0.0 ;
+    int64_t eventCount = 0 ;
+    for (auto _ : state)  {
+        mxArray * scanIndices = NULL ;
+        while (true)  {
+            scanIndices = callNi({ mxCreateString("GetClosedLoopEvents"), taskHandleArray(aiTaskHandle) }) ;
+            if (!mxIsEmpty(scanIndices))  {
+                break ;
+            }
+            mxDestroyArray(scanIndices) ;
+            std::this_thread::sleep_for(std::chrono::microseconds(100)) ;
+        }
+        double scanIndex = mxGetPr(scanIndices)[mxGetM(scanIndices)-1] ;
+        mxDestroyArray(scanIndices) ;
+        double latency = WSSimulatedDAQmxGetTimeOfLastOutputStateChange() - (timeOfStart + (scanIndex+1)/sampleRate) ;
+        latencySum += latency ;
+        maxLatency = std::max(maxLatency, latency) ;
+        ++eventCount ;
+    }
+    state.counters["meanLatencyInUs"] = (eventCount > 0) ? 1e6*latencySum/eventCount : 0.0 ;
+    state.counters["maxLatencyInUs"] = 1e6*maxLatency ;
+    mxDestroyArray(callNi({ mxCreateString("StopClosedLoop"), taskHandleArray(aiTaskHandle) })) ;
+    stopTask(aiTaskHandle) ;
+    clearTask(aiTaskHandle) ;
+    mxDestroyArray(binding) ;
+    stopTask(doTaskHandle) ;
+    clearTask(doTaskHandle) ;
+}
+BENCHMARK(BM_niClosedLoopLatency)->UseRealTime()->Unit(benchmark::kMillisecond) ;
+
+// Set up the counter trigger task for a run with a new trigger interval, as Triggering does 
+// at the start of each run, either by clearing the task and making it anew (arg 0), or by 
+// reconfiguring the task from the last run (arg 1).
+static void BM_niCounterTriggerSetup(benchmark::State & state)  {
+    const bool isReconfigured = (state.range(0) != 0) ;
+    WSSimulatedDAQmxSetTimeScale(0.0) ;
+    uint64_t taskHandle = 0 ;
+    uint32_t i = 0 ;
+    for (auto _ : state)  {
+        double frequency = ((++i) & 1) ? 10.0 : 20.0 ;
+        if (isReconfigured && taskHandle!=0)  {
+            mxDestroyArray(callNi({ mxCreateString("ReconfigureCOPulseTrain"), taskHandleArray(taskHandle), mxCreateDoubleScalar(frequency),
+                                    mxCreateDoubleScalar(0.5), mxCreateDoubleScalar(5.0) })) ;
+        }
+        else  {
+            if (taskHandle!=0)  {
+                clearTask(taskHandle) ;
+            }
+            taskHandle = createTask("BM_niCounterTriggerSetup") ;
+            mxDestroyArray(callNi({ mxCreateString("DAQmxCreateCOPulseChanFreq"), taskHandleArray(taskHandle), mxCreateString("Dev1/ctr0"),
+                                    mxCreateString("DAQmx_Val_Low"), mxCreateDoubleScalar(0.0), mxCreateDoubleScalar(frequency), mxCreateDoubleScalar(0.5) })) ;
+            mxDestroyArray(callNi({ mxCreateString("DAQmxCfgImplicitTiming"), taskHandleArray(taskHandle), mxCreateString("DAQmx_Val_FiniteSamps"),
+                                    mxCreateDoubleScalar(5.0) })) ;
+            mxDestroyArray(callNi({ mxCreateString("DAQmxExportSignal"), taskHandleArray(taskHandle), mxCreateString("DAQmx_Val_CounterOutputEvent"),
+                                    mxCreateString("/Dev1/pfi12") })) ;
+            mxDestroyArray(callNi({ mxCreateString("DAQmxCfgDigEdgeStartTrig"), taskHandleArray(taskHandle), mxCreateString("/Dev1/PFI8"),
+                                    mxCreateString("DAQmx_Val_Rising") })) ;
+            mxDestroyArray(callNi({ mxCreateString("DAQmxTaskControl"), taskHandleArray(taskHandle), mxCreateString("DAQmx_Val_Task_Commit") })) ;
+        }
+    }
+    state.SetItemsProcessed(state.iterations()) ;
+    state.SetLabel(isReconfigured ? "reconfigure" : "rebuild") ;
+    clearTask(taskHandle) ;
+}
+BENCHMARK(BM_niCounterTriggerSetup)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond) ;
+
+
+
+#ifdef WS_HAVE_LOGGER
+//
+// ws.logger
+//
+
+static mxArray * callLogger(std::vector<mxArray *> args)  {
+    return callKernel(&mexFunction_logger, 1, args) ;
+}
+
+// Append a block of AI scans to a sweep's analogScans dataset the way Matlab's h5write() 
+// does: open the file and the dataset, extend it, write the hyperslab, and close it all 
+// again
+static void appendScansAsH5Write(const char * fileName, const char * datasetName, const mxArray * scans, hsize_t offset)  {
+    hid_t fileID = H5Fopen(fileName, H5F_ACC_RDWR, H5P_DEFAULT) ;
+    hid_t datasetID = H5Dopen2(fileID, datasetName, H5P_DEFAULT) ;
+    hsize_t dims[2] = { mxGetN(scans), offset+mxGetM(scans) } ;
+    H5Dset_extent(datasetID, dims) ;
+    hid_t fileSpaceID = H5Dget_space(datasetID) ;
+    hsize_t start[2] = { 0, offset } ;
+    hsize_t count[2] = { mxGetN(scans), mxGetM(scans) } ;
+    H5Sselect_hyperslab(fileSpaceID, H5S_SELECT_SET, start, NULL, count, NULL) ;
+    hid_t memorySpaceID = H5Screate_simple(2, count, NULL) ;
+    H5Dwrite(datasetID, H5T_NATIVE_INT16, memorySpaceID, fileSpaceID, H5P_DEFAULT, mxGetData(scans)) ;
+    H5Sclose(memorySpaceID) ;
+    H5Sclose(fileSpaceID) ;
+    H5Dclose(datasetID) ;
+    H5Fclose(fileID) ;
+}
+
+// The ways BM_loggerAppendScans logs, one per arg
+struct LoggerAppendScansCase  {
+    const char * label ;
+    bool isNative ;  // ws.logger, rather than h5write()
+    bool isAsynchronous ;  // queueing the scans for ws.logger's writer thread
+    const char * format ;  // OpenFile's format
+    bool doWriteOverviews ;
+} ;
+static const LoggerAppendScansCase LOGGER_APPEND_SCANS_CASES[] = {
+    { "h5write",                 false, false, "hdf5",       false },
+    { "ws.logger",               true,  false, "hdf5",       false },
+    { "ws.logger, asynchronous", true,  true,  "hdf5",       false },
+    { "ws.logger, raw",          true,  false, "raw",        false },
+    { "ws.logger, compressed",   true,  false, "compressed", false },
+    { "ws.logger, journal",      true,  false, "journal",    false },
+    { "ws.logger, overviews",    true,  false, "hdf5",       true  }
+} ;
+static const int LOGGER_APPEND_SCANS_CASE_COUNT = (int)(sizeof(LOGGER_APPEND_SCANS_CASES)/sizeof(LOGGER_APPEND_SCANS_CASES[0])) ;
+
+// Log blocks of 32-channel AI scans, as Logging does each time through the acquisition 
+// loop, in one of the ways in LOGGER_APPEND_SCANS_CASES (the arg).  A new sweep is started 
+// every 100 blocks, and a new file every 1000, to bound the file size.  For the 
+// asynchronous case, the queue holds 50 blocks, so the time measured includes waiting for 
+// the writer thread once the queue is full.  The raw files and journals are left 
+// unconverted, since conversion happens after the run.
+static void BM_loggerAppendScans(benchmark::State & state)  {
+    const LoggerAppendScansCase & loggingCase = LOGGER_APPEND_SCANS_CASES[state.range(0)] ;
+    const bool isNative = loggingCase.isNative ;
+    const bool isAsynchronous = loggingCase.isAsynchronous ;
+    const mwSize nChannels = 32 ;
+    const mwSize nScansPerBlock = 1000 ;
+    const int nBlocksPerSweep = 100 ;
+    const int nSweepsPerFile = 10 ;
+    const char * fileName = "BM_loggerAppendScans.h5" ;
+    mxArray * scans = mxCreateNumericMatrix(nScansPerBlock, nChannels, mxINT16_CLASS, mxREAL) ;
+    for (mwSize i=0; i<nScansPerBlock*nChannels; ++i)  {
+        ((int16_t *)mxGetData(scans))[i] = (int16_t)(10000.0*sin(0.001*i)) ;
+    }
+    mxArray * noScans = mxCreateNumericMatrix(0, 0, mxUINT8_CLASS, mxREAL) ;
+    mxArray * logFile = NULL ;
+    int blockIndex = 0 ;
+    char datasetName[32] ;
+    for (auto _ : state)  {
+        int sweepIndex = 1 + (blockIndex/nBlocksPerSweep) % nSweepsPerFile ;
+        if (blockIndex % nBlocksPerSweep == 0)  {
+            state.PauseTiming() ;
+            if (sweepIndex==1 && logFile)  {
+                mxDestroyArray(callLogger({ mxCreateString("CloseFile"), logFile })) ;
+                logFile = NULL ;
+            }
+            if (sweepIndex == 1)  {
+                H5Fclose(H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT)) ;
+            }
+            if (!logFile)  {
+                logFile = callLogger({ mxCreateString("OpenFile"), mxCreateString(fileName), 
+                                       mxCreateDoubleScalar(isAsynchronous ? 50.0*nScansPerBlock*nChannels*sizeof(int16_t) : 0.0), 
+                                       mxCreateString(loggingCase.format), mxCreateString("adaptive"), 
+                                       mxCreateLogicalScalar(loggingCase.doWriteOverviews) }) ;
+            }
+            // Creating the sweep's datasets isn't what's being measured, so both use ws.logger for it
+            mxDestroyArray(callLogger({ mxCreateString("StartSweep"), mxDuplicateArray(logFile), mxCreateDoubleScalar(sweepIndex), 
+                                        mxCreateDoubleScalar(0.0), mxCreateDoubleScalar(nChannels), mxCreateDoubleScalar(0.0), 
+                                        mxCreateDoubleScalar(nBlocksPerSweep*nScansPerBlock) })) ;
+            if (!isNative)  {
+                mxDestroyArray(callLogger({ mxCreateString("CloseFile"), logFile })) ;
+                logFile = NULL ;
+            }
+            state.ResumeTiming() ;
+        }
+        if (isNative)  {
+            mxDestroyArray(callLogger({ mxCreateString("AppendScans"), mxDuplicateArray(logFile), mxDuplicateArray(scans), mxDuplicateArray(noScans) })) ;
+        }
+        else  {
+            sprintf(datasetName, "/sweep_%04d/analogScans", sweepIndex) ;
+            appendScansAsH5Write(fileName, datasetName, scans, (blockIndex%nBlocksPerSweep)*nScansPerBlock) ;
+        }
+        ++blockIndex ;
+    }
+    if (isAsynchronous)  {
+        mxArray * plhs[4] = { NULL, NULL, NULL, NULL } ;
+        mxArray * prhs[2] = { mxCreateString("GetQueueStatus"), logFile } ;
+        mexFunction_logger(4, plhs, 2, (const mxArray **)prhs) ;
+        state.counters["highWaterBytes"] = mxGetScalar(plhs[1]) ;
+        state.counters["backPressureCount"] = mxGetScalar(plhs[2]) ;
+        state.counters["backPressureTime"] = mxGetScalar(plhs[3]) ;
+        for (int i=0; i<4; ++i)  {
+            mxDestroyArray(plhs[i]) ;
+        }
+        mxDestroyArray(prhs[0]) ;
+    }
+    if (logFile)  {
+        mxDestroyArray(callLogger({ mxCreateString("CloseFile"), logFile })) ;
+    }
+    setSamplesProcessed(state, (int64_t)nScansPerBlock, (int64_t)nChannels) ;
+    state.SetBytesProcessed(state.iterations() * nScansPerBlock * nChannels * sizeof(int16_t)) ;
+    state.SetLabel(loggingCase.label) ;
+    mxDestroyArray(scans) ;
+    mxDestroyArray(noScans) ;
+    remove(fileName) ;
+    remove("BM_loggerAppendScans.dat") ;
+    remove("BM_loggerAppendScans.journal") ;
+}
+BENCHMARK(BM_loggerAppendScans)->DenseRange(0, LOGGER_APPEND_SCANS_CASE_COUNT-1)->UseRealTime()->Unit(benchmark::kMicrosecond) ;
+
+// Log a run to the local disk, with ws.logger's fixed layout (first arg 0), one-second 
+// chunks, or a chunk per sweep, and an extension per append, or its adaptive one (first 
+// arg 1), for a given number of channels (second arg), and either continuous (third arg 1) 
+// or in sweeps of a known length (third arg 0).  Scans come at 20 kHz, in blocks of a 
+// tenth of a second, as in the acquisition loop.  A new file is started every 500 blocks, 
+// which is one sweep if continuous, or five if not.  Only creating the file isn't timed, 
+// so ending the sweeps and closing the files, and trimming the datasets, is counted.
+static void BM_loggerLayoutPolicy(benchmark::State & state)  {
+    const bool isAdaptive = (state.range(0) != 0) ;
+    const mwSize nChannels = (mwSize)(state.range(1)) ;
+    const bool isContinuous = (state.range(2) != 0) ;
+    const double scanRate = 20000.0 ;
+    const mwSize nScansPerBlock = 2000 ;
+    const int nBlocksPerFile = 500 ;
+    const int nBlocksPerSweep = isContinuous ? nBlocksPerFile : 100 ;
+    const char * fileName = "BM_loggerLayoutPolicy.h5" ;
+    mxArray * scans = mxCreateNumericMatrix(nScansPerBlock, nChannels, mxINT16_CLASS, mxREAL) ;
+    for (mwSize i=0; i<nScansPerBlock*nChannels; ++i)  {
+        ((int16_t *)mxGetData(scans))[i] = (int16_t)(10000.0*sin(0.001*i)) ;
+    }
+    mxArray * noScans = mxCreateNumericMatrix(0, 0, mxUINT8_CLASS, mxREAL) ;
+    mxArray * logFile = NULL ;
+    int blockIndex = 0 ;
+    for (auto _ : state)  {
+        int blockIndexInFile = blockIndex % nBlocksPerFile ;
+        if (blockIndexInFile == 0)  {
+            if (logFile)  {
+                mxDestroyArray(callLogger({ mxCreateString("CloseFile"), logFile })) ;
+            }
+            state.PauseTiming() ;
+            H5Fclose(H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT)) ;
+            state.ResumeTiming() ;
+            logFile = callLogger({ mxCreateString("OpenFile"), mxCreateString(fileName), mxCreateDoubleScalar(0.0), 
+                                   mxCreateString("hdf5"), mxCreateString(isAdaptive ? "adaptive" : "fixed") }) ;
+        }
+        if (blockIndexInFile % nBlocksPerSweep == 0)  {
+            double expectedScanCount = isContinuous ? mxGetInf() : (double)(nBlocksPerSweep*nScansPerBlock) ;
+            mxDestroyArray(callLogger({ mxCreateString("StartSweep"), mxDuplicateArray(logFile), 
+                                        mxCreateDoubleScalar(1 + blockIndexInFile/nBlocksPerSweep), mxCreateDoubleScalar(0.0), 
+                                        mxCreateDoubleScalar(nChannels), mxCreateDoubleScalar(0.0), 
+                                        mxCreateDoubleScalar(expectedScanCount), mxCreateDoubleScalar(scanRate) })) ;
+        }
+        mxDestroyArray(callLogger({ mxCreateString("AppendScans"), mxDuplicateArray(logFile), mxDuplicateArray(scans), mxDuplicateArray(noScans) })) ;
+        ++blockIndex ;
+    }
+    if (logFile)  {
+        mxDestroyArray(callLogger({ mxCreateString("CloseFile"), logFile })) ;
+    }
+    setSamplesProcessed(state, (int64_t)nScansPerBlock, (int64_t)nChannels) ;
+    state.SetBytesProcessed(state.iterations() * nScansPerBlock * nChannels * sizeof(int16_t)) ;
+    state.SetLabel(isAdaptive ? "adaptive" : "fixed") ;
+    mxDestroyArray(scans) ;
+    mxDestroyArray(noScans) ;
+    remove(fileName) ;
+}
+BENCHMARK(BM_loggerLayoutPolicy)->ArgsProduct({ {0, 1}, {1, 32}, {0, 1} })->UseRealTime()->Unit(benchmark::kMicrosecond) ;
+
+// The first tick of a sweep, as Logging does it: start the sweep, and append the first 
+// block of scans, either with the sweep's group and datasets created then (first arg 0), 
+// or prepared during the sweep before (first arg 1), in which case the tick also asks for 
+// the next sweep to be prepared, as Logging does.  Sweeps are 32 AI channels and 8 DI 
+// channels, 10 blocks of a tenth of a second at 20 kHz.  The rest of each sweep isn't 
+// timed, but the preparation overlaps it.  The file is synchronous, since for an 
+// asynchronous one all of this is the writer thread's problem.  A new file is started 
+// every 100 sweeps.
+static void BM_loggerStartSweep(benchmark::State & state)  {
+    const bool isPrepared = (state.range(0) != 0) ;
+    const mwSize nAIChannels = 32 ;
+    const mwSize nDIChannels = 8 ;
+    const double scanRate = 20000.0 ;
+    const mwSize nScansPerBlock = 2000 ;
+    const int nBlocksPerSweep = 10 ;
+    const int nSweepsPerFile = 100 ;
+    const char * fileName = "BM_loggerStartSweep.h5" ;
+    mxArray * analogScans = mxCreateNumericMatrix(nScansPerBlock, nAIChannels, mxINT16_CLASS, mxREAL) ;
+    for (mwSize i=0; i<nScansPerBlock*nAIChannels; ++i)  {
+        ((int16_t *)mxGetData(analogScans))[i] = (int16_t)(10000.0*sin(0.001*i)) ;
+    }
+    mxArray * digitalScans = mxCreateNumericMatrix(nScansPerBlock, 1, mxUINT8_CLASS, mxREAL) ;
+    for (mwSize i=0; i<nScansPerBlock; ++i)  {
+        ((uint8_t *)mxGetData(digitalScans))[i] = (uint8_t)(i/100) ;
+    }
+    auto sweepArguments = [&]()  {
+        return std::vector<mxArray *>({ mxCreateDoubleScalar(nAIChannels), mxCreateDoubleScalar(nDIChannels), 
+                                        mxCreateDoubleScalar(nBlocksPerSweep*nScansPerBlock), mxCreateDoubleScalar(scanRate) }) ;
+    } ;
+    auto prepareSweep = [&](mxArray * logFile, int sweepIndex)  {
+        std::vector<mxArray *> args = { mxCreateString("PrepareSweep"), mxDuplicateArray(logFile), mxCreateDoubleScalar(sweepIndex) } ;
+        std::vector<mxArray *> rest = sweepArguments() ;
+        args.insert(args.end(), rest.begin(), rest.end()) ;
+        mxDestroyArray(callLogger(args)) ;
+    } ;
+    auto appendScans = [&](mxArray * logFile)  {
+        mxDestroyArray(callLogger({ mxCreateString("AppendScans"), mxDuplicateArray(logFile), mxDuplicateArray(analogScans), mxDuplicateArray(digitalScans) })) ;
+    } ;
+    mxArray * logFile = NULL ;
+    int sweepCount = 0 ;
+    for (auto _ : state)  {
+        int sweepIndex = 1 + sweepCount % nSweepsPerFile ;
+        if (sweepIndex == 1)  {
+            state.PauseTiming() ;
+            if (logFile)  {
+                mxDestroyArray(callLogger({ mxCreateString("CloseFile"), logFile })) ;
+            }
+            H5Fclose(H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT)) ;
+            logFile = callLogger({ mxCreateString("OpenFile"), mxCreateString(fileName) }) ;
+            if (isPrepared)  {
+                prepareSweep(logFile, 1) ;
+            }
+            state.ResumeTiming() ;
+        }
+
+        // The first tick
+        std::vector<mxArray *> args = { mxCreateString("StartSweep"), mxDuplicateArray(logFile), mxCreateDoubleScalar(sweepIndex), 
+                                        mxCreateDoubleScalar(0.0) } ;
+        std::vector<mxArray *> rest = sweepArguments() ;
+        args.insert(args.end(), rest.begin(), rest.end()) ;
+        mxDestroyArray(callLogger(args)) ;
+        appendScans(logFile) ;
+        if (isPrepared)  {
+            prepareSweep(logFile, sweepIndex+1) ;
+        }
+
+        // The rest of the sweep
+        state.PauseTiming() ;
+        for (int i=1; i<nBlocksPerSweep; ++i)  {
+            appendScans(logFile) ;
+        }
+        mxDestroyArray(callLogger({ mxCreateString("EndSweep"), mxDuplicateArray(logFile) })) ;
+        state.ResumeTiming() ;
+        ++sweepCount ;
+    }
+    if (logFile)  {
+        mxDestroyArray(callLogger({ mxCreateString("CloseFile"), logFile })) ;
+    }
+    state.SetLabel(isPrepared ? "prepared" : "unprepared") ;
+    mxDestroyArray(analogScans) ;
+    mxDestroyArray(digitalScans) ;
+    remove(fileName) ;
+}
+BENCHMARK(BM_loggerStartSweep)->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMicrosecond) ;
+
+
+
+//
+// ws.reader
+//
+
+static mxArray * callReader(std::vector<mxArray *> args)  {
+    return callKernel(&mexFunction_reader, 1, args) ;
+}
+
+// Write a data file with one sweep of nScans x nChannels AI scans, in a dataset that's 
+// either chunked as ws.logger chunks it, or contiguous, as h5create() lays out fixed-size 
+// datasets
+static void writeSweepFile(const char * fileName, bool isChunked, hsize_t nChannels, hsize_t nScans)  {
+    std::vector<int16_t> scans(nChannels*nScans) ;
+    for (size_t i=0; i<scans.size(); ++i)  {
+        scans[i] = (int16_t)(10000.0*sin(0.001*i)) ;
+    }
+    hid_t fileID = H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT) ;
+    hid_t groupID = H5Gcreate2(fileID, "sweep_0001", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) ;
+    hsize_t dims[2] = { nChannels, nScans } ;
+    hid_t spaceID = H5Screate_simple(2, dims, NULL) ;
+    hid_t createPropertyListID = H5Pcreate(H5P_DATASET_CREATE) ;
+    if (isChunked)  {
+        hsize_t chunkDims[2] = { nChannels, (4*1024*1024)/(nChannels*sizeof(int16_t)) } ;
+        H5Pset_chunk(createPropertyListID, 2, chunkDims) ;
+    }
+    hid_t datasetID = H5Dcreate2(groupID, "analogScans", H5T_NATIVE_INT16, spaceID, H5P_DEFAULT, createPropertyListID, H5P_DEFAULT) ;
+    H5Dwrite(datasetID, H5T_NATIVE_INT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, scans.data()) ;
+    H5Dclose(datasetID) ;
+    H5Pclose(createPropertyListID) ;
+    H5Sclose(spaceID) ;
+    H5Gclose(groupID) ;
+    H5Fclose(fileID) ;
+}
+
+// Read a 4-channel, 10000-scan slice out of a 32-channel, 2^20-scan sweep, at a different 
+// place each time, either by reading the whole sweep, as ws.loadDataFile() does, and 
+// taking the slice from that (arg 0), or with ws.reader, from a chunked dataset (arg 1) or 
+// a contiguous one, which is memory-mapped (arg 2)
+static void BM_readerReadAnalogScans(benchmark::State & state)  {
+    const bool isNative = (state.range(0) != 0) ;
+    const bool isChunked = (state.range(0) != 2) ;
+    const hsize_t nChannels = 32 ;
+    const hsize_t nScans = 1024*1024 ;
+    const mwSize nChannelsRead = 4 ;
+    const mwSize nScansRead = 10000 ;
+    const char * fileName = "BM_readerReadAnalogScans.h5" ;
+    writeSweepFile(fileName, isChunked, nChannels, nScans) ;
+    mxArray * dataFile = callReader({ mxCreateString("OpenFile"), mxCreateString(fileName) }) ;
+    mxArray * channelIndices = mxCreateDoubleMatrix(1, nChannelsRead, mxREAL) ;
+    for (mwSize k=0; k<nChannelsRead; ++k)  {
+        mxGetPr(channelIndices)[k] = (double)(1 + 7*k) ;
+    }
+    std::vector<int16_t> sweep ;
+    hsize_t firstScanIndex = 0 ;
+    for (auto _ : state)  {
+        if (isNative)  {
+            mxDestroyArray(callReader({ mxCreateString("ReadAnalogScans"), mxDuplicateArray(dataFile), mxCreateDoubleScalar(1.0), 
+                                        mxDuplicateArray(channelIndices), mxCreateDoubleScalar((double)(firstScanIndex+1)), 
+                                        mxCreateDoubleScalar((double)(nScansRead)) })) ;
+        }
+        else  {
+            hid_t fileID = H5Fopen(fileName, H5F_ACC_RDONLY, H5P_DEFAULT) ;
+            hid_t datasetID = H5Dopen2(fileID, "/sweep_0001/analogScans", H5P_DEFAULT) ;
+            sweep.resize(nChannels*nScans) ;
+            H5Dread(datasetID, H5T_NATIVE_INT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, sweep.data()) ;
+            H5Dclose(datasetID) ;
+            H5Fclose(fileID) ;
+            mxArray * slice = mxCreateNumericMatrix(nScansRead, nChannelsRead, mxINT16_CLASS, mxREAL) ;
+            for (mwSize k=0; k<nChannelsRead; ++k)  {
+                memcpy((int16_t *)mxGetData(slice) + k*nScansRead, sweep.data() + (7*k)*nScans + firstScanIndex, nScansRead*sizeof(int16_t)) ;
+            }
+            mxDestroyArray(slice) ;
+        }
+        firstScanIndex = (firstScanIndex + 99991) % (nScans - nScansRead) ;
+    }
+    mxDestroyArray(callReader({ mxCreateString("CloseFile"), dataFile })) ;
+    mxDestroyArray(channelIndices) ;
+    setSamplesProcessed(state, (int64_t)nScansRead, (int64_t)nChannelsRead) ;
+    state.SetLabel(isNative ? (isChunked ? "ws.reader, chunked" : "ws.reader, mapped") : "whole sweep") ;
+    remove(fileName) ;
+}
+BENCHMARK(BM_readerReadAnalogScans)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMicrosecond) ;
+
+
+
+//
+// scanFilter
+//
+
+// Encode (arg 0) or decode (arg 1) one chunk as ws.logger writes them: 32 channels of 
+// 32768 scans each, every channel a sine at its own frequency plus a few LSBs of noise, 
+// like amplified, digitized recordings.  The ratio counter is the compression ratio.
+static void BM_scanFilterCodec(benchmark::State & state)  {
+    const bool isDecode = (state.range(0) != 0) ;
+    const size_t nChannels = 32 ;
+    const size_t nScans = 32768 ;
+    std::vector<int16_t> chunk(nChannels*nScans) ;
+    uint32_t random = 1 ;
+    for (size_t channel=0; channel<nChannels; ++channel)  {
+        for (size_t scan=0; scan<nScans; ++scan)  {
+            random = 1664525*random + 1013904223 ;
+            int noise = (int)(random >> 29) - 4 ;
+            chunk[channel*nScans+scan] = (int16_t)(8000.0*sin(0.0005*(channel+1)*scan) + noise) ;
+        }
+    }
+    const size_t byteCount = chunk.size()*sizeof(int16_t) ;
+    std::vector<uint8_t> encoded(maximumEncodedScanChunkByteCount(byteCount)) ;
+    size_t encodedByteCount = encodeScanChunk(&chunk[0], byteCount, sizeof(int16_t), nScans, &encoded[0]) ;
+    std::vector<int16_t> decoded(chunk.size()) ;
+    for (auto _ : state)  {
+        if (isDecode)  {
+            decodeScanChunk(&encoded[0], encodedByteCount, &decoded[0], byteCount) ;
+            benchmark::DoNotOptimize(decoded[0]) ;
+        }
+        else  {
+            encodedByteCount = encodeScanChunk(&chunk[0], byteCount, sizeof(int16_t), nScans, &encoded[0]) ;
+            benchmark::DoNotOptimize(encoded[0]) ;
+        }
+    }
+    if (isDecode && decoded != chunk)  {
+        state.SkipWithError("decoded chunk differs from the original") ;
+    }
+    state.counters["ratio"] = (double)byteCount/encodedByteCount ;
+    setSamplesProcessed(state, (int64_t)nScans, (int64_t)nChannels) ;
+    state.SetBytesProcessed(state.iterations() * byteCount) ;
+}
+BENCHMARK(BM_scanFilterCodec)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond) ;
+
+
+
+//
+// ws.rescaler
+//
+
+// Verify the scaling of a copy of a folder of 8 data files, each one sweep of 8 channels of 
+// 2^18 scans, with some number of workers (the arg), after adding it.  This is what 
+// ws.verifyScalingOfHDF5FilesRecursivelyGivenCoeffs() does, plus checking that the scans 
+// of each copy match, and scale to finite values, so it's mostly reading scans.
+static void BM_rescalerVerify(benchmark::State & state)  {
+    const size_t nFiles = 8 ;
+    const hsize_t nChannels = 8 ;
+    const hsize_t nScans = 256*1024 ;
+    const std::string sourceFolderPath = "BM_rescalerVerifySource" ;
+    const std::string targetFolderPath = "BM_rescalerVerifyTarget" ;
+#ifdef _WIN32
+    _mkdir(sourceFolderPath.c_str()) ;
+#else
+    mkdir(sourceFolderPath.c_str(), 0777) ;
+#endif
+    std::vector<std::string> fileNames ;
+    for (size_t i=0; i<nFiles; ++i)  {
+        fileNames.push_back("file_" + std::to_string(i) + ".h5") ;
+        std::string fileName = sourceFolderPath + "/" + fileNames.back() ;
+        writeSweepFile(fileName.c_str(), true, nChannels, nScans) ;
+        hid_t fileID = H5Fopen(fileName.c_str(), H5F_ACC_RDWR, H5P_DEFAULT) ;
+        hid_t linkCreatePropertyListID = H5Pcreate(H5P_LINK_CREATE) ;
+        H5Pset_create_intermediate_group(linkCreatePropertyListID, 1) ;
+        hid_t groupID = H5Gcreate2(fileID, "/header/Acquisition", linkCreatePropertyListID, H5P_DEFAULT, H5P_DEFAULT) ;
+        H5Pclose(linkCreatePropertyListID) ;
+        double terminalIDs[nChannels] ;
+        for (hsize_t k=0; k<nChannels; ++k)  {
+            terminalIDs[k] = (double)(k) ;
+        }
+        hsize_t dims[1] = { nChannels } ;
+        hid_t spaceID = H5Screate_simple(1, dims, NULL) ;
+        hid_t datasetID = H5Dcreate2(groupID, "AnalogTerminalIDs", H5T_IEEE_F64LE, spaceID, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) ;
+        H5Dwrite(datasetID, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, terminalIDs) ;
+        H5Dclose(datasetID) ;
+        H5Sclose(spaceID) ;
+        H5Gclose(groupID) ;
+        H5Fclose(fileID) ;
+    }
+    BatchScalingJob job ;
+    job.mode = ADD_SCALING ;
+    job.sourceFolderPath = sourceFolderPath ;
+    job.targetFolderPath = targetFolderPath ;
+    job.coefficientCount = 4 ;
+    job.terminalCount = 32 ;
+    for (size_t i=0; i<job.coefficientCount*job.terminalCount; ++i)  {
+        job.coefficients.push_back((i % job.coefficientCount == 1) ? 3.0e-4 : 1.0e-9) ;
+    }
+    job.isDryRun = false ;
+    job.workerCount = (unsigned)(state.range(0)) ;
+    BatchScalingResult result ;
+    std::string errorMessage ;
+    if ( !runBatchScaling(job, result, errorMessage) || !result.problems.empty() )  {
+        state.SkipWithError("unable to add scaling to the files") ;
+    }
+    job.mode = VERIFY_SCALING ;
+    for (auto _ : state)  {
+        if ( !runBatchScaling(job, result, errorMessage) || !result.problems.empty() )  {
+            state.SkipWithError("verification of the files failed") ;
+            break ;
+        }
+    }
+    setSamplesProcessed(state, (int64_t)(nFiles*nScans), (int64_t)nChannels) ;
+    state.counters["workers"] = (double)(job.workerCount) ;
+    for (size_t i=0; i<nFiles; ++i)  {
+        remove((sourceFolderPath + "/" + fileNames[i]).c_str()) ;
+        remove((targetFolderPath + "/" + fileNames[i]).c_str()) ;
+    }
+#ifdef _WIN32
+    _rmdir(sourceFolderPath.c_str()) ;
+    _rmdir(targetFolderPath.c_str()) ;
+#else
+    rmdir(sourceFolderPath.c_str()) ;
+    rmdir(targetFolderPath.c_str()) ;
+#endif
+}
+BENCHMARK(BM_rescalerVerify)->Arg(1)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond) ;
+#endif
+
+
+
+BENCHMARK_MAIN() ;
@@ -0,0 +1,17 @@
+// The lock around the HDF5 library.  Matlab's HDF5 library isn't built thread-safe, and
+// there's one copy of it in the Matlab process, shared by every MEX file that calls it.
+// ws.logger makes HDF5 calls from its writer and preparer threads while Matlab's thread
+// goes on to call ws.reader or ws.rescaler, so a mutex in each MEX file isn't enough: they
+// have to share one.  So the mutex lives here, in a DLL of its own, hdf5Lock.dll, that
+// each of them links against, and that gets loaded once.
+
+#define WS_HDF5_LOCK_EXPORTS
+#include "hdf5Lock.h"
+
+
+
+std::mutex &
+hdf5Mutex(void)  {
+    static std::mutex result ;
+    return result ;
+}
@@ -0,0 +1,24 @@
+// The lock around the HDF5 library, shared by ws.logger, ws.reader and ws.rescaler.  See
+// hdf5Lock.cpp.
+
+#ifndef WS_HDF5_LOCK_H
+#define WS_HDF5_LOCK_H
+
+#include <mutex>
+
+#ifdef _WIN32
+#ifdef WS_HDF5_LOCK_EXPORTS
+#define WS_HDF5_LOCK_API __declspec(dllexport)
+#else
+#define WS_HDF5_LOCK_API __declspec(dllimport)
+#endif
+#else
+#define WS_HDF5_LOCK_API __attribute__((visibility("default")))
+#endif
+
+// The mutex every HDF5 call made by WaveSurfer's native code is made holding, from any
+// thread of any of the MEX files.  Never hold it while calling back into Matlab, or while
+// erroring out.
+WS_HDF5_LOCK_API std::mutex & hdf5Mutex(void) ;
+
+#endif
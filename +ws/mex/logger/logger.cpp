@@ -0,0 +1,2838 @@
+// ws.logger: the native engine that writes acquired data to WaveSurfer's HDF5 data files.
+// The file is opened once per run, the datasets of the current sweep are kept open, and
+// each block of scans is appended through a cached file dataspace.  (Logging used to call
+// h5write() for each dataset on every acquisition tick, which opened and closed the file
+// every time.)
+//
+// Usage, from ws.Logging:
+//
+//   logFile = ws.logger('OpenFile', fileName[, queueByteCapacity[, format[, layoutPolicy[, doWriteOverviews]]]])
+//   ws.logger('PrepareSweep', logFile, sweepIndex, analogChannelCount, digitalChannelCount, expectedScanCount, scanRate)  % optional
+//   ws.logger('StartSweep', logFile, sweepIndex, timestamp, analogChannelCount, digitalChannelCount, expectedScanCount, scanRate)
+//   ws.logger('AppendScans', logFile, rawAnalogData, rawDigitalData)  % as many times as needed
+//   ws.logger('EndSweep', logFile)
+//   [queuedByteCount, highWaterByteCount, ...] = ws.logger('GetQueueStatus', logFile)  % optional
+//   ws.logger('CloseFile', logFile)
+//
+// and, for the raw and journal formats, after CloseFile, or after a crash:
+//
+//   wasRaw = ws.logger('ConvertRawFile', fileName[, doCompress[, doWriteOverviews]])
+//   [wasJournaled, sweepCount, wasComplete] = ws.logger('ReplayJournal', fileName[, doCompress[, doWriteOverviews]])
+//
+// Each action is described where it's defined.
+//
+// The file has to exist already (Logging writes the header into it with ws.h5save()).
+// Each sweep gets a group, with its datasets laid out as h5create() would lay them out, so
+// that ws.loadDataFile() reads them as before:
+//
+//   /sweep_%04d/timestamp                1 x 1 double
+//   /sweep_%04d/analogScans              nScans x nAnalogChannels int16
+//   /sweep_%04d/digitalScans             nScans x 1, of the smallest unsigned integer type
+//                                        that holds a bit per digital channel
+//   /sweep_%04d/analogScansOverview_<r>  2*ceil(nScans/r) x nAnalogChannels int16, for
+//                                        r = 32, 1024, 32768 and 1048576, if
+//                                        doWriteOverviews is true
+//
+// The overview datasets are a min/max overview of the analog scans at several levels of
+// detail, each bin of r scans a row of maxima then a row of minima, in ADC counts, so that
+// a viewer can draw a whole recording without reading all of it.  See OverviewLevel.
+// ws.loadDataFile() skips them.
+//
+// Creating a sweep's group and datasets takes long enough to make the first tick of the
+// sweep late, so Logging has them created ahead of time, in the background, with
+// PrepareSweep, during the sweep before, or before the run starts.  Then StartSweep only
+// has to write the timestamp.  (So if WaveSurfer dies, the file can have an empty group
+// for the sweep after the last.)
+//
+// The engine picks the scans datasets' chunk size itself, from the channel count, the scan
+// rate, the expected sweep length (Inf for continuous runs) and the block size of the file
+// system the file is on.  The datasets of a sweep of known length are sized for it up
+// front; otherwise they're grown geometrically, rather than on every append.  Either way,
+// they're trimmed to the scans actually written when the sweep ends.  (So if WaveSurfer
+// dies mid-sweep, the sweep may end in zeros.)  A layoutPolicy of 'fixed' asks for the old
+// layout instead, one-second chunks, or whole-sweep ones, and an extension per append.
+//
+// If queueByteCapacity is nonzero, the file is written asynchronously: the scans are
+// copied into a queue, and a writer thread does the writing, so that a disk stall doesn't
+// stall acquisition.  AppendScans only blocks if the queue is full.
+//
+// The HDF5 library isn't thread-safe, and the writer thread, and the thread PrepareSweep
+// starts, make HDF5 calls while Matlab gets on with other things.  ws.reader and
+// ws.rescaler hold the same lock around their HDF5 calls as those threads do (see
+// ../hdf5Lock), so they're safe to call at any time.  Matlab's own HDF5 functions can't
+// take it, so h5read(), h5info(), h5readatt(), h5create(), h5write(), ws.h5save(), and
+// whatever uses them, such as ws.loadDataFile() and the header-reading in
+// ws.DataFileReader, must not be called while a log file is open, between OpenFile and
+// CloseFile, on any file.
+//
+// format is one of:
+//
+//   'hdf5'        The default, as above.
+//   'compressed'  The scans datasets are compressed, a chunk at a time, with the filter in
+//                 ../scanFilter, by whoever writes the file, the writer thread if there is
+//                 one.  ws.loadDataFile() reads them through ws.reader, since Matlab's
+//                 HDF5 library doesn't have the filter.
+//   'raw'         The scans go to a flat binary .dat file next to the HDF5 file (see
+//                 RawScanFile), and the HDF5 file only gets an index of the sweeps in it,
+//                 until ConvertRawFile turns the pair into an ordinary data file.
+//   'journal'     The scans go to a .journal file next to the HDF5 file, a stream of
+//                 checksummed records that describes itself (see JournalRecordHeader),
+//                 synced to disk every JOURNAL_SYNC_INTERVAL seconds.  The HDF5 file
+//                 isn't even opened during the run: its bytes, which are just the header,
+//                 are copied into the journal when it's opened, so that nothing the run
+//                 does can damage it.  ReplayJournal rebuilds the data file from the
+//                 journal, up to the last intact record.
+//
+// For the raw and journal formats, the datasets are only written when the file is
+// converted, or the journal replayed, so that's when they're compressed, if doCompress is
+// true, and get overviews, if doWriteOverviews is true.
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/statvfs.h>
+#include <errno.h>
+#endif
+#include "hdf5.h"
+#include "mex.h"
+#include "matrix.h"
+#include "scanFilter.h"
+#include "hdf5Lock.h"
+
+
+
+// The most bytes we put in one chunk of a scans dataset.  Matlab's h5create() was asked
+// for a whole sweep per chunk, which for long sweeps makes chunks far bigger than the
+// chunk cache, so that every append rewrites the whole chunk.
+#define MAXIMUM_CHUNK_BYTE_COUNT (4*1024*1024)
+
+// In the adaptive layout, chunks of a scans dataset are about TARGET_CHUNK_BYTE_COUNT bytes,
+// a whole number of file system blocks if the scan size allows, but hold no more than
+// MAXIMUM_CHUNK_DURATION seconds of scans, so that a chunk isn't held in the chunk cache
+// for too long before it's written.  The dataset is grown by at least
+// MINIMUM_EXTENT_GROWTH_FACTOR times its size when it's full.  The block size is
+// DEFAULT_FILE_SYSTEM_BLOCK_BYTE_COUNT if it can't be found.
+#define TARGET_CHUNK_BYTE_COUNT (1024*1024)
+#define MAXIMUM_CHUNK_DURATION 10.0
+#define MINIMUM_EXTENT_GROWTH_FACTOR 2
+#define DEFAULT_FILE_SYSTEM_BLOCK_BYTE_COUNT 4096
+
+// The most spare scan buffers a write queue keeps for reuse
+#define MAXIMUM_SPARE_BUFFER_COUNT 8
+
+// Raw scan files are written unbuffered, which needs the writes to be aligned to the
+// disk's sector size, so everything is aligned to this, which is a multiple of the sector
+// size of any disk we're likely to see.  Scans are staged in a buffer of
+// RAW_STAGING_BYTE_COUNT bytes, and the file is grown RAW_PREALLOCATION_BYTE_COUNT bytes
+// at a time, so the file system isn't asked for more space on every write.
+#define RAW_ALIGNMENT 4096
+#define RAW_STAGING_BYTE_COUNT (4*1024*1024)
+#define RAW_PREALLOCATION_BYTE_COUNT (256*1024*1024)
+
+// How many scans ConvertRawFile reads at a time
+#define RAW_CONVERSION_SCAN_COUNT 65536
+
+// How many scans appendRawScans interleaves at a time, which is also the most scans in a
+// journal record
+#define RAW_INTERLEAVING_SCAN_COUNT 4096
+
+// Each journal record starts with JOURNAL_RECORD_MAGIC ("WSJR", little-endian), and a
+// record's payload is no more than MAXIMUM_JOURNAL_PAYLOAD_BYTE_COUNT bytes, which is only
+// checked when reading, to catch corrupt lengths.  While scans are coming in, the journal
+// is synced to disk at least every JOURNAL_SYNC_INTERVAL seconds, so that a crash loses no
+// more than that.
+#define JOURNAL_RECORD_MAGIC 0x524A5357
+#define MAXIMUM_JOURNAL_PAYLOAD_BYTE_COUNT (1024*1024*1024)
+#define JOURNAL_SYNC_INTERVAL 1.0
+
+// A sweep's overview has OVERVIEW_LEVEL_COUNT levels.  A bin of the first level covers
+// OVERVIEW_DECIMATION_FACTOR scans, and a bin of each level after covers
+// OVERVIEW_DECIMATION_FACTOR bins of the level before.  So at 20 kHz, the last level has a
+// bin every 52 s.  The overview datasets are chunked at most OVERVIEW_CHUNK_BYTE_COUNT
+// bytes at a time, since the higher levels are tiny.
+#define OVERVIEW_LEVEL_COUNT 4
+#define OVERVIEW_DECIMATION_FACTOR 32
+#define OVERVIEW_CHUNK_BYTE_COUNT (64*1024)
+
+
+
+// An open, extensible scans dataset, that blocks of scans are appended to.  Matlab's
+// nScans x nChannels arrays are column-major, and Matlab reverses the order of the
+// dimensions when it talks to HDF5, so the dataset is nChannels x nScans to HDF5, and a
+// block of scans from Matlab is one contiguous hyperslab.  fileSpaceID is kept at the
+// dataset's extent, and memorySpaceID at the size of the last block written, so that
+// neither has to be fetched or made for each append.
+// The dataset's extent can run ahead of the scans written, in which case it's trimmed when
+// the dataset is closed.
+struct ScanDataset {
+    hid_t datasetID ;  // negative if the dataset isn't open
+    hid_t fileSpaceID ;
+    hid_t memorySpaceID ;
+    hsize_t memorySpaceScanCount ;  // the number of scans memorySpaceID is sized for
+    hid_t memoryTypeID ;  // not owned, one of the H5T_NATIVE_* types
+    hsize_t channelCount ;
+    hsize_t scanCount ;  // the number of scans written so far
+    hsize_t extentScanCount ;  // the dataset's extent, in scans
+    hsize_t chunkScanCount ;
+    bool isGrownGeometrically ;  // if not, the extent is kept at scanCount
+} ;
+
+// How the scans datasets are chunked and grown.  FIXED_LAYOUT is how Logging used to ask
+// for them: chunks of the whole sweep, or a second of scans if the sweep length isn't
+// known, extended on every append.  ADAPTIVE_LAYOUT is as described at the top.
+enum LayoutPolicy { FIXED_LAYOUT, ADAPTIVE_LAYOUT } ;
+
+// How to create a scans dataset
+struct ScanDatasetLayout {
+    hsize_t chunkScanCount ;
+    hsize_t preallocatedScanCount ;  // the initial extent, in scans
+    bool isGrownGeometrically ;
+    bool isCompressed ;
+} ;
+
+// A sweep, as given to StartSweep.  A sweepIndex of zero means no sweep.
+struct SweepLayout {
+    int sweepIndex ;
+    double timestamp ;
+    hsize_t analogChannelCount ;
+    hsize_t digitalChannelCount ;
+    hsize_t expectedScanCount ;  // zero if not known, as for continuous runs
+    double scanRate ;  // scans per second, zero if not known
+} ;
+
+// One level of the min/max overview of a sweep's analog scans, the dataset
+// /sweep_%04d/analogScansOverview_<r>, where r is the number of scans in a bin (see
+// overviewDecimationFactor()).  The bins are the ones minMaxDownsampleMex makes with that
+// r: runs of r scans
+// from the start of the sweep, with the last run holding whatever's left.  Each bin is two
+// rows of the dataset, the max of each channel over the bin, then the min, so the dataset
+// is 2*nBins x nAnalogChannels int16 to Matlab, laid out like minMaxDownsampleMex's y
+// output, but in ADC counts.  (Scaling is monotonic, so the scaled max and min of a bin are
+// the scaled values of those two rows.)  maxima and minima hold the bin being built, and
+// bins the bins finished by the last append, as in the dataset, until they're written.
+struct OverviewLevel {
+    ScanDataset dataset ;
+    hsize_t binFillCount ;  // the inputs, scans or bins of the level before, in the bin being built
+    std::vector<int16_t> maxima ;  // per channel
+    std::vector<int16_t> minima ;
+    std::vector<int16_t> bins ;
+} ;
+
+// A sweep whose group and datasets have been created ahead of time, by PrepareSweep, so
+// that StartSweep only has to write the timestamp.  The scans datasets are created with
+// no scans, and only preallocated when the sweep is started, so a sweep that's prepared
+// but never started is empty.  A sweep.sweepIndex of zero means nothing is prepared.
+struct PreparedSweep {
+    SweepLayout sweep ;
+    hid_t groupID ;
+    hid_t timestampID ;  // the timestamp dataset, not yet written
+    ScanDataset analogScans ;
+    ScanDataset digitalScans ;
+    ScanDataset analogScansOverviews[OVERVIEW_LEVEL_COUNT] ;  // closed unless the file has overviews
+} ;
+
+// Something for the writer thread of an asynchronous log file to do
+enum WriteCommandType { START_SWEEP, APPEND_SCANS, END_SWEEP, PREPARE_SWEEP } ;
+struct WriteCommand {
+    WriteCommandType type ;
+    SweepLayout layout ;  // for START_SWEEP and PREPARE_SWEEP
+    std::vector<char> analogScans ;  // for APPEND_SCANS, the scans as they were in Matlab
+    hsize_t analogScanCount ;
+    std::vector<char> digitalScans ;
+    hsize_t digitalScanCount ;
+} ;
+
+// The queue of an asynchronous log file, feeding its writer thread.  The scans queued,
+// counting the block being written, are held to byteCapacity bytes: AppendScans waits for
+// space when the queue is full, which is counted as back-pressure.  A block bigger than
+// byteCapacity is let in when the queue is empty, so it can't wait forever.
+struct WriteQueue {
+    size_t byteCapacity ;
+    std::deque<WriteCommand> commands ;
+    size_t queuedByteCount ;  // the bytes of scans queued, plus those being written, if any
+    size_t highWaterByteCount ;  // the most queuedByteCount has been
+    uint64_t backPressureCount ;  // the number of appends that had to wait for space
+    double backPressureTime ;  // the total time appends spent waiting for space, s
+    double maxBackPressureTime ;  // the longest time an append spent waiting for space, s
+    std::string errorMessage ;  // the first error the writer thread got, or empty
+    bool isStopRequested ;
+    std::vector< std::vector<char> > spareBuffers ;  // scan buffers for reuse, to avoid reallocating
+    std::mutex mutex ;  // protects all the above
+    std::condition_variable commandQueued ;
+    std::condition_variable commandDone ;
+    std::thread writerThread ;
+} ;
+
+#ifdef _WIN32
+typedef HANDLE RawFileHandle ;
+#define INVALID_RAW_FILE_HANDLE INVALID_HANDLE_VALUE
+#else
+typedef int RawFileHandle ;
+#define INVALID_RAW_FILE_HANDLE (-1)
+#endif
+
+// A journal is a sequence of records, each a JournalRecordHeader and then its payload,
+// padded with zeros to a multiple of 8 bytes.  The first record is a JOURNAL_DATA_FILE,
+// whose payload is the bytes of the HDF5 file when it was opened.  Then each sweep is a
+// JOURNAL_SWEEP_START, whose payload is a JournalSweepStart, any number of JOURNAL_SCANS,
+// each holding some of the sweep's scans, interleaved as in a raw scan file, and a
+// JOURNAL_SWEEP_END, whose payload is the sweep's scan count as a uint64.  The records are
+// numbered from zero, and the checksum is journalChecksum() of the header, with the
+// checksum zeroed, then of the padded payload.  Everything is little-endian.
+enum JournalRecordType { JOURNAL_DATA_FILE = 1, JOURNAL_SWEEP_START = 2, JOURNAL_SCANS = 3, JOURNAL_SWEEP_END = 4 } ;
+struct JournalRecordHeader {
+    uint32_t magic ;  // JOURNAL_RECORD_MAGIC
+    uint32_t type ;  // a JournalRecordType
+    uint64_t sequenceNumber ;
+    uint64_t payloadByteCount ;  // not counting the padding
+    uint64_t checksum[2] ;
+} ;
+struct JournalSweepStart {
+    int32_t sweepIndex ;
+    uint32_t reserved ;  // zero
+    double timestamp ;
+    uint64_t analogChannelCount ;
+    uint64_t digitalChannelCount ;
+    uint64_t expectedScanCount ;  // zero if not known
+    double scanRate ;  // zero if not known
+} ;
+
+// The .dat file of a raw-format log file.  It's a stream of scans, and each scan is
+// analogChannelCount int16s, then the scan's packed digital word as zero, one or two int16s
+// (none if there are no digital channels, two if there are more than 16), with the low
+// half first.  The sweeps follow one another, and the index, /rawScans/index in the HDF5
+// file, has a row per sweep: sweep index, timestamp, byte offset of the sweep in the .dat
+// file, scan count, analog channel count and digital channel count.  The scans go into
+// staging, which holds the bytes of the file from stagingFileOffset on, and which is
+// written out when full, or, padded to alignment, at the end of each sweep, to be
+// overwritten when the rest of it is written.
+// A journaled log file uses the same machinery for its .journal file, with the scans,
+// and everything else, in journal records, and no index.
+struct RawScanFile {
+    std::string fileName ;
+    bool isJournal ;
+    RawFileHandle handle ;
+    char * staging ;  // RAW_STAGING_BYTE_COUNT bytes, aligned to RAW_ALIGNMENT
+    size_t stagingByteCount ;
+    size_t writtenStagingByteCount ;  // the bytes of staging that have been written out already
+    uint64_t stagingFileOffset ;
+    uint64_t preallocatedByteCount ;
+    std::vector<int16_t> interleavedScans ;  // for interleaving scans before staging them
+    hid_t groupID ;  // /rawScans
+    ScanDataset index ;  // /rawScans/index
+    SweepLayout sweep ;  // the sweep being written, sweepIndex zero if none
+    uint64_t sweepByteOffset ;
+    uint64_t sweepScanCount ;
+    uint64_t journalRecordCount ;  // the number of journal records staged so far
+    std::chrono::steady_clock::time_point lastSyncTime ;  // when the journal was last synced
+} ;
+
+// An open data file, and the datasets of the sweep being written, if any.  sweep is the
+// sweep as Matlab sees it; the HDF5 handles are only touched by whoever writes the file,
+// the writer thread if there is one.
+struct LogFile {
+    std::string fileName ;
+    hid_t fileID ;
+    SweepLayout sweep ;
+    hid_t sweepGroupID ;  // negative unless a sweep is being written
+    hid_t sweepTimestampID ;  // the sweep's timestamp dataset, kept open until the sweep ends
+    ScanDataset analogScans ;
+    ScanDataset digitalScans ;
+    OverviewLevel overviews[OVERVIEW_LEVEL_COUNT] ;  // the datasets are closed unless doWriteOverviews
+    PreparedSweep prepared ;  // the next sweep, if it's been prepared
+    std::thread preparerThread ;  // prepares the next sweep, if the file is synchronous
+    WriteQueue * queue ;  // null unless the file is written asynchronously
+    RawScanFile * raw ;  // null unless the file is in raw format
+    bool isCompressed ;  // whether the scans datasets are compressed with the scan filter
+    bool doWriteOverviews ;  // whether each sweep gets an overview of its analog scans
+    LayoutPolicy layoutPolicy ;
+    size_t fileSystemBlockByteCount ;  // of the file system the file is on
+} ;
+
+// The open log files.  The logFile ID handed to Matlab is the index into this, plus one.
+// Closed files leave a null, so IDs are never reused.
+std::vector<LogFile *> LOG_FILES ;
+
+// The HDF5 library isn't thread-safe, so every HDF5 call made here, from Matlab's thread
+// or a writer thread, is made holding this.  It's the one ws.reader and ws.rescaler hold
+// too, since they share the library with us.  See ../hdf5Lock.
+std::mutex & HDF5_MUTEX = hdf5Mutex() ;
+
+
+
+// Error out if an HDF5 call failed.  HDF5 calls return a negative value on failure.
+void
+checkHDF5(hid_t idOrStatus, const char * whatFailed, const std::string & fileName)  {
+    if (idOrStatus < 0)  {
+        mexErrMsgIdAndTxt("ws:logger:hdf5Error", "Unable to %s in data file %s", whatFailed, fileName.c_str()) ;
+    }
+}
+
+
+
+// The HDF5 type, and the Matlab class, of the digitalScans dataset for the given number
+// of digital channels
+hid_t
+digitalScansTypeID(hsize_t digitalChannelCount)  {
+    return (digitalChannelCount<=8) ? H5T_NATIVE_UINT8 : ( (digitalChannelCount<=16) ? H5T_NATIVE_UINT16 : H5T_NATIVE_UINT32 ) ;
+}
+
+mxClassID
+digitalScansClassID(hsize_t digitalChannelCount)  {
+    return (digitalChannelCount<=8) ? mxUINT8_CLASS : ( (digitalChannelCount<=16) ? mxUINT16_CLASS : mxUINT32_CLASS ) ;
+}
+
+
+
+// A scan dataset that isn't open
+ScanDataset
+closedScanDataset(void)  {
+    ScanDataset result ;
+    result.datasetID = -1 ;
+    result.fileSpaceID = -1 ;
+    result.memorySpaceID = -1 ;
+    result.memorySpaceScanCount = 0 ;
+    result.memoryTypeID = -1 ;
+    result.channelCount = 0 ;
+    result.scanCount = 0 ;
+    result.extentScanCount = 0 ;
+    result.chunkScanCount = 0 ;
+    result.isGrownGeometrically = false ;
+    return result ;
+}
+
+
+
+// Close a scan dataset, if it's open, first trimming its extent to the scans written.
+// Returns a negative value if anything failed.
+herr_t
+closeScanDataset(ScanDataset & dataset)  {
+    herr_t result = 0 ;
+    if ( dataset.datasetID >= 0 && dataset.extentScanCount > dataset.scanCount )  {
+        hsize_t dims[2] = { dataset.channelCount, dataset.scanCount } ;
+        result = std::min(result, H5Dset_extent(dataset.datasetID, dims)) ;
+    }
+    if (dataset.memorySpaceID >= 0)  {
+        result = std::min(result, H5Sclose(dataset.memorySpaceID)) ;
+    }
+    if (dataset.fileSpaceID >= 0)  {
+        result = std::min(result, H5Sclose(dataset.fileSpaceID)) ;
+    }
+    if (dataset.datasetID >= 0)  {
+        result = std::min(result, H5Dclose(dataset.datasetID)) ;
+    }
+    dataset = closedScanDataset() ;
+    return result ;
+}
+
+
+
+// The greatest common divisor of a and b
+hsize_t
+greatestCommonDivisor(hsize_t a, hsize_t b)  {
+    while (b != 0)  {
+        hsize_t remainder = a % b ;
+        a = b ;
+        b = remainder ;
+    }
+    return a ;
+}
+
+
+
+// The block size of the file system the file is on, or DEFAULT_FILE_SYSTEM_BLOCK_BYTE_COUNT
+// if that can't be found.  On Windows, this is the cluster size.
+size_t
+fileSystemBlockByteCount(const std::string & fileName)  {
+    size_t result = 0 ;
+#ifdef _WIN32
+    char volumePath[MAX_PATH] ;
+    DWORD sectorsPerCluster, bytesPerSector, freeClusterCount, clusterCount ;
+    if ( GetVolumePathNameA(fileName.c_str(), volumePath, MAX_PATH) &&
+         GetDiskFreeSpaceA(volumePath, &sectorsPerCluster, &bytesPerSector, &freeClusterCount, &clusterCount) )  {
+        result = (size_t)(sectorsPerCluster) * bytesPerSector ;
+    }
+#else
+    struct statvfs fileSystemInfo ;
+    if (statvfs(fileName.c_str(), &fileSystemInfo) == 0)  {
+        result = (size_t)(fileSystemInfo.f_bsize) ;
+    }
+#endif
+    // Anything odd is ignored
+    if ( result < 512 || result > MAXIMUM_CHUNK_BYTE_COUNT || (result & (result-1)) != 0 )  {
+        result = DEFAULT_FILE_SYSTEM_BLOCK_BYTE_COUNT ;
+    }
+    return result ;
+}
+
+
+
+// How to create a scans dataset for the sweep, whose scans are bytesPerScan bytes, in the
+// log file
+ScanDatasetLayout
+scanDatasetLayout(const LogFile & logFile, const SweepLayout & sweep, hsize_t bytesPerScan)  {
+    ScanDatasetLayout result ;
+    result.isCompressed = logFile.isCompressed ;
+    if (logFile.layoutPolicy == FIXED_LAYOUT)  {
+        if (sweep.expectedScanCount > 0)  {
+            result.chunkScanCount = sweep.expectedScanCount ;
+        }
+        else if (sweep.scanRate > 0)  {
+            result.chunkScanCount = (hsize_t)(std::ceil(sweep.scanRate)) ;
+        }
+        else  {
+            result.chunkScanCount = TARGET_CHUNK_BYTE_COUNT / bytesPerScan ;
+        }
+        result.preallocatedScanCount = 0 ;
+        result.isGrownGeometrically = false ;
+    }
+    else  {
+        // About TARGET_CHUNK_BYTE_COUNT bytes, but no more than MAXIMUM_CHUNK_DURATION seconds
+        // or the whole sweep...
+        hsize_t chunkScanCount = TARGET_CHUNK_BYTE_COUNT / bytesPerScan ;
+        if (sweep.scanRate > 0)  {
+            chunkScanCount = std::min(chunkScanCount, (hsize_t)(MAXIMUM_CHUNK_DURATION * sweep.scanRate)) ;
+        }
+        if (sweep.expectedScanCount > 0)  {
+            chunkScanCount = std::min(chunkScanCount, sweep.expectedScanCount) ;
+        }
+        // ...rounded down to a whole number of file system blocks, if that's at least one,
+        // unless the chunk holds the whole sweep, when rounding would only add a chunk
+        hsize_t blockByteCount = logFile.fileSystemBlockByteCount ;
+        hsize_t blockScanCount = blockByteCount / greatestCommonDivisor(blockByteCount, bytesPerScan) ;
+        if ( chunkScanCount >= blockScanCount && chunkScanCount != sweep.expectedScanCount )  {
+            chunkScanCount -= chunkScanCount % blockScanCount ;
+        }
+        result.chunkScanCount = chunkScanCount ;
+        result.preallocatedScanCount = sweep.expectedScanCount ;
+        result.isGrownGeometrically = true ;
+    }
+    hsize_t maximumChunkScanCount = MAXIMUM_CHUNK_BYTE_COUNT / bytesPerScan ;
+    result.chunkScanCount = std::max<hsize_t>(1, std::min(result.chunkScanCount, maximumChunkScanCount)) ;
+    return result ;
+}
+
+
+
+// Create an extensible channelCount x layout.preallocatedScanCount (to HDF5) dataset in the
+// group, chunked layout.chunkScanCount scans at a time, and with a chunk cache big enough
+// that appends don't evict a partly-written chunk.  If layout.isCompressed, each chunk is
+// compressed with the scan filter as it's evicted, so mostly once, when it's full.
+// Returns a negative value if anything failed.
+herr_t
+createScanDataset(ScanDataset & result, hid_t groupID, const char * name, hid_t typeID,
+                  hsize_t channelCount, const ScanDatasetLayout & layout)  {
+    result = closedScanDataset() ;
+    result.memoryTypeID = typeID ;
+    result.channelCount = channelCount ;
+    result.extentScanCount = layout.preallocatedScanCount ;
+    result.chunkScanCount = layout.chunkScanCount ;
+    result.isGrownGeometrically = layout.isGrownGeometrically ;
+
+    hsize_t chunkDims[2] = { channelCount, layout.chunkScanCount } ;
+    hsize_t dims[2] = { channelCount, layout.preallocatedScanCount } ;
+    hsize_t maxDims[2] = { channelCount, H5S_UNLIMITED } ;
+
+    result.fileSpaceID = H5Screate_simple(2, dims, maxDims) ;
+    if (result.fileSpaceID < 0)  {
+        return -1 ;
+    }
+    hid_t createPropertyListID = H5Pcreate(H5P_DATASET_CREATE) ;
+    H5Pset_chunk(createPropertyListID, 2, chunkDims) ;
+    if ( layout.isCompressed && 
+         ( registerScanFilter() < 0 || setScanFilter(createPropertyListID, H5Tget_size(typeID), chunkDims[1]) < 0 ) )  {
+        H5Pclose(createPropertyListID) ;
+        closeScanDataset(result) ;
+        return -1 ;
+    }
+    hid_t accessPropertyListID = H5Pcreate(H5P_DATASET_ACCESS) ;
+    size_t chunkByteCount = (size_t)(chunkDims[0] * chunkDims[1] * H5Tget_size(typeID)) ;
+    H5Pset_chunk_cache(accessPropertyListID, 521, std::max<size_t>(1024*1024, 2*chunkByteCount), 1.0) ;
+    result.datasetID =
+        H5Dcreate2(groupID, name, typeID, result.fileSpaceID, H5P_DEFAULT, createPropertyListID, accessPropertyListID) ;
+    H5Pclose(accessPropertyListID) ;
+    H5Pclose(createPropertyListID) ;
+    if (result.datasetID < 0)  {
+        closeScanDataset(result) ;
+        return -1 ;
+    }
+    return 0 ;
+}
+
+
+
+// Set the extent of the dataset, in scans, keeping the cached file dataspace in step.
+// Returns a negative value if anything failed, setting *whatFailed.
+herr_t
+setScanDatasetExtent(ScanDataset & dataset, hsize_t extentScanCount, const char ** whatFailed)  {
+    hsize_t dims[2] = { dataset.channelCount, extentScanCount } ;
+    hsize_t maxDims[2] = { dataset.channelCount, H5S_UNLIMITED } ;
+    if (H5Dset_extent(dataset.datasetID, dims) < 0)  {
+        *whatFailed = "extend a scans dataset" ;
+        return -1 ;
+    }
+    if (H5Sset_extent_simple(dataset.fileSpaceID, 2, dims, maxDims) < 0)  {
+        *whatFailed = "extend a dataspace" ;
+        return -1 ;
+    }
+    dataset.extentScanCount = extentScanCount ;
+    return 0 ;
+}
+
+
+
+// Append newScanCount scans, nScans x channelCount as in Matlab, to the dataset.  Returns a
+// negative value if anything failed, setting *whatFailed.
+herr_t
+appendToScanDataset(ScanDataset & dataset, const void * scans, hsize_t newScanCount, const char ** whatFailed)  {
+    if (newScanCount == 0)  {
+        return 0 ;
+    }
+
+    // Extend the dataset, if needed.  If it's grown geometrically, it's grown by a whole
+    // number of chunks.
+    hsize_t neededScanCount = dataset.scanCount + newScanCount ;
+    if (neededScanCount > dataset.extentScanCount)  {
+        hsize_t extentScanCount = neededScanCount ;
+        if (dataset.isGrownGeometrically)  {
+            extentScanCount = std::max(extentScanCount, MINIMUM_EXTENT_GROWTH_FACTOR * dataset.extentScanCount) ;
+            extentScanCount = dataset.chunkScanCount * ((extentScanCount + dataset.chunkScanCount - 1) / dataset.chunkScanCount) ;
+        }
+        if (setScanDatasetExtent(dataset, extentScanCount, whatFailed) < 0)  {
+            return -1 ;
+        }
+    }
+
+    // Select where the new scans go
+    hsize_t start[2] = { 0, dataset.scanCount } ;
+    hsize_t count[2] = { dataset.channelCount, newScanCount } ;
+    if (H5Sselect_hyperslab(dataset.fileSpaceID, H5S_SELECT_SET, start, NULL, count, NULL) < 0)  {
+        *whatFailed = "select a hyperslab" ;
+        return -1 ;
+    }
+
+    // Resize the memory dataspace, if the block size has changed
+    if (dataset.memorySpaceID < 0)  {
+        dataset.memorySpaceID = H5Screate_simple(2, count, NULL) ;
+        if (dataset.memorySpaceID < 0)  {
+            *whatFailed = "make a dataspace" ;
+            return -1 ;
+        }
+        dataset.memorySpaceScanCount = newScanCount ;
+    }
+    else if (dataset.memorySpaceScanCount != newScanCount)  {
+        if (H5Sset_extent_simple(dataset.memorySpaceID, 2, count, NULL) < 0)  {
+            *whatFailed = "resize a dataspace" ;
+            return -1 ;
+        }
+        dataset.memorySpaceScanCount = newScanCount ;
+    }
+
+    // Write
+    if (H5Dwrite(dataset.datasetID, dataset.memoryTypeID, dataset.memorySpaceID, dataset.fileSpaceID, H5P_DEFAULT, scans) < 0)  {
+        *whatFailed = "write scans" ;
+        return -1 ;
+    }
+    dataset.scanCount += newScanCount ;
+    return 0 ;
+}
+
+
+
+// Reduce scanCount more analog scans of the sweep being written, nScans x
+// analogChannelCount as in Matlab, into each level of the sweep's overview, and append the
+// bins that finishes to the level's dataset.  If isSweepEnding, the bin being built at each
+// level is finished too, however full, as minMaxDownsampleMex finishes its last bin.  Does
+// nothing if the sweep has no overview.  Returns a negative value if anything failed,
+// setting *whatFailed.
+herr_t
+appendToOverviews(LogFile & logFile, const int16_t * scans, hsize_t scanCount, bool isSweepEnding, const char ** whatFailed)  {
+    // The inputs to the first level are the scans, each its own max and min, and the
+    // inputs to each level after are the bins just finished by the level before
+    const int16_t * inputMaxima = scans ;
+    const int16_t * inputMinima = scans ;
+    hsize_t inputStride = 1 ;  // between one input of a channel and the next
+    hsize_t inputChannelStride = scanCount ;  // between one channel's inputs and the next's
+    hsize_t inputCount = scanCount ;
+    for (int k = 0; k < OVERVIEW_LEVEL_COUNT; ++k)  {
+        OverviewLevel & level = logFile.overviews[k] ;
+        if (level.dataset.datasetID < 0)  {
+            return 0 ;
+        }
+        const hsize_t channelCount = level.dataset.channelCount ;
+        const hsize_t filledInputCount = level.binFillCount + inputCount ;
+        const bool isLastBinPartial = ( isSweepEnding && filledInputCount % OVERVIEW_DECIMATION_FACTOR != 0 ) ;
+        const hsize_t binCount = filledInputCount / OVERVIEW_DECIMATION_FACTOR + (isLastBinPartial ? 1 : 0) ;
+        const hsize_t rowCount = 2*binCount ;
+        level.bins.resize((size_t)(rowCount * channelCount)) ;
+        hsize_t binFillCount = level.binFillCount ;
+        for (hsize_t c = 0; c < channelCount; ++c)  {
+            const int16_t * maxima = inputMaxima + c*inputChannelStride ;
+            const int16_t * minima = inputMinima + c*inputChannelStride ;
+            int16_t * bin = level.bins.data() + c*rowCount ;
+            int16_t maximum = level.maxima[(size_t)(c)] ;
+            int16_t minimum = level.minima[(size_t)(c)] ;
+            binFillCount = level.binFillCount ;
+            hsize_t i = 0 ;
+            while (i < inputCount)  {
+                // Take the inputs up to the end of the bin, or of the inputs
+                hsize_t runEnd = std::min(inputCount, i + (OVERVIEW_DECIMATION_FACTOR - binFillCount)) ;
+                if (binFillCount == 0)  {
+                    maximum = maxima[i*inputStride] ;
+                    minimum = minima[i*inputStride] ;
+                }
+                for (hsize_t j = i; j < runEnd; ++j)  {
+                    maximum = std::max(maximum, maxima[j*inputStride]) ;
+                    minimum = std::min(minimum, minima[j*inputStride]) ;
+                }
+                binFillCount += runEnd - i ;
+                i = runEnd ;
+                if (binFillCount == OVERVIEW_DECIMATION_FACTOR)  {
+                    bin[0] = maximum ;
+                    bin[1] = minimum ;
+                    bin += 2 ;
+                    binFillCount = 0 ;
+                }
+            }
+            if (isLastBinPartial)  {
+                bin[0] = maximum ;
+                bin[1] = minimum ;
+                binFillCount = 0 ;
+            }
+            level.maxima[(size_t)(c)] = maximum ;
+            level.minima[(size_t)(c)] = minimum ;
+        }
+        level.binFillCount = binFillCount ;
+        if (appendToScanDataset(level.dataset, level.bins.data(), rowCount, whatFailed) < 0)  {
+            return -1 ;
+        }
+        inputMaxima = level.bins.data() ;
+        inputMinima = level.bins.data() + 1 ;
+        inputStride = 2 ;
+        inputChannelStride = rowCount ;
+        inputCount = binCount ;
+    }
+    return 0 ;
+}
+
+
+
+// Close the datasets and group of the sweep being written, if any, and flush the file to
+// disk.  The last bins of the sweep's overview, if it has one, are written first.  Returns a
+// negative value if anything failed, setting *whatFailed.
+herr_t
+endSweep(LogFile & logFile, const char ** whatFailed)  {
+    if (logFile.sweepGroupID < 0)  {
+        return 0 ;
+    }
+    const char * whatFailedToFinishOverviews = "" ;
+    herr_t result = appendToOverviews(logFile, NULL, 0, true, &whatFailedToFinishOverviews) ;
+    for (int k = 0; k < OVERVIEW_LEVEL_COUNT; ++k)  {
+        result = std::min(result, closeScanDataset(logFile.overviews[k].dataset)) ;
+    }
+    result = std::min(result, closeScanDataset(logFile.analogScans)) ;
+    result = std::min(result, closeScanDataset(logFile.digitalScans)) ;
+    result = std::min(result, H5Dclose(logFile.sweepTimestampID)) ;
+    logFile.sweepTimestampID = -1 ;
+    result = std::min(result, H5Gclose(logFile.sweepGroupID)) ;
+    logFile.sweepGroupID = -1 ;
+    result = std::min(result, H5Fflush(logFile.fileID, H5F_SCOPE_LOCAL)) ;
+    if (result < 0)  {
+        *whatFailed = "finish writing a sweep" ;
+    }
+    return result ;
+}
+
+
+
+// A prepared sweep that's nothing
+PreparedSweep
+unpreparedSweep(void)  {
+    PreparedSweep result ;
+    result.sweep = SweepLayout() ;
+    result.groupID = -1 ;
+    result.timestampID = -1 ;
+    result.analogScans = closedScanDataset() ;
+    result.digitalScans = closedScanDataset() ;
+    for (int k = 0; k < OVERVIEW_LEVEL_COUNT; ++k)  {
+        result.analogScansOverviews[k] = closedScanDataset() ;
+    }
+    return result ;
+}
+
+
+
+// The layouts of the scans datasets of the sweep in the log file
+ScanDatasetLayout
+analogScansLayout(const LogFile & logFile, const SweepLayout & sweep)  {
+    return scanDatasetLayout(logFile, sweep, sweep.analogChannelCount * sizeof(int16_t)) ;
+}
+
+ScanDatasetLayout
+digitalScansLayout(const LogFile & logFile, const SweepLayout & sweep)  {
+    return scanDatasetLayout(logFile, sweep, H5Tget_size(digitalScansTypeID(sweep.digitalChannelCount))) ;
+}
+
+
+
+// The number of scans in a bin of the given level, counting from zero, of an overview
+hsize_t
+overviewDecimationFactor(int levelIndex)  {
+    hsize_t result = OVERVIEW_DECIMATION_FACTOR ;
+    for (int k = 0; k < levelIndex; ++k)  {
+        result *= OVERVIEW_DECIMATION_FACTOR ;
+    }
+    return result ;
+}
+
+// The layout of the dataset of the given level of the sweep's overview, whatever the
+// layout policy.  Overviews are never compressed, so that any HDF5 library, Matlab's
+// included, can read them.
+ScanDatasetLayout
+overviewDatasetLayout(const SweepLayout & sweep, int levelIndex)  {
+    hsize_t decimationFactor = overviewDecimationFactor(levelIndex) ;
+    hsize_t expectedRowCount = 2 * ((sweep.expectedScanCount + decimationFactor - 1) / decimationFactor) ;
+    hsize_t chunkRowCount = std::max<hsize_t>(2, OVERVIEW_CHUNK_BYTE_COUNT / (sweep.analogChannelCount * sizeof(int16_t))) ;
+    if (expectedRowCount > 0)  {
+        chunkRowCount = std::min(chunkRowCount, expectedRowCount) ;
+    }
+    ScanDatasetLayout result ;
+    result.chunkScanCount = chunkRowCount ;
+    result.preallocatedScanCount = expectedRowCount ;
+    result.isGrownGeometrically = true ;
+    result.isCompressed = false ;
+    return result ;
+}
+
+
+
+// Close the handles of the prepared sweep, if any, and delete its group, whatever's in it,
+// from the file, so that it's as if it was never prepared.  Returns a negative value if
+// anything failed.
+herr_t
+discardPreparedSweep(LogFile & logFile)  {
+    PreparedSweep & prepared = logFile.prepared ;
+    herr_t result = 0 ;
+    if (prepared.sweep.sweepIndex != 0)  {
+        result = std::min(result, closeScanDataset(prepared.analogScans)) ;
+        result = std::min(result, closeScanDataset(prepared.digitalScans)) ;
+        for (int k = 0; k < OVERVIEW_LEVEL_COUNT; ++k)  {
+            result = std::min(result, closeScanDataset(prepared.analogScansOverviews[k])) ;
+        }
+        if (prepared.timestampID >= 0)  {
+            result = std::min(result, H5Dclose(prepared.timestampID)) ;
+        }
+        if (prepared.groupID >= 0)  {
+            result = std::min(result, H5Gclose(prepared.groupID)) ;
+            char groupName[16] ;
+            sprintf(groupName, "/sweep_%04d", prepared.sweep.sweepIndex) ;
+            result = std::min(result, H5Ldelete(logFile.fileID, groupName, H5P_DEFAULT)) ;
+        }
+    }
+    prepared = unpreparedSweep() ;
+    return result ;
+}
+
+
+
+// Prepare the sweep: create its group, its timestamp dataset, and its scans datasets, with
+// no scans in them, and its overview datasets, if the file has overviews.  The analogScans
+// dataset, and the overview, are only created if there are analog channels, and likewise
+// digitalScans.  Anything already prepared is discarded first.  Returns a
+// negative value if anything failed, setting *whatFailed, and leaving nothing prepared.
+herr_t
+prepareSweep(LogFile & logFile, const SweepLayout & sweep, const char ** whatFailed)  {
+    if (discardPreparedSweep(logFile) < 0)  {
+        *whatFailed = "discard a prepared sweep" ;
+        return -1 ;
+    }
+    PreparedSweep & prepared = logFile.prepared ;
+    prepared.sweep = sweep ;
+
+    // Create the group
+    char groupName[16] ;
+    sprintf(groupName, "/sweep_%04d", sweep.sweepIndex) ;
+    prepared.groupID = H5Gcreate2(logFile.fileID, groupName, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) ;
+    if (prepared.groupID < 0)  {
+        *whatFailed = "create the sweep group" ;
+        prepared = unpreparedSweep() ;  // there's no group to delete
+        return -1 ;
+    }
+
+    // Create the timestamp dataset
+    hsize_t timestampDims[2] = { 1, 1 } ;
+    hid_t timestampSpaceID = H5Screate_simple(2, timestampDims, NULL) ;
+    prepared.timestampID = H5Dcreate2(prepared.groupID, "timestamp", H5T_NATIVE_DOUBLE, timestampSpaceID, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) ;
+    H5Sclose(timestampSpaceID) ;
+    if (prepared.timestampID < 0)  {
+        *whatFailed = "create the sweep timestamp" ;
+        discardPreparedSweep(logFile) ;
+        return -1 ;
+    }
+
+    // Create the scans datasets, empty
+    if (sweep.analogChannelCount > 0)  {
+        ScanDatasetLayout layout = analogScansLayout(logFile, sweep) ;
+        layout.preallocatedScanCount = 0 ;
+        if (createScanDataset(prepared.analogScans, prepared.groupID, "analogScans", H5T_NATIVE_INT16,
+                              sweep.analogChannelCount, layout) < 0)  {
+            *whatFailed = "create the analogScans dataset" ;
+            discardPreparedSweep(logFile) ;
+            return -1 ;
+        }
+    }
+    if (sweep.digitalChannelCount > 0)  {
+        ScanDatasetLayout layout = digitalScansLayout(logFile, sweep) ;
+        layout.preallocatedScanCount = 0 ;
+        if (createScanDataset(prepared.digitalScans, prepared.groupID, "digitalScans",
+                              digitalScansTypeID(sweep.digitalChannelCount), 1, layout) < 0)  {
+            *whatFailed = "create the digitalScans dataset" ;
+            discardPreparedSweep(logFile) ;
+            return -1 ;
+        }
+    }
+    if ( logFile.doWriteOverviews && sweep.analogChannelCount > 0 )  {
+        for (int k = 0; k < OVERVIEW_LEVEL_COUNT; ++k)  {
+            ScanDatasetLayout layout = overviewDatasetLayout(sweep, k) ;
+            layout.preallocatedScanCount = 0 ;
+            char datasetName[40] ;
+            sprintf(datasetName, "analogScansOverview_%llu", (unsigned long long)(overviewDecimationFactor(k))) ;
+            if (createScanDataset(prepared.analogScansOverviews[k], prepared.groupID, datasetName, H5T_NATIVE_INT16,
+                                  sweep.analogChannelCount, layout) < 0)  {
+                *whatFailed = "create an analogScansOverview dataset" ;
+                discardPreparedSweep(logFile) ;
+                return -1 ;
+            }
+        }
+    }
+    return 0 ;
+}
+
+
+
+// Whether the prepared sweep is the sweep, laid out the same.  The timestamp doesn't
+// matter, since it's only written when the sweep starts.
+bool
+isPreparedFor(const PreparedSweep & prepared, const SweepLayout & sweep)  {
+    return prepared.sweep.sweepIndex == sweep.sweepIndex &&
+           prepared.sweep.analogChannelCount == sweep.analogChannelCount &&
+           prepared.sweep.digitalChannelCount == sweep.digitalChannelCount &&
+           prepared.sweep.expectedScanCount == sweep.expectedScanCount &&
+           prepared.sweep.scanRate == sweep.scanRate ;
+}
+
+
+
+// End the sweep being written, if any, then start the new sweep, preparing it first if it
+// hasn't been prepared already, or was prepared differently: write its timestamp, and
+// preallocate its scans datasets.  Returns a negative value if anything failed, setting
+// *whatFailed.
+herr_t
+startSweep(LogFile & logFile, const SweepLayout & sweep, const char ** whatFailed)  {
+    // End the last sweep, if needed
+    if (endSweep(logFile, whatFailed) < 0)  {
+        return -1 ;
+    }
+
+    // Prepare the sweep, if need be
+    if ( !isPreparedFor(logFile.prepared, sweep) && prepareSweep(logFile, sweep, whatFailed) < 0 )  {
+        return -1 ;
+    }
+
+    // Take it over
+    PreparedSweep & prepared = logFile.prepared ;
+    logFile.sweepGroupID = prepared.groupID ;
+    logFile.sweepTimestampID = prepared.timestampID ;
+    logFile.analogScans = prepared.analogScans ;
+    logFile.digitalScans = prepared.digitalScans ;
+    for (int k = 0; k < OVERVIEW_LEVEL_COUNT; ++k)  {
+        OverviewLevel & level = logFile.overviews[k] ;
+        level.dataset = prepared.analogScansOverviews[k] ;
+        level.binFillCount = 0 ;
+        level.maxima.assign((size_t)(sweep.analogChannelCount), 0) ;
+        level.minima.assign((size_t)(sweep.analogChannelCount), 0) ;
+    }
+    prepared = unpreparedSweep() ;
+
+    // Write the timestamp.  The dataset's closed when the sweep ends, since closing it takes
+    // about as long as the write.
+    if (H5Dwrite(logFile.sweepTimestampID, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &sweep.timestamp) < 0)  {
+        *whatFailed = "write the sweep timestamp" ;
+        return -1 ;
+    }
+
+    // Preallocate the scans datasets
+    if (sweep.analogChannelCount > 0)  {
+        hsize_t preallocatedScanCount = analogScansLayout(logFile, sweep).preallocatedScanCount ;
+        if ( preallocatedScanCount > 0 && setScanDatasetExtent(logFile.analogScans, preallocatedScanCount, whatFailed) < 0 )  {
+            return -1 ;
+        }
+    }
+    if (sweep.digitalChannelCount > 0)  {
+        hsize_t preallocatedScanCount = digitalScansLayout(logFile, sweep).preallocatedScanCount ;
+        if ( preallocatedScanCount > 0 && setScanDatasetExtent(logFile.digitalScans, preallocatedScanCount, whatFailed) < 0 )  {
+            return -1 ;
+        }
+    }
+    for (int k = 0; k < OVERVIEW_LEVEL_COUNT; ++k)  {
+        ScanDataset & dataset = logFile.overviews[k].dataset ;
+        hsize_t preallocatedRowCount = overviewDatasetLayout(sweep, k).preallocatedScanCount ;
+        if ( dataset.datasetID >= 0 && preallocatedRowCount > 0 && setScanDatasetExtent(dataset, preallocatedRowCount, whatFailed) < 0 )  {
+            return -1 ;
+        }
+    }
+    return 0 ;
+}
+
+
+
+// The number of int16s a scan's digital word takes up in a raw scan file
+hsize_t
+rawDigitalWordCount(hsize_t digitalChannelCount)  {
+    return (digitalChannelCount==0) ? 0 : ( (digitalChannelCount<=16) ? 1 : 2 ) ;
+}
+
+
+
+// Open (creating or truncating) a file for unbuffered writing, if the file system
+// supports that, or buffered writing if not
+RawFileHandle
+openRawFileForWriting(const std::string & fileName)  {
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(fileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, NULL) ;
+    if (handle == INVALID_HANDLE_VALUE)  {
+        handle = CreateFileA(fileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL) ;
+    }
+    return handle ;
+#else
+    int fd = -1 ;
+#ifdef O_DIRECT
+    fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644) ;
+#endif
+    if (fd < 0)  {
+        fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) ;
+    }
+    return fd ;
+#endif
+}
+
+
+
+// Write byteCount bytes to the file at offset.  Returns false if that fails.
+bool
+writeRawFile(RawFileHandle handle, const char * bytes, size_t byteCount, uint64_t offset)  {
+    while (byteCount > 0)  {
+#ifdef _WIN32
+        OVERLAPPED overlapped = OVERLAPPED() ;
+        overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF) ;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32) ;
+        DWORD byteCountWritten = 0 ;
+        if ( !WriteFile(handle, bytes, (DWORD)(std::min<size_t>(byteCount, 1u<<30)), &byteCountWritten, &overlapped) || byteCountWritten==0 )  {
+            return false ;
+        }
+#else
+        ssize_t byteCountWritten = pwrite(handle, bytes, byteCount, (off_t)offset) ;
+        if (byteCountWritten < 0 && errno == EINTR)  {
+            continue ;
+        }
+        if (byteCountWritten <= 0)  {
+            return false ;
+        }
+#endif
+        bytes += byteCountWritten ;
+        byteCount -= byteCountWritten ;
+        offset += byteCountWritten ;
+    }
+    return true ;
+}
+
+
+
+// Set the size of the file, truncating or extending it.  Returns false if that fails.
+bool
+setRawFileSize(RawFileHandle handle, uint64_t byteCount)  {
+#ifdef _WIN32
+    LARGE_INTEGER size ;
+    size.QuadPart = (LONGLONG)(byteCount) ;
+    return SetFilePointerEx(handle, size, NULL, FILE_BEGIN) && SetEndOfFile(handle) ;
+#else
+    return ftruncate(handle, (off_t)byteCount) == 0 ;
+#endif
+}
+
+
+
+// Have the file system set aside space for the file to be byteCount bytes long.  This is
+// only to keep the file from fragmenting, so it's not an error if it can't be done.
+void
+preallocateRawFile(RawFileHandle handle, uint64_t byteCount)  {
+#ifdef _WIN32
+    setRawFileSize(handle, byteCount) ;
+#elif defined(__linux__)
+    posix_fallocate(handle, 0, (off_t)byteCount) ;
+#else
+    (void)handle ;
+    (void)byteCount ;
+#endif
+}
+
+
+
+// Make sure what's been written to the file is on disk.  Returns false if that fails.
+bool
+syncRawFile(RawFileHandle handle)  {
+#ifdef _WIN32
+    return FlushFileBuffers(handle) != 0 ;
+#elif defined(__APPLE__)
+    return fsync(handle) == 0 ;
+#else
+    return fdatasync(handle) == 0 ;
+#endif
+}
+
+
+
+void
+closeRawFileHandle(RawFileHandle handle)  {
+#ifdef _WIN32
+    CloseHandle(handle) ;
+#else
+    close(handle) ;
+#endif
+}
+
+
+
+char *
+allocateAligned(size_t byteCount)  {
+#ifdef _WIN32
+    return (char *)(_aligned_malloc(byteCount, RAW_ALIGNMENT)) ;
+#else
+    void * result = NULL ;
+    return (posix_memalign(&result, RAW_ALIGNMENT, byteCount) == 0) ? (char *)(result) : (char *)(0) ;
+#endif
+}
+
+
+
+void
+freeAligned(char * bytes)  {
+#ifdef _WIN32
+    _aligned_free(bytes) ;
+#else
+    free(bytes) ;
+#endif
+}
+
+
+
+// Write the staged bytes that haven't been written yet to the file, padded to alignment,
+// starting from the aligned block the last write ended in.  If the staging buffer is full,
+// it's emptied, and its file offset moved on; otherwise it's kept, so that the last,
+// partial, block can be written again when there's more in it.  Returns false if that
+// fails.
+bool
+writeStagedScans(RawScanFile & raw)  {
+    if (raw.stagingByteCount == raw.writtenStagingByteCount)  {
+        return true ;
+    }
+    size_t firstByteIndex = raw.writtenStagingByteCount / RAW_ALIGNMENT * RAW_ALIGNMENT ;
+    size_t paddedByteCount = (raw.stagingByteCount + RAW_ALIGNMENT - 1) / RAW_ALIGNMENT * RAW_ALIGNMENT ;
+    if (raw.stagingFileOffset + paddedByteCount > raw.preallocatedByteCount)  {
+        raw.preallocatedByteCount += RAW_PREALLOCATION_BYTE_COUNT ;
+        preallocateRawFile(raw.handle, raw.preallocatedByteCount) ;
+    }
+    memset(raw.staging + raw.stagingByteCount, 0, paddedByteCount - raw.stagingByteCount) ;
+    if (!writeRawFile(raw.handle, raw.staging + firstByteIndex, paddedByteCount - firstByteIndex, raw.stagingFileOffset + firstByteIndex))  {
+        return false ;
+    }
+    raw.writtenStagingByteCount = raw.stagingByteCount ;
+    if (raw.stagingByteCount == RAW_STAGING_BYTE_COUNT)  {
+        raw.stagingFileOffset += RAW_STAGING_BYTE_COUNT ;
+        raw.stagingByteCount = 0 ;
+        raw.writtenStagingByteCount = 0 ;
+    }
+    return true ;
+}
+
+
+
+// Copy bytes to the staging buffer, writing it out each time it fills.  Returns false if
+// that fails.
+bool
+stageBytes(RawScanFile & raw, const char * bytes, size_t byteCount)  {
+    while (byteCount > 0)  {
+        size_t byteCountToCopy = std::min(byteCount, (size_t)(RAW_STAGING_BYTE_COUNT) - raw.stagingByteCount) ;
+        memcpy(raw.staging + raw.stagingByteCount, bytes, byteCountToCopy) ;
+        raw.stagingByteCount += byteCountToCopy ;
+        bytes += byteCountToCopy ;
+        byteCount -= byteCountToCopy ;
+        if (raw.stagingByteCount == RAW_STAGING_BYTE_COUNT)  {
+            if (!writeStagedScans(raw))  {
+                return false ;
+            }
+        }
+    }
+    return true ;
+}
+
+
+
+// Add to the checksum sums the Fletcher checksum of the bytes, which must be a multiple of
+// four long, taken as 32-bit words, with 64-bit sums, as ZFS does.  This is much quicker
+// than a CRC, and catches what it's there for, records that were only partly written.
+void
+journalChecksum(const char * bytes, size_t byteCount, uint64_t sums[2])  {
+    uint64_t a = sums[0] ;
+    uint64_t b = sums[1] ;
+    for (size_t i = 0; i + 4 <= byteCount; i += 4)  {
+        uint32_t word ;
+        memcpy(&word, bytes + i, 4) ;
+        a += word ;
+        b += a ;
+    }
+    sums[0] = a ;
+    sums[1] = b ;
+}
+
+
+
+// The number of bytes a journal record's payload takes up, with its padding
+uint64_t
+paddedJournalPayloadByteCount(uint64_t payloadByteCount)  {
+    return (payloadByteCount + 7) / 8 * 8 ;
+}
+
+
+
+// The checksum of the journal record.  The header's checksum is ignored, and payload must
+// be followed by its padding.
+void
+journalRecordChecksum(const JournalRecordHeader & header, const char * payload, uint64_t result[2])  {
+    JournalRecordHeader headerToCheck = header ;
+    headerToCheck.checksum[0] = 0 ;
+    headerToCheck.checksum[1] = 0 ;
+    result[0] = 0 ;
+    result[1] = 0 ;
+    journalChecksum((const char *)(&headerToCheck), sizeof(headerToCheck), result) ;
+    journalChecksum(payload, (size_t)(paddedJournalPayloadByteCount(header.payloadByteCount)), result) ;
+}
+
+
+
+// Add a record to the journal.  payload must have room for the padding after its
+// payloadByteCount bytes, which this zeroes.  Returns false if that fails.
+bool
+stageJournalRecord(RawScanFile & raw, JournalRecordType type, char * payload, size_t payloadByteCount)  {
+    size_t paddedByteCount = (size_t)(paddedJournalPayloadByteCount(payloadByteCount)) ;
+    memset(payload + payloadByteCount, 0, paddedByteCount - payloadByteCount) ;
+    JournalRecordHeader header ;
+    header.magic = JOURNAL_RECORD_MAGIC ;
+    header.type = (uint32_t)(type) ;
+    header.sequenceNumber = raw.journalRecordCount ;
+    header.payloadByteCount = payloadByteCount ;
+    journalRecordChecksum(header, payload, header.checksum) ;
+    ++(raw.journalRecordCount) ;
+    return stageBytes(raw, (const char *)(&header), sizeof(header)) && stageBytes(raw, payload, paddedByteCount) ;
+}
+
+
+
+// Write out what's staged, and make sure it's on disk.  Returns false if that fails.
+bool
+syncRawScanFile(RawScanFile & raw)  {
+    raw.lastSyncTime = std::chrono::steady_clock::now() ;
+    return writeStagedScans(raw) && syncRawFile(raw.handle) ;
+}
+
+
+
+// Finish the raw sweep being written, if any: add its row to the index, or its end record
+// to the journal, and make sure its scans are on disk.  Returns a negative value if
+// anything failed, setting *whatFailed.
+herr_t
+endRawSweep(LogFile & logFile, const char ** whatFailed)  {
+    RawScanFile & raw = *logFile.raw ;
+    if (raw.sweep.sweepIndex == 0)  {
+        return 0 ;
+    }
+    if (raw.isJournal)  {
+        raw.sweep = SweepLayout() ;
+        uint64_t sweepEnd[1] = { raw.sweepScanCount } ;
+        if ( !stageJournalRecord(raw, JOURNAL_SWEEP_END, (char *)(sweepEnd), sizeof(sweepEnd)) || !syncRawScanFile(raw) )  {
+            *whatFailed = "write to the journal" ;
+            return -1 ;
+        }
+        return 0 ;
+    }
+    double indexRow[6] = { (double)(raw.sweep.sweepIndex), raw.sweep.timestamp, (double)(raw.sweepByteOffset),
+                           (double)(raw.sweepScanCount), (double)(raw.sweep.analogChannelCount), (double)(raw.sweep.digitalChannelCount) } ;
+    raw.sweep = SweepLayout() ;
+    if ( !writeStagedScans(raw) || !syncRawFile(raw.handle) )  {
+        *whatFailed = "write scans to the raw scans file" ;
+        return -1 ;
+    }
+    if (appendToScanDataset(raw.index, indexRow, 1, whatFailed) < 0)  {
+        return -1 ;
+    }
+    if (H5Fflush(logFile.fileID, H5F_SCOPE_LOCAL) < 0)  {
+        *whatFailed = "flush the raw scans index" ;
+        return -1 ;
+    }
+    return 0 ;
+}
+
+
+
+// End the raw sweep being written, if any, and start a new one
+herr_t
+startRawSweep(LogFile & logFile, const SweepLayout & sweep, const char ** whatFailed)  {
+    if (endRawSweep(logFile, whatFailed) < 0)  {
+        return -1 ;
+    }
+    RawScanFile & raw = *logFile.raw ;
+    raw.sweep = sweep ;
+    raw.sweepByteOffset = raw.stagingFileOffset + raw.stagingByteCount ;
+    raw.sweepScanCount = 0 ;
+    if (raw.isJournal)  {
+        JournalSweepStart sweepStart ;
+        sweepStart.sweepIndex = (int32_t)(sweep.sweepIndex) ;
+        sweepStart.reserved = 0 ;
+        sweepStart.timestamp = sweep.timestamp ;
+        sweepStart.analogChannelCount = sweep.analogChannelCount ;
+        sweepStart.digitalChannelCount = sweep.digitalChannelCount ;
+        sweepStart.expectedScanCount = sweep.expectedScanCount ;
+        sweepStart.scanRate = sweep.scanRate ;
+        if (!stageJournalRecord(raw, JOURNAL_SWEEP_START, (char *)(&sweepStart), sizeof(sweepStart)))  {
+            *whatFailed = "write to the journal" ;
+            return -1 ;
+        }
+    }
+    return 0 ;
+}
+
+
+
+// Interleave the scans, analogScans nScans x analogChannelCount int16 and digitalScans
+// nScans x 1 unsigned integers, both as in Matlab, and add them to the raw scan file, or
+// the journal, a record per RAW_INTERLEAVING_SCAN_COUNT scans, syncing it if it's been
+// JOURNAL_SYNC_INTERVAL since it was last synced.  Either is null if the sweep has no
+// channels of that kind.
+herr_t
+appendRawScans(RawScanFile & raw, const void * analogScans, const void * digitalScans, hsize_t scanCount, const char ** whatFailed)  {
+    const hsize_t analogChannelCount = (analogScans) ? raw.sweep.analogChannelCount : 0 ;
+    const hsize_t digitalWordCount = (digitalScans) ? rawDigitalWordCount(raw.sweep.digitalChannelCount) : 0 ;
+    const hsize_t scanWordCount = raw.sweep.analogChannelCount + rawDigitalWordCount(raw.sweep.digitalChannelCount) ;
+    const size_t digitalElementSize = H5Tget_size(digitalScansTypeID(raw.sweep.digitalChannelCount)) ;
+    const int16_t * analog = (const int16_t *)(analogScans) ;
+    const char * digital = (const char *)(digitalScans) ;
+    const hsize_t blockScanCount = RAW_INTERLEAVING_SCAN_COUNT ;
+    raw.interleavedScans.assign((size_t)(std::min(scanCount, blockScanCount) * scanWordCount + 4), 0) ;  // with room for a journal record's padding
+    for (hsize_t firstScan = 0; firstScan < scanCount; firstScan += blockScanCount)  {
+        hsize_t blockSize = std::min(blockScanCount, scanCount - firstScan) ;
+        int16_t * interleaved = raw.interleavedScans.data() ;
+        for (hsize_t c = 0; c < analogChannelCount; ++c)  {
+            const int16_t * channel = analog + c*scanCount + firstScan ;
+            for (hsize_t i = 0; i < blockSize; ++i)  {
+                interleaved[i*scanWordCount + c] = channel[i] ;
+            }
+        }
+        if (digitalWordCount > 0)  {
+            for (hsize_t i = 0; i < blockSize; ++i)  {
+                uint32_t word = 0 ;
+                memcpy(&word, digital + (firstScan+i)*digitalElementSize, digitalElementSize) ;  // little-endian
+                int16_t * wordInScan = interleaved + i*scanWordCount + raw.sweep.analogChannelCount ;
+                wordInScan[0] = (int16_t)(word & 0xFFFF) ;
+                if (digitalWordCount > 1)  {
+                    wordInScan[1] = (int16_t)(word >> 16) ;
+                }
+            }
+        }
+        size_t byteCount = (size_t)(blockSize * scanWordCount * sizeof(int16_t)) ;
+        bool isOK = (raw.isJournal) ? stageJournalRecord(raw, JOURNAL_SCANS, (char *)(interleaved), byteCount) :
+                                      stageBytes(raw, (const char *)(interleaved), byteCount) ;
+        if (!isOK)  {
+            *whatFailed = (raw.isJournal) ? "write to the journal" : "write scans to the raw scans file" ;
+            return -1 ;
+        }
+    }
+    raw.sweepScanCount += scanCount ;
+    if ( raw.isJournal && 
+         std::chrono::duration<double>(std::chrono::steady_clock::now() - raw.lastSyncTime).count() >= JOURNAL_SYNC_INTERVAL &&
+         !syncRawScanFile(raw) )  {
+        *whatFailed = "sync the journal" ;
+        return -1 ;
+    }
+    return 0 ;
+}
+
+
+
+// The .dat, or .journal, file name to go with a data file name: the .h5 extension, if
+// any, replaced
+std::string
+rawScanFileNameFromFileName(const std::string & fileName, bool isJournal)  {
+    const char * extension = (isJournal) ? ".journal" : ".dat" ;
+    size_t length = fileName.size() ;
+    if ( length>3 && fileName.compare(length-3, 3, ".h5")==0 )  {
+        return fileName.substr(0, length-3) + extension ;
+    }
+    return fileName + extension ;
+}
+
+
+
+// Read the whole file into bytes, leaving room for padByteCount more.  Returns false if
+// that fails.
+bool
+readWholeFile(const std::string & fileName, std::vector<char> & bytes, size_t padByteCount)  {
+    FILE * file = fopen(fileName.c_str(), "rb") ;
+    if (!file)  {
+        return false ;
+    }
+    bytes.clear() ;
+    char buffer[65536] ;
+    size_t byteCountRead ;
+    while ((byteCountRead = fread(buffer, 1, sizeof(buffer), file)) > 0)  {
+        bytes.insert(bytes.end(), buffer, buffer + byteCountRead) ;
+    }
+    bool isOK = (ferror(file) == 0) ;
+    fclose(file) ;
+    bytes.resize(bytes.size() + padByteCount) ;
+    return isOK ;
+}
+
+
+
+// The leaf name of a file name
+std::string
+leafFileName(const std::string & fileName)  {
+    size_t lastSeparator = fileName.find_last_of("/\\") ;
+    return (lastSeparator == std::string::npos) ? fileName : fileName.substr(lastSeparator+1) ;
+}
+
+
+
+// Set up raw-format writing for the log file: create the .dat file, and the /rawScans
+// group, with a dataFileName attribute holding the .dat file's leaf name, and the index
+// dataset.  Or, if isJournal, create the .journal file, copy the HDF5 file, which isn't
+// open, into it, and make sure that's on disk.  Caller must hold HDF5_MUTEX.  Returns a
+// negative value if anything failed, setting *whatFailed.
+herr_t
+openRawScanFile(LogFile & logFile, bool isJournal, const char ** whatFailed)  {
+    RawScanFile * raw = new RawScanFile() ;
+    raw->fileName = rawScanFileNameFromFileName(logFile.fileName, isJournal) ;
+    raw->isJournal = isJournal ;
+    raw->handle = INVALID_RAW_FILE_HANDLE ;
+    raw->staging = allocateAligned(RAW_STAGING_BYTE_COUNT) ;
+    raw->stagingByteCount = 0 ;
+    raw->writtenStagingByteCount = 0 ;
+    raw->stagingFileOffset = 0 ;
+    raw->preallocatedByteCount = 0 ;
+    raw->groupID = -1 ;
+    raw->index = closedScanDataset() ;
+    raw->sweep = SweepLayout() ;
+    raw->sweepByteOffset = 0 ;
+    raw->sweepScanCount = 0 ;
+    raw->journalRecordCount = 0 ;
+    raw->lastSyncTime = std::chrono::steady_clock::now() ;
+    logFile.raw = raw ;
+    if (!raw->staging)  {
+        *whatFailed = "allocate the raw scans staging buffer" ;
+        return -1 ;
+    }
+    raw->handle = openRawFileForWriting(raw->fileName) ;
+    if (raw->handle == INVALID_RAW_FILE_HANDLE)  {
+        *whatFailed = (isJournal) ? "create the journal" : "create the raw scans file" ;
+        return -1 ;
+    }
+
+    if (isJournal)  {
+        std::vector<char> dataFile ;
+        if (!readWholeFile(logFile.fileName, dataFile, 8))  {
+            *whatFailed = "read the file" ;
+            return -1 ;
+        }
+        if ( !stageJournalRecord(*raw, JOURNAL_DATA_FILE, dataFile.data(), dataFile.size()-8) || !syncRawScanFile(*raw) )  {
+            *whatFailed = "write to the journal" ;
+            return -1 ;
+        }
+        return 0 ;
+    }
+
+    raw->groupID = H5Gcreate2(logFile.fileID, "/rawScans", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) ;
+    if (raw->groupID < 0)  {
+        *whatFailed = "create the raw scans group" ;
+        return -1 ;
+    }
+    std::string dataFileName = leafFileName(raw->fileName) ;
+    hid_t stringTypeID = H5Tcopy(H5T_C_S1) ;
+    H5Tset_size(stringTypeID, dataFileName.size()) ;
+    hid_t scalarSpaceID = H5Screate(H5S_SCALAR) ;
+    hid_t attributeID = H5Acreate2(raw->groupID, "dataFileName", stringTypeID, scalarSpaceID, H5P_DEFAULT, H5P_DEFAULT) ;
+    herr_t status = (attributeID < 0) ? -1 : H5Awrite(attributeID, stringTypeID, dataFileName.c_str()) ;
+    if (attributeID >= 0)  {
+        H5Aclose(attributeID) ;
+    }
+    H5Sclose(scalarSpaceID) ;
+    H5Tclose(stringTypeID) ;
+    if (status < 0)  {
+        *whatFailed = "write the raw scans file name" ;
+        return -1 ;
+    }
+    ScanDatasetLayout indexLayout = { 64, 0, false, false } ;
+    if (createScanDataset(raw->index, raw->groupID, "index", H5T_NATIVE_DOUBLE, 6, indexLayout) < 0)  {
+        *whatFailed = "create the raw scans index" ;
+        return -1 ;
+    }
+    return 0 ;
+}
+
+
+
+// End the raw sweep, if any, write out what's staged, trim the .dat file to the scans
+// written, and close it, and free everything.  Caller must hold HDF5_MUTEX.  Returns a
+// negative value if anything failed, setting *whatFailed.
+herr_t
+closeRawScanFile(LogFile & logFile, const char ** whatFailed)  {
+    RawScanFile * raw = logFile.raw ;
+    herr_t result = 0 ;
+    if (raw->handle != INVALID_RAW_FILE_HANDLE)  {
+        result = endRawSweep(logFile, whatFailed) ;
+        if ( !writeStagedScans(*raw) || !setRawFileSize(raw->handle, raw->stagingFileOffset + raw->stagingByteCount) ||
+             ( raw->isJournal && !syncRawFile(raw->handle) ) )  {
+            *whatFailed = (raw->isJournal) ? "finish writing the journal" : "finish writing the raw scans file" ;
+            result = -1 ;
+        }
+        closeRawFileHandle(raw->handle) ;
+    }
+    result = std::min(result, closeScanDataset(raw->index)) ;
+    if (raw->groupID >= 0)  {
+        result = std::min(result, H5Gclose(raw->groupID)) ;
+    }
+    if (raw->staging)  {
+        freeAligned(raw->staging) ;
+    }
+    delete raw ;
+    logFile.raw = (RawScanFile *)(0) ;
+    return result ;
+}
+
+
+
+// Do a write: start a sweep, append scans to it, end it, or prepare the next.  For
+// APPEND_SCANS, analogScans is nScans x analogChannelCount int16 and digitalScans nScans x
+// 1 unsigned integers, both as in Matlab, and either can be empty.  Preparing a sweep is
+// only ever a head start, so if it fails, that's not an error: the sweep is just created
+// when it's started, and any real problem reported then.  Caller must hold HDF5_MUTEX.
+// Returns a negative value if anything failed, setting *whatFailed.
+herr_t
+doWrite(LogFile & logFile, WriteCommandType type, const SweepLayout & sweep,
+        const void * analogScans, hsize_t analogScanCount, const void * digitalScans, hsize_t digitalScanCount,
+        const char ** whatFailed)  {
+    if (type == PREPARE_SWEEP)  {
+        const char * whatFailedToPrepare = "" ;
+        if (!logFile.raw)  {
+            prepareSweep(logFile, sweep, &whatFailedToPrepare) ;
+        }
+        return 0 ;
+    }
+    else if (type == START_SWEEP)  {
+        return (logFile.raw) ? startRawSweep(logFile, sweep, whatFailed) : startSweep(logFile, sweep, whatFailed) ;
+    }
+    else if (type == APPEND_SCANS)  {
+        if (logFile.raw)  {
+            // AppendScans has checked that the scan counts match
+            return appendRawScans(*logFile.raw, (analogScanCount>0) ? analogScans : NULL, (digitalScanCount>0) ? digitalScans : NULL,
+                                  std::max(analogScanCount, digitalScanCount), whatFailed) ;
+        }
+        if ( appendToScanDataset(logFile.analogScans, analogScans, analogScanCount, whatFailed) < 0 ||
+             appendToOverviews(logFile, (const int16_t *)(analogScans), analogScanCount, false, whatFailed) < 0 )  {
+            return -1 ;
+        }
+        return appendToScanDataset(logFile.digitalScans, digitalScans, digitalScanCount, whatFailed) ;
+    }
+    else  {
+        return (logFile.raw) ? endRawSweep(logFile, whatFailed) : endSweep(logFile, whatFailed) ;
+    }
+}
+
+
+
+// The body of an asynchronous log file's writer thread.  Does the queued commands in
+// order, until asked to stop and the queue is empty.  After an error, it records the error
+// and drops the rest of the commands, so that Matlab never waits on a broken file.
+void
+writeQueuedCommands(LogFile * logFile)  {
+    {
+        // In a thread-safe HDF5, error printing is set per thread
+        std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+        H5Eset_auto2(H5E_DEFAULT, NULL, NULL) ;
+    }
+    WriteQueue * queue = logFile->queue ;
+    std::unique_lock<std::mutex> lock(queue->mutex) ;
+    for (;;)  {
+        while (queue->commands.empty() && !queue->isStopRequested)  {
+            queue->commandQueued.wait(lock) ;
+        }
+        if (queue->commands.empty())  {
+            break ;
+        }
+        WriteCommand command = std::move(queue->commands.front()) ;
+        queue->commands.pop_front() ;
+        bool isBroken = !queue->errorMessage.empty() ;
+
+        // Matlab doesn't touch the command, or the HDF5 handles, so it's safe to do the
+        // write without the lock
+        lock.unlock() ;
+        herr_t status = 0 ;
+        const char * whatFailed = "" ;
+        if (!isBroken)  {
+            std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+            status = doWrite(*logFile, command.type, command.layout, command.analogScans.data(), command.analogScanCount,
+                             command.digitalScans.data(), command.digitalScanCount, &whatFailed) ;
+        }
+        lock.lock() ;
+
+        if (status < 0 && queue->errorMessage.empty())  {
+            queue->errorMessage = std::string("Unable to ") + whatFailed + " in data file " + logFile->fileName ;
+        }
+        queue->queuedByteCount -= command.analogScans.size() + command.digitalScans.size() ;
+        if (command.type == APPEND_SCANS)  {
+            if (queue->spareBuffers.size() < MAXIMUM_SPARE_BUFFER_COUNT)  {
+                queue->spareBuffers.push_back(std::move(command.analogScans)) ;
+            }
+            if (queue->spareBuffers.size() < MAXIMUM_SPARE_BUFFER_COUNT)  {
+                queue->spareBuffers.push_back(std::move(command.digitalScans)) ;
+            }
+        }
+        queue->commandDone.notify_all() ;
+    }
+}
+// end of function
+
+
+
+// Copy the scans in the Matlab array into buffer, reusing one of the queue's spare buffers
+// if there is one.  Caller must hold the queue's mutex.
+void
+copyScansIntoBuffer(WriteQueue & queue, const mxArray * scans, std::vector<char> & buffer)  {
+    size_t byteCount = mxGetNumberOfElements(scans) * mxGetElementSize(scans) ;
+    if (byteCount == 0)  {
+        return ;
+    }
+    if (!queue.spareBuffers.empty())  {
+        buffer = std::move(queue.spareBuffers.back()) ;
+        queue.spareBuffers.pop_back() ;
+    }
+    buffer.resize(byteCount) ;
+    memcpy(buffer.data(), mxGetData(scans), byteCount) ;
+}
+
+
+
+// Error out if the writer thread of the log file has had an error
+void
+checkWriteQueue(const LogFile & logFile)  {
+    if (logFile.queue)  {
+        std::string errorMessage ;
+        {
+            std::lock_guard<std::mutex> lock(logFile.queue->mutex) ;
+            errorMessage = logFile.queue->errorMessage ;
+        }
+        if (!errorMessage.empty())  {
+            mexErrMsgIdAndTxt("ws:logger:hdf5Error", "%s", errorMessage.c_str()) ;
+        }
+    }
+}
+
+
+
+// The number of scans in the Matlab array, which is zero if it's empty
+hsize_t
+scanCount(const mxArray * scans)  {
+    return mxIsEmpty(scans) ? 0 : mxGetM(scans) ;
+}
+
+
+
+// Write the command now, or queue it for the writer thread if the file is asynchronous.
+// For APPEND_SCANS, the scans are taken from the Matlab arrays, and when queueing, this
+// waits for space in the queue if need be.
+void
+writeOrQueueCommand(LogFile & logFile, WriteCommandType type, const SweepLayout & layout,
+                    const mxArray * analogScans, const mxArray * digitalScans)  {
+    if (!logFile.queue)  {
+        // Write it now
+        herr_t status = 0 ;
+        const char * whatFailed = "" ;
+        {
+            std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+            if (type == APPEND_SCANS)  {
+                status = doWrite(logFile, type, layout, mxGetData(analogScans), scanCount(analogScans),
+                                 mxGetData(digitalScans), scanCount(digitalScans), &whatFailed) ;
+            }
+            else  {
+                status = doWrite(logFile, type, layout, NULL, 0, NULL, 0, &whatFailed) ;
+            }
+        }
+        checkHDF5(status, whatFailed, logFile.fileName) ;
+        return ;
+    }
+
+    // Queue it
+    WriteQueue & queue = *logFile.queue ;
+    WriteCommand command ;
+    command.type = type ;
+    command.layout = layout ;
+    command.analogScanCount = 0 ;
+    command.digitalScanCount = 0 ;
+    {
+        std::unique_lock<std::mutex> lock(queue.mutex) ;
+        if (type == APPEND_SCANS)  {
+            size_t byteCount = mxGetNumberOfElements(analogScans) * mxGetElementSize(analogScans) +
+                               mxGetNumberOfElements(digitalScans) * mxGetElementSize(digitalScans) ;
+            if ( queue.queuedByteCount>0 && queue.queuedByteCount+byteCount>queue.byteCapacity && queue.errorMessage.empty() )  {
+                // Back-pressure: wait for the writer thread to make space
+                std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now() ;
+                while ( queue.queuedByteCount>0 && queue.queuedByteCount+byteCount>queue.byteCapacity && queue.errorMessage.empty() )  {
+                    queue.commandDone.wait(lock) ;
+                }
+                double waitTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count() ;
+                ++(queue.backPressureCount) ;
+                queue.backPressureTime += waitTime ;
+                queue.maxBackPressureTime = std::max(queue.maxBackPressureTime, waitTime) ;
+            }
+            copyScansIntoBuffer(queue, analogScans, command.analogScans) ;
+            command.analogScanCount = scanCount(analogScans) ;
+            copyScansIntoBuffer(queue, digitalScans, command.digitalScans) ;
+            command.digitalScanCount = scanCount(digitalScans) ;
+            queue.queuedByteCount += byteCount ;
+            queue.highWaterByteCount = std::max(queue.highWaterByteCount, queue.queuedByteCount) ;
+        }
+        queue.commands.push_back(std::move(command)) ;
+    }
+    queue.commandQueued.notify_one() ;
+}
+
+
+
+// The body of the thread that prepares the next sweep of a synchronous log file, while
+// Matlab gets on with the current one.  It holds HDF5_MUTEX throughout, so an append made
+// meanwhile waits for it.
+void
+prepareSweepInBackground(LogFile * logFile, SweepLayout sweep)  {
+    std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+    H5Eset_auto2(H5E_DEFAULT, NULL, NULL) ;  // in a thread-safe HDF5, error printing is set per thread
+    doWrite(*logFile, PREPARE_SWEEP, sweep, NULL, 0, NULL, 0, NULL) ;
+}
+
+
+
+// Wait for the log file's preparer thread to finish, if it's running, so that the prepared
+// sweep can be used
+void
+joinPreparerThread(LogFile & logFile)  {
+    if (logFile.preparerThread.joinable())  {
+        logFile.preparerThread.join() ;
+    }
+}
+
+
+
+// Close the log file and forget about it.  If it's asynchronous, waits for the writer
+// thread to finish what's queued first.  Returns a negative value if anything failed,
+// setting errorMessage.
+herr_t
+closeLogFile(uint32_t logFileID, std::string & errorMessage)  {
+    LogFile * logFile = LOG_FILES[logFileID-1] ;
+    herr_t result = 0 ;
+    joinPreparerThread(*logFile) ;
+    WriteQueue * queue = logFile->queue ;
+    if (queue)  {
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex) ;
+            queue->isStopRequested = true ;
+        }
+        queue->commandQueued.notify_all() ;
+        queue->writerThread.join() ;
+        if (!queue->errorMessage.empty())  {
+            errorMessage = queue->errorMessage ;
+            result = -1 ;
+        }
+        delete queue ;
+    }
+    {
+        std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+        const char * whatFailed = "" ;
+        herr_t status = (logFile->raw) ? closeRawScanFile(*logFile, &whatFailed) : endSweep(*logFile, &whatFailed) ;
+        status = std::min(status, discardPreparedSweep(*logFile)) ;
+        if (logFile->fileID >= 0)  {
+            status = std::min(status, H5Fclose(logFile->fileID)) ;
+        }
+        if (status < 0)  {
+            if (result >= 0)  {
+                errorMessage = "Unable to finish writing and close data file " + logFile->fileName ;
+            }
+            result = -1 ;
+        }
+    }
+    delete logFile ;
+    LOG_FILES[logFileID-1] = (LogFile *)(0) ;
+    return result ;
+}
+
+
+
+// This will be registered with mexAtExit()
+static void finalize(void)  {
+    // Close all the open files, so the data in them isn't lost
+    std::string errorMessage ;
+    for (size_t i = 0; i < LOG_FILES.size(); ++i)  {
+        if (LOG_FILES[i])  {
+            closeLogFile((uint32_t)(i+1), errorMessage) ;  // Ignore return value, b/c can't do anything about it anyway
+        }
+    }
+
+    // It's now safe to clear the DLL from memory
+    mexUnlock() ;
+}
+// end of function
+
+
+
+// This is called if the entry point is unlocked
+static void
+initialize(void)  {
+    mexLock() ;
+        // Don't clear the DLL on exit, to preserve the open files
+    mexAtExit(&finalize) ;
+        // Makes it so if this mex function gets cleared, all the files get closed
+    std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+    H5Eset_auto2(H5E_DEFAULT, NULL, NULL) ;
+        // We report HDF5 errors ourselves, so don't have HDF5 print its error stack
+}
+
+
+
+// Read the string at prhs[index], which must be a nonempty char array
+std::string
+readStringArgument(int nrhs, const mxArray *prhs[], int index, const char * argumentName)  {
+    if ( (nrhs>index) && mxIsChar(prhs[index]) && !mxIsEmpty(prhs[index]) )  {
+        char * valueAsCharPtr = mxArrayToString(prhs[index]) ;
+        std::string result(valueAsCharPtr) ;
+        mxFree(valueAsCharPtr) ;
+        return result ;
+    }
+    mexErrMsgIdAndTxt("ws:logger:badArgument", "%s must be a nonempty string", argumentName) ;
+    return std::string() ;  // never get here
+}
+
+
+
+// Read the scalar at prhs[index], which must be a nonnegative integer no bigger than maximumValue
+double
+readCountArgument(int nrhs, const mxArray *prhs[], int index, const char * argumentName, double maximumValue)  {
+    if ( (nrhs>index) && mxIsScalar(prhs[index]) && mxIsNumeric(prhs[index]) && !mxIsComplex(prhs[index]) )  {
+        double value = mxGetScalar(prhs[index]) ;
+        if ( value>=0 && value<=maximumValue && value==floor(value) )  {
+            return value ;
+        }
+    }
+    mexErrMsgIdAndTxt("ws:logger:badArgument", "%s must be a nonnegative integer no greater than %g", argumentName, maximumValue) ;
+    return 0 ;  // never get here
+}
+
+
+
+// Read the optional logical scalar at prhs[index], which is false if not given
+bool
+readOptionalLogicalArgument(int nrhs, const mxArray *prhs[], int index, const char * argumentName)  {
+    if (nrhs<=index)  {
+        return false ;
+    }
+    if ( !mxIsScalar(prhs[index]) || !(mxIsLogical(prhs[index]) || mxIsNumeric(prhs[index])) )  {
+        mexErrMsgIdAndTxt("ws:logger:badArgument", "%s must be a logical scalar", argumentName) ;
+    }
+    return (mxGetScalar(prhs[index]) != 0) ;
+}
+
+
+
+// Look up the log file given by the uint32 scalar at prhs[index].  Errors if it's not open.
+uint32_t
+readLogFileArgument(int nrhs, const mxArray *prhs[], int index)  {
+    if ( (nrhs>index) && mxGetClassID(prhs[index])==mxUINT32_CLASS && mxGetNumberOfElements(prhs[index])==1 )  {
+        uint32_t logFileID = *((uint32_t *)mxGetData(prhs[index])) ;
+        if ( logFileID>0 && logFileID<=LOG_FILES.size() && LOG_FILES[logFileID-1] )  {
+            return logFileID ;
+        }
+    }
+    mexErrMsgIdAndTxt("ws:logger:badLogFile", "The log file is not valid") ;
+    return 0 ;  // never get here
+}
+
+
+
+// logFile = OpenFile(fileName[, queueByteCapacity[, format[, layoutPolicy[, doWriteOverviews]]]])
+//
+// Open an existing HDF5 file for appending sweeps to.  logFile is a uint32 scalar.  If
+// queueByteCapacity is given, and nonzero, the file is written asynchronously, by a writer
+// thread, with up to queueByteCapacity bytes of scans queued for it.  format is 'hdf5'
+// (the default), 'compressed', to compress the scans datasets with the scan filter, or
+// 'raw', to write the scans to a .dat file alongside (see RawScanFile), or 'journal', to
+// write them to a crash-safe .journal file alongside, leaving the HDF5 file alone (see
+// JournalRecordHeader).  layoutPolicy is 'adaptive' (the default) or 'fixed' (see
+// LayoutPolicy).  If doWriteOverviews is true, each sweep gets an overview of its analog
+// scans (see OverviewLevel), except in the raw and journal formats, where that's up to
+// ConvertRawFile and ReplayJournal.
+void
+OpenFile(int /*nlhs*/, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: fileName
+    std::string fileName = readStringArgument(nrhs, prhs, 1, "fileName") ;
+
+    // prhs[2]: queueByteCapacity, optional
+    size_t queueByteCapacity = (nrhs>2) ? (size_t)readCountArgument(nrhs, prhs, 2, "queueByteCapacity", 1e15) : 0 ;
+
+    // prhs[3]: format, optional
+    std::string format = (nrhs>3) ? readStringArgument(nrhs, prhs, 3, "format") : std::string("hdf5") ;
+    if ( format != "hdf5" && format != "compressed" && format != "raw" && format != "journal" )  {
+        mexErrMsgIdAndTxt("ws:logger:badArgument", "format must be 'hdf5', 'compressed', 'raw' or 'journal'") ;
+    }
+    bool isJournal = (format == "journal") ;
+
+    // prhs[4]: layoutPolicy, optional
+    std::string layoutPolicy = (nrhs>4) ? readStringArgument(nrhs, prhs, 4, "layoutPolicy") : std::string("adaptive") ;
+    if ( layoutPolicy != "adaptive" && layoutPolicy != "fixed" )  {
+        mexErrMsgIdAndTxt("ws:logger:badArgument", "layoutPolicy must be 'adaptive' or 'fixed'") ;
+    }
+
+    // prhs[5]: doWriteOverviews, optional
+    bool doWriteOverviews = readOptionalLogicalArgument(nrhs, prhs, 5, "doWriteOverviews") ;
+
+    // Open it, unless it's journaled, when it's only read, into the journal
+    hid_t fileID = -1 ;
+    if (!isJournal)  {
+        {
+            std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+            fileID = H5Fopen(fileName.c_str(), H5F_ACC_RDWR, H5P_DEFAULT) ;
+        }
+        checkHDF5(fileID, "open the file", fileName) ;
+    }
+
+    // Record it
+    LogFile * logFile = new LogFile() ;
+    logFile->fileName = fileName ;
+    logFile->fileID = fileID ;
+    logFile->sweep = SweepLayout() ;
+    logFile->sweepGroupID = -1 ;
+    logFile->sweepTimestampID = -1 ;
+    logFile->analogScans = closedScanDataset() ;
+    logFile->digitalScans = closedScanDataset() ;
+    for (int k = 0; k < OVERVIEW_LEVEL_COUNT; ++k)  {
+        logFile->overviews[k].dataset = closedScanDataset() ;
+    }
+    logFile->prepared = unpreparedSweep() ;
+    logFile->queue = (WriteQueue *)(0) ;
+    logFile->raw = (RawScanFile *)(0) ;
+    logFile->isCompressed = (format == "compressed") ;
+    logFile->doWriteOverviews = doWriteOverviews ;
+    logFile->layoutPolicy = (layoutPolicy == "fixed") ? FIXED_LAYOUT : ADAPTIVE_LAYOUT ;
+    logFile->fileSystemBlockByteCount = fileSystemBlockByteCount(fileName) ;
+
+    // Set up the raw scans file, or the journal
+    if ( format == "raw" || isJournal )  {
+        herr_t status ;
+        const char * whatFailed = "" ;
+        {
+            std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+            status = openRawScanFile(*logFile, isJournal, &whatFailed) ;
+            if (status < 0)  {
+                const char * whatElseFailed = "" ;
+                closeRawScanFile(*logFile, &whatElseFailed) ;
+                if (fileID >= 0)  {
+                    H5Fclose(fileID) ;
+                }
+            }
+        }
+        if (status < 0)  {
+            delete logFile ;
+            checkHDF5(status, whatFailed, fileName) ;
+        }
+    }
+    LOG_FILES.push_back(logFile) ;
+
+    // Start the writer thread, if asynchronous
+    if (queueByteCapacity > 0)  {
+        WriteQueue * queue = new WriteQueue() ;
+        queue->byteCapacity = queueByteCapacity ;
+        queue->queuedByteCount = 0 ;
+        queue->highWaterByteCount = 0 ;
+        queue->backPressureCount = 0 ;
+        queue->backPressureTime = 0.0 ;
+        queue->maxBackPressureTime = 0.0 ;
+        queue->isStopRequested = false ;
+        logFile->queue = queue ;
+        queue->writerThread = std::thread(writeQueuedCommands, logFile) ;
+    }
+
+    // Return the ID
+    plhs[0] = mxCreateNumericMatrix(1, 1, mxUINT32_CLASS, mxREAL) ;
+    *((uint32_t *)mxGetData(plhs[0])) = (uint32_t)(LOG_FILES.size()) ;
+}
+// end of function
+
+
+
+// Read analogChannelCount, digitalChannelCount, expectedScanCount, and optionally
+// scanRate, from prhs[index] on, into sweep.  expectedScanCount can be Inf, which is
+// stored as zero, and scanRate defaults to zero.
+void
+readSweepShapeArguments(int nrhs, const mxArray *prhs[], int index, SweepLayout & sweep)  {
+    // analogChannelCount, digitalChannelCount
+    sweep.analogChannelCount = (hsize_t)readCountArgument(nrhs, prhs, index, "analogChannelCount", 1e6) ;
+    sweep.digitalChannelCount = (hsize_t)readCountArgument(nrhs, prhs, index+1, "digitalChannelCount", 32) ;
+
+    // expectedScanCount, which can be Inf
+    if ( (nrhs>index+2) && mxIsDouble(prhs[index+2]) && mxIsScalar(prhs[index+2]) && mxIsInf(mxGetScalar(prhs[index+2])) &&
+         mxGetScalar(prhs[index+2]) > 0 )  {
+        sweep.expectedScanCount = 0 ;
+    }
+    else  {
+        sweep.expectedScanCount = (hsize_t)readCountArgument(nrhs, prhs, index+2, "expectedScanCount", 1e15) ;
+    }
+
+    // scanRate, optional
+    sweep.scanRate = 0.0 ;
+    if (nrhs>index+3)  {
+        const mxArray * scanRate = prhs[index+3] ;
+        if ( !(mxIsDouble(scanRate) && mxIsScalar(scanRate) && !mxIsComplex(scanRate) && mxGetScalar(scanRate) >= 0 && mxIsFinite(mxGetScalar(scanRate))) )  {
+            mexErrMsgIdAndTxt("ws:logger:badArgument", "scanRate must be a nonnegative double scalar") ;
+        }
+        sweep.scanRate = mxGetScalar(scanRate) ;
+    }
+}
+
+
+
+// StartSweep(logFile, sweepIndex, timestamp, analogChannelCount, digitalChannelCount, expectedScanCount[, scanRate])
+//
+// Create the group for the sweep, write its timestamp, and create its scans datasets.
+// The analogScans dataset is only created if analogChannelCount is nonzero, and likewise
+// digitalScans.  Ends the previous sweep, if that hasn't been done.  expectedScanCount is
+// the number of scans the sweep is expected to have, Inf if that isn't known, and scanRate
+// is in scans per second.  The datasets are laid out based on them, but a sweep can end
+// up with any number of scans.  If the sweep has been prepared (see PrepareSweep), the
+// group and datasets are already there, and only the timestamp is written.
+void
+StartSweep(int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: logFile
+    LogFile & logFile = *LOG_FILES[readLogFileArgument(nrhs, prhs, 1)-1] ;
+    checkWriteQueue(logFile) ;
+
+    // prhs[2]: sweepIndex
+    SweepLayout sweep ;
+    sweep.sweepIndex = (int)readCountArgument(nrhs, prhs, 2, "sweepIndex", 9999) ;
+    if (sweep.sweepIndex == 0)  {
+        mexErrMsgIdAndTxt("ws:logger:badArgument", "sweepIndex must be positive") ;
+    }
+
+    // prhs[3]: timestamp
+    if ( !((nrhs>3) && mxIsDouble(prhs[3]) && mxIsScalar(prhs[3]) && !mxIsComplex(prhs[3])) )  {
+        mexErrMsgIdAndTxt("ws:logger:badArgument", "timestamp must be a double scalar") ;
+    }
+    sweep.timestamp = mxGetScalar(prhs[3]) ;
+
+    // prhs[4]-prhs[7]: analogChannelCount, digitalChannelCount, expectedScanCount, scanRate
+    readSweepShapeArguments(nrhs, prhs, 4, sweep) ;
+
+    // Start it, once the sweep being prepared, if any, is ready
+    joinPreparerThread(logFile) ;
+    logFile.sweep = SweepLayout() ;  // in case of error
+    writeOrQueueCommand(logFile, START_SWEEP, sweep, NULL, NULL) ;
+    logFile.sweep = sweep ;
+}
+// end of function
+
+
+
+// PrepareSweep(logFile, sweepIndex, analogChannelCount, digitalChannelCount, expectedScanCount[, scanRate])
+//
+// Create the group and datasets of a sweep that's to come, in the background, so that when
+// StartSweep is called for it, with the same arguments, it only has to write the
+// timestamp.  For a synchronous file, a thread is started to do it, and for an
+// asynchronous one, it's queued for the writer thread.  Either way, this returns at once.
+// If StartSweep is called for a different sweep, or the same sweep laid out differently,
+// what was prepared is thrown away, as it is if the file is closed first.  Preparing one
+// sweep throws away any other that's been prepared.  Does nothing for a raw file, where
+// starting a sweep is cheap anyway.
+void
+PrepareSweep(int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: logFile
+    LogFile & logFile = *LOG_FILES[readLogFileArgument(nrhs, prhs, 1)-1] ;
+    checkWriteQueue(logFile) ;
+
+    // prhs[2]: sweepIndex
+    SweepLayout sweep ;
+    sweep.sweepIndex = (int)readCountArgument(nrhs, prhs, 2, "sweepIndex", 9999) ;
+    if (sweep.sweepIndex == 0)  {
+        mexErrMsgIdAndTxt("ws:logger:badArgument", "sweepIndex must be positive") ;
+    }
+    sweep.timestamp = 0.0 ;
+
+    // prhs[3]-prhs[6]: analogChannelCount, digitalChannelCount, expectedScanCount, scanRate
+    readSweepShapeArguments(nrhs, prhs, 3, sweep) ;
+
+    // Prepare it
+    if (logFile.raw)  {
+        return ;
+    }
+    if (logFile.queue)  {
+        writeOrQueueCommand(logFile, PREPARE_SWEEP, sweep, NULL, NULL) ;
+    }
+    else  {
+        joinPreparerThread(logFile) ;
+        logFile.preparerThread = std::thread(prepareSweepInBackground, &logFile, sweep) ;
+    }
+}
+// end of function
+
+
+
+// Check that scans is empty, or an nScans x channelCount array of the given class.  A
+// channelCount of zero means the sweep has no dataset for the scans.
+void
+checkScansArgument(const mxArray * scans, mxClassID classID, hsize_t channelCount, const char * argumentName)  {
+    if (mxIsEmpty(scans))  {
+        return ;
+    }
+    if (channelCount == 0)  {
+        mexErrMsgIdAndTxt("ws:logger:badArgument", "%s must be empty, since the sweep has no dataset for it", argumentName) ;
+    }
+    if ( mxGetClassID(scans) != classID || mxIsComplex(scans) || mxGetNumberOfDimensions(scans) != 2 ||
+         mxGetN(scans) != channelCount )  {
+        mexErrMsgIdAndTxt("ws:logger:badArgument", "%s must be a %s array with %d columns",
+                          argumentName, (classID == mxINT16_CLASS) ? "int16" : "unsigned integer", (int)(channelCount)) ;
+    }
+}
+
+
+
+// AppendScans(logFile, rawAnalogData, rawDigitalData)
+//
+// Append a block of scans to the current sweep.  rawAnalogData is nScans x
+// analogChannelCount int16, rawDigitalData nScans x 1, of the digitalScans dataset's
+// type.  Either can be empty.  For a raw file, where the two are interleaved, each must
+// have the same number of scans, unless the sweep has no channels of its kind.
+void
+AppendScans(int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: logFile
+    LogFile & logFile = *LOG_FILES[readLogFileArgument(nrhs, prhs, 1)-1] ;
+    checkWriteQueue(logFile) ;
+    const SweepLayout & sweep = logFile.sweep ;
+    if (sweep.sweepIndex == 0)  {
+        mexErrMsgIdAndTxt("ws:logger:noSweep", "There is no sweep to append scans to") ;
+    }
+
+    // prhs[2]: rawAnalogData, prhs[3]: rawDigitalData
+    if (nrhs < 4)  {
+        mexErrMsgIdAndTxt("ws:logger:badArgument", "rawAnalogData and rawDigitalData are both needed") ;
+    }
+    checkScansArgument(prhs[2], mxINT16_CLASS, sweep.analogChannelCount, "rawAnalogData") ;
+    checkScansArgument(prhs[3], digitalScansClassID(sweep.digitalChannelCount), (sweep.digitalChannelCount>0) ? 1 : 0, "rawDigitalData") ;
+    if ( logFile.raw && sweep.analogChannelCount>0 && sweep.digitalChannelCount>0 && scanCount(prhs[2])!=scanCount(prhs[3]) )  {
+        mexErrMsgIdAndTxt("ws:logger:badArgument", "rawAnalogData and rawDigitalData must have the same number of scans") ;
+    }
+
+    // Append them
+    if ( !mxIsEmpty(prhs[2]) || !mxIsEmpty(prhs[3]) )  {
+        writeOrQueueCommand(logFile, APPEND_SCANS, sweep, prhs[2], prhs[3]) ;
+    }
+}
+// end of function
+
+
+
+// EndSweep(logFile)
+//
+// Close the current sweep's datasets, and flush the file to disk.  Does nothing if there's
+// no current sweep.  If the file is asynchronous, this is queued like everything else, so
+// doesn't wait for the disk.
+void
+EndSweep(int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: logFile
+    LogFile & logFile = *LOG_FILES[readLogFileArgument(nrhs, prhs, 1)-1] ;
+    checkWriteQueue(logFile) ;
+    if (logFile.sweep.sweepIndex != 0)  {
+        logFile.sweep = SweepLayout() ;
+        writeOrQueueCommand(logFile, END_SWEEP, logFile.sweep, NULL, NULL) ;
+    }
+}
+// end of function
+
+
+
+// CloseFile(logFile)
+//
+// End the current sweep, if any, and close the file.  If the file is asynchronous, first
+// waits for everything queued to be written.  The logFile is no longer valid after, even
+// if this errors.
+void
+CloseFile(int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: logFile
+    uint32_t logFileID = readLogFileArgument(nrhs, prhs, 1) ;
+    std::string errorMessage ;
+    if (closeLogFile(logFileID, errorMessage) < 0)  {
+        mexErrMsgIdAndTxt("ws:logger:hdf5Error", "%s", errorMessage.c_str()) ;
+    }
+}
+// end of function
+
+
+
+// Read byteCount bytes at offset from the file.  Returns false if that fails.
+bool
+readFileAt(FILE * file, uint64_t offset, char * bytes, size_t byteCount)  {
+#ifdef _WIN32
+    if (_fseeki64(file, (__int64)(offset), SEEK_SET) != 0)  {
+#else
+    if (fseeko(file, (off_t)(offset), SEEK_SET) != 0)  {
+#endif
+        return false ;
+    }
+    return fread(bytes, 1, byteCount, file) == byteCount ;
+}
+
+
+
+// Make sure the file, which must exist, is on disk.  Returns false if that fails.
+bool
+syncFileNamed(const std::string & fileName)  {
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(fileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL) ;
+#else
+    int handle = open(fileName.c_str(), O_WRONLY) ;
+#endif
+    if (handle == INVALID_RAW_FILE_HANDLE)  {
+        return false ;
+    }
+    bool result = syncRawFile(handle) ;
+    closeRawFileHandle(handle) ;
+    return result ;
+}
+
+
+
+// Rename the file, replacing newFileName if it exists.  Returns false if that fails.
+bool
+replaceFile(const std::string & fileName, const std::string & newFileName)  {
+#ifdef _WIN32
+    return MoveFileExA(fileName.c_str(), newFileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0 ;
+#else
+    return rename(fileName.c_str(), newFileName.c_str()) == 0 ;
+#endif
+}
+
+
+
+// Copy the file to newFileName, replacing it if it exists.  Returns false if that fails.
+bool
+copyFile(const std::string & fileName, const std::string & newFileName)  {
+    FILE * file = fopen(fileName.c_str(), "rb") ;
+    if (!file)  {
+        return false ;
+    }
+    FILE * newFile = fopen(newFileName.c_str(), "wb") ;
+    bool isOK = (newFile != NULL) ;
+    std::vector<char> buffer(1024*1024) ;
+    while (isOK)  {
+        size_t byteCount = fread(buffer.data(), 1, buffer.size(), file) ;
+        isOK = (byteCount == 0 || fwrite(buffer.data(), byteCount, 1, newFile) == 1) ;
+        if (byteCount < buffer.size())  {
+            isOK = isOK && !ferror(file) ;
+            break ;
+        }
+    }
+    fclose(file) ;
+    if (newFile)  {
+        isOK = (fclose(newFile) == 0) && isOK ;
+    }
+    return isOK ;
+}
+
+
+
+// Set up logFile for turning a raw-format or journaled data file into an ordinary one,
+// with the scans datasets compressed if isCompressed, and overviews if doWriteOverviews.
+// Doesn't open the HDF5 file.
+void
+setUpLogFileForConversion(LogFile & logFile, const std::string & fileName, bool isCompressed, bool doWriteOverviews)  {
+    logFile.fileName = fileName ;
+    logFile.fileID = -1 ;
+    logFile.sweep = SweepLayout() ;
+    logFile.sweepGroupID = -1 ;
+    logFile.sweepTimestampID = -1 ;
+    logFile.analogScans = closedScanDataset() ;
+    logFile.digitalScans = closedScanDataset() ;
+    for (int k = 0; k < OVERVIEW_LEVEL_COUNT; ++k)  {
+        logFile.overviews[k].dataset = closedScanDataset() ;
+    }
+    logFile.prepared = unpreparedSweep() ;
+    logFile.queue = (WriteQueue *)(0) ;
+    logFile.raw = (RawScanFile *)(0) ;
+    logFile.isCompressed = isCompressed ;
+    logFile.doWriteOverviews = doWriteOverviews ;
+    logFile.layoutPolicy = ADAPTIVE_LAYOUT ;
+    logFile.fileSystemBlockByteCount = fileSystemBlockByteCount(fileName) ;
+}
+
+
+
+// Split scanCount scans of the sweep, interleaved as in a raw scan file, into analogScans,
+// nScans x analogChannelCount int16, and digitalScans, nScans x 1 of the digitalScans
+// dataset's type, both as in Matlab, and append them to the sweep's datasets, and its
+// overview.  Returns a negative value if that fails, setting *whatFailed.
+herr_t
+appendInterleavedScans(LogFile & logFile, const SweepLayout & sweep, const int16_t * interleaved, hsize_t scanCount,
+                       std::vector<int16_t> & analogScans, std::vector<char> & digitalScans, const char ** whatFailed)  {
+    const hsize_t nAnalog = sweep.analogChannelCount ;
+    const hsize_t digitalWordCount = rawDigitalWordCount(sweep.digitalChannelCount) ;
+    const hsize_t scanWordCount = nAnalog + digitalWordCount ;
+    const size_t digitalElementSize = H5Tget_size(digitalScansTypeID(sweep.digitalChannelCount)) ;
+    analogScans.resize((size_t)(scanCount * nAnalog)) ;
+    for (hsize_t c = 0; c < nAnalog; ++c)  {
+        for (hsize_t i = 0; i < scanCount; ++i)  {
+            analogScans[(size_t)(c*scanCount + i)] = interleaved[(size_t)(i*scanWordCount + c)] ;
+        }
+    }
+    digitalScans.resize((size_t)(scanCount * digitalElementSize)) ;
+    if (digitalWordCount > 0)  {
+        for (hsize_t i = 0; i < scanCount; ++i)  {
+            const int16_t * wordInScan = &interleaved[(size_t)(i*scanWordCount + nAnalog)] ;
+            uint32_t word = (uint16_t)(wordInScan[0]) ;
+            if (digitalWordCount > 1)  {
+                word |= ((uint32_t)(uint16_t)(wordInScan[1])) << 16 ;
+            }
+            memcpy(&digitalScans[(size_t)(i*digitalElementSize)], &word, digitalElementSize) ;  // little-endian
+        }
+    }
+    if ( appendToScanDataset(logFile.analogScans, analogScans.data(), (nAnalog>0) ? scanCount : 0, whatFailed) < 0 ||
+         appendToOverviews(logFile, analogScans.data(), (nAnalog>0) ? scanCount : 0, false, whatFailed) < 0 )  {
+        return -1 ;
+    }
+    return appendToScanDataset(logFile.digitalScans, digitalScans.data(), (digitalWordCount>0) ? scanCount : 0, whatFailed) ;
+}
+
+
+
+// Turn the raw-format data file into an ordinary one, with a /sweep_%04d group per sweep
+// in the index, then delete the index and the .dat file.  The scans datasets are
+// compressed if isCompressed, and each sweep gets an overview if doWriteOverviews.  The
+// conversion is done in a copy of the file, fileName.converting, which is only put in
+// place of the data file once it's complete, so that if it fails partway, the data file is
+// as it was, and it can just be done again.  Caller must hold HDF5_MUTEX.  Sets isRaw to
+// false, and does nothing, if the file isn't in raw format.  Returns false if anything
+// failed, setting errorMessage.
+bool
+convertRawFile(const std::string & fileName, bool isCompressed, bool doWriteOverviews, bool & isRaw, std::string & errorMessage)  {
+    isRaw = false ;
+    hid_t fileID = H5Fopen(fileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) ;
+    if (fileID < 0)  {
+        errorMessage = "Unable to open data file " + fileName ;
+        return false ;
+    }
+    isRaw = (H5Lexists(fileID, "/rawScans", H5P_DEFAULT) > 0) ;
+    H5Fclose(fileID) ;
+    if (!isRaw)  {
+        return true ;
+    }
+
+    // Work in a copy.  Until it's converted, the data file is just the header and the index,
+    // so this is quick.
+    std::string convertingFileName = fileName + ".converting" ;
+    LogFile logFile ;
+    setUpLogFileForConversion(logFile, convertingFileName, isCompressed, doWriteOverviews) ;
+    if (copyFile(fileName, convertingFileName))  {
+        logFile.fileID = H5Fopen(convertingFileName.c_str(), H5F_ACC_RDWR, H5P_DEFAULT) ;
+    }
+    if (logFile.fileID < 0)  {
+        remove(convertingFileName.c_str()) ;
+        errorMessage = "Unable to copy data file " + fileName + " to " + convertingFileName ;
+        return false ;
+    }
+
+    // Read the .dat file name, and the index
+    std::string dataFileName ;
+    std::vector<double> index ;
+    hsize_t sweepCount = 0 ;
+    hid_t attributeID = H5Aopen_by_name(logFile.fileID, "/rawScans", "dataFileName", H5P_DEFAULT, H5P_DEFAULT) ;
+    hid_t indexID = H5Dopen2(logFile.fileID, "/rawScans/index", H5P_DEFAULT) ;
+    bool isOK = (attributeID >= 0 && indexID >= 0) ;
+    if (isOK)  {
+        hid_t typeID = H5Aget_type(attributeID) ;
+        std::vector<char> name(H5Tget_size(typeID)+1, '\0') ;
+        isOK = (H5Aread(attributeID, typeID, name.data()) >= 0) ;
+        H5Tclose(typeID) ;
+        dataFileName = fileName.substr(0, fileName.size() - leafFileName(fileName).size()) + std::string(name.data()) ;
+    }
+    if (isOK)  {
+        hid_t spaceID = H5Dget_space(indexID) ;
+        hsize_t dims[2] = { 0, 0 } ;
+        isOK = (H5Sget_simple_extent_dims(spaceID, dims, NULL) == 2 && dims[0] == 6) ;
+        H5Sclose(spaceID) ;
+        sweepCount = dims[1] ;
+        index.resize((size_t)(6*sweepCount)) ;
+        isOK = isOK && (sweepCount == 0 || H5Dread(indexID, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, index.data()) >= 0) ;
+    }
+    if (attributeID >= 0)  {
+        H5Aclose(attributeID) ;
+    }
+    if (indexID >= 0)  {
+        H5Dclose(indexID) ;
+    }
+    if (!isOK)  {
+        H5Fclose(logFile.fileID) ;
+        remove(convertingFileName.c_str()) ;
+        errorMessage = "Unable to read the raw scans index in data file " + fileName ;
+        return false ;
+    }
+
+    // Copy each sweep from the .dat file to the datasets of an ordinary data file
+    FILE * dataFile = (sweepCount > 0) ? fopen(dataFileName.c_str(), "rb") : (FILE *)(0) ;
+    if ( sweepCount > 0 && !dataFile )  {
+        H5Fclose(logFile.fileID) ;
+        remove(convertingFileName.c_str()) ;
+        errorMessage = "Unable to open raw scans file " + dataFileName ;
+        return false ;
+    }
+    std::vector<int16_t> interleaved ;
+    std::vector<int16_t> analogScans ;
+    std::vector<uint32_t> digitalWords ;
+    std::vector<char> digitalScans ;
+    const char * whatFailed = "" ;
+    for (hsize_t k = 0; k < sweepCount && isOK; ++k)  {
+        // The index is nSweeps x 6 to Matlab, so 6 x nSweeps to HDF5, so column j of the
+        // index is row j here
+        const double * row = &index[(size_t)(k)] ;
+        SweepLayout sweep ;
+        sweep.sweepIndex = (int)(row[0]) ;
+        sweep.timestamp = row[sweepCount] ;
+        uint64_t byteOffset = (uint64_t)(row[2*sweepCount]) ;
+        hsize_t sweepScanCount = (hsize_t)(row[3*sweepCount]) ;
+        sweep.analogChannelCount = (hsize_t)(row[4*sweepCount]) ;
+        sweep.digitalChannelCount = (hsize_t)(row[5*sweepCount]) ;
+        sweep.expectedScanCount = sweepScanCount ;
+        sweep.scanRate = 0.0 ;
+        const hsize_t scanWordCount = sweep.analogChannelCount + rawDigitalWordCount(sweep.digitalChannelCount) ;
+        if (startSweep(logFile, sweep, &whatFailed) < 0)  {
+            isOK = false ;
+            break ;
+        }
+        for (hsize_t firstScan = 0; firstScan < sweepScanCount; firstScan += RAW_CONVERSION_SCAN_COUNT)  {
+            hsize_t blockSize = std::min<hsize_t>(RAW_CONVERSION_SCAN_COUNT, sweepScanCount - firstScan) ;
+            interleaved.resize((size_t)(blockSize * scanWordCount)) ;
+            if (!readFileAt(dataFile, byteOffset + firstScan*scanWordCount*sizeof(int16_t), (char *)(interleaved.data()),
+                            (size_t)(blockSize * scanWordCount * sizeof(int16_t))))  {
+                errorMessage = "Unable to read raw scans file " + dataFileName ;
+                isOK = false ;
+                break ;
+            }
+            if (appendInterleavedScans(logFile, sweep, interleaved.data(), blockSize, analogScans, digitalScans, &whatFailed) < 0)  {
+                isOK = false ;
+                break ;
+            }
+        }
+        if ( isOK && endSweep(logFile, &whatFailed) < 0 )  {
+            isOK = false ;
+        }
+    }
+    if (dataFile)  {
+        fclose(dataFile) ;
+    }
+    if ( isOK && H5Ldelete(logFile.fileID, "/rawScans", H5P_DEFAULT) < 0 )  {
+        whatFailed = "delete the raw scans index" ;
+        isOK = false ;
+    }
+    const char * whatElseFailed = "" ;
+    endSweep(logFile, &whatElseFailed) ;
+    if ( H5Fclose(logFile.fileID) < 0 && isOK )  {
+        whatFailed = "close the file" ;
+        isOK = false ;
+    }
+    if ( isOK && !( syncFileNamed(convertingFileName) && replaceFile(convertingFileName, fileName) ) )  {
+        whatFailed = "replace the data file with the one converted" ;
+        isOK = false ;
+    }
+    if (!isOK)  {
+        remove(convertingFileName.c_str()) ;
+        if (errorMessage.empty())  {
+            errorMessage = std::string("Unable to ") + whatFailed + " in data file " + fileName ;
+        }
+        return false ;
+    }
+    remove(dataFileName.c_str()) ;
+    return true ;
+}
+
+
+
+// Read the next record of the journal, which should be numbered sequenceNumber, into
+// header and payload, which gets the payload's padding too.  byteCountLeft is the number
+// of bytes left in the journal, and is decremented by the record's size.  Returns false,
+// without reading anything, if there's no intact record to read, as at the end of the
+// journal, or where a crash cut it short.
+bool
+readJournalRecord(FILE * journal, uint64_t sequenceNumber, uint64_t & byteCountLeft, JournalRecordHeader & header,
+                  std::vector<char> & payload)  {
+    if ( byteCountLeft < sizeof(header) || fread(&header, sizeof(header), 1, journal) != 1 )  {
+        return false ;
+    }
+    uint64_t paddedByteCount = paddedJournalPayloadByteCount(header.payloadByteCount) ;
+    if ( header.magic != JOURNAL_RECORD_MAGIC || header.sequenceNumber != sequenceNumber ||
+         header.payloadByteCount > MAXIMUM_JOURNAL_PAYLOAD_BYTE_COUNT || paddedByteCount > byteCountLeft - sizeof(header) )  {
+        return false ;
+    }
+    payload.resize((size_t)(paddedByteCount)) ;
+    if ( paddedByteCount > 0 && fread(payload.data(), (size_t)(paddedByteCount), 1, journal) != 1 )  {
+        return false ;
+    }
+    uint64_t checksum[2] ;
+    journalRecordChecksum(header, payload.data(), checksum) ;
+    if ( checksum[0] != header.checksum[0] || checksum[1] != header.checksum[1] )  {
+        return false ;
+    }
+    byteCountLeft -= sizeof(header) + paddedByteCount ;
+    return true ;
+}
+
+
+
+// Rebuild the journaled data file from its journal: write the HDF5 file as it was when the
+// journal was opened to fileName.recovering, add a /sweep_%04d group per sweep in the
+// journal, with the scans datasets compressed if isCompressed, and an overview if
+// doWriteOverviews, then put it in place of the data file, and delete the journal.  The journal is read up to the last intact record,
+// and a sweep the journal doesn't end is ended there.  So that a crash during this can't
+// lose anything either, the journal is only deleted once the rebuilt file is on disk, and
+// doing it again gives the same file.  Sets sweepCount to the number of sweeps, and
+// isComplete to whether the journal was closed normally, with all its sweeps ended.
+// Caller must hold HDF5_MUTEX.  Sets isJournaled to false, and does nothing, if the file
+// doesn't have a journal.  Returns false if anything failed, setting errorMessage.
+bool
+replayJournal(const std::string & fileName, bool isCompressed, bool doWriteOverviews, bool & isJournaled, uint64_t & sweepCount,
+              bool & isComplete, std::string & errorMessage)  {
+    isJournaled = false ;
+    sweepCount = 0 ;
+    isComplete = false ;
+    std::string journalFileName = rawScanFileNameFromFileName(fileName, true) ;
+    FILE * journal = fopen(journalFileName.c_str(), "rb") ;
+    if (!journal)  {
+        return true ;
+    }
+    isJournaled = true ;
+#ifdef _WIN32
+    bool isOK = (_fseeki64(journal, 0, SEEK_END) == 0) ;
+    uint64_t byteCountLeft = (uint64_t)(_ftelli64(journal)) ;
+#else
+    bool isOK = (fseeko(journal, 0, SEEK_END) == 0) ;
+    uint64_t byteCountLeft = (uint64_t)(ftello(journal)) ;
+#endif
+    isOK = isOK && readFileAt(journal, 0, (char *)(0), 0) ;
+
+    // Write out the data file as it was
+    JournalRecordHeader header ;
+    std::vector<char> payload ;
+    uint64_t sequenceNumber = 0 ;
+    if ( !isOK || !readJournalRecord(journal, sequenceNumber++, byteCountLeft, header, payload) || header.type != JOURNAL_DATA_FILE )  {
+        fclose(journal) ;
+        errorMessage = "The journal " + journalFileName + " is not a valid journal" ;
+        return false ;
+    }
+    std::string recoveringFileName = fileName + ".recovering" ;
+    FILE * recoveringFile = fopen(recoveringFileName.c_str(), "wb") ;
+    isOK = (recoveringFile != NULL) ;
+    if (isOK)  {
+        isOK = (header.payloadByteCount == 0 || fwrite(payload.data(), (size_t)(header.payloadByteCount), 1, recoveringFile) == 1) ;
+        isOK = (fclose(recoveringFile) == 0) && isOK ;
+    }
+    LogFile logFile ;
+    setUpLogFileForConversion(logFile, recoveringFileName, isCompressed, doWriteOverviews) ;
+    if (isOK)  {
+        logFile.fileID = H5Fopen(recoveringFileName.c_str(), H5F_ACC_RDWR, H5P_DEFAULT) ;
+        isOK = (logFile.fileID >= 0) ;
+    }
+    if (!isOK)  {
+        fclose(journal) ;
+        remove(recoveringFileName.c_str()) ;
+        errorMessage = "Unable to write the data file in the journal " + journalFileName + " to " + recoveringFileName ;
+        return false ;
+    }
+
+    // Add the sweeps
+    SweepLayout sweep = SweepLayout() ;
+    std::vector<int16_t> analogScans ;
+    std::vector<char> digitalScans ;
+    const char * whatFailed = "" ;
+    while ( isOK && readJournalRecord(journal, sequenceNumber, byteCountLeft, header, payload) )  {
+        if ( header.type == JOURNAL_SWEEP_START && header.payloadByteCount == sizeof(JournalSweepStart) )  {
+            JournalSweepStart sweepStart ;
+            memcpy(&sweepStart, payload.data(), sizeof(sweepStart)) ;
+            if ( sweepStart.sweepIndex <= 0 || sweepStart.sweepIndex > 9999 || sweepStart.analogChannelCount > 1000000 ||
+                 sweepStart.digitalChannelCount > 32 )  {
+                break ;
+            }
+            if ( sweep.sweepIndex != 0 && endSweep(logFile, &whatFailed) < 0 )  {
+                isOK = false ;
+                break ;
+            }
+            sweep.sweepIndex = (int)(sweepStart.sweepIndex) ;
+            sweep.timestamp = sweepStart.timestamp ;
+            sweep.analogChannelCount = sweepStart.analogChannelCount ;
+            sweep.digitalChannelCount = sweepStart.digitalChannelCount ;
+            sweep.expectedScanCount = sweepStart.expectedScanCount ;
+            sweep.scanRate = sweepStart.scanRate ;
+            isOK = (startSweep(logFile, sweep, &whatFailed) >= 0) ;
+            ++sweepCount ;
+        }
+        else if ( header.type == JOURNAL_SCANS && sweep.sweepIndex != 0 )  {
+            hsize_t scanByteCount = (sweep.analogChannelCount + rawDigitalWordCount(sweep.digitalChannelCount)) * sizeof(int16_t) ;
+            if ( scanByteCount == 0 || header.payloadByteCount % scanByteCount != 0 )  {
+                break ;
+            }
+            isOK = (appendInterleavedScans(logFile, sweep, (const int16_t *)(payload.data()), header.payloadByteCount / scanByteCount,
+                                           analogScans, digitalScans, &whatFailed) >= 0) ;
+        }
+        else if ( header.type == JOURNAL_SWEEP_END && sweep.sweepIndex != 0 )  {
+            sweep = SweepLayout() ;
+            isOK = (endSweep(logFile, &whatFailed) >= 0) ;
+        }
+        else  {
+            break ;
+        }
+        ++sequenceNumber ;
+    }
+    isComplete = ( byteCountLeft == 0 && sweep.sweepIndex == 0 ) ;
+    fclose(journal) ;
+
+    // Put it in place of the data file
+    const char * whatElseFailed = "" ;
+    if ( endSweep(logFile, isOK ? &whatFailed : &whatElseFailed) < 0 )  {
+        isOK = false ;
+    }
+    if ( H5Fclose(logFile.fileID) < 0 && isOK )  {
+        whatFailed = "close the file" ;
+        isOK = false ;
+    }
+    if ( isOK && !( syncFileNamed(recoveringFileName) && replaceFile(recoveringFileName, fileName) ) )  {
+        whatFailed = "replace the data file with the one rebuilt" ;
+        isOK = false ;
+    }
+    if (!isOK)  {
+        remove(recoveringFileName.c_str()) ;
+        errorMessage = std::string("Unable to ") + whatFailed + " from the journal " + journalFileName ;
+        return false ;
+    }
+    remove(journalFileName.c_str()) ;
+    return true ;
+}
+
+
+
+// wasRaw = ConvertRawFile(fileName[, doCompress[, doWriteOverviews]])
+//
+// Turn a raw-format data file, once closed, into an ordinary one, that ws.loadDataFile()
+// can read, and delete its .dat file.  If doCompress is true, the scans datasets are
+// compressed, as for the 'compressed' format, and if doWriteOverviews is true, each sweep
+// gets an overview, as if OpenFile had been asked for them.  wasRaw is false, and the file is left
+// alone, if it isn't in raw format.
+void
+ConvertRawFile(int /*nlhs*/, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: fileName
+    std::string fileName = readStringArgument(nrhs, prhs, 1, "fileName") ;
+
+    // prhs[2]: doCompress, optional
+    bool doCompress = readOptionalLogicalArgument(nrhs, prhs, 2, "doCompress") ;
+
+    // prhs[3]: doWriteOverviews, optional
+    bool doWriteOverviews = readOptionalLogicalArgument(nrhs, prhs, 3, "doWriteOverviews") ;
+
+    // Convert it
+    bool isRaw ;
+    bool isOK ;
+    std::string errorMessage ;
+    {
+        std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+        isOK = convertRawFile(fileName, doCompress, doWriteOverviews, isRaw, errorMessage) ;
+    }
+    if (!isOK)  {
+        mexErrMsgIdAndTxt("ws:logger:conversionFailed", "%s", errorMessage.c_str()) ;
+    }
+
+    // Return output data
+    plhs[0] = mxCreateLogicalScalar(isRaw) ;
+}
+// end of function
+
+
+
+// [wasJournaled, sweepCount, wasComplete] = ReplayJournal(fileName[, doCompress[, doWriteOverviews]])
+//
+// Rebuild a journaled data file from its .journal file, whether it was closed or the
+// program writing it crashed, and delete the journal.  The file is then an ordinary one,
+// that ws.loadDataFile() can read, with the scans datasets compressed if doCompress is
+// true, and an overview of each sweep if doWriteOverviews is true.  sweepCount is the number of sweeps recovered, and wasComplete is false if the
+// journal was cut short, in which case the last sweep may be missing scans.  wasJournaled
+// is false, and the file is left alone, if it doesn't have a journal.
+void
+ReplayJournal(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: fileName
+    std::string fileName = readStringArgument(nrhs, prhs, 1, "fileName") ;
+
+    // prhs[2]: doCompress, optional
+    bool doCompress = readOptionalLogicalArgument(nrhs, prhs, 2, "doCompress") ;
+
+    // prhs[3]: doWriteOverviews, optional
+    bool doWriteOverviews = readOptionalLogicalArgument(nrhs, prhs, 3, "doWriteOverviews") ;
+
+    // Replay it
+    bool isJournaled ;
+    uint64_t sweepCount ;
+    bool isComplete ;
+    bool isOK ;
+    std::string errorMessage ;
+    {
+        std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+        isOK = replayJournal(fileName, doCompress, doWriteOverviews, isJournaled, sweepCount, isComplete, errorMessage) ;
+    }
+    if (!isOK)  {
+        mexErrMsgIdAndTxt("ws:logger:replayFailed", "%s", errorMessage.c_str()) ;
+    }
+
+    // Return output data
+    plhs[0] = mxCreateLogicalScalar(isJournaled) ;
+    if (nlhs>1)  {
+        plhs[1] = mxCreateDoubleScalar((double)(sweepCount)) ;
+    }
+    if (nlhs>2)  {
+        plhs[2] = mxCreateLogicalScalar(isComplete) ;
+    }
+}
+// end of function
+
+
+
+// [queuedByteCount, highWaterByteCount, backPressureCount, backPressureTime, maxBackPressureTime] = GetQueueStatus(logFile)
+//
+// The state of an asynchronous log file's write queue.  queuedByteCount is the bytes of
+// scans queued but not yet written, and highWaterByteCount the most there have been.
+// backPressureCount is the number of appends that had to wait for space in the queue,
+// backPressureTime the total time they waited, and maxBackPressureTime the longest any
+// waited, in seconds.  Raises the writer thread's error, if any.
+void
+GetQueueStatus(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: logFile
+    LogFile & logFile = *LOG_FILES[readLogFileArgument(nrhs, prhs, 1)-1] ;
+    if (!logFile.queue)  {
+        mexErrMsgIdAndTxt("ws:logger:notAsynchronous", "The log file is not written asynchronously") ;
+    }
+    checkWriteQueue(logFile) ;
+
+    size_t queuedByteCount ;
+    size_t highWaterByteCount ;
+    uint64_t backPressureCount ;
+    double backPressureTime ;
+    double maxBackPressureTime ;
+    {
+        std::lock_guard<std::mutex> lock(logFile.queue->mutex) ;
+        queuedByteCount = logFile.queue->queuedByteCount ;
+        highWaterByteCount = logFile.queue->highWaterByteCount ;
+        backPressureCount = logFile.queue->backPressureCount ;
+        backPressureTime = logFile.queue->backPressureTime ;
+        maxBackPressureTime = logFile.queue->maxBackPressureTime ;
+    }
+
+    // Return output data
+    plhs[0] = mxCreateDoubleScalar((double)(queuedByteCount)) ;
+    if (nlhs>1)  {
+        plhs[1] = mxCreateDoubleScalar((double)(highWaterByteCount)) ;
+    }
+    if (nlhs>2)  {
+        plhs[2] = mxCreateDoubleScalar((double)(backPressureCount)) ;
+    }
+    if (nlhs>3)  {
+        plhs[3] = mxCreateDoubleScalar(backPressureTime) ;
+    }
+    if (nlhs>4)  {
+        plhs[4] = mxCreateDoubleScalar(maxBackPressureTime) ;
+    }
+}
+// end of function
+
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // Dispatch on the 'method' name
+    if ( nrhs<1 || !mxIsChar(prhs[0]) )  {
+        mexErrMsgIdAndTxt("ws:logger:argNotAString",
+                          "First argument to ws.logger() must be a string.") ;
+    }
+
+    // Keep the DLL in memory after exit, so that this function acts as a poor man's
+    // Singleton object, and we can keep the files open
+    if (!mexIsLocked())  {
+        initialize() ;
+    }
+
+    char* actionAsCharPtr = mxArrayToString(prhs[0]) ;
+    std::string action(actionAsCharPtr) ;
+    mxFree(actionAsCharPtr) ;
+
+    if (action == "AppendScans")  {
+        AppendScans(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "StartSweep")  {
+        StartSweep(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "EndSweep")  {
+        EndSweep(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "PrepareSweep")  {
+        PrepareSweep(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "GetQueueStatus")  {
+        GetQueueStatus(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "OpenFile")  {
+        OpenFile(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "CloseFile")  {
+        CloseFile(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "ConvertRawFile")  {
+        ConvertRawFile(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "ReplayJournal")  {
+        ReplayJournal(nlhs, plhs, nrhs, prhs) ;
+    }
+    else  {
+        // Doesn't match anything, so error
+        mexErrMsgIdAndTxt("ws:logger:noSuchMethod",
+                          "ws.logger() doesn't recognize method name %s", action.c_str()) ;
+    }
+}
+// end of function
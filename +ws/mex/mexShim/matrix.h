@@ -0,0 +1,119 @@
+// A minimal stand-in for MATLAB's matrix.h, declaring the subset of the mxArray API 
+// used by the MEX kernels in +ws/mex.  Implemented in mexShim.cpp.  This lets the 
+// kernels be built as plain native libraries, for benchmarking and profiling outside 
+// of Matlab.  It is not used when building the actual MEX files.
+//
+// Arrays are stored column-major, like in Matlab.  Complex arrays, sparse arrays, and 
+// objects are not supported.
+
+#ifndef ___ws_mex_shim_matrix_h___
+#define ___ws_mex_shim_matrix_h___
+
+#include <cstddef>
+#include <stdint.h>
+
+typedef size_t mwSize ;
+typedef size_t mwIndex ;
+typedef ptrdiff_t mwSignedIndex ;
+typedef uint16_t mxChar ;
+typedef bool mxLogical ;
+
+typedef enum {
+    mxUNKNOWN_CLASS = 0,
+    mxCELL_CLASS,
+    mxSTRUCT_CLASS,
+    mxLOGICAL_CLASS,
+    mxCHAR_CLASS,
+    mxVOID_CLASS,
+    mxDOUBLE_CLASS,
+    mxSINGLE_CLASS,
+    mxINT8_CLASS,
+    mxUINT8_CLASS,
+    mxINT16_CLASS,
+    mxUINT16_CLASS,
+    mxINT32_CLASS,
+    mxUINT32_CLASS,
+    mxINT64_CLASS,
+    mxUINT64_CLASS,
+    mxFUNCTION_CLASS
+} mxClassID ;
+
+typedef enum { mxREAL = 0, mxCOMPLEX } mxComplexity ;
+
+struct mxArray_tag ;
+typedef struct mxArray_tag mxArray ;
+
+// Memory
+void * mxMalloc(size_t n) ;
+void * mxCalloc(size_t n, size_t size) ;
+void mxFree(void * ptr) ;
+
+// Creation and destruction
+mxArray * mxCreateNumericMatrix(mwSize m, mwSize n, mxClassID classID, mxComplexity complexity) ;
+mxArray * mxCreateNumericArray(mwSize ndim, const mwSize * dims, mxClassID classID, mxComplexity complexity) ;
+mxArray * mxCreateDoubleMatrix(mwSize m, mwSize n, mxComplexity complexity) ;
+mxArray * mxCreateDoubleScalar(double value) ;
+mxArray * mxCreateLogicalMatrix(mwSize m, mwSize n) ;
+mxArray * mxCreateLogicalScalar(bool value) ;
+mxArray * mxCreateString(const char * str) ;
+mxArray * mxCreateCellMatrix(mwSize m, mwSize n) ;
+mxArray * mxCreateStructMatrix(mwSize m, mwSize n, int nfields, const char ** fieldnames) ;
+mxArray * mxDuplicateArray(const mxArray * pa) ;
+void mxDestroyArray(mxArray * pa) ;
+
+// Size and type
+mxClassID mxGetClassID(const mxArray * pa) ;
+const char * mxGetClassName(const mxArray * pa) ;
+mwSize mxGetM(const mxArray * pa) ;
+mwSize mxGetN(const mxArray * pa) ;
+void mxSetM(mxArray * pa, mwSize m) ;
+void mxSetN(mxArray * pa, mwSize n) ;
+mwSize mxGetNumberOfDimensions(const mxArray * pa) ;
+const mwSize * mxGetDimensions(const mxArray * pa) ;
+size_t mxGetNumberOfElements(const mxArray * pa) ;
+size_t mxGetElementSize(const mxArray * pa) ;
+bool mxIsClass(const mxArray * pa, const char * name) ;
+bool mxIsNumeric(const mxArray * pa) ;
+bool mxIsDouble(const mxArray * pa) ;
+bool mxIsSingle(const mxArray * pa) ;
+bool mxIsInt16(const mxArray * pa) ;
+bool mxIsUint8(const mxArray * pa) ;
+bool mxIsUint16(const mxArray * pa) ;
+bool mxIsUint32(const mxArray * pa) ;
+bool mxIsUint64(const mxArray * pa) ;
+bool mxIsLogical(const mxArray * pa) ;
+bool mxIsChar(const mxArray * pa) ;
+bool mxIsCell(const mxArray * pa) ;
+bool mxIsStruct(const mxArray * pa) ;
+bool mxIsComplex(const mxArray * pa) ;
+bool mxIsEmpty(const mxArray * pa) ;
+bool mxIsScalar(const mxArray * pa) ;
+
+// Data
+void * mxGetData(const mxArray * pa) ;
+double * mxGetPr(const mxArray * pa) ;
+mxLogical * mxGetLogicals(const mxArray * pa) ;
+mxChar * mxGetChars(const mxArray * pa) ;
+double mxGetScalar(const mxArray * pa) ;
+char * mxArrayToString(const mxArray * pa) ;
+int mxGetString(const mxArray * pa, char * buf, mwSize buflen) ;
+
+// Special values
+double mxGetInf(void) ;
+double mxGetNaN(void) ;
+bool mxIsInf(double value) ;
+bool mxIsFinite(double value) ;
+
+// Cells and structs
+mxArray * mxGetCell(const mxArray * pa, mwIndex i) ;
+void mxSetCell(mxArray * pa, mwIndex i, mxArray * value) ;
+int mxGetNumberOfFields(const mxArray * pa) ;
+const char * mxGetFieldNameByNumber(const mxArray * pa, int n) ;
+mxArray * mxGetField(const mxArray * pa, mwIndex i, const char * fieldname) ;
+void mxSetField(mxArray * pa, mwIndex i, const char * fieldname, mxArray * value) ;
+
+// Objects.  Only works for the exceptions returned by mexCallMATLABWithTrap(), which 
+// are structs in the shim.
+mxArray * mxGetProperty(const mxArray * pa, mwIndex i, const char * propname) ;
+
+#endif // ___ws_mex_shim_matrix_h___
@@ -0,0 +1,59 @@
+// A minimal stand-in for MATLAB's mex.h, declaring the subset of the mex API used by 
+// the MEX kernels in +ws/mex.  Implemented in mexShim.cpp.  See matrix.h.
+//
+// mexErrMsgIdAndTxt() and mexErrMsgTxt() throw a MexShimError, which the code calling 
+// the kernel's mexFunction() should catch.  Function handles can be made from C++ 
+// functions with mexShimCreateFunctionHandle(), and are called by mexCallMATLAB() 
+// and mexCallMATLABWithTrap() when the function name is "feval".
+
+#ifndef ___ws_mex_shim_mex_h___
+#define ___ws_mex_shim_mex_h___
+
+#include <stdexcept>
+#include <string>
+#include <functional>
+#include "matrix.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) ;
+
+[[noreturn]] void mexErrMsgIdAndTxt(const char * identifier, const char * format, ...) ;
+[[noreturn]] void mexErrMsgTxt(const char * message) ;
+void mexWarnMsgIdAndTxt(const char * identifier, const char * format, ...) ;
+int mexPrintf(const char * format, ...) ;
+int mexEvalString(const char * command) ;  // does nothing, since there's no Matlab to evaluate it
+
+void mexLock(void) ;
+void mexUnlock(void) ;
+bool mexIsLocked(void) ;
+int mexAtExit(void (*exitFunction)(void)) ;
+void mexMakeArrayPersistent(mxArray * pa) ;
+
+int mexCallMATLAB(int nlhs, mxArray *plhs[], int nrhs, mxArray *prhs[], const char * functionName) ;
+mxArray * mexCallMATLABWithTrap(int nlhs, mxArray *plhs[], int nrhs, mxArray *prhs[], const char * functionName) ;
+
+
+
+//
+// Not part of the mex API
+//
+
+// What mexErrMsgIdAndTxt() and mexErrMsgTxt() throw
+class MexShimError : public std::runtime_error  {
+public:
+    MexShimError(const std::string & identifier, const std::string & message) : 
+        std::runtime_error(message), identifier_(identifier)  {}
+    const std::string & identifier() const  { return identifier_ ; }
+private:
+    std::string identifier_ ;
+} ;
+
+typedef std::function<void (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])> MexShimFunction ;
+
+// Make a function handle array that calls the given function when feval'ed
+mxArray * mexShimCreateFunctionHandle(const MexShimFunction & function) ;
+
+// Call the functions registered with mexAtExit(), as Matlab does when a MEX file is 
+// cleared, and clear the lock
+void mexShimCallAtExitFunctions(void) ;
+
+#endif // ___ws_mex_shim_mex_h___
@@ -0,0 +1,565 @@
+// Implementation of the minimal mex/mxArray API declared in mex.h and matrix.h.  See
+// the comments there.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <limits>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "mex.h"
+
+struct mxArray_tag  {
+    mxClassID classID ;
+    std::vector<mwSize> dims ;
+    void * data ;  // for numeric, logical, and char arrays, allocated with calloc()
+    std::vector<std::string> fieldNames ;  // for structs
+    std::vector<mxArray *> elements ;  // for cells and structs, structs are element-major
+    MexShimFunction function ;  // for function handles
+} ;
+
+
+
+//
+// Helpers
+//
+
+static size_t elementSizeFromClassID(mxClassID classID)  {
+    switch (classID)  {
+        case mxLOGICAL_CLASS: return sizeof(mxLogical) ;
+        case mxCHAR_CLASS: return sizeof(mxChar) ;
+        case mxDOUBLE_CLASS: return sizeof(double) ;
+        case mxSINGLE_CLASS: return sizeof(float) ;
+        case mxINT8_CLASS:
+        case mxUINT8_CLASS: return 1 ;
+        case mxINT16_CLASS:
+        case mxUINT16_CLASS: return 2 ;
+        case mxINT32_CLASS:
+        case mxUINT32_CLASS: return 4 ;
+        case mxINT64_CLASS:
+        case mxUINT64_CLASS: return 8 ;
+        default: return sizeof(mxArray *) ;
+    }
+}
+
+static size_t elementCountFromDims(const std::vector<mwSize> & dims)  {
+    size_t result = 1 ;
+    for (size_t i=0; i<dims.size(); ++i)  {
+        result *= dims[i] ;
+    }
+    return result ;
+}
+
+static mxArray * createArray(mxClassID classID, mwSize ndim, const mwSize * dims)  {
+    mxArray * result = new mxArray_tag() ;
+    result->classID = classID ;
+    result->dims.assign(dims, dims+ndim) ;
+    while (result->dims.size()<2)  {
+        result->dims.push_back(1) ;
+    }
+    // Trailing singleton dimensions are dropped, as in Matlab
+    while (result->dims.size()>2 && result->dims.back()==1)  {
+        result->dims.pop_back() ;
+    }
+    result->data = NULL ;
+    size_t n = elementCountFromDims(result->dims) ;
+    if (classID==mxCELL_CLASS || classID==mxSTRUCT_CLASS || classID==mxFUNCTION_CLASS)  {
+        // elements vector is filled in by caller, if needed
+    }
+    else  {
+        // Always allocate at least one byte, so data pointers of empty arrays are non-null
+        result->data = calloc(std::max<size_t>(n,1), elementSizeFromClassID(classID)) ;
+        if (!result->data)  {
+            delete result ;
+            mexErrMsgIdAndTxt("mexShim:outOfMemory", "Unable to allocate array") ;
+        }
+    }
+    return result ;
+}
+
+static mxArray * createMatrix(mxClassID classID, mwSize m, mwSize n)  {
+    mwSize dims[2] = { m, n } ;
+    return createArray(classID, 2, dims) ;
+}
+
+static int fieldIndexFromName(const mxArray * pa, const char * fieldname)  {
+    for (size_t i=0; i<pa->fieldNames.size(); ++i)  {
+        if (pa->fieldNames[i]==fieldname)  {
+            return (int)i ;
+        }
+    }
+    return -1 ;
+}
+
+static std::string stringFromFormatAndArgs(const char * format, va_list args)  {
+    va_list argsCopy ;
+    va_copy(argsCopy, args) ;
+    int n = vsnprintf(NULL, 0, format, argsCopy) ;
+    va_end(argsCopy) ;
+    if (n<0)  {
+        return std::string(format) ;
+    }
+    std::vector<char> buffer(n+1) ;
+    vsnprintf(&buffer[0], buffer.size(), format, args) ;
+    return std::string(&buffer[0]) ;
+}
+
+
+
+//
+// Memory
+//
+
+void * mxMalloc(size_t n)  {
+    return malloc(std::max<size_t>(n,1)) ;
+}
+
+void * mxCalloc(size_t n, size_t size)  {
+    return calloc(std::max<size_t>(n,1), std::max<size_t>(size,1)) ;
+}
+
+void mxFree(void * ptr)  {
+    free(ptr) ;
+}
+
+
+
+//
+// Creation and destruction
+//
+
+mxArray * mxCreateNumericMatrix(mwSize m, mwSize n, mxClassID classID, mxComplexity complexity)  {
+    if (complexity!=mxREAL)  {
+        mexErrMsgIdAndTxt("mexShim:complexNotSupported", "Complex arrays are not supported") ;
+    }
+    return createMatrix(classID, m, n) ;
+}
+
+mxArray * mxCreateNumericArray(mwSize ndim, const mwSize * dims, mxClassID classID, mxComplexity complexity)  {
+    if (complexity!=mxREAL)  {
+        mexErrMsgIdAndTxt("mexShim:complexNotSupported", "Complex arrays are not supported") ;
+    }
+    return createArray(classID, ndim, dims) ;
+}
+
+mxArray * mxCreateDoubleMatrix(mwSize m, mwSize n, mxComplexity complexity)  {
+    return mxCreateNumericMatrix(m, n, mxDOUBLE_CLASS, complexity) ;
+}
+
+mxArray * mxCreateDoubleScalar(double value)  {
+    mxArray * result = createMatrix(mxDOUBLE_CLASS, 1, 1) ;
+    *((double *)(result->data)) = value ;
+    return result ;
+}
+
+mxArray * mxCreateLogicalMatrix(mwSize m, mwSize n)  {
+    return createMatrix(mxLOGICAL_CLASS, m, n) ;
+}
+
+mxArray * mxCreateLogicalScalar(bool value)  {
+    mxArray * result = createMatrix(mxLOGICAL_CLASS, 1, 1) ;
+    *((mxLogical *)(result->data)) = value ;
+    return result ;
+}
+
+mxArray * mxCreateString(const char * str)  {
+    size_t n = strlen(str) ;
+    mxArray * result = createMatrix(mxCHAR_CLASS, (n>0) ? 1 : 0, n) ;
+    mxChar * chars = (mxChar *)(result->data) ;
+    for (size_t i=0; i<n; ++i)  {
+        chars[i] = (mxChar)(unsigned char)(str[i]) ;
+    }
+    return result ;
+}
+
+mxArray * mxCreateCellMatrix(mwSize m, mwSize n)  {
+    mxArray * result = createMatrix(mxCELL_CLASS, m, n) ;
+    result->elements.assign(m*n, (mxArray *)NULL) ;
+    return result ;
+}
+
+mxArray * mxCreateStructMatrix(mwSize m, mwSize n, int nfields, const char ** fieldnames)  {
+    mxArray * result = createMatrix(mxSTRUCT_CLASS, m, n) ;
+    for (int i=0; i<nfields; ++i)  {
+        result->fieldNames.push_back(fieldnames[i]) ;
+    }
+    result->elements.assign(m*n*nfields, (mxArray *)NULL) ;
+    return result ;
+}
+
+mxArray * mxDuplicateArray(const mxArray * pa)  {
+    if (!pa)  {
+        return NULL ;
+    }
+    mxArray * result = new mxArray_tag() ;
+    result->classID = pa->classID ;
+    result->dims = pa->dims ;
+    result->fieldNames = pa->fieldNames ;
+    result->function = pa->function ;
+    result->data = NULL ;
+    if (pa->data)  {
+        size_t nBytes = std::max<size_t>(elementCountFromDims(pa->dims),1) * elementSizeFromClassID(pa->classID) ;
+        result->data = malloc(nBytes) ;
+        memcpy(result->data, pa->data, nBytes) ;
+    }
+    for (size_t i=0; i<pa->elements.size(); ++i)  {
+        result->elements.push_back(mxDuplicateArray(pa->elements[i])) ;
+    }
+    return result ;
+}
+
+void mxDestroyArray(mxArray * pa)  {
+    if (!pa)  {
+        return ;
+    }
+    for (size_t i=0; i<pa->elements.size(); ++i)  {
+        mxDestroyArray(pa->elements[i]) ;
+    }
+    free(pa->data) ;
+    delete pa ;
+}
+
+
+
+//
+// Size and type
+//
+
+mxClassID mxGetClassID(const mxArray * pa)  {
+    return pa->classID ;
+}
+
+const char * mxGetClassName(const mxArray * pa)  {
+    switch (pa->classID)  {
+        case mxCELL_CLASS: return "cell" ;
+        case mxSTRUCT_CLASS: return "struct" ;
+        case mxLOGICAL_CLASS: return "logical" ;
+        case mxCHAR_CLASS: return "char" ;
+        case mxDOUBLE_CLASS: return "double" ;
+        case mxSINGLE_CLASS: return "single" ;
+        case mxINT8_CLASS: return "int8" ;
+        case mxUINT8_CLASS: return "uint8" ;
+        case mxINT16_CLASS: return "int16" ;
+        case mxUINT16_CLASS: return "uint16" ;
+        case mxINT32_CLASS: return "int32" ;
+        case mxUINT32_CLASS: return "uint32" ;
+        case mxINT64_CLASS: return "int64" ;
+        case mxUINT64_CLASS: return "uint64" ;
+        case mxFUNCTION_CLASS: return "function_handle" ;
+        default: return "unknown" ;
+    }
+}
+
+mwSize mxGetM(const mxArray * pa)  {
+    return pa->dims[0] ;
+}
+
+mwSize mxGetN(const mxArray * pa)  {
+    // As in Matlab, the product of all dimensions but the first
+    size_t result = 1 ;
+    for (size_t i=1; i<pa->dims.size(); ++i)  {
+        result *= pa->dims[i] ;
+    }
+    return result ;
+}
+
+// Like the real thing, these only change the dimensions, not the allocated storage.
+// Shrinking is always safe; growing past the original allocation is the caller's problem.
+void mxSetM(mxArray * pa, mwSize m)  {
+    pa->dims[0] = m ;
+}
+
+void mxSetN(mxArray * pa, mwSize n)  {
+    pa->dims.resize(2) ;
+    pa->dims[1] = n ;
+}
+
+mwSize mxGetNumberOfDimensions(const mxArray * pa)  {
+    return pa->dims.size() ;
+}
+
+const mwSize * mxGetDimensions(const mxArray * pa)  {
+    return &(pa->dims[0]) ;
+}
+
+size_t mxGetNumberOfElements(const mxArray * pa)  {
+    return elementCountFromDims(pa->dims) ;
+}
+
+size_t mxGetElementSize(const mxArray * pa)  {
+    return elementSizeFromClassID(pa->classID) ;
+}
+
+bool mxIsClass(const mxArray * pa, const char * name)  {
+    return strcmp(mxGetClassName(pa), name)==0 ;
+}
+
+bool mxIsNumeric(const mxArray * pa)  {
+    return pa->classID>=mxDOUBLE_CLASS && pa->classID<=mxUINT64_CLASS ;
+}
+
+bool mxIsDouble(const mxArray * pa)  { return pa->classID==mxDOUBLE_CLASS ; }
+bool mxIsSingle(const mxArray * pa)  { return pa->classID==mxSINGLE_CLASS ; }
+bool mxIsInt16(const mxArray * pa)  { return pa->classID==mxINT16_CLASS ; }
+bool mxIsUint8(const mxArray * pa)  { return pa->classID==mxUINT8_CLASS ; }
+bool mxIsUint16(const mxArray * pa)  { return pa->classID==mxUINT16_CLASS ; }
+bool mxIsUint32(const mxArray * pa)  { return pa->classID==mxUINT32_CLASS ; }
+bool mxIsUint64(const mxArray * pa)  { return pa->classID==mxUINT64_CLASS ; }
+bool mxIsLogical(const mxArray * pa)  { return pa->classID==mxLOGICAL_CLASS ; }
+bool mxIsChar(const mxArray * pa)  { return pa->classID==mxCHAR_CLASS ; }
+bool mxIsCell(const mxArray * pa)  { return pa->classID==mxCELL_CLASS ; }
+bool mxIsStruct(const mxArray * pa)  { return pa->classID==mxSTRUCT_CLASS ; }
+bool mxIsComplex(const mxArray * /*pa*/)  { return false ; }
+bool mxIsEmpty(const mxArray * pa)  { return mxGetNumberOfElements(pa)==0 ; }
+bool mxIsScalar(const mxArray * pa)  { return mxGetNumberOfElements(pa)==1 ; }
+
+
+
+//
+// Data
+//
+
+void * mxGetData(const mxArray * pa)  {
+    return pa->data ;
+}
+
+double * mxGetPr(const mxArray * pa)  {
+    return (pa->classID==mxDOUBLE_CLASS) ? (double *)(pa->data) : NULL ;
+}
+
+mxLogical * mxGetLogicals(const mxArray * pa)  {
+    return (pa->classID==mxLOGICAL_CLASS) ? (mxLogical *)(pa->data) : NULL ;
+}
+
+mxChar * mxGetChars(const mxArray * pa)  {
+    return (pa->classID==mxCHAR_CLASS) ? (mxChar *)(pa->data) : NULL ;
+}
+
+double mxGetInf(void)  {
+    return std::numeric_limits<double>::infinity() ;
+}
+
+double mxGetNaN(void)  {
+    return std::numeric_limits<double>::quiet_NaN() ;
+}
+
+bool mxIsInf(double value)  {
+    return value == std::numeric_limits<double>::infinity() || value == -std::numeric_limits<double>::infinity() ;
+}
+
+bool mxIsFinite(double value)  {
+    return !mxIsInf(value) && value == value ;
+}
+
+double mxGetScalar(const mxArray * pa)  {
+    if (!pa->data || mxIsEmpty(pa))  {
+        return 0.0 ;
+    }
+    switch (pa->classID)  {
+        case mxLOGICAL_CLASS: return *((mxLogical *)(pa->data)) ? 1.0 : 0.0 ;
+        case mxCHAR_CLASS: return *((mxChar *)(pa->data)) ;
+        case mxDOUBLE_CLASS: return *((double *)(pa->data)) ;
+        case mxSINGLE_CLASS: return *((float *)(pa->data)) ;
+        case mxINT8_CLASS: return *((int8_t *)(pa->data)) ;
+        case mxUINT8_CLASS: return *((uint8_t *)(pa->data)) ;
+        case mxINT16_CLASS: return *((int16_t *)(pa->data)) ;
+        case mxUINT16_CLASS: return *((uint16_t *)(pa->data)) ;
+        case mxINT32_CLASS: return *((int32_t *)(pa->data)) ;
+        case mxUINT32_CLASS: return *((uint32_t *)(pa->data)) ;
+        case mxINT64_CLASS: return (double)*((int64_t *)(pa->data)) ;
+        case mxUINT64_CLASS: return (double)*((uint64_t *)(pa->data)) ;
+        default: return 0.0 ;
+    }
+}
+
+char * mxArrayToString(const mxArray * pa)  {
+    if (pa->classID!=mxCHAR_CLASS)  {
+        return NULL ;
+    }
+    size_t n = mxGetNumberOfElements(pa) ;
+    char * result = (char *) mxMalloc(n+1) ;
+    const mxChar * chars = (const mxChar *)(pa->data) ;
+    for (size_t i=0; i<n; ++i)  {
+        result[i] = (char)(chars[i]) ;
+    }
+    result[n] = '\0' ;
+    return result ;
+}
+
+int mxGetString(const mxArray * pa, char * buf, mwSize buflen)  {
+    if (pa->classID!=mxCHAR_CLASS || buflen==0)  {
+        return 1 ;
+    }
+    size_t n = mxGetNumberOfElements(pa) ;
+    size_t nToCopy = std::min<size_t>(n, buflen-1) ;
+    const mxChar * chars = (const mxChar *)(pa->data) ;
+    for (size_t i=0; i<nToCopy; ++i)  {
+        buf[i] = (char)(chars[i]) ;
+    }
+    buf[nToCopy] = '\0' ;
+    return (nToCopy<n) ? 1 : 0 ;   // nonzero means truncated
+}
+
+
+
+//
+// Cells and structs
+//
+
+mxArray * mxGetCell(const mxArray * pa, mwIndex i)  {
+    return (pa->classID==mxCELL_CLASS && i<pa->elements.size()) ? pa->elements[i] : NULL ;
+}
+
+void mxSetCell(mxArray * pa, mwIndex i, mxArray * value)  {
+    if (pa->classID==mxCELL_CLASS && i<pa->elements.size())  {
+        pa->elements[i] = value ;
+    }
+}
+
+int mxGetNumberOfFields(const mxArray * pa)  {
+    return (int)(pa->fieldNames.size()) ;
+}
+
+const char * mxGetFieldNameByNumber(const mxArray * pa, int n)  {
+    return (n>=0 && n<(int)pa->fieldNames.size()) ? pa->fieldNames[n].c_str() : NULL ;
+}
+
+mxArray * mxGetField(const mxArray * pa, mwIndex i, const char * fieldname)  {
+    if (pa->classID!=mxSTRUCT_CLASS)  {
+        return NULL ;
+    }
+    int fieldIndex = fieldIndexFromName(pa, fieldname) ;
+    if (fieldIndex<0 || i>=mxGetNumberOfElements(pa))  {
+        return NULL ;
+    }
+    return pa->elements[i*pa->fieldNames.size()+fieldIndex] ;
+}
+
+void mxSetField(mxArray * pa, mwIndex i, const char * fieldname, mxArray * value)  {
+    if (pa->classID!=mxSTRUCT_CLASS)  {
+        return ;
+    }
+    int fieldIndex = fieldIndexFromName(pa, fieldname) ;
+    if (fieldIndex<0 || i>=mxGetNumberOfElements(pa))  {
+        return ;
+    }
+    pa->elements[i*pa->fieldNames.size()+fieldIndex] = value ;
+}
+
+mxArray * mxGetProperty(const mxArray * pa, mwIndex i, const char * propname)  {
+    // As in Matlab, the result is a copy, owned by the caller
+    return mxDuplicateArray(mxGetField(pa, i, propname)) ;
+}
+
+
+
+//
+// mex API
+//
+
+void mexErrMsgIdAndTxt(const char * identifier, const char * format, ...)  {
+    va_list args ;
+    va_start(args, format) ;
+    std::string message = stringFromFormatAndArgs(format, args) ;
+    va_end(args) ;
+    throw MexShimError(identifier, message) ;
+}
+
+void mexErrMsgTxt(const char * message)  {
+    throw MexShimError("", message) ;
+}
+
+void mexWarnMsgIdAndTxt(const char * identifier, const char * format, ...)  {
+    va_list args ;
+    va_start(args, format) ;
+    std::string message = stringFromFormatAndArgs(format, args) ;
+    va_end(args) ;
+    fprintf(stderr, "Warning: %s [%s]\n", message.c_str(), identifier) ;
+}
+
+int mexPrintf(const char * format, ...)  {
+    va_list args ;
+    va_start(args, format) ;
+    int result = vprintf(format, args) ;
+    va_end(args) ;
+    return result ;
+}
+
+int mexEvalString(const char * /*command*/)  {
+    return 0 ;
+}
+
+static bool IS_LOCKED = false ;
+static std::vector<void (*)(void)> AT_EXIT_FUNCTIONS ;
+
+void mexLock(void)  {
+    IS_LOCKED = true ;
+}
+
+void mexUnlock(void)  {
+    IS_LOCKED = false ;
+}
+
+bool mexIsLocked(void)  {
+    return IS_LOCKED ;
+}
+
+int mexAtExit(void (*exitFunction)(void))  {
+    // Like Matlab, keep only the most-recently-registered function
+    AT_EXIT_FUNCTIONS.assign(1, exitFunction) ;
+    return 0 ;
+}
+
+void mexMakeArrayPersistent(mxArray * /*pa*/)  {
+    // Arrays are never freed automatically in the shim, so nothing to do
+}
+
+int mexCallMATLAB(int nlhs, mxArray *plhs[], int nrhs, mxArray *prhs[], const char * functionName)  {
+    if (strcmp(functionName, "feval")!=0)  {
+        mexErrMsgIdAndTxt("mexShim:functionNotSupported", "mexCallMATLAB() only supports feval in the shim") ;
+    }
+    if (nrhs<1 || !prhs[0] || prhs[0]->classID!=mxFUNCTION_CLASS || !prhs[0]->function)  {
+        mexErrMsgIdAndTxt("mexShim:notAFunctionHandle", "First argument to feval must be a function handle") ;
+    }
+    prhs[0]->function(nlhs, plhs, nrhs-1, (const mxArray **)(prhs+1)) ;
+    return 0 ;
+}
+
+mxArray * mexCallMATLABWithTrap(int nlhs, mxArray *plhs[], int nrhs, mxArray *prhs[], const char * functionName)  {
+    try  {
+        mexCallMATLAB(nlhs, plhs, nrhs, prhs, functionName) ;
+    }
+    catch (const std::exception & e)  {
+        // Return a struct standing in for an MException
+        const char * fieldNames[] = { "identifier", "message" } ;
+        mxArray * result = mxCreateStructMatrix(1, 1, 2, fieldNames) ;
+        const MexShimError * mexError = dynamic_cast<const MexShimError *>(&e) ;
+        mxSetField(result, 0, "identifier", mxCreateString(mexError ? mexError->identifier().c_str() : "")) ;
+        mxSetField(result, 0, "message", mxCreateString(e.what())) ;
+        return result ;
+    }
+    return NULL ;
+}
+
+
+
+//
+// Not part of the mex API
+//
+
+mxArray * mexShimCreateFunctionHandle(const MexShimFunction & function)  {
+    mxArray * result = createMatrix(mxFUNCTION_CLASS, 1, 1) ;
+    result->function = function ;
+    return result ;
+}
+
+void mexShimCallAtExitFunctions(void)  {
+    std::vector<void (*)(void)> functions ;
+    functions.swap(AT_EXIT_FUNCTIONS) ;
+    for (size_t i=0; i<functions.size(); ++i)  {
+        functions[i]() ;
+    }
+    IS_LOCKED = false ;
+}
@@ -1,8 +1,16 @@
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <algorithm>
 #include <limits>
+#include <cmath>
 //#include <iostream>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <chrono>
 #include "float.h"
 #include "mex.h"
 #include "matrix.h"
@@ -19,21 +27,201 @@
 
 
 
+// A registered everyNSamples callback.  There can be at most one per task.
+struct EveryNSamplesRegistration {
+    bool isRegistered ;
+    uInt32 nSamples ;
+    mxArray * matlabCallback ;
+} ;
+
+// A streaming AO output.  A refill thread keeps the task's output buffer topped up from 
+// a ring buffer, which Matlab fills a chunk at a time with WriteToOutputStream.  So the 
+// memory used is fixed, however long the stimulus.  While the stream exists, the refill 
+// thread is the only thing that writes to the task.  The ring holds ringScanCount scans, 
+// scan-major (i.e. DAQmx_Val_GroupByScanNumber), and the scans in it are those with 
+// index scanCountRefilled <= i < scanCountQueued, scan i being at i % ringScanCount.
+struct OutputStream {
+    TaskHandle taskHandle ;
+    uInt32 channelCount ;
+    uInt32 ringScanCount ;
+    int32 regenModeBeforeStreaming ;  // put back when the stream stops
+    std::vector<float64> ring ;
+    uInt64 scanCountQueued ;  // total scans copied into the ring
+    uInt64 scanCountRefilled ;  // total scans written from the ring to the task
+    int32 errorStatus ;  // the first DAQmx error the refill thread got, or zero
+    bool isStopRequested ;
+    std::mutex mutex ;  // protects all the above, except the ring contents
+    std::condition_variable ringChanged ;
+    std::thread refillThread ;
+} ;
+
+// A histogram of the latencies of on-demand DO writes.  Bin 0 counts latencies under 1 us, 
+// and bin k>0 those in [2^(k-1), 2^k) us, except the last bin, which has no upper limit.
+#define LATENCY_HISTOGRAM_BIN_COUNT 24
+struct LatencyHistogram {
+    uInt64 countPerBin[LATENCY_HISTOGRAM_BIN_COUNT] ;
+    uInt64 count ;
+    float64 totalLatency ;  // s
+    float64 maxLatency ;  // s
+} ;
+
+// An on-demand DO task bound for fast writes, with ws.ni(binding, state).  Bit j of state 
+// sets line j of the binding, which is bit terminalIDPerLine[j] of the port word.  The 
+// port word is written to every channel in the task, each channel taking its own lines.
+struct OnDemandDOBinding {
+    TaskHandle taskHandle ;
+    std::vector<uInt32> terminalIDPerLine ;
+    std::vector<uInt32> portWordPerChannel ;  // preallocated, so writes don't allocate
+    uInt32 lineState ;  // the state last written, bit j for line j
+    LatencyHistogram latency ;
+    std::mutex mutex ;  // serializes writes from Matlab and from closed-loop engines
+} ;
+
+// A threshold rule of a closed-loop engine.  The rule is above once a sample of its channel 
+// reaches upperThreshold, and below again once one falls to lowerThreshold, both in ADC 
+// counts.  Its line is high while the rule is above, or while it's below, if isInverted.
+struct ThresholdRule {
+    uInt32 channelIndex ;  // zero-based, within the AI task
+    uInt32 lineIndex ;  // zero-based, within the DO binding
+    int16 upperThreshold ;
+    int16 lowerThreshold ;
+    bool isInverted ;
+    bool isAbove ;
+} ;
+
+// A change of state of a closed-loop rule
+struct ClosedLoopEvent {
+    uInt64 scanIndex ;  // zero-based, counting from the start of the engine
+    uInt32 ruleIndex ;
+    bool isLineHigh ;
+} ;
+
+// A closed-loop engine.  Its reader thread is the only reader of the AI task: it reads 
+// each chunk of raw scans as soon as it's available, applies the threshold rules, sets 
+// the DO lines through the on-demand DO binding if they changed, and then appends the 
+// chunk to a ring, which DAQmxReadBinaryI16 and DAQmxGetReadAvailSampPerChan on the AI task 
+// draw from instead of the driver.  The ring holds ringScanCount scans, scan-major, and 
+// holds those with index scanCountConsumed <= i < scanCountRead, scan i being at 
+// i % ringScanCount.
+struct ClosedLoopEngine {
+    TaskHandle aiTaskHandle ;
+    uInt32 doBindingID ;
+    uInt32 channelCount ;
+    std::vector<ThresholdRule> rules ;  // only touched by the reader thread once it's started
+    uInt32 ringScanCount ;
+    std::vector<int16> ring ;
+    uInt64 scanCountRead ;  // total scans read from the task
+    uInt64 scanCountConsumed ;  // total scans taken from the ring by Matlab
+    bool isRingOverflowed ;
+    std::vector<ClosedLoopEvent> events ;  // not yet collected by Matlab
+    uInt64 eventCountDropped ;  // events not logged because the log was full
+    int32 errorStatus ;  // the first DAQmx error the reader thread got, or zero
+    bool isStopRequested ;
+    std::mutex mutex ;  // protects all the above, except the ring contents and the rules
+    std::condition_variable scansRead ;
+    std::thread readerThread ;
+} ;
+
+// A hash of the data last written to a task's output buffer, so that writing the same 
+// data again (e.g. the same stimulus every sweep) can be skipped
+struct WriteCache {
+    bool isValid ;
+    uInt64 contentHash ;
+} ;
+
+// The arguments of the last successful DAQmxCfgSampClkTiming() on a task, so that 
+// setting the same timing again, as AOTask and DOTask do before each write, doesn't 
+// throw away the write cache
+struct SampleClockTiming {
+    bool isValid ;
+    uInt64 sourceHash ;
+    float64 rate ;
+    int32 activeEdge ;
+    int32 sampleMode ;
+    uInt64 sampsPerChan ;
+} ;
+
+// The pulse train a counter-output task is currently configured for, so that reconfiguring 
+// a CO task for the next run only touches what changed.  sampleMode is zero until the 
+// timing has been set with DAQmxCfgImplicitTiming.
+struct COPulseTrainState {
+    bool isValid ;  // true iff the task has a CO pulse channel made by DAQmxCreateCOPulseChanFreq
+    float64 frequency ;
+    float64 dutyCycle ;
+    int32 sampleMode ;
+    uInt64 pulseCount ;  // ignored unless sampleMode is DAQmx_Val_FiniteSamps
+} ;
+
+// A hash of the configuration calls made on a task, and the task's configuration 
+// fingerprint when it was last verified and last committed, so that verifying or 
+// committing a task whose configuration hasn't changed since can be skipped.  That lets 
+// a task be kept, committed, from run to run, and only restarted.
+struct ConfigurationState {
+    uInt64 callHash ;  // hash of the configuration calls made on the task so far, in order
+    bool isVerified ;
+    uInt64 verifiedFingerprint ;
+    bool isCommitted ;
+    uInt64 committedFingerprint ;
+} ;
+
+// The per-task state we keep for each task we've created
+struct TaskRecord {
+    TaskHandle taskHandle ;
+    EveryNSamplesRegistration everyNSamples ;
+    OutputStream * outputStream ;  // null unless streaming
+    WriteCache writeCache ;
+    SampleClockTiming sampleClockTiming ;
+    uInt32 onDemandDOBindingID ;  // zero unless bound
+    ClosedLoopEngine * closedLoopEngine ;  // null unless running a closed loop on this AI task
+    COPulseTrainState coPulseTrain ;
+    ConfigurationState configuration ;
+} ;
+
 // Define the 'instance variables' for the 'Singleton'
 // We use these to check TaskHandles for validity, and thus
-// avoid segfaulting.
-#define MAXIMUM_TASK_HANDLE_COUNT 32 
-TaskHandle TASK_HANDLES[MAXIMUM_TASK_HANDLE_COUNT] ;
-int32 TASK_HANDLE_COUNT = 0 ;
+// avoid segfaulting.  TASK_HANDLES holds the handles in order of creation,
+// and TASK_RECORD_FROM_HANDLE lets us look up a handle in constant time, 
+// which matters since this happens on every read and write.
+// (std::unordered_map never moves its elements, so pointers to
+// TaskRecords stay valid until the task is cleared.)
+std::vector<TaskHandle> TASK_HANDLES ;
+std::unordered_map<TaskHandle, TaskRecord> TASK_RECORD_FROM_HANDLE ;
 
-bool IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED = false;
-mxArray * EVERY_N_SAMPLES_MATLAB_CALLBACK = 0;
-uInt32 N_SAMPLES = 0;
-TaskHandle EVERY_N_SAMPLES_TASK_HANDLE = (TaskHandle)(0);
+// The on-demand DO bindings.  A binding's ID is one plus its index.  Unbinding leaves a 
+// null pointer, and IDs are never reused, so a stale ID can't write to some other task.
+std::vector<OnDemandDOBinding *> ON_DEMAND_DO_BINDINGS ;
 
 
 
+#if defined(_MSC_VER)
 #define isfinite(x) ( _finite(x) )        // MSVC-specific, change as needed
+#else
+using std::isfinite ;
+#endif
+
+// For x64 intrinsics: the bit-gathering instruction (PEXT) used to pack digital data, and
+// the SSE2 used to convert volts to DAC codes
+#if defined(_M_X64) || defined(__x86_64__)
+#define WS_IS_X64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define WS_TARGET_BMI2
+#else
+#include <cpuid.h>
+#define WS_TARGET_BMI2 __attribute__((target("bmi2")))
+#endif
+#endif
+
+
+
+// Find the record for the given task handle.  Returns a null pointer if the handle is not 
+// a registered task handle.
+TaskRecord *
+findTaskRecord(TaskHandle taskHandle)  {
+    std::unordered_map<TaskHandle, TaskRecord>::iterator it = TASK_RECORD_FROM_HANDLE.find(taskHandle) ;
+    return ( it == TASK_RECORD_FROM_HANDLE.end() ) ? (TaskRecord *)(0) : &(it->second) ;
+}
 
 
 
@@ -42,9 +230,10 @@ int32 CVICALLBACK everyNSamplesCppCallback(TaskHandle taskHandle, int32 everyNsa
     mxArray *rhs[1];
 
 	//mexPrintf("Inside everyNSamplesCppCallback()\n");
-    // Double-check here to make sure something is registered
-    if (IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED) {
-        rhs[0] = EVERY_N_SAMPLES_MATLAB_CALLBACK;
+    // Double-check here to make sure something is registered for this task
+    TaskRecord * taskRecord = findTaskRecord(taskHandle) ;
+    if (taskRecord && taskRecord->everyNSamples.isRegistered) {
+        rhs[0] = taskRecord->everyNSamples.matlabCallback;
 
         mxArray *matlabExceptionOrNull = mexCallMATLABWithTrap(0, NULL, 1, rhs, "feval");
         if (matlabExceptionOrNull) {
@@ -321,6 +510,12 @@ daqmxValueFromString(const std::string & valueAsString)  {
     else if (valueAsString == "DAQmx_Val_CounterOutputEvent") {
         resultMaybe = std::make_pair(true, DAQmx_Val_CounterOutputEvent);
     }
+    else if (valueAsString == "DAQmx_Val_GroupByChannel") {
+        resultMaybe = std::make_pair(true, DAQmx_Val_GroupByChannel);
+    }
+    else if (valueAsString == "DAQmx_Val_GroupByScanNumber") {
+        resultMaybe = std::make_pair(true, DAQmx_Val_GroupByScanNumber);
+    }
     else  {
         // Doesn't match anything, so result is empty
         resultMaybe = std::make_pair(false, 0);
@@ -397,33 +592,42 @@ readValueArgument(int nrhs, const mxArray *prhs[],
     return result ;
 }
 
+
+
+// Read the optional fillMode argument of the read 'methods'.  If missing or empty, 
+// the fill mode is DAQmx_Val_GroupByChannel, giving an nScans x nChannels output.
+// DAQmx_Val_GroupByScanNumber gives an nChannels x nScans output, i.e. the scans are
+// interleaved in memory, which is the layout of a row-major (scan, channel) array on disk.
+bool32
+readFillModeArgument(int nrhs, const mxArray *prhs[], int index)  {
+    bool32 fillMode ;
+    if ( (nrhs>index) && !mxIsEmpty(prhs[index]) )  {
+        int32 fillModeAsInt32 = readValueArgument(nrhs, prhs, index, "fillMode") ;
+        if ( fillModeAsInt32 != DAQmx_Val_GroupByChannel && fillModeAsInt32 != DAQmx_Val_GroupByScanNumber )  {
+            mexErrMsgIdAndTxt("ws:ni:badArgument",
+                              "fillMode must be DAQmx_Val_GroupByChannel or DAQmx_Val_GroupByScanNumber");
+        }
+        fillMode = (bool32) fillModeAsInt32 ;
+    }
+    else  {
+        fillMode = DAQmx_Val_GroupByChannel ;
+    }
+    return fillMode ;
+}
+
     
 
 // Helper function for reading a task handle argument and validating it
 TaskHandle
 readTaskHandleArgument(std::string action, int nrhs, const mxArray *prhs[])  {
     TaskHandle taskHandle = 0 ;
-    bool isTaskHandleValid ;
-    mwSize i ;
 
     // Read the task handle argument, which, when present, is always the second argument (i.e. the one after the 'method' name)
     if ( (nrhs>1) && mxIsUint64(prhs[1]) && mxIsScalar(prhs[1]) )  {
         taskHandle = *((TaskHandle*) mxGetData(prhs[1])) ;
         // Check that this is a valid taskHandle.  If we didn't do this check, then handing in an invalid taskHandle
         // could cause Matlab to dump core.
-        isTaskHandleValid = false ;
-        for (i=0; i<TASK_HANDLE_COUNT; ++i)  {
-            //mexPrintf("Checking one registered task handle against the given one.\n");
-            //mexPrintf("taskHandle: %llu\n", (uInt64)(taskHandle)) ;
-            //mexPrintf("TASK_HANDLES[i]: %llu\n", (uInt64)(TASK_HANDLES[i])) ;
-            if ( taskHandle == TASK_HANDLES[i] )  {
-                //mexPrintf("Found a match!\n");
-                isTaskHandleValid = true ;
-                break ;
-            }
-        }
-        //mexPrintf("isTaskHandleValid: %d\n", isTaskHandleValid) ;
-        if (!isTaskHandleValid)  {
+        if (!findTaskRecord(taskHandle))  {
             std::string errorMessage = sprintfpp("In ws.ni 'method' %s, taskHandle is not a registered task handle", action.c_str());
             mexErrMsgIdAndTxt("ws:ni:badArgument",
                               errorMessage.c_str());
@@ -465,32 +669,31 @@ bool isMxArrayAString(const mxArray* arg)  {
 
     
 // A helper function that calls DAQmxRegisterEveryNSamplesEvent() to unregister the 
-// callback and modifies the globals appropriately.
+// callback for the given task, if there is one, and modifies the task record appropriately.
 // Never throws a Matlab error, returns the status from DAQmxRegisterEveryNSamplesEvent(),
 // or zero if no callback is registered.
-int32 unregisterEveryNSamplesEventAndUpdateGlobals(bool doIgnoreErrors) {
+int32 unregisterEveryNSamplesEvent(TaskRecord & taskRecord, bool doIgnoreErrors) {
     int32 status = 0;
-    if (IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED) {
+    EveryNSamplesRegistration & registration = taskRecord.everyNSamples ;
+    if (registration.isRegistered) {
         // Call the DAQmx function
         status =
             DAQmxRegisterEveryNSamplesEvent(
-                EVERY_N_SAMPLES_TASK_HANDLE,
+                taskRecord.taskHandle,
                 DAQmx_Val_Acquired_Into_Buffer,
-                N_SAMPLES,
+                registration.nSamples,
                 DAQmx_Val_SynchronousEventCallbacks,
                 (DAQmxEveryNSamplesEventCallbackPtr)(0),
                 (void *)(0));
 		//mexPrintf("Return from call to DAQmxRegisterEveryNSamplesEvent() to unregister was %d\n", status);
         status = doIgnoreErrors ? 0 : status;
 
-        // If that worked, update the global variables
+        // If that worked, update the task record
         if (status >= 0) {
-			//mexPrintf("About to set IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED = false\n");
-            IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED = false;
-            mxDestroyArray(EVERY_N_SAMPLES_MATLAB_CALLBACK);
-            EVERY_N_SAMPLES_MATLAB_CALLBACK = (mxArray *)(0);
-            EVERY_N_SAMPLES_TASK_HANDLE = (TaskHandle)(0);
-            N_SAMPLES = 0;
+            registration.isRegistered = false ;
+            mxDestroyArray(registration.matlabCallback);
+            registration.matlabCallback = (mxArray *)(0) ;
+            registration.nSamples = 0 ;
         }
     }
 
@@ -500,57 +703,670 @@ int32 unregisterEveryNSamplesEventAndUpdateGlobals(bool doIgnoreErrors) {
 
 
 
-// Find the index in TASK_HANDLES of the given task handle.  Returns int32,
-// which is -1 if the handle is not found.
+// Unregister all the everyNSamples callbacks.  Never throws a Matlab error,
+// returns a NI-style status code.  Ignores NI warnings.
+int32 unregisterAllEveryNSamplesEvents(bool doIgnoreErrors) {
+    int32 status = 0;
+    std::vector<TaskHandle>::reverse_iterator it ;
+    for (it = TASK_HANDLES.rbegin(); it != TASK_HANDLES.rend(); ++it)  {
+        int32 thisStatus = unregisterEveryNSamplesEvent(*findTaskRecord(*it), doIgnoreErrors) ;
+        if ( thisStatus < 0 )  {  // ignore warnings but not errors
+            status = thisStatus ;
+        }
+    }
+    return status;
+}
+// end of function
+
+
+
+// xxHash64 of the given bytes (see https://github.com/Cyan4973/xxHash).  Fast enough that 
+// hashing a stimulus costs much less than uploading it.
+static const uInt64 XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL ;
+static const uInt64 XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL ;
+static const uInt64 XXH_PRIME64_3 = 0x165667B19E3779F9ULL ;
+static const uInt64 XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL ;
+static const uInt64 XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL ;
+
+static inline uInt64 xxhRotl64(uInt64 x, int r)  { return (x << r) | (x >> (64 - r)) ; }
+static inline uInt64 xxhRead64(const unsigned char * p)  { uInt64 v ; memcpy(&v, p, 8) ; return v ; }
+static inline uInt32 xxhRead32(const unsigned char * p)  { uInt32 v ; memcpy(&v, p, 4) ; return v ; }
+
+static inline uInt64 xxhRound(uInt64 acc, uInt64 input)  {
+    acc += input * XXH_PRIME64_2 ;
+    acc = xxhRotl64(acc, 31) ;
+    return acc * XXH_PRIME64_1 ;
+}
+
+static inline uInt64 xxhMergeRound(uInt64 acc, uInt64 val)  {
+    acc ^= xxhRound(0, val) ;
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4 ;
+}
+
+uInt64
+xxHash64(const void * data, size_t length, uInt64 seed)  {
+    const unsigned char * p = (const unsigned char *)(data) ;
+    const unsigned char * end = p + length ;
+    uInt64 h ;
+    if (length >= 32)  {
+        const unsigned char * limit = end - 32 ;
+        uInt64 v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2 ;
+        uInt64 v2 = seed + XXH_PRIME64_2 ;
+        uInt64 v3 = seed ;
+        uInt64 v4 = seed - XXH_PRIME64_1 ;
+        do  {
+            v1 = xxhRound(v1, xxhRead64(p)) ; p += 8 ;
+            v2 = xxhRound(v2, xxhRead64(p)) ; p += 8 ;
+            v3 = xxhRound(v3, xxhRead64(p)) ; p += 8 ;
+            v4 = xxhRound(v4, xxhRead64(p)) ; p += 8 ;
+        } while (p <= limit) ;
+        h = xxhRotl64(v1, 1) + xxhRotl64(v2, 7) + xxhRotl64(v3, 12) + xxhRotl64(v4, 18) ;
+        h = xxhMergeRound(h, v1) ;
+        h = xxhMergeRound(h, v2) ;
+        h = xxhMergeRound(h, v3) ;
+        h = xxhMergeRound(h, v4) ;
+    }
+    else  {
+        h = seed + XXH_PRIME64_5 ;
+    }
+    h += (uInt64)(length) ;
+    for ( ; p + 8 <= end; p += 8)  {
+        h ^= xxhRound(0, xxhRead64(p)) ;
+        h = xxhRotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4 ;
+    }
+    if (p + 4 <= end)  {
+        h ^= (uInt64)(xxhRead32(p)) * XXH_PRIME64_1 ;
+        h = xxhRotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3 ;
+        p += 4 ;
+    }
+    for ( ; p < end; ++p)  {
+        h ^= (*p) * XXH_PRIME64_5 ;
+        h = xxhRotl64(h, 11) * XXH_PRIME64_1 ;
+    }
+    h ^= h >> 33 ;
+    h *= XXH_PRIME64_2 ;
+    h ^= h >> 29 ;
+    h *= XXH_PRIME64_3 ;
+    h ^= h >> 32 ;
+    return h ;
+}
+
+
+
+// Hash the data for a write to a task's output buffer.  The action name and the array 
+// dimensions are hashed in too, so different kinds of writes never match.
+uInt64
+hashOfWrite(const std::string & action, const mxArray * writeArray)  {
+    uInt64 seed = xxHash64(action.data(), action.size(), 0) ;
+    uInt64 dims[2] = { (uInt64)(mxGetM(writeArray)), (uInt64)(mxGetN(writeArray)) } ;
+    seed = xxHash64(dims, sizeof(dims), seed) ;
+    return xxHash64(mxGetData(writeArray), mxGetNumberOfElements(writeArray)*mxGetElementSize(writeArray), seed) ;
+}
+
+
+
+// Whether a write with the given hash can be skipped, because the task's output buffer 
+// already holds exactly that data.  That's only so if the task regenerates from its buffer 
+// (a sample-clocked task with regeneration allowed), since otherwise the data gets used up.
+bool
+isWriteRedundant(TaskRecord & taskRecord, uInt64 contentHash)  {
+    if ( !taskRecord.writeCache.isValid || taskRecord.writeCache.contentHash != contentHash )  {
+        return false ;
+    }
+    int32 regenMode ;
+    int32 sampleTimingType ;
+    if ( DAQmxGetWriteRegenMode(taskRecord.taskHandle, &regenMode) < 0 || regenMode != DAQmx_Val_AllowRegen )  {
+        return false ;
+    }
+    if ( DAQmxGetSampTimingType(taskRecord.taskHandle, &sampleTimingType) < 0 || sampleTimingType != DAQmx_Val_SampClk )  {
+        return false ;
+    }
+    return true ;
+}
+
+
+
+// Record the outcome of a write to the task's output buffer.  Only a complete, error-free 
+// write leaves the buffer in a known state.
+void
+updateWriteCache(TaskRecord & taskRecord, uInt64 contentHash, int32 status, int32 nSampsPerChan, int32 nSampsPerChanWritten)  {
+    taskRecord.writeCache.isValid = (status >= 0 && nSampsPerChanWritten == nSampsPerChan) ;
+    taskRecord.writeCache.contentHash = contentHash ;
+}
+
+
+
+// Forget what's in the task's output buffer, e.g. because it's been reallocated
+void
+invalidateWriteCache(TaskHandle taskHandle)  {
+    TaskRecord * taskRecord = findTaskRecord(taskHandle) ;
+    if (taskRecord)  {
+        taskRecord->writeCache.isValid = false ;
+    }
+}
+
+
+
+// The fingerprint of a task's current configuration: the hash of the configuration calls 
+// made on it, combined with the CO pulse train, which ReconfigureCOPulseTrain can change 
+// without changing the calls
+uInt64
+configurationFingerprint(const TaskRecord & taskRecord)  {
+    uInt64 result = taskRecord.configuration.callHash ;
+    const COPulseTrainState & coPulseTrain = taskRecord.coPulseTrain ;
+    if (coPulseTrain.isValid)  {
+        result = xxHash64(&coPulseTrain.frequency, sizeof(coPulseTrain.frequency), result) ;
+        result = xxHash64(&coPulseTrain.dutyCycle, sizeof(coPulseTrain.dutyCycle), result) ;
+        result = xxHash64(&coPulseTrain.sampleMode, sizeof(coPulseTrain.sampleMode), result) ;
+        result = xxHash64(&coPulseTrain.pulseCount, sizeof(coPulseTrain.pulseCount), result) ;
+    }
+    return result ;
+}
+
+
+
+// Whether an action changes the configuration of the task given as its first argument
+bool
+isConfigurationAction(const std::string & action)  {
+    static const char * CONFIGURATION_ACTIONS[] = {
+        "DAQmxCreateAIVoltageChan", "DAQmxCreateAOVoltageChan", "DAQmxCreateDIChan", "DAQmxCreateDOChan", 
+        "DAQmxCreateCOPulseChanFreq", "DAQmxCfgSampClkTiming", "DAQmxCfgImplicitTiming", "DAQmxCfgDigEdgeStartTrig", 
+        "DAQmxDisableStartTrig", "DAQmxSetRefClkSrc", "DAQmxSetRefClkRate", "DAQmxCfgInputBuffer", "DAQmxCfgOutputBuffer", 
+        "DAQmxResetWriteRelativeTo", "DAQmxResetWriteOffset", "DAQmxExportSignal" } ;
+    for (size_t i = 0; i < sizeof(CONFIGURATION_ACTIONS)/sizeof(CONFIGURATION_ACTIONS[0]); ++i)  {
+        if (action == CONFIGURATION_ACTIONS[i])  {
+            return true ;
+        }
+    }
+    return false ;
+}
+
+
+
+// Fold a configuration call that has succeeded into its task's call hash: the action name, 
+// and the class, dimensions, and contents of each argument
+void
+noteConfigurationCall(const std::string & action, int nrhs, const mxArray *prhs[])  {
+    TaskRecord * taskRecord = (nrhs>1) ? findTaskRecord(readTaskHandleArgument(action, nrhs, prhs)) : (TaskRecord *)(0) ;
+    if (!taskRecord)  {
+        return ;
+    }
+    uInt64 hash = xxHash64(action.data(), action.size(), taskRecord->configuration.callHash) ;
+    for (int i = 2; i < nrhs; ++i)  {
+        uInt64 header[3] = { (uInt64)(mxGetClassID(prhs[i])), (uInt64)(mxGetM(prhs[i])), (uInt64)(mxGetN(prhs[i])) } ;
+        hash = xxHash64(header, sizeof(header), hash) ;
+        hash = xxHash64(mxGetData(prhs[i]), mxGetNumberOfElements(prhs[i])*mxGetElementSize(prhs[i]), hash) ;
+    }
+    taskRecord->configuration.callHash = hash ;
+}
+
+
+
+// Whether the task has been verified, and its configuration hasn't changed since
+bool
+isTaskVerifiedAsConfigured(const TaskRecord & taskRecord)  {
+    return taskRecord.configuration.isVerified && 
+           taskRecord.configuration.verifiedFingerprint == configurationFingerprint(taskRecord) ;
+}
+
+
+
+// Whether the task has been committed, and hasn't been reconfigured or unreserved since
+bool
+isTaskCommittedAsConfigured(const TaskRecord & taskRecord)  {
+    return taskRecord.configuration.isCommitted && 
+           taskRecord.configuration.committedFingerprint == configurationFingerprint(taskRecord) ;
+}
+
+
+
+// Update a task's verified/committed state after a successful DAQmxTaskControl().  
+// Committing verifies too, and unreserving or aborting takes the task back to verified.
+void
+noteTaskControl(TaskRecord & taskRecord, int32 taskAction)  {
+    ConfigurationState & configuration = taskRecord.configuration ;
+    uInt64 fingerprint = configurationFingerprint(taskRecord) ;
+    if (taskAction==DAQmx_Val_Task_Verify || taskAction==DAQmx_Val_Task_Commit)  {
+        configuration.isVerified = true ;
+        configuration.verifiedFingerprint = fingerprint ;
+    }
+    if (taskAction==DAQmx_Val_Task_Commit)  {
+        configuration.isCommitted = true ;
+        configuration.committedFingerprint = fingerprint ;
+    }
+    else if (taskAction==DAQmx_Val_Task_Unreserve || taskAction==DAQmx_Val_Task_Abort)  {
+        configuration.isCommitted = false ;
+    }
+}
+
+
+
+// If a write is skipped because the buffer already holds the data, do the rest of what 
+// the write would have done: start the task if autoStart is set.  Returns a DAQmx status.
 int32
-findTaskByHandle(TaskHandle taskHandle)  {
-    // Find the given taskHandle in the list of valid taskHandles, return -1 if can't find it
-    int32 taskHandleIndex = -1 ;
-    int32 i ;
-    for ( i = 0 ; i < TASK_HANDLE_COUNT ; ++i )  {
-        if ( taskHandle == TASK_HANDLES[i] )  {
-            taskHandleIndex = i ;
+completeSkippedWrite(TaskHandle taskHandle, bool32 autoStart)  {
+    if (autoStart)  {
+        bool32 isTaskDone ;
+        int32 status = DAQmxIsTaskDone(taskHandle, &isTaskDone) ;
+        if (status < 0)  {
+            return status ;
+        }
+        if (isTaskDone)  {
+            return DAQmxStartTask(taskHandle) ;
+        }
+    }
+    return 0 ;
+}
+
+
+
+// Set the outputs of a write action: the number of samples per channel written, and, if 
+// asked for, whether the write was skipped because the buffer already held the data
+void
+setWriteOutputs(int nlhs, mxArray *plhs[], int32 nSampsPerChanWritten, bool wasSkipped)  {
+    plhs[0] = mxCreateDoubleScalar(nSampsPerChanWritten) ;
+        // even if nlhs==0, still safe to assign to plhs[0], and should do this, so ans gets assigned
+    if (nlhs>1)  {
+        plhs[1] = mxCreateLogicalScalar(wasSkipped) ;
+    }
+}
+
+
+
+// How long the refill thread of an output stream waits for ring data or buffer space 
+// before checking whether it has been asked to stop, in seconds
+#define OUTPUT_STREAM_POLL_INTERVAL 0.01
+
+// The body of an output stream's refill thread.  Writes each contiguous run of scans 
+// in the ring to the task, letting the DAQmx write block until there's space in the output 
+// buffer.  Exits on a DAQmx error, or when asked to stop.
+void
+refillOutputStream(OutputStream * stream)  {
+    std::unique_lock<std::mutex> lock(stream->mutex) ;
+    while (!stream->isStopRequested)  {
+        uInt64 scanCountInRing = stream->scanCountQueued - stream->scanCountRefilled ;
+        if (scanCountInRing == 0)  {
+            // Nothing to write, but check on the task, so that an underflow gets reported 
+            // even if Matlab has stopped queueing scans
+            lock.unlock() ;
+            bool32 isTaskDone ;
+            int32 status = DAQmxIsTaskDone(stream->taskHandle, &isTaskDone) ;
+            lock.lock() ;
+            if (status < 0)  {
+                stream->errorStatus = status ;
+                stream->ringChanged.notify_all() ;
+                break ;
+            }
+            stream->ringChanged.wait_for(lock, std::chrono::duration<double>(OUTPUT_STREAM_POLL_INTERVAL)) ;
+            continue ;
+        }
+        uInt32 ringIndex = (uInt32)(stream->scanCountRefilled % stream->ringScanCount) ;
+        int32 scanCountToWrite = (int32)(std::min(scanCountInRing, (uInt64)(stream->ringScanCount - ringIndex))) ;
+        const float64 * scans = &(stream->ring[(size_t)(ringIndex)*stream->channelCount]) ;
+
+        // Matlab only writes to the part of the ring not holding queued scans, so it's 
+        // safe to read these without the lock
+        lock.unlock() ;
+        int32 scanCountWritten = 0 ;
+        int32 status = DAQmxWriteAnalogF64(stream->taskHandle,
+                                           scanCountToWrite,
+                                           false,
+                                           OUTPUT_STREAM_POLL_INTERVAL,
+                                           DAQmx_Val_GroupByScanNumber,
+                                           scans,
+                                           &scanCountWritten,
+                                           NULL) ;
+        lock.lock() ;
+
+        stream->scanCountRefilled += (scanCountWritten > 0) ? scanCountWritten : 0 ;
+        stream->ringChanged.notify_all() ;
+        if (status == DAQmxErrorSamplesCanNotYetBeWritten)  {
+            // Output buffer is full.  If the task isn't running yet, the write may not
+            // have waited at all, so wait here to avoid spinning.
+            if (scanCountWritten == 0)  {
+                stream->ringChanged.wait_for(lock, std::chrono::duration<double>(OUTPUT_STREAM_POLL_INTERVAL)) ;
+            }
+        }
+        else if (status < 0)  {
+            stream->errorStatus = status ;
+            stream->ringChanged.notify_all() ;
             break ;
         }
     }
-    return taskHandleIndex ;
 }
-    
+// end of function
+
+
+
+// Stop the task's output stream, if any, and free it.  If isRegenModeRestored, the task's 
+// regeneration mode is then set back to what it was before streaming, which can't be done 
+// while the task is running.  Returns a DAQmx status.
+int32
+stopOutputStream(TaskRecord & taskRecord, bool isRegenModeRestored)  {
+    int32 status = 0 ;
+    OutputStream * stream = taskRecord.outputStream ;
+    if (stream)  {
+        {
+            std::lock_guard<std::mutex> lock(stream->mutex) ;
+            stream->isStopRequested = true ;
+        }
+        stream->ringChanged.notify_all() ;
+        stream->refillThread.join() ;
+        int32 regenModeBeforeStreaming = stream->regenModeBeforeStreaming ;
+        delete stream ;
+        taskRecord.outputStream = (OutputStream *)(0) ;
+        if (isRegenModeRestored)  {
+            status = DAQmxSetWriteRegenMode(taskRecord.taskHandle, regenModeBeforeStreaming) ;
+        }
+    }
+    return status ;
+}
+// end of function
+
+
+
+// Write lineState, bit j for line j of the binding, to the binding's task, as one port word 
+// per channel.  Caller must hold the binding's mutex.  Returns a DAQmx status.
+int32
+writeOnDemandDOLineState(OnDemandDOBinding & binding, uInt32 lineState)  {
+    const std::vector<uInt32> & terminalIDPerLine = binding.terminalIDPerLine ;
+    uInt32 portWord = 0 ;
+    for (size_t j = 0; j < terminalIDPerLine.size(); ++j)  {
+        portWord |= ((lineState >> j) & 1) << terminalIDPerLine[j] ;
+    }
+    std::fill(binding.portWordPerChannel.begin(), binding.portWordPerChannel.end(), portWord) ;
+    int32 nSampsPerChanWritten ;
+    int32 status = DAQmxWriteDigitalU32(binding.taskHandle, 1, true, DAQmx_Val_WaitInfinitely, DAQmx_Val_GroupByChannel,
+                                        binding.portWordPerChannel.data(), &nSampsPerChanWritten, NULL) ;
+    if (status >= 0)  {
+        binding.lineState = lineState ;
+    }
+    return status ;
+}
+
+
+
+// How long the reader thread of a closed-loop engine waits before checking for new scans 
+// again, in seconds.  This bounds the latency added by polling.
+#define CLOSED_LOOP_POLL_INTERVAL 0.0005
+
+// The most scans the reader thread reads at a time
+#define CLOSED_LOOP_MAX_CHUNK_SCAN_COUNT 4096
+
+// The most events an engine logs before Matlab collects them, after which they're dropped
+#define CLOSED_LOOP_MAX_EVENT_COUNT 1000000
+
+// Record a failed DAQmx call in a closed-loop engine, so Matlab's next read of the task 
+// errors, unless an earlier error is already recorded
+void
+recordClosedLoopError(ClosedLoopEngine * engine, int32 status)  {
+    {
+        std::lock_guard<std::mutex> lock(engine->mutex) ;
+        if (engine->errorStatus == 0)  {
+            engine->errorStatus = status ;
+        }
+    }
+    engine->scansRead.notify_all() ;
+}
+
+
+
+// The body of a closed-loop engine's reader thread.  The rules are applied scan by scan, 
+// and the lines are written as soon as a scan changes them, so a line never lags the scan 
+// that set it by more than the time to read the chunk holding it.  The thread exits on 
+// any DAQmx error other than the ones expected while the task is stopped between sweeps, 
+// after recording it for Matlab to see.
+void
+runClosedLoop(ClosedLoopEngine * engine, OnDemandDOBinding * binding)  {
+    const uInt32 channelCount = engine->channelCount ;
+    std::vector<int16> chunk((size_t)(CLOSED_LOOP_MAX_CHUNK_SCAN_COUNT)*channelCount) ;
+    std::vector<ClosedLoopEvent> chunkEvents ;
+    std::vector<ThresholdRule> & rules = engine->rules ;
+    uInt32 ruleLineMask = 0 ;
+    uInt32 ruleLineState = 0 ;
+    for (size_t r = 0; r < rules.size(); ++r)  {
+        ruleLineMask |= ((uInt32)1) << rules[r].lineIndex ;
+        ruleLineState |= ((uInt32)(rules[r].isAbove != rules[r].isInverted)) << rules[r].lineIndex ;
+    }
+    uInt64 scanCountRead = 0 ;
+    while (true)  {
+        // See how many scans there are to read.  Errors are expected while the task is 
+        // stopped, between sweeps, and are otherwise fatal.
+        uInt32 scanCountAvailable = 0 ;
+        int32 status = DAQmxGetReadAvailSampPerChan(engine->aiTaskHandle, &scanCountAvailable) ;
+        if (status < 0)  {
+            bool32 isTaskDone = false ;
+            if ( DAQmxIsTaskDone(engine->aiTaskHandle, &isTaskDone) < 0 || !isTaskDone )  {
+                recordClosedLoopError(engine, status) ;
+                break ;
+            }
+            scanCountAvailable = 0 ;
+        }
+
+        // Read a chunk, if there's anything to read
+        int32 scanCountReadThisTime = 0 ;
+        if (scanCountAvailable > 0)  {
+            int32 scanCount = (int32)(std::min(scanCountAvailable, (uInt32)(CLOSED_LOOP_MAX_CHUNK_SCAN_COUNT))) ;
+            status = DAQmxReadBinaryI16(engine->aiTaskHandle, scanCount, 0.0, DAQmx_Val_GroupByScanNumber,
+                                        chunk.data(), (uInt32)(chunk.size()), &scanCountReadThisTime, NULL) ;
+            if (status < 0)  {
+                // The task may have stopped since the check above, which is fine
+                bool32 isTaskDone = false ;
+                if ( DAQmxIsTaskDone(engine->aiTaskHandle, &isTaskDone) < 0 || !isTaskDone )  {
+                    recordClosedLoopError(engine, status) ;
+                    break ;
+                }
+                scanCountReadThisTime = 0 ;
+            }
+        }
+        if (scanCountReadThisTime <= 0)  {
+            std::unique_lock<std::mutex> lock(engine->mutex) ;
+            if (engine->isStopRequested)  {
+                break ;
+            }
+            engine->scansRead.wait_for(lock, std::chrono::duration<float64>(CLOSED_LOOP_POLL_INTERVAL)) ;
+            if (engine->isStopRequested)  {
+                break ;
+            }
+            continue ;
+        }
+
+        // Apply the rules to each scan in turn, setting the lines as soon as they change
+        chunkEvents.clear() ;
+        status = 0 ;
+        for (int32 i = 0; i < scanCountReadThisTime && status >= 0; ++i)  {
+            const int16 * scan = chunk.data() + (size_t)(i)*channelCount ;
+            uInt32 newRuleLineState = ruleLineState ;
+            for (size_t r = 0; r < rules.size(); ++r)  {
+                ThresholdRule & rule = rules[r] ;
+                int16 sample = scan[rule.channelIndex] ;
+                if ( rule.isAbove ? (sample <= rule.lowerThreshold) : (sample >= rule.upperThreshold) )  {
+                    rule.isAbove = !rule.isAbove ;
+                    bool isLineHigh = (rule.isAbove != rule.isInverted) ;
+                    ClosedLoopEvent event = { scanCountRead+i, (uInt32)(r), isLineHigh } ;
+                    chunkEvents.push_back(event) ;
+                    newRuleLineState = (newRuleLineState & ~(((uInt32)1) << rule.lineIndex)) | (((uInt32)(isLineHigh)) << rule.lineIndex) ;
+                }
+            }
+            if (newRuleLineState != ruleLineState)  {
+                ruleLineState = newRuleLineState ;
+                std::lock_guard<std::mutex> lock(binding->mutex) ;
+                uInt32 lineState = (binding->lineState & ~ruleLineMask) | ruleLineState ;
+                if (lineState != binding->lineState)  {
+                    status = writeOnDemandDOLineState(*binding, lineState) ;
+                }
+            }
+        }
+
+        // Hand the scans and events over to Matlab
+        {
+            std::lock_guard<std::mutex> lock(engine->mutex) ;
+            uInt64 scanCountInRing = engine->scanCountRead - engine->scanCountConsumed ;
+            if ( scanCountInRing + scanCountReadThisTime > engine->ringScanCount )  {
+                engine->isRingOverflowed = true ;
+            }
+            if (!engine->isRingOverflowed)  {
+                for (int32 i = 0; i < scanCountReadThisTime; ++i)  {
+                    size_t ringIndex = (size_t)((engine->scanCountRead + i) % engine->ringScanCount) ;
+                    std::copy(chunk.data() + (size_t)(i)*channelCount, chunk.data() + (size_t)(i+1)*channelCount,
+                              engine->ring.data() + ringIndex*channelCount) ;
+                }
+                engine->scanCountRead += scanCountReadThisTime ;
+            }
+            size_t eventCountToLog = std::min(chunkEvents.size(), CLOSED_LOOP_MAX_EVENT_COUNT - std::min(engine->events.size(), (size_t)(CLOSED_LOOP_MAX_EVENT_COUNT))) ;
+            engine->events.insert(engine->events.end(), chunkEvents.begin(), chunkEvents.begin()+eventCountToLog) ;
+            engine->eventCountDropped += chunkEvents.size() - eventCountToLog ;
+        }
+        engine->scansRead.notify_all() ;
+        scanCountRead += scanCountReadThisTime ;
+
+        // A failed write to the lines is fatal too
+        if (status < 0)  {
+            recordClosedLoopError(engine, status) ;
+            break ;
+        }
+    }
+}
+
+
+
+// Stop the task's closed-loop engine, if it has one, and delete it.  The engine's lines 
+// are left as they are.
+void
+stopClosedLoop(TaskRecord & taskRecord)  {
+    ClosedLoopEngine * engine = taskRecord.closedLoopEngine ;
+    if (engine)  {
+        {
+            std::lock_guard<std::mutex> lock(engine->mutex) ;
+            engine->isStopRequested = true ;
+        }
+        engine->scansRead.notify_all() ;
+        engine->readerThread.join() ;
+        delete engine ;
+        taskRecord.closedLoopEngine = (ClosedLoopEngine *)(0) ;
+    }
+}
+// end of function
+
+
+
+// Error out if a closed-loop engine is reading the task.  Only DAQmxReadBinaryI16 and 
+// DAQmxGetReadAvailSampPerChan know to get scans from the engine instead of the driver.
+void
+checkNoClosedLoop(TaskHandle taskHandle, const std::string & action)  {
+    if (findTaskRecord(taskHandle)->closedLoopEngine)  {
+        mexErrMsgIdAndTxt("ws:ni:closedLoopIsRunning", "%s can't read from a task with a closed loop running on it", action.c_str()) ;
+    }
+}
+
+
+
+// Take scans from the ring of a closed-loop engine, as DAQmxReadBinaryI16 would take them 
+// from the driver.  A negative scanCountRequested means all the scans in the ring.  On 
+// success, sets *outputDataMXArray to a new int16 array laid out according to fillMode.  
+// Returns a DAQmx status, which is DAQmxErrorSamplesNotYetAvailable on a timeout, and 
+// DAQmxErrorSamplesNoLongerAvailable if the ring overflowed.
+int32
+takeScansFromClosedLoop(ClosedLoopEngine & engine, int32 scanCountRequested, float64 timeout, bool32 fillMode, mxArray ** outputDataMXArray)  {
+    std::unique_lock<std::mutex> lock(engine.mutex) ;
+    uInt64 scanCount ;
+    if (scanCountRequested >= 0)  {
+        auto isReady = [&engine, scanCountRequested]()  {
+            return engine.errorStatus < 0 || engine.isRingOverflowed ||
+                   engine.scanCountRead - engine.scanCountConsumed >= (uInt64)(scanCountRequested) ;
+        } ;
+        if (timeout < 0)  {
+            engine.scansRead.wait(lock, isReady) ;
+        }
+        else if (!engine.scansRead.wait_for(lock, std::chrono::duration<float64>(timeout), isReady))  {
+            return DAQmxErrorSamplesNotYetAvailable ;
+        }
+        scanCount = (uInt64)(scanCountRequested) ;
+    }
+    else  {
+        scanCount = engine.scanCountRead - engine.scanCountConsumed ;
+    }
+    if (engine.errorStatus < 0)  {
+        return engine.errorStatus ;
+    }
+    if (engine.isRingOverflowed)  {
+        return DAQmxErrorSamplesNoLongerAvailable ;
+    }
+
+    // Copy the scans out of the ring
+    const size_t channelCount = engine.channelCount ;
+    const int16 * ring = engine.ring.data() ;
+    if (fillMode == DAQmx_Val_GroupByScanNumber)  {
+        *outputDataMXArray = mxCreateNumericMatrix(channelCount, (mwSize)(scanCount), mxINT16_CLASS, mxREAL) ;
+        int16 * outputData = (int16 *)mxGetData(*outputDataMXArray) ;
+        for (uInt64 i = 0; i < scanCount; ++i)  {
+            size_t ringIndex = (size_t)((engine.scanCountConsumed + i) % engine.ringScanCount) ;
+            std::copy(ring + ringIndex*channelCount, ring + (ringIndex+1)*channelCount, outputData + i*channelCount) ;
+        }
+    }
+    else  {
+        *outputDataMXArray = mxCreateNumericMatrix((mwSize)(scanCount), channelCount, mxINT16_CLASS, mxREAL) ;
+        int16 * outputData = (int16 *)mxGetData(*outputDataMXArray) ;
+        for (uInt64 i = 0; i < scanCount; ++i)  {
+            size_t ringIndex = (size_t)((engine.scanCountConsumed + i) % engine.ringScanCount) ;
+            for (size_t j = 0; j < channelCount; ++j)  {
+                outputData[j*scanCount + i] = ring[ringIndex*channelCount + j] ;
+            }
+        }
+    }
+    engine.scanCountConsumed += scanCount ;
+    return 0 ;
+}
+
+
+
+// Release the task's on-demand DO binding, if it has one.  Stops any closed-loop 
+// engines that drive it first.
+void
+unbindOnDemandDO(TaskRecord & taskRecord)  {
+    if (taskRecord.onDemandDOBindingID)  {
+        std::unordered_map<TaskHandle, TaskRecord>::iterator it ;
+        for (it = TASK_RECORD_FROM_HANDLE.begin(); it != TASK_RECORD_FROM_HANDLE.end(); ++it)  {
+            if ( it->second.closedLoopEngine && it->second.closedLoopEngine->doBindingID == taskRecord.onDemandDOBindingID )  {
+                stopClosedLoop(it->second) ;
+            }
+        }
+        OnDemandDOBinding * & binding = ON_DEMAND_DO_BINDINGS[taskRecord.onDemandDOBindingID-1] ;
+        delete binding ;
+        binding = (OnDemandDOBinding *)(0) ;
+        taskRecord.onDemandDOBindingID = 0 ;
+    }
+}
+// end of function
+
 
 
-// Utility to clear the task at the indicated index in TASK_HANDLES.  
+// Utility to clear the given task, which must be a registered task handle.
 // Won't throw a Matlab error, but returns a NI-style status code.
-// Doesn't let a warning stop it from removing an item from TASK_HANDLES.
+// Doesn't let a warning stop it from un-registering the task.
 int32
-clearTaskByIndex(int32 taskHandleIndex, bool doIgnoreErrors)  {
+clearTask(TaskHandle taskHandle, bool doIgnoreErrors)  {
     int32 status ;
 
-    //mexPrintf("Just entered clearTaskByIndex, with taskHandleIndex = %d\n", taskHandleIndex) ;
-    if ( 0 <= taskHandleIndex && taskHandleIndex < TASK_HANDLE_COUNT )  {
-        TaskHandle taskHandle = TASK_HANDLES[taskHandleIndex] ;
-        if (IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED && taskHandle == EVERY_N_SAMPLES_TASK_HANDLE) {
-            status = unregisterEveryNSamplesEventAndUpdateGlobals(doIgnoreErrors);
-            status = doIgnoreErrors ? 0 : status;
-            if (status < 0) {
-                return status;
-            }
+    TaskRecord * taskRecord = findTaskRecord(taskHandle) ;
+    if ( taskRecord )  {
+        stopOutputStream(*taskRecord, false) ;
+        stopClosedLoop(*taskRecord) ;
+        unbindOnDemandDO(*taskRecord) ;
+        status = unregisterEveryNSamplesEvent(*taskRecord, doIgnoreErrors);
+        status = doIgnoreErrors ? 0 : status;
+        if (status < 0) {
+            return status;
         }
         status = DAQmxClearTask(taskHandle);
         status = doIgnoreErrors ? 0 : status;
-        if ( status >= 0 )  {  // Even if a warning, still remove the task from TASK_HANDLES
-            // Remove it from the list, shifting tasks after it one left
-            int32 i ;
-            for ( i = taskHandleIndex ; i < (TASK_HANDLE_COUNT-1) ; ++i )  {
-                TASK_HANDLES[i] = TASK_HANDLES[i+1] ;
-            }
-            TASK_HANDLES[TASK_HANDLE_COUNT-1] = 0 ;  // For tidyness
-            
-            // Decrement the task handle count
-            --TASK_HANDLE_COUNT ;
+        if ( status >= 0 )  {  // Even if a warning, still un-register the task
+            TASK_RECORD_FROM_HANDLE.erase(taskHandle) ;
+            TASK_HANDLES.erase(std::find(TASK_HANDLES.begin(), TASK_HANDLES.end(), taskHandle)) ;
         }
     }    
     else {
-        // the taskHandleIndex was bad, but we'll just ignore that
+        // the taskHandle was bad, but we'll just ignore that
         status = 0 ;
     }
         
@@ -564,12 +1380,13 @@ clearTaskByIndex(int32 taskHandleIndex, bool doIgnoreErrors)  {
 int32
 clearAllTasks(bool doIgnoreErrors)  {
     int32 status = 0 ;  // Used several places for DAQmx return codes
-    int32 taskHandleIndex ;
 
-    // Delete each task, last to first
-    //for ( taskHandleIndex=0 ; taskHandleIndex<TASK_HANDLE_COUNT ; ++taskHandleIndex)  {
-    for (taskHandleIndex=(TASK_HANDLE_COUNT-1); taskHandleIndex>=0; --taskHandleIndex)  {  // faster
-        int32 thisStatus = clearTaskByIndex(taskHandleIndex, doIgnoreErrors) ;
+    // Delete each task, last to first.  Copy the handles first, since clearing a task
+    // removes it from TASK_HANDLES.
+    std::vector<TaskHandle> taskHandles(TASK_HANDLES) ;
+    std::vector<TaskHandle>::reverse_iterator it ;
+    for (it = taskHandles.rbegin(); it != taskHandles.rend(); ++it)  {
+        int32 thisStatus = clearTask(*it, doIgnoreErrors) ;
         if ( thisStatus < 0 )  {  // ignore warnings but not errors
             status = thisStatus ;
         }
@@ -583,9 +1400,9 @@ clearAllTasks(bool doIgnoreErrors)  {
 
 // This will be registered with mexAtExit()
 static void finalize(void)  {
-    // If a callback is registered, unregister it
+    // If any callbacks are registered, unregister them
     const bool doIgnoreErrors = true;
-    unregisterEveryNSamplesEventAndUpdateGlobals(doIgnoreErrors);
+    unregisterAllEveryNSamplesEvents(doIgnoreErrors);
 
     // Clear all the tasks
     clearAllTasks(doIgnoreErrors) ;  // Ignore return value, b/c can't do anything about it anyway
@@ -617,11 +1434,6 @@ CreateTask(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArra
     TaskHandle *taskHandlePtr ;
     //mwSize i ;
 
-    if ( TASK_HANDLE_COUNT == MAXIMUM_TASK_HANDLE_COUNT )  {
-        mexErrMsgIdAndTxt("ws:ni:tooManyTasks",
-                          "Unable to create new DAQmx task, because the maximum number of tasks already exist") ;
-    }    
-    
     // prhs[1]: taskName
     std::string taskName(readMandatoryStringArgument(nrhs, prhs, 1, "taskName", EMPTY_IS_NOT_ALLOWED)) ;
 
@@ -634,8 +1446,10 @@ CreateTask(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArra
     //mexPrintf("Point 3\n");
 
     // Register the taskHandle
-    TASK_HANDLES[TASK_HANDLE_COUNT] = taskHandle ;
-    ++TASK_HANDLE_COUNT ;
+    TaskRecord taskRecord = TaskRecord() ;  // value-initialized, so all zeros
+    taskRecord.taskHandle = taskHandle ;
+    TASK_RECORD_FROM_HANDLE[taskHandle] = taskRecord ;
+    TASK_HANDLES.push_back(taskHandle) ;
 
     // Allocate the output buffer
     taskHandleMXArray = mxCreateNumericMatrix(1, 1, mxUINT64_CLASS, mxREAL) ;
@@ -664,11 +1478,12 @@ void GetAllTaskHandles(std::string action, int nlhs, mxArray *plhs[], int nrhs,
     //TaskHandle *taskHandlePtr ;
     //mwSize i ;
 
-    mxArray* taskHandleMXArray = mxCreateNumericMatrix(1, TASK_HANDLE_COUNT, mxUINT64_CLASS, mxREAL) ;
+    mwSize taskHandleCount = TASK_HANDLES.size() ;
+    mxArray* taskHandleMXArray = mxCreateNumericMatrix(1, taskHandleCount, mxUINT64_CLASS, mxREAL) ;
     uInt64* taskHandleMxArrayStoragePointer = (uInt64*)(mxGetData(taskHandleMXArray)) ;
     
     mwSize i ;
-    for (i=0; i<TASK_HANDLE_COUNT; ++i)  {
+    for (i=0; i<taskHandleCount; ++i)  {
         taskHandleMxArrayStoragePointer[i] = (uInt64)(TASK_HANDLES[i]) ;
     }
     
@@ -689,16 +1504,10 @@ void ClearTask(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mx
     taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
         // This will error out if there are zero registered tasks
     
-    // Find the index of the task handle
-    int taskHandleIndex = findTaskByHandle(taskHandle) ;
-    if ( taskHandleIndex < 0 )  {
-        mexErrMsgIdAndTxt("ws:ni:BadArgument", "Not a valid task handle");
-    }
-    
     // Clear the task
     const bool doIgnoreErrors = false;
     int32 status;  // Used several places for DAQmx return codes
-    status = clearTaskByIndex(taskHandleIndex, doIgnoreErrors) ;
+    status = clearTask(taskHandle, doIgnoreErrors) ;
     handlePossibleDAQmxErrorOrWarning(status, action);
     
     // If get here, task was successfully un-registered                    
@@ -777,9 +1586,23 @@ void TaskControl(std::string action, int nlhs, mxArray *plhs[], int nrhs, const
     taskAction = readValueArgument(nrhs, prhs, 
                                    2, "taskAction") ;
 
+    // Unreserving or aborting a task can free its output buffer
+    if (taskAction==DAQmx_Val_Task_Unreserve || taskAction==DAQmx_Val_Task_Abort)  {
+        invalidateWriteCache(taskHandle) ;
+    }
+
+    // Verifying or committing a task again is a no-op if its configuration hasn't changed 
+    // since the last time, but can take a good while, so skip it
+    TaskRecord & taskRecord = *findTaskRecord(taskHandle) ;
+    if ( (taskAction==DAQmx_Val_Task_Verify && isTaskVerifiedAsConfigured(taskRecord)) || 
+         (taskAction==DAQmx_Val_Task_Commit && isTaskCommittedAsConfigured(taskRecord)) )  {
+        return ;
+    }
+
     // Make the call
     status = DAQmxTaskControl(taskHandle, taskAction) ;
     handlePossibleDAQmxErrorOrWarning(status, action);
+    noteTaskControl(taskRecord, taskAction) ;
     }
 // end of function
 
@@ -875,7 +1698,28 @@ void CfgSampClkTiming(std::string action, int nlhs, mxArray *plhs[], int nrhs, c
         mexErrMsgTxt("sampsPerChannelToAcquire must be a numeric scalar");        
     }
 
-    // Call it in
+    // Call it in.  A change of timing can resize the output buffer, so forget what was 
+    // written to it, unless the timing is the same as last time.
+    TaskRecord & taskRecord = *findTaskRecord(taskHandle) ;
+    SampleClockTiming timing ;
+    timing.isValid = true ;
+    timing.sourceHash = xxHash64(source.data(), source.size(), 0) ;
+    timing.rate = rate ;
+    timing.activeEdge = activeEdge ;
+    timing.sampleMode = sampleMode ;
+    timing.sampsPerChan = sampsPerChanToAcquire ;
+    const SampleClockTiming & lastTiming = taskRecord.sampleClockTiming ;
+    bool isTimingUnchanged = 
+        lastTiming.isValid && 
+        lastTiming.sourceHash == timing.sourceHash && 
+        lastTiming.rate == timing.rate && 
+        lastTiming.activeEdge == timing.activeEdge && 
+        lastTiming.sampleMode == timing.sampleMode && 
+        lastTiming.sampsPerChan == timing.sampsPerChan ;
+    if (!isTimingUnchanged)  {
+        taskRecord.writeCache.isValid = false ;
+    }
+    taskRecord.sampleClockTiming.isValid = false ;  // until we know the call worked
     int32 status;
     const char * sourceArgument = (source.empty() ? NULL : source.c_str()) ;
     status = DAQmxCfgSampClkTiming(taskHandle,
@@ -884,6 +1728,12 @@ void CfgSampClkTiming(std::string action, int nlhs, mxArray *plhs[], int nrhs, c
                                    activeEdge, 
                                    sampleMode,
                                    sampsPerChanToAcquire);
+    if (status < 0)  {
+        taskRecord.writeCache.isValid = false ;
+    }
+    else  {
+        taskRecord.sampleClockTiming = timing ;
+    }
     handlePossibleDAQmxErrorOrWarning(status, action);
     }
 // end of function
@@ -1029,9 +1879,19 @@ void GetReadAvailSampPerChan(std::string action, int nlhs, mxArray *plhs[], int
     taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
 
     //
-    // Make the call
+    // Make the call, or ask the closed-loop engine, if one is reading the task
     //
-    status = DAQmxGetReadAvailSampPerChan(taskHandle, &nSampsPerChanAvail);
+    ClosedLoopEngine * engine = findTaskRecord(taskHandle)->closedLoopEngine ;
+    if (engine)
+        {
+        std::lock_guard<std::mutex> lock(engine->mutex) ;
+        status = engine->isRingOverflowed ? DAQmxErrorSamplesNoLongerAvailable : engine->errorStatus ;
+        nSampsPerChanAvail = (uInt32)(engine->scanCountRead - engine->scanCountConsumed) ;
+        }
+    else
+        {
+        status = DAQmxGetReadAvailSampPerChan(taskHandle, &nSampsPerChanAvail);
+        }
     handlePossibleDAQmxErrorOrWarning(status, action);
 
     // Return output data
@@ -1061,7 +1921,7 @@ void IsTaskDone(std::string action, int nlhs, mxArray *plhs[], int nrhs, const m
 
 
 
-// outputData = DAQmxReadBinaryI16(taskHandle, nSampsPerChanWanted, timeout)
+// outputData = DAQmxReadBinaryI16(taskHandle, nSampsPerChanWanted, timeout, [fillMode])
 void ReadBinaryI16(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  
     {
     int32 status ;  // Used several places for DAQmx return codes
@@ -1084,6 +1944,7 @@ void ReadBinaryI16(std::string action, int nlhs, mxArray *plhs[], int nrhs, cons
     // prhs[1]: taskHandle
     // prhs[2]: numSampsPerChanRequested
     // prhs[3]: timeout
+    // prhs[4]: fillMode (optional)
 
     // prhs[1]: taskHandle
     taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
@@ -1101,6 +1962,20 @@ void ReadBinaryI16(std::string action, int nlhs, mxArray *plhs[], int nrhs, cons
     // prhs[3]: timeout
     timeout = readTimeoutArgument(nrhs, prhs, 3) ;
     
+    // prhs[4]: fillMode
+    bool32 fillMode = readFillModeArgument(nrhs, prhs, 4) ;
+
+    // If a closed-loop engine is reading the task, take the scans from it instead
+    ClosedLoopEngine * engine = findTaskRecord(taskHandle)->closedLoopEngine ;
+    if (engine)
+        {
+        outputDataMXArray = 0 ;
+        status = takeScansFromClosedLoop(*engine, numSampsPerChanRequested, timeout, fillMode, &outputDataMXArray) ;
+        handlePossibleDAQmxErrorOrWarning(status, action);
+        plhs[0] = outputDataMXArray ;
+        return ;
+        }
+
     // Determine # of channels
     status = DAQmxGetReadNumChans(taskHandle,&numChannels); 
     handlePossibleDAQmxErrorOrWarning(status, action);
@@ -1120,8 +1995,16 @@ void ReadBinaryI16(std::string action, int nlhs, mxArray *plhs[], int nrhs, cons
         }
     
     // Allocate the output buffer
-    outputDataMXArray = 
-        mxCreateNumericMatrix(numSampsPerChanToTryToRead,numChannels,mxINT16_CLASS,mxREAL);
+    if (fillMode == DAQmx_Val_GroupByScanNumber)
+        {
+        outputDataMXArray = 
+            mxCreateNumericMatrix(numChannels,numSampsPerChanToTryToRead,mxINT16_CLASS,mxREAL);
+        }
+    else
+        {
+        outputDataMXArray = 
+            mxCreateNumericMatrix(numSampsPerChanToTryToRead,numChannels,mxINT16_CLASS,mxREAL);
+        }
 
     // Check that the array size is correct
     arraySizeInSamps = ((uInt32)numSampsPerChanToTryToRead) * numChannels ;
@@ -1143,7 +2026,7 @@ void ReadBinaryI16(std::string action, int nlhs, mxArray *plhs[], int nrhs, cons
         status = DAQmxReadBinaryI16(taskHandle, 
                                     numSampsPerChanToTryToRead, 
                                     timeout, 
-                                    DAQmx_Val_GroupByChannel, 
+                                    fillMode, 
                                     outputDataPtr, 
                                     arraySizeInSamps, 
                                     &numSampsPerChanRead, 
@@ -1160,14 +2043,16 @@ void ReadBinaryI16(std::string action, int nlhs, mxArray *plhs[], int nrhs, cons
 
 
 
-// outputData = DAQmxReadAnalogF64(taskHandle, nSampsPerChanWanted, timeout)
+// outputData = DAQmxReadAnalogF64(taskHandle, nSampsPerChanWanted, timeout, [fillMode])
 void ReadAnalogF64(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
     // prhs[1]: taskHandle
     // prhs[2]: numSampsPerChanRequested
     // prhs[3]: timeout
+    // prhs[4]: fillMode (optional)
 
     // prhs[1]: taskHandle
     TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs);
+    checkNoClosedLoop(taskHandle, action);
 
     // prhs[2]: numSampsPerChanRequested
     int32 numSampsPerChanRequested;  // this does take negative vals in the case of DAQmx_Val_Auto
@@ -1181,6 +2066,9 @@ void ReadAnalogF64(std::string action, int nlhs, mxArray *plhs[], int nrhs, cons
     // prhs[3]: timeout
     float64 timeout = readTimeoutArgument(nrhs, prhs, 3);
 
+    // prhs[4]: fillMode
+    bool32 fillMode = readFillModeArgument(nrhs, prhs, 4);
+
     // Determine # of channels
     uInt32 numChannels;
     int32 status = DAQmxGetReadNumChans(taskHandle, &numChannels);
@@ -1202,8 +2090,14 @@ void ReadAnalogF64(std::string action, int nlhs, mxArray *plhs[], int nrhs, cons
 
     // Allocate the output buffer
     mxArray *outputDataMXArray;
-    outputDataMXArray =
-        mxCreateNumericMatrix(numSampsPerChanToTryToRead, numChannels, mxDOUBLE_CLASS, mxREAL);
+    if (fillMode == DAQmx_Val_GroupByScanNumber)  {
+        outputDataMXArray =
+            mxCreateNumericMatrix(numChannels, numSampsPerChanToTryToRead, mxDOUBLE_CLASS, mxREAL);
+    }
+    else  {
+        outputDataMXArray =
+            mxCreateNumericMatrix(numSampsPerChanToTryToRead, numChannels, mxDOUBLE_CLASS, mxREAL);
+    }
 
     // Check that the array size is correct
     uInt32 arraySizeInSamps = ((uInt32)numSampsPerChanToTryToRead) * numChannels;
@@ -1226,7 +2120,7 @@ void ReadAnalogF64(std::string action, int nlhs, mxArray *plhs[], int nrhs, cons
             taskHandle,
             numSampsPerChanToTryToRead,
             timeout,
-            DAQmx_Val_GroupByChannel,
+            fillMode,
             outputDataPtr,
             arraySizeInSamps,
             &numSampsPerChanRead,
@@ -1277,8 +2171,8 @@ parseListOfChannelNames(const std::string & listOfChannelNames) {
         size_t endPosition = listOfChannelNames.find(',', startPosition);  // returns end-of-string when ',' not found
         std::string raw = listOfChannelNames.substr(startPosition, endPosition - startPosition);
         result[i] = trim(raw);
-        // Prepare for next iteration
-        startPosition = endPosition;
+        // Prepare for next iteration, skipping the comma
+        startPosition = (endPosition == std::string::npos) ? endPosition : endPosition + 1;
     }
 
     return result;
@@ -1286,6 +2180,48 @@ parseListOfChannelNames(const std::string & listOfChannelNames) {
 
 
 
+// Get the names of the channels in the task, in order.  Errors out on a DAQmx error.
+std::vector<std::string>
+getTaskChannelNames(TaskHandle taskHandle, const std::string & action) {
+    int32 bufferSize = DAQmxGetTaskChannels(taskHandle, NULL, 0) ;  // This is the length of the string + 1, for the null terminator
+    handlePossibleDAQmxErrorOrWarning(bufferSize, action);  // This is an error code if there was a problem
+    std::vector<char> channelListAsCharVector(bufferSize);
+    int32 status = DAQmxGetTaskChannels(taskHandle, channelListAsCharVector.data(), bufferSize);
+    handlePossibleDAQmxErrorOrWarning(status, action);
+    std::string channelListAsString(channelListAsCharVector.data());
+
+    // channelListAsString now contains a comma-separated list of channel names, e.g.
+    // "Dev1/ai0, Dev1/ai1"
+
+    // Parse the list to get a vector of channel names
+    return parseListOfChannelNames(channelListAsString);
+}
+
+
+
+// How many volts-to-DAC-code coefficients we ask DAQmx for, per AO channel.  Devices 
+// generally have two (offset and gain), the rest come back as zeros.
+#define AO_DEV_SCALING_COEFFICIENT_COUNT 4
+
+// Get the coefficients DAQmx uses to convert volts to DAC codes for each AO channel in the 
+// task, coefficientCount per channel, constant term first.  Coefficients the device 
+// doesn't have are zero.  Errors out on a DAQmx error.
+std::vector<float64>
+getAODevScalingCoeffs(TaskHandle taskHandle, uInt32 coefficientCount, const std::string & action) {
+    uInt32 channelCount ;
+    int32 status = DAQmxGetWriteNumChans(taskHandle, &channelCount) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+    std::vector<std::string> channelNames(getTaskChannelNames(taskHandle, action)) ;
+    std::vector<float64> result((size_t)(coefficientCount)*channelCount, 0.0) ;
+    for (uInt32 i = 0; i < channelCount && i < channelNames.size(); ++i) {
+        status = DAQmxGetAODevScalingCoeff(taskHandle, channelNames[i].c_str(), result.data()+i*coefficientCount, coefficientCount) ;
+        handlePossibleDAQmxErrorOrWarning(status, action) ;
+    }
+    return result ;
+}
+
+
+
 // coefficients = DAQmxGetAIDevScalingCoeffs(taskHandle)
 void GetAIDevScalingCoeffs(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
     // All X series devices seem to return 4 coefficients
@@ -1303,23 +2239,7 @@ void GetAIDevScalingCoeffs(std::string action, int nlhs, mxArray *plhs[], int nr
     handlePossibleDAQmxErrorOrWarning(status, action);
 
     // Get the names of the channels
-    int32 bufferSize = DAQmxGetTaskChannels(taskHandle, NULL, 0) ;  // This is the length of the string + 1, for the null terminator
-    handlePossibleDAQmxErrorOrWarning(bufferSize, action);  // This is an error code if there was a problem
-    std::vector<char> channelListAsCharVector(bufferSize);
-    //status = DAQmxGetTaskChannels(taskHandle, const_cast<char*>(channelListAsCharVector.data()), bufferSizeNeeded);
-    status = DAQmxGetTaskChannels(taskHandle, channelListAsCharVector.data(), bufferSize);
-    handlePossibleDAQmxErrorOrWarning(status, action);
-    std::string channelListAsString(channelListAsCharVector.data());
-
-    // Print that string
-    //mexPrintf("channelListAsString size: %d\n", bufferSizeNeeded);
-    //mexPrintf("channel names: %s\n", channelListAsString.data());
-
-    // channelListAsString now contains a comma-separated list of channel names, e.g.
-    // "Dev1/ai0, Dev1/ai1"
-
-    // Parse the list to get a vector of channel names
-    std::vector<std::string> channelNames(parseListOfChannelNames(channelListAsString));
+    std::vector<std::string> channelNames(getTaskChannelNames(taskHandle, action));
     //for (uInt32 i = 0; i < channelCount; ++i) {
     //    mexPrintf("channelNames[%d]: %s\n", i, channelNames[i].c_str());
     //}
@@ -1336,7 +2256,7 @@ void GetAIDevScalingCoeffs(std::string action, int nlhs, mxArray *plhs[], int nr
     for (uInt32 i = 0; i < channelCount; ++i) {
         status = DAQmxGetAIDevScalingCoeff(taskHandle, channelNames[i].c_str(), outputDataPtr+i*coefficientCount, coefficientCount);
         if (status < 0) {
-            mxFree(outputDataMXArray);
+            mxDestroyArray(outputDataMXArray);
         }
         handlePossibleDAQmxErrorOrWarning(status, action);
         //mexPrintf("coeff[0]: %g\n", *(outputDataPtr + i*coefficientCount + 0));
@@ -1352,6 +2272,29 @@ void GetAIDevScalingCoeffs(std::string action, int nlhs, mxArray *plhs[], int nr
 
 
 
+// coefficients = DAQmxGetAODevScalingCoeffs(taskHandle)
+//
+// Returns a AO_DEV_SCALING_COEFFICIENT_COUNT x nChannels double array.  Each column 
+// holds the coefficients of the polynomial DAQmx uses to convert volts to DAC codes for 
+// that channel, constant term first.
+void GetAODevScalingCoeffs(std::string action, int /*nlhs*/, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+
+    std::vector<float64> coefficients(getAODevScalingCoeffs(taskHandle, AO_DEV_SCALING_COEFFICIENT_COUNT, action)) ;
+    mwSize channelCount = coefficients.size() / AO_DEV_SCALING_COEFFICIENT_COUNT ;
+    mxArray * outputDataMXArray = mxCreateNumericMatrix(AO_DEV_SCALING_COEFFICIENT_COUNT, channelCount, mxDOUBLE_CLASS, mxREAL) ;
+    if (!coefficients.empty())  {
+        std::copy(coefficients.begin(), coefficients.end(), mxGetPr(outputDataMXArray)) ;
+    }
+
+    // Return output data
+    plhs[0] = outputDataMXArray ;
+}
+// end of function
+
+
+
 // outputData = DAQmxReadDigitalLines(taskHandle, nSampsPerChanWanted, timeout)
 void ReadDigitalLines(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  
     {
@@ -1546,90 +2489,602 @@ void ReadDigitalU32(std::string action, int nlhs, mxArray *plhs[], int nrhs, con
 
 
 
-// DAQmxWaitUntilTaskDone(taskHandle, timeToWait)
-void WaitUntilTaskDone(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
-    int32 status ;  // Used several places for DAQmx return codes
-    TaskHandle taskHandle ;
-    float64 timeToWait ;
-    int index ;
+// Read a terminalIDPerLine argument: a real double vector of at most 32 distinct 
+// integers between 0 and 31, each the DIO line (i.e. the bit of the port word) of a line
+std::vector<uInt32>
+readTerminalIDPerLineArgument(int nrhs, const mxArray *prhs[], int index)  {
+    std::vector<uInt32> terminalIDPerLine ;
+    if ( (nrhs>index) && mxIsDouble(prhs[index]) && !mxIsComplex(prhs[index]) && mxGetNumberOfDimensions(prhs[index])==2 && 
+         mxGetNumberOfElements(prhs[index])<=32 )  {
+        size_t lineCount = mxGetNumberOfElements(prhs[index]) ;
+        double * terminalIDPerLineAsDouble = mxGetPr(prhs[index]) ;
+        uInt32 linesSeen = 0 ;
+        for (size_t lineIndex = 0; lineIndex < lineCount; ++lineIndex)  {
+            double terminalIDAsDouble = terminalIDPerLineAsDouble[lineIndex] ;
+            if ( !(0.0<=terminalIDAsDouble && terminalIDAsDouble<=31.0) || terminalIDAsDouble != floor(terminalIDAsDouble) )  {
+                mexErrMsgIdAndTxt("ws:ni:badArgument", "Each element of terminalIDPerLine must be an integer between 0 and 31");
+            }
+            uInt32 terminalID = (uInt32)(terminalIDAsDouble) ;
+            if ( (linesSeen >> terminalID) & 1 )  {
+                mexErrMsgIdAndTxt("ws:ni:badArgument", "The elements of terminalIDPerLine must be distinct");
+            }
+            linesSeen |= ((uInt32)1) << terminalID ;
+            terminalIDPerLine.push_back(terminalID) ;
+        }
+    }
+    else {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "terminalIDPerLine must be a real double vector with at most 32 elements");
+    }
+    return terminalIDPerLine ;
+}
 
-    //
-    // Read input arguments
-    //
 
-    // prhs[1]: taskHandle
-    taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
 
-    // prhs[2]: timeToWait
-    index=2 ;
-    if (nrhs>index)  {
-        if ( mxIsEmpty(prhs[index]) )   {
-            timeToWait = DAQmx_Val_WaitInfinitely ;
-        }
-        else if ( mxIsScalar(prhs[index]) )   {
-            timeToWait = (float64) mxGetScalar(prhs[index]) ;
-            if (timeToWait==-1.0 || timeToWait>=0)  {
-                if ( isfinite(timeToWait) )  {
-                    // do nothing, all is well
-                }
-                else  {
-                    timeToWait = DAQmx_Val_WaitInfinitely ;
-                }
+// Build the lookup tables for gathering the bits of a raw DI port word into a packed word.
+// After this, for a raw word w, the packed word is 
+//
+//     table[0][w&0xff] | table[1][(w>>8)&0xff] | table[2][(w>>16)&0xff] | table[3][w>>24]
+//
+// where bit i of the packed word is bit terminalIDPerLine[i] of w.  This works for any 
+// order of the terminal IDs.
+void
+buildBitGatherTables(const std::vector<uInt32> & terminalIDPerLine, uInt32 table[4][256])  {
+    for (int byteIndex = 0; byteIndex < 4; ++byteIndex)  {
+        // contributionFromBit[j] is what bit j of this byte contributes to the packed word
+        uInt32 contributionFromBit[8] = { 0, 0, 0, 0, 0, 0, 0, 0 } ;
+        for (size_t lineIndex = 0; lineIndex < terminalIDPerLine.size(); ++lineIndex)  {
+            uInt32 terminalID = terminalIDPerLine[lineIndex] ;
+            if ( terminalID/8 == (uInt32)byteIndex )  {
+                contributionFromBit[terminalID%8] |= ((uInt32)1) << lineIndex ;
             }
-            else  {
-                mexErrMsgTxt("timeToWait must be DAQmx_Val_WaitInfinitely (-1), 0, or positive");
+        }
+        // Each entry is the entry with the lowest set bit cleared, plus the contribution of that bit
+        table[byteIndex][0] = 0 ;
+        for (uInt32 byteValue = 1; byteValue < 256; ++byteValue)  {
+            uInt32 lowestBitIndex = 0 ;
+            while ( !((byteValue >> lowestBitIndex) & 1) )  {
+                ++lowestBitIndex ;
             }
+            table[byteIndex][byteValue] = table[byteIndex][byteValue & (byteValue-1)] | contributionFromBit[lowestBitIndex] ;
+        }
+    }
+}
+
+
+
+// Whether the CPU has the BMI2 instructions, in particular PEXT.  Checked once.
+bool
+isBMI2Supported()  {
+#if defined(WS_IS_X64)
+    static int result = -1 ;
+    if (result < 0)  {
+#if defined(_MSC_VER)
+        int registers[4] ;  // eax, ebx, ecx, edx
+        __cpuidex(registers, 7, 0) ;
+        result = (registers[1] >> 8) & 1 ;
+#else
+        unsigned int eax, ebx, ecx, edx ;
+        result = ( __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && ((ebx >> 8) & 1) ) ? 1 : 0 ;
+#endif
+    }
+    return (result != 0) ;
+#else
+    return false ;
+#endif
+}
+
+
+
+#if defined(WS_IS_X64)
+// Gather the bits given by mask from each raw word, packing them into the low-order bits.
+// Only valid if the terminal IDs are in increasing order.  Caller must check isBMI2Supported().
+WS_TARGET_BMI2
+void
+gatherBitsWithPEXT(const uInt32 * rawWords, size_t wordCount, uInt32 mask, uInt32 * packedWords)  {
+    for (size_t i = 0; i < wordCount; ++i)  {
+        packedWords[i] = _pext_u32(rawWords[i], mask) ;
+    }
+}
+#endif
+
+
+
+// Pack and reorder the raw words into the target, which holds elements of type T.
+// Bit i of each target element is set to bit terminalIDPerLine[i] of the corresponding raw word.
+template<typename T>
+void
+packDigitalData(const uInt32 * rawWords, size_t wordCount, const std::vector<uInt32> & terminalIDPerLine, T * target)  {
+    // Check if the terminal IDs are in increasing order, in which case the gather is a single PEXT
+    bool isIncreasing = true ;
+    uInt32 mask = 0 ;
+    for (size_t lineIndex = 0; lineIndex < terminalIDPerLine.size(); ++lineIndex)  {
+        if ( lineIndex>0 && terminalIDPerLine[lineIndex] <= terminalIDPerLine[lineIndex-1] )  {
+            isIncreasing = false ;
+        }
+        mask |= ((uInt32)1) << terminalIDPerLine[lineIndex] ;
+    }
+
+#if defined(WS_IS_X64)
+    if ( isIncreasing && isBMI2Supported() )  {
+        if ( sizeof(T) == sizeof(uInt32) )  {
+            gatherBitsWithPEXT(rawWords, wordCount, mask, (uInt32 *)(target)) ;
         }
         else  {
-            mexErrMsgTxt("timeToWait must be a missing, empty, or a scalar");        
+            // Do it in blocks, so the intermediate buffer stays in cache
+            const size_t blockSize = 4096 ;
+            uInt32 packedBlock[blockSize] ;
+            for (size_t blockStart = 0; blockStart < wordCount; blockStart += blockSize)  {
+                size_t thisBlockSize = std::min(blockSize, wordCount-blockStart) ;
+                gatherBitsWithPEXT(rawWords+blockStart, thisBlockSize, mask, packedBlock) ;
+                for (size_t i = 0; i < thisBlockSize; ++i)  {
+                    target[blockStart+i] = (T)(packedBlock[i]) ;
+                }
+            }
         }
+        return ;
     }
-    else  {
-        timeToWait = DAQmx_Val_WaitInfinitely ;
+#endif
+
+    // General case: Use a lookup table per byte of the raw word
+    uInt32 table[4][256] ;
+    buildBitGatherTables(terminalIDPerLine, table) ;
+    for (size_t i = 0; i < wordCount; ++i)  {
+        uInt32 w = rawWords[i] ;
+        target[i] = (T)( table[0][w & 0xff] | table[1][(w >> 8) & 0xff] | table[2][(w >> 16) & 0xff] | table[3][w >> 24] ) ;
     }
+}
 
-    //
-    // Make the call
-    status = DAQmxWaitUntilTaskDone(taskHandle,timeToWait) ; 
-    handlePossibleDAQmxErrorOrWarning(status, action);
+
+
+// Allocate an nScans x 1 array for packed digital lines, of the smallest of uint8, uint16, 
+// uint32 that will hold lineCount lines
+mxArray *
+createPackedDigitalLinesArray(size_t scanCount, size_t lineCount)  {
+    mxClassID classID = (lineCount<=8) ? mxUINT8_CLASS : ( (lineCount<=16) ? mxUINT16_CLASS : mxUINT32_CLASS ) ;
+    mxArray * result = mxCreateNumericMatrix(scanCount, 1, classID, mxREAL);
+    if ( mxGetNumberOfElements(result) != scanCount )  {
+        mexErrMsgIdAndTxt("ws:ni:failedToAllocateMemory", "Failed to allocate an output array of the desired size");    
+    }
+    return result ;
 }
 
 
 
-// sampsPerChanWritten = DAQmxWriteAnalogF64(taskHandle, autoStart, timeout, writeArray)
-void WriteAnalogF64(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  
-    {
-    int32 status ;  // Used several places for DAQmx return codes
-    int index ; // index of the input arg we're currently dealing with
-    TaskHandle taskHandle ;
-    bool32 autoStart ;
-    float64 timeout ;
-    float64 *writeArray = 0 ;
-    mwSize nSampsPerChan ;
-    mwSize nChannelsInWriteArray ;
-    uInt32 nChannelsInTask ;
-    int32 nSampsPerChanWritten ;
+// Pack and reorder wordCount raw port words into an array from createPackedDigitalLinesArray()
+void
+packDigitalDataIntoArray(const uInt32 * rawWords, size_t wordCount, const std::vector<uInt32> & terminalIDPerLine, mxArray * target)  {
+    void * targetData = mxGetData(target) ;
+    mxClassID classID = mxGetClassID(target) ;
+    if (classID == mxUINT8_CLASS)  {
+        packDigitalData(rawWords, wordCount, terminalIDPerLine, (uInt8 *)(targetData)) ;
+    }
+    else if (classID == mxUINT16_CLASS)  {
+        packDigitalData(rawWords, wordCount, terminalIDPerLine, (uInt16 *)(targetData)) ;
+    }
+    else  {
+        packDigitalData(rawWords, wordCount, terminalIDPerLine, (uInt32 *)(targetData)) ;
+    }
+}
+
 
-    //
-    // Read input arguments
-    //
 
+// outputData = ReadPackedDigitalLines(taskHandle, nSampsPerChanWanted, timeout, terminalIDPerLine)
+//
+// Like DAQmxReadDigitalU32, for a task with a single DI channel holding all the lines, but 
+// with the lines packed and reordered, so that bit i (zero-based) of each output element 
+// is the line with terminal ID terminalIDPerLine(i+1).  The output is an nScans x 1 
+// array of the smallest of uint8, uint16, uint32 that will hold all the lines.  This 
+// does in one pass what ws.reorderDIData() followed by ws.dropExtraBits() does.
+void ReadPackedDigitalLines(std::string action, int /*nlhs*/, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
     // prhs[1]: taskHandle
-    taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
 
-    // prhs[2]: autoStart
-    index = 2;
-    if ( (nrhs>index) && mxIsScalar(prhs[index]) )  
-        {
-        autoStart = (bool32) mxGetScalar(prhs[index]) ;
+    // prhs[2]: numSampsPerChanWanted
+    int32 numSampsPerChanWanted;  // this does take negative vals in the case of DAQmx_Val_Auto
+    if ( (nrhs>2) && mxIsScalar(prhs[2]) )   {
+        numSampsPerChanWanted = (int32) mxGetScalar(prhs[2]) ;
+    }
+    else {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "numSampsPerChanWanted must be a scalar");        
+    }
+
+    // prhs[3]: timeout
+    float64 timeout = readTimeoutArgument(nrhs, prhs, 3) ;
+
+    // prhs[4]: terminalIDPerLine
+    std::vector<uInt32> terminalIDPerLine(readTerminalIDPerLineArgument(nrhs, prhs, 4)) ;
+    size_t lineCount = terminalIDPerLine.size() ;
+
+    // Determine the number of samples to try to read.
+    // If user has requested all the sample available, find out how many that is.
+    int32 status;  // Used for DAQmx return code(s)
+    int32 numSampsPerChanToTryToRead;
+    if (numSampsPerChanWanted>=0)  {
+        numSampsPerChanToTryToRead = numSampsPerChanWanted ;
+    }
+    else {
+        uInt32 nSampsPerChanAvailable;
+        status = DAQmxGetReadAvailSampPerChan(taskHandle,&nSampsPerChanAvailable);
+        handlePossibleDAQmxErrorOrWarning(status, action);
+        numSampsPerChanToTryToRead = nSampsPerChanAvailable ;
+    }
+
+    // Allocate the output buffer
+    mxArray *outputDataMXArray = createPackedDigitalLinesArray(numSampsPerChanToTryToRead, lineCount) ;
+
+    // Read the data into a buffer of raw port words.
+    // The daqmx reading functions complain if you call them when there's no more data to read, 
+    // even if you ask for zero scans.
+    // So we don't attempt a read if numSampsPerChanToTryToRead is zero.
+    if (numSampsPerChanToTryToRead>0)  {
+        std::vector<uInt32> rawWords(numSampsPerChanToTryToRead) ;
+        int32 numSampsPerChanActuallyRead = 0;
+        status = DAQmxReadDigitalU32(taskHandle, 
+                                     numSampsPerChanToTryToRead, 
+                                     timeout, 
+                                     DAQmx_Val_GroupByChannel, 
+                                     rawWords.data(), 
+                                     numSampsPerChanToTryToRead,
+                                     &numSampsPerChanActuallyRead, 
+                                     NULL);
+        handlePossibleDAQmxErrorOrWarning(status, action);
+
+        // The read can come up short, so only keep the scans we actually got
+        size_t scanCount = (numSampsPerChanActuallyRead>0) ? (size_t)(numSampsPerChanActuallyRead) : 0 ;
+        if (scanCount > rawWords.size())  {
+            scanCount = rawWords.size() ;  // Should never happen, but just in case
         }
-    else 
-        {
-        mexErrMsgTxt("autoStart must be a scalar");        
+        mxSetM(outputDataMXArray, scanCount) ;
+
+        // Pack and reorder into the output
+        packDigitalDataIntoArray(rawWords.data(), scanCount, terminalIDPerLine, outputDataMXArray) ;
+    }
+
+    // Return output data
+    plhs[0] = outputDataMXArray ;  
+        // even if nlhs==0, still safe to assign to plhs[0], and should do this, so ans gets assigned        
+}
+// end of function
+
+
+
+// How long WaitForScans and WaitForPackedDigitalLines block in the driver at a time, in 
+// seconds, before checking whether the task has been stopped.  This bounds how long a wait 
+// can outlast a stop.
+#define WAIT_FOR_SCANS_SLICE_DURATION 0.01
+
+// Read nScansWanted scans and the task's doneness for WaitForScans and 
+// WaitForPackedDigitalLines.  nScansWanted is first clamped, for a finite task to the scans 
+// that remain to be read, and if the task is already done to the scans available, so this 
+// never waits for scans that will never come.  The scans are then read in driver reads 
+// lasting at most WAIT_FOR_SCANS_SLICE_DURATION each, until all are in, or timeout seconds 
+// have passed (forever if timeout is -1).  Once the task is done, whether before or during 
+// the wait, the scans still in the buffer are read without waiting.  makeBuffer(nScans) is called 
+// once the clamped count is known, and readScans(scanOffset, nScans, sliceTimeout, 
+// &nScansRead) does one read of nScans into the buffer starting at scanOffset, returning 
+// its DAQmx status.  Returns the number of scans read.  DAQmx errors other than a read 
+// timing out, or coming up short because the task was stopped, are raised.
+template <typename MakeBuffer, typename ReadScans>
+int32
+waitForAndReadScans(std::string action, TaskHandle taskHandle, uInt64 nScansWanted, float64 timeout, 
+                    MakeBuffer makeBuffer, ReadScans readScans, bool32 * isTaskDone)  {
+    // For a finite task, don't wait for more scans than remain to be read
+    int32 sampleMode ;
+    int32 status = DAQmxGetSampQuantSampMode(taskHandle, &sampleMode) ;
+    handlePossibleDAQmxErrorOrWarning(status, action);
+    if (sampleMode == DAQmx_Val_FiniteSamps)  {
+        uInt64 nScansPerChanInTask ;
+        status = DAQmxGetSampQuantSampPerChan(taskHandle, &nScansPerChanInTask) ;
+        handlePossibleDAQmxErrorOrWarning(status, action);
+        uInt64 nScansReadSoFar ;
+        status = DAQmxGetReadCurrReadPos(taskHandle, &nScansReadSoFar) ;
+        handlePossibleDAQmxErrorOrWarning(status, action);
+        uInt64 nScansRemaining = (nScansReadSoFar<nScansPerChanInTask) ? (nScansPerChanInTask-nScansReadSoFar) : 0 ;
+        nScansWanted = std::min(nScansWanted, nScansRemaining) ;
+    }
+
+    // If the task is already done, no more scans are coming, so just read what's there
+    status = DAQmxIsTaskDone(taskHandle, isTaskDone) ;
+    handlePossibleDAQmxErrorOrWarning(status, action);
+    if (*isTaskDone)  {
+        uInt32 nScansAvailable ;
+        status = DAQmxGetReadAvailSampPerChan(taskHandle, &nScansAvailable) ;
+        handlePossibleDAQmxErrorOrWarning(status, action);
+        nScansWanted = std::min(nScansWanted, (uInt64)(nScansAvailable)) ;
+    }
+    int32 nScansToRead = (int32)(nScansWanted) ;
+    makeBuffer(nScansToRead) ;
+
+    // Read in slices, checking for the task being done between them.
+    // The daqmx reading functions complain if you call them when there's no more data to read, 
+    // even if you ask for zero scans, so we stop before that.  (And reading a stopped task 
+    // would start it again.)
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now() ;
+    int32 nScansRead = 0 ;
+    while (nScansRead < nScansToRead)  {
+        float64 timeLeft = std::numeric_limits<float64>::infinity() ;
+        if (timeout >= 0)  {
+            timeLeft = timeout - std::chrono::duration<float64>(std::chrono::steady_clock::now() - startTime).count() ;
+        }
+        float64 sliceTimeout = (*isTaskDone) ? 0.0 : std::max(0.0, std::min(timeLeft, (float64)(WAIT_FOR_SCANS_SLICE_DURATION))) ;
+        int32 nScansReadThisTime = 0 ;
+        status = readScans(nScansRead, nScansToRead-nScansRead, sliceTimeout, &nScansReadThisTime) ;
+        if (nScansReadThisTime > 0)  {
+            nScansRead += nScansReadThisTime ;
+        }
+        if (status == DAQmxErrorSamplesNotYetAvailable)  {
+            // The slice ran out.  Stop if the whole timeout has, or if the task was already 
+            // done, otherwise go round again.  If the task is done now, only the scans still 
+            // in the buffer are left to read.
+            if (*isTaskDone || sliceTimeout >= timeLeft)  {
+                break ;
+            }
+            status = DAQmxIsTaskDone(taskHandle, isTaskDone) ;
+            handlePossibleDAQmxErrorOrWarning(status, action);
+            if (*isTaskDone)  {
+                uInt32 nScansAvailable ;
+                status = DAQmxGetReadAvailSampPerChan(taskHandle, &nScansAvailable) ;
+                handlePossibleDAQmxErrorOrWarning(status, action);
+                nScansToRead = std::min(nScansToRead, nScansRead + (int32)(nScansAvailable)) ;
+            }
+        }
+        else if (status == DAQmxErrorSamplesWillNeverBeAvailable)  {
+            // The task was stopped during the read, which returned what there was
+            break ;
+        }
+        else  {
+            handlePossibleDAQmxErrorOrWarning(status, action);
         }
+    }
+
+    // Check doneness again, after the read
+    status = DAQmxIsTaskDone(taskHandle, isTaskDone) ;
+    handlePossibleDAQmxErrorOrWarning(status, action);
+    return nScansRead ;
+}
+
+
+
+// Read an nScansWanted argument for WaitForScans and WaitForPackedDigitalLines
+uInt64
+readScansWantedArgument(int nrhs, const mxArray *prhs[], int index)  {
+    double nScansWantedAsDouble = 0.0 ;
+    if ( (nrhs>index) && mxIsScalar(prhs[index]) && mxIsNumeric(prhs[index]) )  {
+        nScansWantedAsDouble = mxGetScalar(prhs[index]) ;
+    }
+    else {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "nScansWanted must be a numeric scalar");
+    }
+    if ( !(nScansWantedAsDouble>=0) || nScansWantedAsDouble != floor(nScansWantedAsDouble) || nScansWantedAsDouble > (double)(std::numeric_limits<int32>::max()) )  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "nScansWanted must be a nonnegative integer");
+    }
+    return (uInt64)(nScansWantedAsDouble) ;
+}
+
+
+
+// [outputData, isTaskDone] = WaitForScans(taskHandle, nScansWanted, timeout, [fillMode])
+//
+// Blocks until nScansWanted scans have been acquired, the task is done, or timeout 
+// seconds have elapsed, then reads the scans as int16, as DAQmxReadBinaryI16 does.  
+// The wait happens inside the driver, which sleeps until the samples arrive, so 
+// no polling is done on the MATLAB side.  The driver is only waited on for 
+// WAIT_FOR_SCANS_SLICE_DURATION at a time, though, so if the task is stopped, this 
+// returns soon after.  For a finite task, nScansWanted is clamped to the number of 
+// scans that remain to be read, and if the task is already done, it is clamped to the 
+// number of scans available, so this never waits for scans that will never come.  
+// Unlike DAQmxReadBinaryI16, a timeout is not an error: whatever scans were acquired 
+// before the timeout are returned, so the output may have fewer than nScansWanted 
+// scans.  A timeout of -1 means wait forever.  isTaskDone is the value of 
+// DAQmxIsTaskDone() after the read.
+void WaitForScans(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+    checkNoClosedLoop(taskHandle, action) ;
+
+    // prhs[2]: nScansWanted
+    uInt64 nScansWanted = readScansWantedArgument(nrhs, prhs, 2) ;
 
     // prhs[3]: timeout
-    index++;
+    float64 timeout = readTimeoutArgument(nrhs, prhs, 3) ;
+
+    // prhs[4]: fillMode
+    bool32 fillMode = readFillModeArgument(nrhs, prhs, 4) ;
+
+    // Determine # of channels
+    int32 status ;
+    uInt32 numChannels ;
+    status = DAQmxGetReadNumChans(taskHandle, &numChannels) ; 
+    handlePossibleDAQmxErrorOrWarning(status, action);
+
+    // Read, grouped by scan, so that each slice can be read into the end of the scans 
+    // read so far.  That's the output itself when it's also grouped by scan.
+    mxArray *outputDataMXArray = NULL ;
+    std::vector<int16> scansBuffer ;
+    int16 * scans = NULL ;
+    auto makeBuffer = [&](int32 nScans)  {
+        if (fillMode == DAQmx_Val_GroupByScanNumber)  {
+            outputDataMXArray = mxCreateNumericMatrix(numChannels, nScans, mxINT16_CLASS, mxREAL) ;
+        }
+        else  {
+            outputDataMXArray = mxCreateNumericMatrix(nScans, numChannels, mxINT16_CLASS, mxREAL) ;
+        }
+        if ( mxGetNumberOfElements(outputDataMXArray) != ((size_t)nScans) * numChannels )  {
+            mexErrMsgIdAndTxt("ws:ni:failedToAllocateMemory", "Failed to allocate an output array of the desired size");    
+        }
+        if (fillMode == DAQmx_Val_GroupByScanNumber)  {
+            scans = (int16 *)mxGetData(outputDataMXArray) ;
+        }
+        else  {
+            scansBuffer.resize(((size_t)nScans) * numChannels) ;
+            scans = scansBuffer.data() ;
+        }
+    } ;
+    auto readScans = [&](int32 scanOffset, int32 nScans, float64 sliceTimeout, int32 * nScansRead)  {
+        return DAQmxReadBinaryI16(taskHandle, nScans, sliceTimeout, DAQmx_Val_GroupByScanNumber, 
+                                  scans + ((size_t)scanOffset)*numChannels, ((uInt32)nScans)*numChannels, nScansRead, NULL) ;
+    } ;
+    bool32 isTaskDone = false ;
+    int32 nScansRead = waitForAndReadScans(action, taskHandle, nScansWanted, timeout, makeBuffer, readScans, &isTaskDone) ;
+
+    // Trim the output to the scans read, transposing them if grouping by channel
+    if (fillMode == DAQmx_Val_GroupByScanNumber)  {
+        mxSetN(outputDataMXArray, nScansRead) ;
+    }
+    else  {
+        int16 * outputDataPtr = (int16 *)mxGetData(outputDataMXArray) ;
+        for (uInt32 channelIndex = 0; channelIndex < numChannels; ++channelIndex)  {
+            int16 * target = outputDataPtr + ((size_t)channelIndex)*nScansRead ;
+            for (int32 i = 0; i < nScansRead; ++i)  {
+                target[i] = scans[((size_t)i)*numChannels + channelIndex] ;
+            }
+        }
+        mxSetM(outputDataMXArray, nScansRead) ;
+    }
+
+    // Return output data
+    plhs[0] = outputDataMXArray ;  
+        // even if nlhs==0, still safe to assign to plhs[0], and should do this, so ans gets assigned        
+    if (nlhs>1)  {
+        plhs[1] = mxCreateLogicalScalar(isTaskDone ? true : false) ;
+    }
+}
+// end of function
+
+
+
+// [outputData, isTaskDone] = WaitForPackedDigitalLines(taskHandle, nScansWanted, timeout, terminalIDPerLine)
+//
+// WaitForScans for a DI task, returning the lines packed and reordered as 
+// ReadPackedDigitalLines does.
+void WaitForPackedDigitalLines(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+
+    // prhs[2]: nScansWanted
+    uInt64 nScansWanted = readScansWantedArgument(nrhs, prhs, 2) ;
+
+    // prhs[3]: timeout
+    float64 timeout = readTimeoutArgument(nrhs, prhs, 3) ;
+
+    // prhs[4]: terminalIDPerLine
+    std::vector<uInt32> terminalIDPerLine(readTerminalIDPerLineArgument(nrhs, prhs, 4)) ;
+
+    // Read the raw port words
+    std::vector<uInt32> rawWords ;
+    auto makeBuffer = [&](int32 nScans)  {
+        rawWords.resize(nScans) ;
+    } ;
+    auto readScans = [&](int32 scanOffset, int32 nScans, float64 sliceTimeout, int32 * nScansRead)  {
+        return DAQmxReadDigitalU32(taskHandle, nScans, sliceTimeout, DAQmx_Val_GroupByChannel, 
+                                   rawWords.data() + scanOffset, (uInt32)(nScans), nScansRead, NULL) ;
+    } ;
+    bool32 isTaskDone = false ;
+    int32 nScansRead = waitForAndReadScans(action, taskHandle, nScansWanted, timeout, makeBuffer, readScans, &isTaskDone) ;
+
+    // Pack and reorder into the output
+    mxArray * outputDataMXArray = createPackedDigitalLinesArray(nScansRead, terminalIDPerLine.size()) ;
+    packDigitalDataIntoArray(rawWords.data(), nScansRead, terminalIDPerLine, outputDataMXArray) ;
+
+    // Return output data
+    plhs[0] = outputDataMXArray ;  
+        // even if nlhs==0, still safe to assign to plhs[0], and should do this, so ans gets assigned        
+    if (nlhs>1)  {
+        plhs[1] = mxCreateLogicalScalar(isTaskDone ? true : false) ;
+    }
+}
+// end of function
+
+
+
+// DAQmxWaitUntilTaskDone(taskHandle, timeToWait)
+void WaitUntilTaskDone(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    int32 status ;  // Used several places for DAQmx return codes
+    TaskHandle taskHandle ;
+    float64 timeToWait ;
+    int index ;
+
+    //
+    // Read input arguments
+    //
+
+    // prhs[1]: taskHandle
+    taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+
+    // prhs[2]: timeToWait
+    index=2 ;
+    if (nrhs>index)  {
+        if ( mxIsEmpty(prhs[index]) )   {
+            timeToWait = DAQmx_Val_WaitInfinitely ;
+        }
+        else if ( mxIsScalar(prhs[index]) )   {
+            timeToWait = (float64) mxGetScalar(prhs[index]) ;
+            if (timeToWait==-1.0 || timeToWait>=0)  {
+                if ( isfinite(timeToWait) )  {
+                    // do nothing, all is well
+                }
+                else  {
+                    timeToWait = DAQmx_Val_WaitInfinitely ;
+                }
+            }
+            else  {
+                mexErrMsgTxt("timeToWait must be DAQmx_Val_WaitInfinitely (-1), 0, or positive");
+            }
+        }
+        else  {
+            mexErrMsgTxt("timeToWait must be a missing, empty, or a scalar");        
+        }
+    }
+    else  {
+        timeToWait = DAQmx_Val_WaitInfinitely ;
+    }
+
+    //
+    // Make the call
+    status = DAQmxWaitUntilTaskDone(taskHandle,timeToWait) ; 
+    handlePossibleDAQmxErrorOrWarning(status, action);
+}
+
+
+
+// [sampsPerChanWritten, wasSkipped] = DAQmxWriteAnalogF64(taskHandle, autoStart, timeout, writeArray)
+//
+// If the task regenerates from its buffer, and the buffer already holds exactly writeArray 
+// from the last write, the write is skipped (but the task is still started if autoStart 
+// is true), and wasSkipped is true.  The same goes for the other buffered write actions.
+void WriteAnalogF64(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  
+    {
+    int32 status ;  // Used several places for DAQmx return codes
+    int index ; // index of the input arg we're currently dealing with
+    TaskHandle taskHandle ;
+    bool32 autoStart ;
+    float64 timeout ;
+    float64 *writeArray = 0 ;
+    mwSize nSampsPerChan ;
+    mwSize nChannelsInWriteArray ;
+    uInt32 nChannelsInTask ;
+    int32 nSampsPerChanWritten ;
+
+    //
+    // Read input arguments
+    //
+
+    // prhs[1]: taskHandle
+    taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+
+    // prhs[2]: autoStart
+    index = 2;
+    if ( (nrhs>index) && mxIsScalar(prhs[index]) )  
+        {
+        autoStart = (bool32) mxGetScalar(prhs[index]) ;
+        }
+    else 
+        {
+        mexErrMsgTxt("autoStart must be a scalar");        
+        }
+
+    // prhs[3]: timeout
+    index++;
     timeout = readTimeoutArgument(nrhs, prhs, index) ;
     
     // prhs[4]: writeArray
@@ -1646,116 +3101,970 @@ void WriteAnalogF64(std::string action, int nlhs, mxArray *plhs[], int nrhs, con
         mexErrMsgIdAndTxt("ws:ni:badArgument","writeArray must be an matrix of real doubles");        
         }
 
-    // Determine # of channels in task
-    status = DAQmxGetWriteNumChans(taskHandle,&nChannelsInTask); 
-    handlePossibleDAQmxErrorOrWarning(status, action);
+    // Determine # of channels in task
+    status = DAQmxGetWriteNumChans(taskHandle,&nChannelsInTask); 
+    handlePossibleDAQmxErrorOrWarning(status, action);
+
+    // Verify the number of channels in the task equals that in the writeArray
+    //mexPrintf("nChannelsInTask: %d\n",nChannelsInTask) ;
+    //mexPrintf("nChannelsInWriteArray: %d\n",nChannelsInWriteArray) ;    
+    if (nChannelsInTask != nChannelsInWriteArray)
+        {
+        mexErrMsgIdAndTxt("ws:ni:badArgument",
+                          "writeArray must have the same number of columns as the task has channels");
+        }
+
+    // Check that nSampsPerChan will fit in an int32, and error if not
+    if (nSampsPerChan > std::numeric_limits<int32>::max()) {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "writeArray has too many rows, maximum is %d", std::numeric_limits<int32>::max());
+    }
+    int32 nSampsPerChanAsInt32 = int32(nSampsPerChan);
+
+    // If the output buffer already holds this data, don't upload it again
+    TaskRecord & taskRecord = *findTaskRecord(taskHandle) ;
+    uInt64 contentHash = hashOfWrite(action, prhs[index]) ;
+    if (isWriteRedundant(taskRecord, contentHash))  {
+        handlePossibleDAQmxErrorOrWarning(completeSkippedWrite(taskHandle, autoStart), action) ;
+        setWriteOutputs(nlhs, plhs, nSampsPerChanAsInt32, true) ;
+        return ;
+    }
+
+    // Make the call
+    status = DAQmxWriteAnalogF64(taskHandle, 
+                                 nSampsPerChanAsInt32,
+                                 autoStart,
+                                 timeout, 
+                                 DAQmx_Val_GroupByChannel,
+                                 writeArray,
+                                 &nSampsPerChanWritten, 
+                                 NULL);
+    updateWriteCache(taskRecord, contentHash, status, nSampsPerChanAsInt32, nSampsPerChanWritten) ;
+    handlePossibleDAQmxErrorOrWarning(status, action);
+
+    // Return output data
+    setWriteOutputs(nlhs, plhs, nSampsPerChanWritten, false) ;
+    }
+
+
+
+// Convert volts to DAC codes with the polynomial DAQmx uses, given by coefficientCount 
+// coefficients, constant term first.  Rounds to the nearest code (ties to even, like 
+// the SSE2 conversion), and saturates at the int16 limits.  NaNs become -32768.
+void
+dacCodesFromVolts(const float64 * volts, size_t sampleCount, const float64 * coefficients, int coefficientCount, int16 * codes)  {
+    // Drop trailing zero coefficients, which are common, since most devices only have two
+    while (coefficientCount>1 && coefficients[coefficientCount-1]==0.0)  {
+        --coefficientCount ;
+    }
+    size_t i = 0 ;
+#if defined(WS_IS_X64)
+    // SSE2 is always there on x64.  Do eight samples at a time, as four pairs.
+    const __m128d lowest = _mm_set1_pd(-32768.0) ;
+    const __m128d highest = _mm_set1_pd(32767.0) ;
+    for ( ; i+8 <= sampleCount; i += 8)  {
+        __m128d y[4] ;
+        for (int k = 0; k < 4; ++k)  {
+            __m128d x = _mm_loadu_pd(volts + i + 2*k) ;
+            __m128d acc = _mm_set1_pd(coefficients[coefficientCount-1]) ;
+            for (int c = coefficientCount-2; c >= 0; --c)  {
+                acc = _mm_add_pd(_mm_mul_pd(acc, x), _mm_set1_pd(coefficients[c])) ;
+            }
+            y[k] = _mm_min_pd(_mm_max_pd(acc, lowest), highest) ;
+        }
+        __m128i lo = _mm_unpacklo_epi64(_mm_cvtpd_epi32(y[0]), _mm_cvtpd_epi32(y[1])) ;
+        __m128i hi = _mm_unpacklo_epi64(_mm_cvtpd_epi32(y[2]), _mm_cvtpd_epi32(y[3])) ;
+        _mm_storeu_si128((__m128i *)(codes + i), _mm_packs_epi32(lo, hi)) ;
+    }
+#endif
+    for ( ; i < sampleCount; ++i)  {
+        float64 x = volts[i] ;
+        float64 acc = coefficients[coefficientCount-1] ;
+        for (int c = coefficientCount-2; c >= 0; --c)  {
+            acc = acc*x + coefficients[c] ;
+        }
+        // Written so a NaN ends up as the lowest code, as in the SSE2 version
+        acc = (acc > -32768.0) ? acc : -32768.0 ;
+        acc = (acc < 32767.0) ? acc : 32767.0 ;
+        codes[i] = (int16)(std::nearbyint(acc)) ;
+    }
+}
+
+
+
+// Read the autoStart and timeout arguments of a write action, at prhs[2] and prhs[3]
+void
+readAutoStartAndTimeoutArguments(int nrhs, const mxArray *prhs[], bool32 * autoStart, float64 * timeout)  {
+    if ( (nrhs>2) && mxIsScalar(prhs[2]) )  {
+        *autoStart = (bool32) mxGetScalar(prhs[2]) ;
+    }
+    else  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "autoStart must be a scalar") ;
+    }
+    *timeout = readTimeoutArgument(nrhs, prhs, 3) ;
+}
+
+
+
+// Check that writeArray has one column per channel in the task, and a number of rows that 
+// fits in an int32, and return the number of rows
+int32
+checkWriteArraySize(TaskHandle taskHandle, const mxArray * writeArray, const std::string & action)  {
+    uInt32 nChannelsInTask ;
+    int32 status = DAQmxGetWriteNumChans(taskHandle, &nChannelsInTask) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+    if (nChannelsInTask != mxGetN(writeArray))  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument",
+                          "writeArray must have the same number of columns as the task has channels") ;
+    }
+    if (mxGetM(writeArray) > (mwSize)(std::numeric_limits<int32>::max()))  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "writeArray has too many rows, maximum is %d", std::numeric_limits<int32>::max()) ;
+    }
+    return int32(mxGetM(writeArray)) ;
+}
+
+
+
+// [sampsPerChanWritten, wasSkipped] = DAQmxWriteBinaryI16(taskHandle, autoStart, timeout, writeArray)
+//
+// writeArray is an nScans x nChannels int16 array of DAC codes
+void WriteBinaryI16(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+
+    // prhs[2]: autoStart, prhs[3]: timeout
+    bool32 autoStart ;
+    float64 timeout ;
+    readAutoStartAndTimeoutArguments(nrhs, prhs, &autoStart, &timeout) ;
+
+    // prhs[4]: writeArray
+    int index = 4 ;
+    if ( !(nrhs>index && mxGetClassID(prhs[index])==mxINT16_CLASS && !mxIsComplex(prhs[index]) && mxGetNumberOfDimensions(prhs[index])==2) )  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "writeArray must be a matrix of real int16s") ;
+    }
+    int32 nSampsPerChan = checkWriteArraySize(taskHandle, prhs[index], action) ;
+
+    // If the output buffer already holds this data, don't upload it again
+    TaskRecord & taskRecord = *findTaskRecord(taskHandle) ;
+    uInt64 contentHash = hashOfWrite(action, prhs[index]) ;
+    if (isWriteRedundant(taskRecord, contentHash))  {
+        handlePossibleDAQmxErrorOrWarning(completeSkippedWrite(taskHandle, autoStart), action) ;
+        setWriteOutputs(nlhs, plhs, nSampsPerChan, true) ;
+        return ;
+    }
+
+    // Make the call
+    int32 nSampsPerChanWritten ;
+    int32 status = DAQmxWriteBinaryI16(taskHandle,
+                                       nSampsPerChan,
+                                       autoStart,
+                                       timeout,
+                                       DAQmx_Val_GroupByChannel,
+                                       (int16 *)mxGetData(prhs[index]),
+                                       &nSampsPerChanWritten,
+                                       NULL) ;
+    updateWriteCache(taskRecord, contentHash, status, nSampsPerChan, nSampsPerChanWritten) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+
+    // Return output data
+    setWriteOutputs(nlhs, plhs, nSampsPerChanWritten, false) ;
+}
+// end of function
+
+
+
+// [sampsPerChanWritten, wasSkipped] = WriteAnalogF64AsBinaryI16(taskHandle, autoStart, timeout, writeArray)
+//
+// Same as DAQmxWriteAnalogF64, but converts the volts in writeArray to DAC codes here, 
+// using the device's AO scaling coefficients, and writes those with DAQmxWriteBinaryI16.  
+// This hands the driver a quarter as many bytes, and saves it converting each sample.
+void WriteAnalogF64AsBinaryI16(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+
+    // prhs[2]: autoStart, prhs[3]: timeout
+    bool32 autoStart ;
+    float64 timeout ;
+    readAutoStartAndTimeoutArguments(nrhs, prhs, &autoStart, &timeout) ;
+
+    // prhs[4]: writeArray
+    int index = 4 ;
+    if ( !(nrhs>index && mxIsDouble(prhs[index]) && !mxIsComplex(prhs[index]) && mxGetNumberOfDimensions(prhs[index])==2) )  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "writeArray must be a matrix of real doubles") ;
+    }
+    int32 nSampsPerChan = checkWriteArraySize(taskHandle, prhs[index], action) ;
+    size_t nChannels = mxGetN(prhs[index]) ;
+    const float64 * volts = mxGetPr(prhs[index]) ;
+
+    // If the output buffer already holds this data, don't convert or upload it again
+    TaskRecord & taskRecord = *findTaskRecord(taskHandle) ;
+    uInt64 contentHash = hashOfWrite(action, prhs[index]) ;
+    if (isWriteRedundant(taskRecord, contentHash))  {
+        handlePossibleDAQmxErrorOrWarning(completeSkippedWrite(taskHandle, autoStart), action) ;
+        setWriteOutputs(nlhs, plhs, nSampsPerChan, true) ;
+        return ;
+    }
+
+    // Convert, one channel at a time, since each has its own coefficients
+    std::vector<float64> coefficients(getAODevScalingCoeffs(taskHandle, AO_DEV_SCALING_COEFFICIENT_COUNT, action)) ;
+    std::vector<int16> codes((size_t)(nSampsPerChan)*nChannels) ;
+    for (size_t j = 0; j < nChannels; ++j)  {
+        dacCodesFromVolts(volts + j*nSampsPerChan, nSampsPerChan,
+                          coefficients.data() + j*AO_DEV_SCALING_COEFFICIENT_COUNT, AO_DEV_SCALING_COEFFICIENT_COUNT,
+                          codes.data() + j*nSampsPerChan) ;
+    }
+
+    // Make the call
+    int32 nSampsPerChanWritten ;
+    int32 status = DAQmxWriteBinaryI16(taskHandle,
+                                       nSampsPerChan,
+                                       autoStart,
+                                       timeout,
+                                       DAQmx_Val_GroupByChannel,
+                                       codes.data(),
+                                       &nSampsPerChanWritten,
+                                       NULL) ;
+    updateWriteCache(taskRecord, contentHash, status, nSampsPerChan, nSampsPerChanWritten) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+
+    // Return output data
+    setWriteOutputs(nlhs, plhs, nSampsPerChanWritten, false) ;
+}
+// end of function
+
+
+
+// [sampsPerChanWritten, wasSkipped] = DAQmxWriteDigitalLines(taskHandle, autoStart, timeout, writeArray)
+void WriteDigitalLines(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    //
+    // Read input arguments
+    //
+
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+
+    // prhs[2]: autoStart
+    bool32 autoStart;
+    int index = 2; // index of the input arg we're currently dealing with
+    if ( (nrhs>index) && mxIsScalar(prhs[index]) )  {
+        autoStart = (bool32) mxGetScalar(prhs[index]) ;
+    }
+    else  {
+        mexErrMsgTxt("autoStart must be a scalar");        
+    }
+
+    // prhs[3]: timeout
+    index++;
+    float64 timeout = readTimeoutArgument(nrhs, prhs, index) ;
+
+    // prhs[4]: writeArray
+    uInt8 *writeArray = 0;
+    size_t nSampsPerChan;
+    size_t nChannelsInWriteArray;
+    index++;
+    if ( nrhs>index && mxIsLogical(prhs[index]) && mxGetNumberOfDimensions(prhs[index])==2 )  {
+        nSampsPerChan = mxGetM(prhs[index]) ;
+        nChannelsInWriteArray = mxGetN(prhs[index]) ;
+        writeArray = (uInt8 *)mxGetData(prhs[index]) ;
+    }
+    else  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "writeArray must be a matrix of class logical");        
+    }
+
+    // Determine # of channels in task
+    uInt32 nChannelsInTask;
+    int32 status = DAQmxGetWriteNumChans(taskHandle,&nChannelsInTask);
+    handlePossibleDAQmxErrorOrWarning(status, action);
+
+    // Verify the number of channels in the task equals that in the writeArray
+    //mexPrintf("nChannelsInTask: %d\n",nChannelsInTask) ;
+    //mexPrintf("nChannelsInWriteArray: %d\n",nChannelsInWriteArray) ;    
+    if (nChannelsInTask != nChannelsInWriteArray)  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument",
+                          "writeArray must have the same number of columns as the task has channels");
+    }
+
+    // Check that nSampsPerChan will fit in an int32, and error if not
+    if (nSampsPerChan > std::numeric_limits<int32>::max())  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "writeArray has too many rows, maximum is %d", std::numeric_limits<int32>::max());
+    }
+    int32 nSampsPerChanAsInt32 = int32(nSampsPerChan);
+
+    // If the output buffer already holds this data, don't upload it again
+    TaskRecord & taskRecord = *findTaskRecord(taskHandle) ;
+    uInt64 contentHash = hashOfWrite(action, prhs[index]) ;
+    if (isWriteRedundant(taskRecord, contentHash))  {
+        handlePossibleDAQmxErrorOrWarning(completeSkippedWrite(taskHandle, autoStart), action) ;
+        setWriteOutputs(nlhs, plhs, nSampsPerChanAsInt32, true) ;
+        return ;
+    }
+
+    //
+    // Make the call
+    // 
+    int32 nSampsPerChanWritten;
+    status = DAQmxWriteDigitalLines(taskHandle,
+                                    nSampsPerChanAsInt32,
+                                    autoStart,
+                                    timeout, 
+                                    DAQmx_Val_GroupByChannel,
+                                    writeArray,
+                                    &nSampsPerChanWritten, 
+                                    NULL);
+    updateWriteCache(taskRecord, contentHash, status, nSampsPerChanAsInt32, nSampsPerChanWritten) ;
+    handlePossibleDAQmxErrorOrWarning(status, action);
+
+    // Return output data
+    setWriteOutputs(nlhs, plhs, nSampsPerChanWritten, false) ;
+}
+// end of function
+
+
+
+// StartOutputStream(taskHandle, ringScanCount)
+//
+// Start streaming to an AO task: Starts a thread that writes scans to the task as they're 
+// queued with WriteToOutputStream, and as space frees up in the output buffer.  The 
+// ring buffer holds ringScanCount scans.  The task's regeneration mode is set to 
+// DAQmx_Val_DoNotAllowRegen, so the task errors if the queued scans run out, rather than 
+// regenerating old ones, until StopOutputStream puts it back.  Configure the output buffer (DAQmxCfgOutputBuffer) and timing 
+// before calling this, queue enough scans to fill the output buffer, then start the task.
+void StartOutputStream(std::string action, int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[]) {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+    TaskRecord * taskRecord = findTaskRecord(taskHandle) ;
+    if (taskRecord->outputStream)  {
+        mexErrMsgIdAndTxt("ws:ni:alreadyStreaming", "The task already has an output stream") ;
+    }
+
+    // prhs[2]: ringScanCount
+    int index = 2 ;
+    double ringScanCountAsDouble = 0.0 ;
+    if ((nrhs>index) && mxIsScalar(prhs[index]) && mxIsNumeric(prhs[index]) && !mxIsComplex(prhs[index]))  {
+        ringScanCountAsDouble = mxGetScalar(prhs[index]) ;
+        if (!isfinite(ringScanCountAsDouble) || ringScanCountAsDouble < 1 || ringScanCountAsDouble>4294967295.0)  {
+            mexErrMsgIdAndTxt("ws:ni:badArgument", "ringScanCount must be a finite value of at least one");
+        }
+    }
+    else {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "ringScanCount must be a numeric non-complex scalar");
+    }
+    uInt32 ringScanCount = uInt32(round(ringScanCountAsDouble)) ;
+
+    // Get the number of channels, which also checks that this is an output task
+    uInt32 channelCount ;
+    int32 status = DAQmxGetWriteNumChans(taskHandle, &channelCount) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+    if (channelCount == 0)  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "The task has no output channels") ;
+    }
+
+    // Streaming means never regenerating, and the stream's writes replace whatever was in the buffer
+    taskRecord->writeCache.isValid = false ;
+    int32 regenModeBeforeStreaming ;
+    status = DAQmxGetWriteRegenMode(taskHandle, &regenModeBeforeStreaming) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+    status = DAQmxSetWriteRegenMode(taskHandle, DAQmx_Val_DoNotAllowRegen) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+
+    // Set up the stream and start the thread
+    OutputStream * stream = new OutputStream() ;
+    stream->taskHandle = taskHandle ;
+    stream->channelCount = channelCount ;
+    stream->ringScanCount = ringScanCount ;
+    stream->regenModeBeforeStreaming = regenModeBeforeStreaming ;
+    stream->ring.assign((size_t)(ringScanCount)*channelCount, 0.0) ;
+    stream->scanCountQueued = 0 ;
+    stream->scanCountRefilled = 0 ;
+    stream->errorStatus = 0 ;
+    stream->isStopRequested = false ;
+    stream->refillThread = std::thread(refillOutputStream, stream) ;
+    taskRecord->outputStream = stream ;
+}
+// end of function
+
+
+
+// scanCountQueued = WriteToOutputStream(taskHandle, timeout, writeArray)
+//
+// Queue the scans in writeArray, a nScans x nChannels double matrix, on the task's 
+// output stream.  Waits up to timeout seconds for room in the ring buffer, and returns 
+// the number of scans queued, which is less than nScans only if it timed out.  If the 
+// refill thread has hit a DAQmx error (e.g. because the queued scans ran out), that
+// error is raised here.
+void WriteToOutputStream(std::string action, int /*nlhs*/, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+    OutputStream * stream = findTaskRecord(taskHandle)->outputStream ;
+    if (!stream)  {
+        mexErrMsgIdAndTxt("ws:ni:notStreaming", "The task has no output stream") ;
+    }
+
+    // prhs[2]: timeout
+    float64 timeout = readTimeoutArgument(nrhs, prhs, 2) ;
+
+    // prhs[3]: writeArray
+    int index = 3 ;
+    if (!(nrhs>index && mxIsDouble(prhs[index]) && !mxIsComplex(prhs[index]) && mxGetNumberOfDimensions(prhs[index])==2))  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "writeArray must be a matrix of real doubles") ;
+    }
+    mwSize scanCount = mxGetM(prhs[index]) ;
+    if (!mxIsEmpty(prhs[index]) && mxGetN(prhs[index]) != stream->channelCount)  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument",
+                          "writeArray must have the same number of columns as the task has channels") ;
+    }
+    const float64 * writeArray = mxGetPr(prhs[index]) ;
+
+    // Copy the scans into the ring as room frees up, transposing to scan-major
+    std::chrono::steady_clock::time_point deadline = 
+        std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(std::max(timeout, 0.0))) ;
+    mwSize scanCountQueued = 0 ;
+    int32 status = 0 ;
+    {
+        std::unique_lock<std::mutex> lock(stream->mutex) ;
+        while (scanCountQueued < scanCount)  {
+            if (stream->errorStatus != 0)  {
+                status = stream->errorStatus ;
+                break ;
+            }
+            uInt64 roomInRing = stream->ringScanCount - (stream->scanCountQueued - stream->scanCountRefilled) ;
+            if (roomInRing == 0)  {
+                if (timeout != DAQmx_Val_WaitInfinitely && std::chrono::steady_clock::now() >= deadline)  {
+                    break ;
+                }
+                stream->ringChanged.wait_for(lock, std::chrono::duration<double>(OUTPUT_STREAM_POLL_INTERVAL)) ;
+                continue ;
+            }
+            // The refill thread only reads the queued part of the ring, so can copy 
+            // without the lock
+            mwSize scanCountThisTime = (mwSize)(std::min((uInt64)(scanCount - scanCountQueued), roomInRing)) ;
+            uInt64 firstScanIndex = stream->scanCountQueued ;
+            lock.unlock() ;
+            for (mwSize i = 0; i < scanCountThisTime; ++i)  {
+                float64 * scan = &(stream->ring[(size_t)((firstScanIndex + i) % stream->ringScanCount)*stream->channelCount]) ;
+                for (uInt32 j = 0; j < stream->channelCount; ++j)  {
+                    scan[j] = writeArray[j*scanCount + scanCountQueued + i] ;
+                }
+            }
+            lock.lock() ;
+            stream->scanCountQueued += scanCountThisTime ;
+            scanCountQueued += scanCountThisTime ;
+            stream->ringChanged.notify_all() ;
+        }
+    }
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+
+    // Return output data
+    plhs[0] = mxCreateDoubleScalar((double)(scanCountQueued)) ;
+}
+// end of function
+
+
+
+// [scanCountInRing, scanCountWrittenToTask] = GetOutputStreamStatus(taskHandle)
+//
+// The number of scans queued but not yet written to the task, and the total number 
+// written to the task so far.  Raises the refill thread's DAQmx error, if any.
+void GetOutputStreamStatus(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+    OutputStream * stream = findTaskRecord(taskHandle)->outputStream ;
+    if (!stream)  {
+        mexErrMsgIdAndTxt("ws:ni:notStreaming", "The task has no output stream") ;
+    }
+
+    uInt64 scanCountInRing ;
+    uInt64 scanCountRefilled ;
+    int32 status ;
+    {
+        std::lock_guard<std::mutex> lock(stream->mutex) ;
+        scanCountInRing = stream->scanCountQueued - stream->scanCountRefilled ;
+        scanCountRefilled = stream->scanCountRefilled ;
+        status = stream->errorStatus ;
+    }
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+
+    // Return output data
+    plhs[0] = mxCreateDoubleScalar((double)(scanCountInRing)) ;
+    if (nlhs>=2)  {
+        plhs[1] = mxCreateDoubleScalar((double)(scanCountRefilled)) ;
+    }
+}
+// end of function
+
+
+
+// StopOutputStream(taskHandle)
+//
+// Stop the refill thread and free the ring buffer.  Queued scans not yet written to the 
+// task are discarded.  Then puts the task's regeneration mode back to what it was before 
+// StartOutputStream, so the task must be stopped first.  Does nothing if the task has no 
+// output stream.
+void StopOutputStream(std::string action, int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[]) {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+    int32 status = stopOutputStream(*findTaskRecord(taskHandle), true) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+}
+// end of function
+
+
+
+// [sampsPerChanWritten, wasSkipped] = DAQmxWriteDigitalU32(taskHandle, autoStart, timeout, writeArray)
+//
+// writeArray is an nScans x nChannels uint32 array.  Each element is a port word: each line 
+// in the channel is set from the bit of the word corresponding to its line number.  So 
+// for a task with a single channel holding all the lines, there's one word per scan.
+void WriteDigitalU32(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+
+    // prhs[2]: autoStart, prhs[3]: timeout
+    bool32 autoStart ;
+    float64 timeout ;
+    readAutoStartAndTimeoutArguments(nrhs, prhs, &autoStart, &timeout) ;
+
+    // prhs[4]: writeArray
+    int index = 4 ;
+    if ( !(nrhs>index && mxGetClassID(prhs[index])==mxUINT32_CLASS && !mxIsComplex(prhs[index]) && mxGetNumberOfDimensions(prhs[index])==2) )  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "writeArray must be a matrix of real uint32s") ;
+    }
+    int32 nSampsPerChan = checkWriteArraySize(taskHandle, prhs[index], action) ;
+
+    // If the output buffer already holds this data, don't upload it again
+    TaskRecord & taskRecord = *findTaskRecord(taskHandle) ;
+    uInt64 contentHash = hashOfWrite(action, prhs[index]) ;
+    if (isWriteRedundant(taskRecord, contentHash))  {
+        handlePossibleDAQmxErrorOrWarning(completeSkippedWrite(taskHandle, autoStart), action) ;
+        setWriteOutputs(nlhs, plhs, nSampsPerChan, true) ;
+        return ;
+    }
+
+    // Make the call
+    int32 nSampsPerChanWritten ;
+    int32 status = DAQmxWriteDigitalU32(taskHandle,
+                                        nSampsPerChan,
+                                        autoStart,
+                                        timeout,
+                                        DAQmx_Val_GroupByChannel,
+                                        (uInt32 *)mxGetData(prhs[index]),
+                                        &nSampsPerChanWritten,
+                                        NULL) ;
+    updateWriteCache(taskRecord, contentHash, status, nSampsPerChan, nSampsPerChanWritten) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+
+    // Return output data
+    setWriteOutputs(nlhs, plhs, nSampsPerChanWritten, false) ;
+}
+// end of function
+
+
+
+// Pack lines, a column-major nScans x nLines array with one byte per line (nonzero meaning 
+// high), into one word per scan, with line j going to bit terminalIDPerLine[j] of the word.  
+// Bits not assigned to any line are zero.
+void
+packDigitalLines(const uInt8 * lines, size_t scanCount, const std::vector<uInt32> & terminalIDPerLine, uInt32 * words)  {
+    std::fill(words, words+scanCount, (uInt32)(0)) ;
+    for (size_t j = 0; j < terminalIDPerLine.size(); ++j)  {
+        // A simple streaming pass per line, which the compiler can vectorize
+        const uInt8 * column = lines + j*scanCount ;
+        uInt32 terminalID = terminalIDPerLine[j] ;
+        for (size_t i = 0; i < scanCount; ++i)  {
+            words[i] |= (uInt32)(column[i] != 0) << terminalID ;
+        }
+    }
+}
+
+
+
+// packedData = PackDigitalLines(lineData, terminalIDPerLine)
+//
+// lineData is an nScans x nLines logical array, and terminalIDPerLine a vector of nLines 
+// distinct terminal IDs (0-31).  Returns an nScans x 1 uint32 array, with line j in bit 
+// terminalIDPerLine(j) of each element.  This is the port-word form DAQmxWriteDigitalU32 
+// takes, at four bytes per scan rather than one per line.  (Does not need a task.)
+void PackDigitalLines(std::string /*action*/, int /*nlhs*/, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: lineData
+    int index = 1 ;
+    if ( !(nrhs>index && mxIsLogical(prhs[index]) && mxGetNumberOfDimensions(prhs[index])==2) )  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "lineData must be a matrix of class logical") ;
+    }
+    size_t scanCount = mxGetM(prhs[index]) ;
+    size_t lineCount = mxGetN(prhs[index]) ;
+    const uInt8 * lines = (const uInt8 *)mxGetData(prhs[index]) ;
+
+    // prhs[2]: terminalIDPerLine
+    std::vector<uInt32> terminalIDPerLine(readTerminalIDPerLineArgument(nrhs, prhs, 2)) ;
+    if (terminalIDPerLine.size() != lineCount)  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "terminalIDPerLine must have one element per column of lineData") ;
+    }
+
+    // Pack
+    mxArray * packedDataMXArray = mxCreateNumericMatrix(scanCount, 1, mxUINT32_CLASS, mxREAL) ;
+    packDigitalLines(lines, scanCount, terminalIDPerLine, (uInt32 *)mxGetData(packedDataMXArray)) ;
+
+    // Return output data
+    plhs[0] = packedDataMXArray ;
+}
+// end of function
+
+
+
+// binding = BindOnDemandDO(taskHandle, terminalIDPerLine)
+//
+// Bind an on-demand (i.e. untimed) DO task for fast writes.  After this, 
+// ws.ni(binding, state) sets the task's lines: line j (the DIO line terminalIDPerLine(j)) 
+// is set from bit j of state, a uint32 scalar, or from element j of state, a logical 
+// vector.  That call skips the string dispatch and argument checking of the other actions, 
+// and allocates nothing, so it adds as little latency as possible.  binding is a uint32 
+// scalar.  Rebinding a task replaces its old binding, and clearing it releases it.
+void BindOnDemandDO(std::string action, int /*nlhs*/, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+    TaskRecord * taskRecord = findTaskRecord(taskHandle) ;
+
+    // prhs[2]: terminalIDPerLine
+    std::vector<uInt32> terminalIDPerLine(readTerminalIDPerLineArgument(nrhs, prhs, 2)) ;
+
+    // Get the number of channels, which also checks that this is an output task
+    uInt32 channelCount ;
+    int32 status = DAQmxGetWriteNumChans(taskHandle, &channelCount) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+    if (channelCount == 0)  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "The task has no output channels") ;
+    }
+
+    // Make the binding
+    unbindOnDemandDO(*taskRecord) ;
+    OnDemandDOBinding * binding = new OnDemandDOBinding() ;
+    binding->taskHandle = taskHandle ;
+    binding->terminalIDPerLine = terminalIDPerLine ;
+    binding->portWordPerChannel.assign(channelCount, 0) ;
+    ON_DEMAND_DO_BINDINGS.push_back(binding) ;
+    taskRecord->onDemandDOBindingID = (uInt32)(ON_DEMAND_DO_BINDINGS.size()) ;
+
+    // Return the binding ID
+    plhs[0] = mxCreateNumericMatrix(1, 1, mxUINT32_CLASS, mxREAL) ;
+    *((uInt32 *)mxGetData(plhs[0])) = taskRecord->onDemandDOBindingID ;
+}
+// end of function
+
+
+
+// Look up the binding given by the uint32 scalar at prhs[index].  Errors if it's not a live binding.
+OnDemandDOBinding *
+readOnDemandDOBindingArgument(int nrhs, const mxArray *prhs[], int index)  {
+    if ( (nrhs>index) && mxGetClassID(prhs[index])==mxUINT32_CLASS && mxGetNumberOfElements(prhs[index])==1 )  {
+        uInt32 bindingID = *((uInt32 *)mxGetData(prhs[index])) ;
+        if ( bindingID>0 && bindingID<=ON_DEMAND_DO_BINDINGS.size() && ON_DEMAND_DO_BINDINGS[bindingID-1] )  {
+            return ON_DEMAND_DO_BINDINGS[bindingID-1] ;
+        }
+    }
+    mexErrMsgIdAndTxt("ws:ni:badBinding", "The on-demand DO binding is not valid") ;
+    return (OnDemandDOBinding *)(0) ;  // never get here
+}
+
+
+
+// ws.ni(binding, state)
+//
+// The on-demand DO fast path.  See BindOnDemandDO().  Returns nothing.  The latency, from 
+// entry to the write returning, is added to the binding's histogram.
+void
+WriteOnDemandDO(int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[])  {
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now() ;
+
+    // prhs[0]: binding
+    OnDemandDOBinding * binding = readOnDemandDOBindingArgument(nrhs, prhs, 0) ;
+
+    // prhs[1]: state, trusted to be a uint32 scalar or a logical vector with one element per line
+    size_t lineCount = binding->terminalIDPerLine.size() ;
+    uInt32 lineState = 0 ;
+    if ( nrhs>1 && mxIsLogical(prhs[1]) )  {
+        const mxLogical * lines = mxGetLogicals(prhs[1]) ;
+        lineCount = std::min(lineCount, mxGetNumberOfElements(prhs[1])) ;
+        for (size_t j = 0; j < lineCount; ++j)  {
+            lineState |= ((uInt32)(lines[j] != 0)) << j ;
+        }
+    }
+    else if ( nrhs>1 && mxGetClassID(prhs[1])==mxUINT32_CLASS && mxGetNumberOfElements(prhs[1])>0 )  {
+        uInt32 lineMask = (lineCount < 32) ? ((((uInt32)1) << lineCount) - 1) : ~((uInt32)0) ;
+        lineState = *((uInt32 *)mxGetData(prhs[1])) & lineMask ;
+    }
+    else  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "state must be a uint32 scalar or a logical vector") ;
+    }
+
+    // Write it.  A closed-loop engine may be writing to the same lines.
+    int32 status ;
+    {
+        std::lock_guard<std::mutex> lock(binding->mutex) ;
+        status = writeOnDemandDOLineState(*binding, lineState) ;
+    }
 
-    // Verify the number of channels in the task equals that in the writeArray
-    //mexPrintf("nChannelsInTask: %d\n",nChannelsInTask) ;
-    //mexPrintf("nChannelsInWriteArray: %d\n",nChannelsInWriteArray) ;    
-    if (nChannelsInTask != nChannelsInWriteArray)
-        {
-        mexErrMsgIdAndTxt("ws:ni:badArgument",
-                          "writeArray must have the same number of columns as the task has channels");
-        }
+    // Add the latency to the histogram
+    float64 latency = std::chrono::duration<float64>(std::chrono::steady_clock::now() - startTime).count() ;
+    LatencyHistogram & histogram = binding->latency ;
+    int binIndex = 0 ;
+    for (float64 binUpperEdge = 1e-6; latency >= binUpperEdge && binIndex < LATENCY_HISTOGRAM_BIN_COUNT-1; binUpperEdge *= 2.0)  {
+        ++binIndex ;
+    }
+    ++histogram.countPerBin[binIndex] ;
+    ++histogram.count ;
+    histogram.totalLatency += latency ;
+    histogram.maxLatency = std::max(histogram.maxLatency, latency) ;
 
-    // Check that nSampsPerChan will fit in an int32, and error if not
-    if (nSampsPerChan > std::numeric_limits<int32>::max()) {
-        mexErrMsgIdAndTxt("ws:ni:badArgument", "writeArray has too many rows, maximum is %d", std::numeric_limits<int32>::max());
+    if (status < 0)  {
+        handlePossibleDAQmxErrorOrWarning(status, "WriteOnDemandDO") ;
     }
-    int32 nSampsPerChanAsInt32 = int32(nSampsPerChan);
+}
+// end of function
 
-    // Make the call
-    status = DAQmxWriteAnalogF64(taskHandle, 
-                                 nSampsPerChanAsInt32,
-                                 autoStart,
-                                 timeout, 
-                                 DAQmx_Val_GroupByChannel,
-                                 writeArray,
-                                 &nSampsPerChanWritten, 
-                                 NULL);
-    handlePossibleDAQmxErrorOrWarning(status, action);
 
-    // Return output data
-    plhs[0] = mxCreateDoubleScalar(nSampsPerChanWritten) ;  
-        // even if nlhs==0, still safe to assign to plhs[0], and should do this, so ans gets assigned        
+
+// [countPerBin, binEdges, meanLatency, maxLatency] = GetOnDemandDOLatencyHistogram(binding)
+//
+// The histogram of the latencies of the fast writes through binding.  countPerBin is 
+// 1 x nBins, and binEdges is 1 x (nBins+1), in seconds: zero, then 1 us, doubling to the 
+// last finite edge, then Inf.  meanLatency and maxLatency are in seconds, and are NaN 
+// and zero respectively if there have been no writes.
+void GetOnDemandDOLatencyHistogram(std::string /*action*/, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: binding
+    const LatencyHistogram & histogram = readOnDemandDOBindingArgument(nrhs, prhs, 1)->latency ;
+
+    plhs[0] = mxCreateDoubleMatrix(1, LATENCY_HISTOGRAM_BIN_COUNT, mxREAL) ;
+    for (int k = 0; k < LATENCY_HISTOGRAM_BIN_COUNT; ++k)  {
+        mxGetPr(plhs[0])[k] = (double)(histogram.countPerBin[k]) ;
+    }
+    if (nlhs>1)  {
+        plhs[1] = mxCreateDoubleMatrix(1, LATENCY_HISTOGRAM_BIN_COUNT+1, mxREAL) ;
+        double * binEdges = mxGetPr(plhs[1]) ;
+        binEdges[0] = 0.0 ;
+        binEdges[1] = 1e-6 ;
+        for (int k = 2; k < LATENCY_HISTOGRAM_BIN_COUNT; ++k)  {
+            binEdges[k] = 2.0*binEdges[k-1] ;
+        }
+        binEdges[LATENCY_HISTOGRAM_BIN_COUNT] = mxGetInf() ;
     }
+    if (nlhs>2)  {
+        plhs[2] = mxCreateDoubleScalar( (histogram.count>0) ? histogram.totalLatency/histogram.count : mxGetNaN() ) ;
+    }
+    if (nlhs>3)  {
+        plhs[3] = mxCreateDoubleScalar(histogram.maxLatency) ;
+    }
+}
+// end of function
 
 
 
-// sampsPerChanWritten = DAQmxWriteDigitalLines(taskHandle, autoStart, timeout, writeArray)
-void WriteDigitalLines(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
-    //
-    // Read input arguments
-    //
+// ResetOnDemandDOLatencyHistogram(binding)
+void ResetOnDemandDOLatencyHistogram(std::string /*action*/, int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: binding
+    readOnDemandDOBindingArgument(nrhs, prhs, 1)->latency = LatencyHistogram() ;
+}
+// end of function
 
-    // prhs[1]: taskHandle
-    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
 
-    // prhs[2]: autoStart
-    bool32 autoStart;
-    int index = 2; // index of the input arg we're currently dealing with
-    if ( (nrhs>index) && mxIsScalar(prhs[index]) )  {
-        autoStart = (bool32) mxGetScalar(prhs[index]) ;
-    }
-    else  {
-        mexErrMsgTxt("autoStart must be a scalar");        
-    }
 
-    // prhs[3]: timeout
-    index++;
-    float64 timeout = readTimeoutArgument(nrhs, prhs, index) ;
+// UnbindOnDemandDO(binding)
+void UnbindOnDemandDO(std::string /*action*/, int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: binding
+    OnDemandDOBinding * binding = readOnDemandDOBindingArgument(nrhs, prhs, 1) ;
+    unbindOnDemandDO(*findTaskRecord(binding->taskHandle)) ;
+}
+// end of function
 
-    // prhs[4]: writeArray
-    uInt8 *writeArray = 0;
-    size_t nSampsPerChan;
-    size_t nChannelsInWriteArray;
-    index++;
-    if ( nrhs>index && mxIsLogical(prhs[index]) && mxGetNumberOfDimensions(prhs[index])==2 )  {
-        nSampsPerChan = mxGetM(prhs[index]) ;
-        nChannelsInWriteArray = mxGetN(prhs[index]) ;
-        writeArray = (uInt8 *)mxGetData(prhs[index]) ;
+
+
+// StartClosedLoop(aiTaskHandle, doBinding, rules, ringScanCount)
+//
+// Start a closed-loop engine on an AI task, which sets the lines of an on-demand DO task, 
+// bound with BindOnDemandDO, from threshold rules applied to the raw AI samples, without 
+// going through Matlab.  rules is an nRules x 5 double array, one rule per row:
+//
+//     [channelIndex lineIndex upperThreshold lowerThreshold isInverted]
+//
+// channelIndex is the (one-based) AI channel within the task, and lineIndex the (one-based) 
+// line within the binding.  The rule goes above once a sample reaches upperThreshold, and 
+// below again once one falls to lowerThreshold, both in ADC counts, so 
+// upperThreshold-lowerThreshold is the hysteresis.  The line is high while the rule is 
+// above, or while it's below if isInverted is true.  Each line can have at most one rule; 
+// lines without one keep whatever state was last written through the binding.  Rules start 
+// out below, and their lines are set accordingly at the start.
+//
+// While the engine runs, it is the only reader of the AI task.  It keeps the scans in a 
+// ring of ringScanCount scans, and DAQmxReadBinaryI16 and DAQmxGetReadAvailSampPerChan on 
+// the task get them from there, so they can be used as usual.  Other reads of the task are 
+// errors.  If the ring overflows, reads error with DAQmxErrorSamplesNoLongerAvailable.  The 
+// engine can be started before the task is, and keeps running across task stops and starts.
+// If reading the task or writing the lines fails otherwise, the engine stops, and reads 
+// error with that DAQmx status until StopClosedLoop().  The rules are applied scan by scan, 
+// and the lines written at the scan that changes them.  Every rule state change is logged, 
+// see GetClosedLoopEvents().
+void StartClosedLoop(std::string action, int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: aiTaskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+    TaskRecord * taskRecord = findTaskRecord(taskHandle) ;
+    if (taskRecord->closedLoopEngine)  {
+        mexErrMsgIdAndTxt("ws:ni:closedLoopIsRunning", "The task already has a closed loop running on it") ;
+    }
+    uInt32 channelCount ;
+    int32 status = DAQmxGetReadNumChans(taskHandle, &channelCount) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+    if (channelCount == 0)  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "The task has no input channels") ;
+    }
+
+    // prhs[2]: doBinding
+    OnDemandDOBinding * binding = readOnDemandDOBindingArgument(nrhs, prhs, 2) ;
+    uInt32 bindingID = *((uInt32 *)mxGetData(prhs[2])) ;
+    size_t lineCount = binding->terminalIDPerLine.size() ;
+
+    // prhs[3]: rules
+    int index = 3 ;
+    if ( !(nrhs>index && mxIsDouble(prhs[index]) && !mxIsComplex(prhs[index]) && mxGetNumberOfDimensions(prhs[index])==2 &&
+           (mxGetN(prhs[index])==5 || mxIsEmpty(prhs[index]))) )  {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "rules must be an nRules x 5 matrix of real doubles") ;
+    }
+    size_t ruleCount = mxIsEmpty(prhs[index]) ? 0 : mxGetM(prhs[index]) ;
+    const double * rulesAsDouble = mxGetPr(prhs[index]) ;
+    std::vector<ThresholdRule> rules(ruleCount) ;
+    uInt32 ruleLineMask = 0 ;
+    uInt32 ruleLineState = 0 ;
+    for (size_t r = 0; r < ruleCount; ++r)  {
+        double channelIndex = rulesAsDouble[r] ;
+        double lineIndex = rulesAsDouble[ruleCount + r] ;
+        double upperThreshold = rulesAsDouble[2*ruleCount + r] ;
+        double lowerThreshold = rulesAsDouble[3*ruleCount + r] ;
+        double isInverted = rulesAsDouble[4*ruleCount + r] ;
+        if ( !(1.0<=channelIndex && channelIndex<=channelCount) || channelIndex != floor(channelIndex) )  {
+            mexErrMsgIdAndTxt("ws:ni:badArgument", "Each rule's channelIndex must be an integer between 1 and %d", (int)(channelCount)) ;
+        }
+        if ( !(1.0<=lineIndex && lineIndex<=lineCount) || lineIndex != floor(lineIndex) )  {
+            mexErrMsgIdAndTxt("ws:ni:badArgument", "Each rule's lineIndex must be an integer between 1 and %d", (int)(lineCount)) ;
+        }
+        if ( !(-32768.0<=lowerThreshold && lowerThreshold<=upperThreshold && upperThreshold<=32767.0) ||
+             lowerThreshold != floor(lowerThreshold) || upperThreshold != floor(upperThreshold) )  {
+            mexErrMsgIdAndTxt("ws:ni:badArgument", "Each rule's thresholds must be int16 values, with lowerThreshold <= upperThreshold") ;
+        }
+        if ( !(isInverted==0.0 || isInverted==1.0) )  {
+            mexErrMsgIdAndTxt("ws:ni:badArgument", "Each rule's isInverted must be 0 or 1") ;
+        }
+        ThresholdRule & rule = rules[r] ;
+        rule.channelIndex = (uInt32)(channelIndex) - 1 ;
+        rule.lineIndex = (uInt32)(lineIndex) - 1 ;
+        rule.upperThreshold = (int16)(upperThreshold) ;
+        rule.lowerThreshold = (int16)(lowerThreshold) ;
+        rule.isInverted = (isInverted != 0.0) ;
+        rule.isAbove = false ;
+        if ( (ruleLineMask >> rule.lineIndex) & 1 )  {
+            mexErrMsgIdAndTxt("ws:ni:badArgument", "Each line can have at most one rule") ;
+        }
+        ruleLineMask |= ((uInt32)1) << rule.lineIndex ;
+        ruleLineState |= ((uInt32)(rule.isInverted)) << rule.lineIndex ;
     }
-    else  {
-        mexErrMsgIdAndTxt("ws:ni:badArgument", "writeArray must be a matrix of class logical");        
+
+    // prhs[4]: ringScanCount
+    index = 4 ;
+    double ringScanCountAsDouble = 0.0 ;
+    if ((nrhs>index) && mxIsScalar(prhs[index]) && mxIsNumeric(prhs[index]) && !mxIsComplex(prhs[index]))  {
+        ringScanCountAsDouble = mxGetScalar(prhs[index]) ;
+        if (!isfinite(ringScanCountAsDouble) || ringScanCountAsDouble < 1 || ringScanCountAsDouble>4294967295.0)  {
+            mexErrMsgIdAndTxt("ws:ni:badArgument", "ringScanCount must be a finite value of at least one");
+        }
     }
+    else {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "ringScanCount must be a numeric non-complex scalar");
+    }
+    uInt32 ringScanCount = uInt32(round(ringScanCountAsDouble)) ;
+
+    // Set the lines to the starting states of their rules
+    if (ruleCount > 0)  {
+        std::lock_guard<std::mutex> lock(binding->mutex) ;
+        status = writeOnDemandDOLineState(*binding, (binding->lineState & ~ruleLineMask) | ruleLineState) ;
+    }
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+
+    // Set up the engine and start the thread
+    ClosedLoopEngine * engine = new ClosedLoopEngine() ;
+    engine->aiTaskHandle = taskHandle ;
+    engine->doBindingID = bindingID ;
+    engine->channelCount = channelCount ;
+    engine->rules = rules ;
+    engine->ringScanCount = ringScanCount ;
+    engine->ring.assign((size_t)(ringScanCount)*channelCount, 0) ;
+    engine->scanCountRead = 0 ;
+    engine->scanCountConsumed = 0 ;
+    engine->isRingOverflowed = false ;
+    engine->eventCountDropped = 0 ;
+    engine->errorStatus = 0 ;
+    engine->isStopRequested = false ;
+    engine->readerThread = std::thread(runClosedLoop, engine, binding) ;
+    taskRecord->closedLoopEngine = engine ;
+}
+// end of function
 
-    // Determine # of channels in task
-    uInt32 nChannelsInTask;
-    int32 status = DAQmxGetWriteNumChans(taskHandle,&nChannelsInTask);
-    handlePossibleDAQmxErrorOrWarning(status, action);
 
-    // Verify the number of channels in the task equals that in the writeArray
-    //mexPrintf("nChannelsInTask: %d\n",nChannelsInTask) ;
-    //mexPrintf("nChannelsInWriteArray: %d\n",nChannelsInWriteArray) ;    
-    if (nChannelsInTask != nChannelsInWriteArray)  {
-        mexErrMsgIdAndTxt("ws:ni:badArgument",
-                          "writeArray must have the same number of columns as the task has channels");
-    }
 
-    // Check that nSampsPerChan will fit in an int32, and error if not
-    if (nSampsPerChan > std::numeric_limits<int32>::max())  {
-        mexErrMsgIdAndTxt("ws:ni:badArgument", "writeArray has too many rows, maximum is %d", std::numeric_limits<int32>::max());
+// StopClosedLoop(aiTaskHandle)
+//
+// Stop the task's closed-loop engine, if it has one.  Scans in its ring that haven't been 
+// read are lost, and reads go to the driver again.  The lines are left as they are.
+void StopClosedLoop(std::string action, int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: aiTaskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+    stopClosedLoop(*findTaskRecord(taskHandle)) ;
+}
+// end of function
+
+
+
+// [scanIndex, ruleIndex, isLineHigh, eventCountDropped] = GetClosedLoopEvents(aiTaskHandle)
+//
+// Collect the rule state changes logged by the task's closed-loop engine since the last 
+// call, in scan order.  scanIndex (zero-based, counting from the start of the engine) is 
+// the scan that triggered the change, ruleIndex the (one-based) row of the rule, and 
+// isLineHigh the new state of the rule's line.  All are nEvents x 1.  If too many events 
+// went uncollected, later ones were dropped, and eventCountDropped says how many.
+void GetClosedLoopEvents(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: aiTaskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs) ;
+    ClosedLoopEngine * engine = findTaskRecord(taskHandle)->closedLoopEngine ;
+    if (!engine)  {
+        mexErrMsgIdAndTxt("ws:ni:noClosedLoop", "The task has no closed loop running on it") ;
     }
-    int32 nSampsPerChanAsInt32 = int32(nSampsPerChan);
 
-    //
-    // Make the call
-    // 
-    int32 nSampsPerChanWritten;
-    status = DAQmxWriteDigitalLines(taskHandle,
-                                    nSampsPerChanAsInt32,
-                                    autoStart,
-                                    timeout, 
-                                    DAQmx_Val_GroupByChannel,
-                                    writeArray,
-                                    &nSampsPerChanWritten, 
-                                    NULL);
-    handlePossibleDAQmxErrorOrWarning(status, action);
+    // Take the events
+    std::vector<ClosedLoopEvent> events ;
+    uInt64 eventCountDropped ;
+    {
+        std::lock_guard<std::mutex> lock(engine->mutex) ;
+        events.swap(engine->events) ;
+        eventCountDropped = engine->eventCountDropped ;
+        engine->eventCountDropped = 0 ;
+    }
 
     // Return output data
-    plhs[0] = mxCreateDoubleScalar(nSampsPerChanWritten) ;  
-        // even if nlhs==0, still safe to assign to plhs[0], and should do this, so ans gets assigned        
+    size_t eventCount = events.size() ;
+    plhs[0] = mxCreateDoubleMatrix(eventCount, 1, mxREAL) ;
+    for (size_t i = 0; i < eventCount; ++i)  {
+        mxGetPr(plhs[0])[i] = (double)(events[i].scanIndex) ;
+    }
+    if (nlhs>1)  {
+        plhs[1] = mxCreateDoubleMatrix(eventCount, 1, mxREAL) ;
+        for (size_t i = 0; i < eventCount; ++i)  {
+            mxGetPr(plhs[1])[i] = (double)(events[i].ruleIndex + 1) ;
+        }
+    }
+    if (nlhs>2)  {
+        plhs[2] = mxCreateLogicalMatrix(eventCount, 1) ;
+        for (size_t i = 0; i < eventCount; ++i)  {
+            mxGetLogicals(plhs[2])[i] = events[i].isLineHigh ;
+        }
+    }
+    if (nlhs>3)  {
+        plhs[3] = mxCreateDoubleScalar((double)(eventCountDropped)) ;
+    }
 }
 // end of function
 
@@ -2039,7 +4348,8 @@ void CfgOutputBuffer(std::string action, int nlhs, mxArray *plhs[], int nrhs, co
     }
     uInt32 scanCount = uInt32(round(scanCountAsDouble));
 
-    // Make the call
+    // Make the call.  This reallocates the buffer, so whatever was written to it is gone.
+    invalidateWriteCache(taskHandle) ;
     int32 status = DAQmxCfgOutputBuffer(taskHandle, scanCount);
     handlePossibleDAQmxErrorOrWarning(status, action);
 }
@@ -2073,6 +4383,42 @@ void ResetWriteOffset(std::string action, int nlhs, mxArray *plhs[], int nrhs, c
 
 
 
+// Read a counter-output pulse frequency argument, which must be finite and positive
+float64
+readCOPulseFrequencyArgument(int nrhs, const mxArray *prhs[], int index)  {
+    float64 frequency ;
+    if ((nrhs>index) && mxIsScalar(prhs[index]) && mxIsNumeric(prhs[index]) && !mxIsComplex(prhs[index])) {
+        frequency = mxGetScalar(prhs[index]);
+        if (!isfinite(frequency) || frequency<=0.0) {
+            mexErrMsgIdAndTxt("ws:ni:badArgument", "frequency must be a finite, positive value");
+        }
+    }
+    else {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "frequency must be a numeric non-complex scalar");
+    }
+    return frequency ;
+}
+
+
+
+// Read a counter-output duty cycle argument, which must be strictly between 0 and 1
+float64
+readCOPulseDutyCycleArgument(int nrhs, const mxArray *prhs[], int index)  {
+    float64 dutyCycle ;
+    if ((nrhs>index) && mxIsScalar(prhs[index]) && mxIsNumeric(prhs[index]) && !mxIsComplex(prhs[index])) {
+        dutyCycle = mxGetScalar(prhs[index]);
+        if (!isfinite(dutyCycle) || dutyCycle <= 0.0 || dutyCycle >= 1.0) {
+            mexErrMsgIdAndTxt("ws:ni:badArgument", "dutyCycle must be a finite value greater than 0.0 and less than 1.0");
+        }
+    }
+    else {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "dutyCycle must be a numeric non-complex scalar");
+    }
+    return dutyCycle ;
+}
+
+
+
 // DAQmxCreateCOPulseChanFreq(taskHandle, counter, idleState, initialDelay, freq, dutyCycle)
 void CreateCOPulseChanFreq(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
     // prhs[1]: taskHandle
@@ -2141,6 +4487,14 @@ void CreateCOPulseChanFreq(std::string action, int nlhs, mxArray *plhs[], int nr
                                    freq, 
                                    dutyCycle);
     handlePossibleDAQmxErrorOrWarning(status, action);
+
+    // Remember the pulse train, for ReconfigureCOPulseTrain()
+    COPulseTrainState & coPulseTrain = findTaskRecord(taskHandle)->coPulseTrain ;
+    coPulseTrain.isValid = true ;
+    coPulseTrain.frequency = freq ;
+    coPulseTrain.dutyCycle = dutyCycle ;
+    coPulseTrain.sampleMode = 0 ;
+    coPulseTrain.pulseCount = 0 ;
 }
 // end of function
 
@@ -2180,6 +4534,163 @@ void CfgImplicitTiming(std::string action, int nlhs, mxArray *plhs[], int nrhs,
             sampleMode,
             sampsPerChanToAcquire);
     handlePossibleDAQmxErrorOrWarning(status, action);
+
+    // Remember the pulse count, for ReconfigureCOPulseTrain()
+    COPulseTrainState & coPulseTrain = findTaskRecord(taskHandle)->coPulseTrain ;
+    coPulseTrain.sampleMode = sampleMode ;
+    coPulseTrain.pulseCount = sampsPerChanToAcquire ;
+}
+// end of function
+
+
+
+// DAQmxWriteCtrFreqScalar(taskHandle, autoStart, timeout, frequency, dutyCycle)
+//
+// Changes the frequency and duty cycle of a counter-output pulse train, which can be done 
+// while the task is running.
+void WriteCtrFreqScalar(std::string action, int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[]) {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs);
+
+    // prhs[2]: autoStart, prhs[3]: timeout
+    bool32 autoStart ;
+    float64 timeout ;
+    readAutoStartAndTimeoutArguments(nrhs, prhs, &autoStart, &timeout) ;
+
+    // prhs[4]: frequency, prhs[5]: dutyCycle
+    float64 frequency = readCOPulseFrequencyArgument(nrhs, prhs, 4) ;
+    float64 dutyCycle = readCOPulseDutyCycleArgument(nrhs, prhs, 5) ;
+
+    //
+    // Make the call
+    //
+    int32 status = DAQmxWriteCtrFreqScalar(taskHandle, autoStart, timeout, frequency, dutyCycle, NULL) ;
+    handlePossibleDAQmxErrorOrWarning(status, action);
+
+    // Remember the new pulse train
+    COPulseTrainState & coPulseTrain = findTaskRecord(taskHandle)->coPulseTrain ;
+    if (coPulseTrain.isValid)  {
+        coPulseTrain.frequency = frequency ;
+        coPulseTrain.dutyCycle = dutyCycle ;
+    }
+}
+// end of function
+
+
+
+// didChange = ReconfigureCOPulseTrain(taskHandle, frequency, dutyCycle, pulseCount)
+//
+// Sets the frequency, duty cycle, and pulse count of a counter-output task made with 
+// DAQmxCreateCOPulseChanFreq, so that a task can be reused from run to run instead of 
+// being cleared and made anew.  A pulseCount of Inf means a continuous pulse train.  
+// The task is stopped first, whether it's running or is a finite task that's done but 
+// was never stopped, since DAQmx won't change the attributes of either.  Only the 
+// attributes that differ from the task's current configuration are then set, and the 
+// task is committed, unless it's committed as configured already, so that starting it 
+// later is quick.  didChange is true iff any attribute was set.
+void ReconfigureCOPulseTrain(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs);
+    TaskRecord & taskRecord = *findTaskRecord(taskHandle) ;
+    COPulseTrainState & coPulseTrain = taskRecord.coPulseTrain ;
+    if (!coPulseTrain.isValid)  {
+        mexErrMsgIdAndTxt("ws:ni:notACOPulseTrainTask", 
+                          "The task has no counter-output pulse channel made with DAQmxCreateCOPulseChanFreq") ;
+    }
+
+    // prhs[2]: frequency, prhs[3]: dutyCycle
+    float64 frequency = readCOPulseFrequencyArgument(nrhs, prhs, 2) ;
+    float64 dutyCycle = readCOPulseDutyCycleArgument(nrhs, prhs, 3) ;
+
+    // prhs[4]: pulseCount
+    int index = 4 ;
+    double pulseCountAsDouble ;
+    if ((nrhs>index) && mxIsScalar(prhs[index]) && mxIsNumeric(prhs[index]) && !mxIsComplex(prhs[index])) {
+        pulseCountAsDouble = mxGetScalar(prhs[index]) ;
+        if ( !(pulseCountAsDouble >= 1) || 
+             ( isfinite(pulseCountAsDouble) && 
+               (pulseCountAsDouble != round(pulseCountAsDouble) || pulseCountAsDouble > std::numeric_limits<uInt64>::max()) ) )  {
+            mexErrMsgIdAndTxt("ws:ni:badArgument", "pulseCount must be a positive integer, or Inf");
+        }
+    }
+    else {
+        mexErrMsgIdAndTxt("ws:ni:badArgument", "pulseCount must be a numeric non-complex scalar");
+    }
+    bool isContinuous = !isfinite(pulseCountAsDouble) ;
+    int32 sampleMode = isContinuous ? DAQmx_Val_ContSamps : DAQmx_Val_FiniteSamps ;
+    uInt64 pulseCount = isContinuous ? 0 : uInt64(pulseCountAsDouble) ;
+
+    // Work out what has changed
+    bool isPulseShapeChanged = (frequency != coPulseTrain.frequency || dutyCycle != coPulseTrain.dutyCycle) ;
+    bool isTimingChanged = 
+        (sampleMode != coPulseTrain.sampleMode) || 
+        (!isContinuous && pulseCount != coPulseTrain.pulseCount) ;
+
+    // Stop the task.  This is a no-op if it's stopped already, and otherwise takes it back 
+    // to the state it was in before it was started, so a commit made then still holds.
+    int32 status = DAQmxStopTask(taskHandle) ;
+    handlePossibleDAQmxErrorOrWarning(status, action) ;
+
+    // Set the attributes that changed
+    if (isPulseShapeChanged)  {
+        std::vector<std::string> channelNames(getTaskChannelNames(taskHandle, action)) ;
+        for (size_t i = 0; i < channelNames.size(); ++i)  {
+            const char * channelName = channelNames[i].c_str() ;
+            if (frequency != coPulseTrain.frequency)  {
+                status = DAQmxSetCOPulseFreq(taskHandle, channelName, frequency) ;
+                handlePossibleDAQmxErrorOrWarning(status, action) ;
+            }
+            if (dutyCycle != coPulseTrain.dutyCycle)  {
+                status = DAQmxSetCOPulseDutyCyc(taskHandle, channelName, dutyCycle) ;
+                handlePossibleDAQmxErrorOrWarning(status, action) ;
+            }
+        }
+    }
+    if (isTimingChanged)  {
+        // For continuous generation, DAQmx uses the count only to size the buffer
+        status = DAQmxCfgImplicitTiming(taskHandle, sampleMode, isContinuous ? 1000 : pulseCount) ;
+        handlePossibleDAQmxErrorOrWarning(status, action) ;
+    }
+
+    // Remember the new pulse train
+    bool didChange = isPulseShapeChanged || isTimingChanged ;
+    coPulseTrain.frequency = frequency ;
+    coPulseTrain.dutyCycle = dutyCycle ;
+    coPulseTrain.sampleMode = sampleMode ;
+    coPulseTrain.pulseCount = pulseCount ;
+    if (!isTaskCommittedAsConfigured(taskRecord))  {
+        status = DAQmxTaskControl(taskHandle, DAQmx_Val_Task_Commit) ;
+        handlePossibleDAQmxErrorOrWarning(status, action) ;
+        noteTaskControl(taskRecord, DAQmx_Val_Task_Commit) ;
+    }
+
+    // Return didChange
+    if (nlhs >= 1)  {
+        plhs[0] = mxCreateLogicalScalar(didChange) ;
+    }
+}
+// end of function
+
+
+
+// [fingerprint, isCommitted] = GetTaskConfigurationFingerprint(taskHandle)
+//
+// fingerprint is a uint64 hash of all the configuration calls made on the task through 
+// ws.ni(), in order, and of its CO pulse train, if any.  Two tasks configured by the same 
+// sequence of calls have the same fingerprint, so it can be stored and checked later to 
+// see whether a task can be reused as is.  isCommitted is true iff the task has been 
+// committed, and not reconfigured or unreserved since.
+void GetTaskConfigurationFingerprint(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    // prhs[1]: taskHandle
+    TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs);
+    const TaskRecord & taskRecord = *findTaskRecord(taskHandle) ;
+
+    // Return the fingerprint, and whether the task is committed as configured
+    plhs[0] = mxCreateNumericMatrix(1, 1, mxUINT64_CLASS, mxREAL) ;
+    *((uInt64 *)mxGetData(plhs[0])) = configurationFingerprint(taskRecord) ;
+    if (nlhs >= 2)  {
+        plhs[1] = mxCreateLogicalScalar(isTaskCommittedAsConfigured(taskRecord)) ;
+    }
 }
 // end of function
 
@@ -2243,15 +4754,12 @@ void CfgInputBuffer(std::string action, int nlhs, mxArray *plhs[], int nrhs, con
 
 
 //void printGlobalState() {
-//	mexPrintf("TASK_HANDLE_COUNT: %d\n", TASK_HANDLE_COUNT);
-//	for (int i = 0; i < TASK_HANDLE_COUNT; ++i) {
-//		mexPrintf("TASK_HANDLES[%d]: %p\n", i, TASK_HANDLES[i]);
+//	mexPrintf("TASK_HANDLES.size(): %d\n", (int)TASK_HANDLES.size());
+//	for (size_t i = 0; i < TASK_HANDLES.size(); ++i) {
+//		const TaskRecord & taskRecord = *findTaskRecord(TASK_HANDLES[i]);
+//		mexPrintf("TASK_HANDLES[%d]: %p, everyNSamples: %d, nSamples %u, callback %p\n", (int)i, taskRecord.taskHandle,
+//		          (int)taskRecord.everyNSamples.isRegistered, taskRecord.everyNSamples.nSamples, taskRecord.everyNSamples.matlabCallback);
 //	}
-//
-//	mexPrintf("IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED: %d\n", IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED);
-//	mexPrintf("EVERY_N_SAMPLES_MATLAB_CALLBACK: %p\n", EVERY_N_SAMPLES_MATLAB_CALLBACK);
-//	mexPrintf("N_SAMPLES: %ud\n", N_SAMPLES);
-//	mexPrintf("EVERY_N_SAMPLES_TASK_HANDLE: %p\n", EVERY_N_SAMPLES_TASK_HANDLE);
 //}
 //// end of function
 
@@ -2261,12 +4769,14 @@ void CfgInputBuffer(std::string action, int nlhs, mxArray *plhs[], int nrhs, con
 void RegisterEveryNSamplesEvent(std::string action, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
 	//printGlobalState();
 
-    if (IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED) {
-        mexErrMsgIdAndTxt("ws:ni:callbackAlreadyRegistered", "A callback is already registered for everyNSamplesEvent");
-    }
-
     // prhs[1]: taskHandle
     TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs);
+    TaskRecord & taskRecord = *findTaskRecord(taskHandle) ;
+
+    if (taskRecord.everyNSamples.isRegistered) {
+        std::string errorMessage = sprintfpp("A callback is already registered for everyNSamplesEvent for task handle %p", taskHandle);
+        mexErrMsgIdAndTxt("ws:ni:callbackAlreadyRegistered", errorMessage.c_str());
+    }
 
     // prhs[2]: nSamples
     int index = 2;
@@ -2308,13 +4818,12 @@ void RegisterEveryNSamplesEvent(std::string action, int nlhs, mxArray *plhs[], i
 
 	// If get here, that must have worked
 
-    // Modify the globals appropriately
-	EVERY_N_SAMPLES_TASK_HANDLE = taskHandle;
-	N_SAMPLES = nSamples;
-	EVERY_N_SAMPLES_MATLAB_CALLBACK = mxDuplicateArray(callbackFunction);
-    mexMakeArrayPersistent(EVERY_N_SAMPLES_MATLAB_CALLBACK);
-	//mexPrintf("About to set IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED = true\n");
-	IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED = true;
+    // Modify the task record appropriately
+    EveryNSamplesRegistration & registration = taskRecord.everyNSamples ;
+	registration.nSamples = nSamples;
+	registration.matlabCallback = mxDuplicateArray(callbackFunction);
+    mexMakeArrayPersistent(registration.matlabCallback);
+	registration.isRegistered = true;
 		
 	// Stopping the task after registering makes it work properly in repeated usage.
 	// Why that might be is mysterious to me.
@@ -2330,20 +4839,16 @@ void UnregisterEveryNSamplesEvent(std::string action, int nlhs, mxArray *plhs[],
     // prhs[1]: taskHandle
     TaskHandle taskHandle = readTaskHandleArgument(action, nrhs, prhs);
 
-    if (IS_EVERY_N_SAMPLES_MATLAB_CALLBACK_REGISTERED)  {
-        if (taskHandle == EVERY_N_SAMPLES_TASK_HANDLE) {
-            // Unregister the callback
-            const bool doIgnoreErrors = false;
-            int32 status = unregisterEveryNSamplesEventAndUpdateGlobals(doIgnoreErrors);
-            handlePossibleDAQmxErrorOrWarning(status, action);
-        }
-        else {
-            std::string errorMessage = sprintfpp("No callback is registered for everyNSamplesEvent for task handle %p", taskHandle);
-            mexErrMsgIdAndTxt("ws:ni:noCallbackRegisteredForTask", errorMessage.c_str());
-        }
+    TaskRecord & taskRecord = *findTaskRecord(taskHandle) ;
+    if (taskRecord.everyNSamples.isRegistered) {
+        // Unregister the callback
+        const bool doIgnoreErrors = false;
+        int32 status = unregisterEveryNSamplesEvent(taskRecord, doIgnoreErrors);
+        handlePossibleDAQmxErrorOrWarning(status, action);
     }
     else {
-        mexErrMsgIdAndTxt("ws:ni:noCallbackRegistered", "No callback is registered for everyNSamplesEvent");
+        std::string errorMessage = sprintfpp("No callback is registered for everyNSamplesEvent for task handle %p", taskHandle);
+        mexErrMsgIdAndTxt("ws:ni:noCallbackRegisteredForTask", errorMessage.c_str());
     }
 }
 // end of function
@@ -2358,6 +4863,12 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
                           "ws.ni() needs at least one argument") ;
     }
     
+    // The on-demand DO fast path, which is called with a binding in place of the action
+    if (mxGetClassID(prhs[0]) == mxUINT32_CLASS)  {
+        WriteOnDemandDO(nlhs, plhs, nrhs, prhs) ;
+        return ;
+    }
+
     const mxArray* actionAsMxArray = (mxArray*)(prhs[0]) ;
     if (!isMxArrayAString(actionAsMxArray))  {
         mexErrMsgIdAndTxt("ws:ni:argNotAString", 
@@ -2387,12 +4898,66 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
     else if (action == "DAQmxReadDigitalU32") {
         ReadDigitalU32(action, nlhs, plhs, nrhs, prhs);
     }
+    else if (action == "ReadPackedDigitalLines") {
+        ReadPackedDigitalLines(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "WaitForScans") {
+        WaitForScans(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "WaitForPackedDigitalLines") {
+        WaitForPackedDigitalLines(action, nlhs, plhs, nrhs, prhs);
+    }
     else if (action == "DAQmxWriteAnalogF64") {
         WriteAnalogF64(action, nlhs, plhs, nrhs, prhs);
     }
+    else if (action == "DAQmxWriteBinaryI16") {
+        WriteBinaryI16(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "WriteAnalogF64AsBinaryI16") {
+        WriteAnalogF64AsBinaryI16(action, nlhs, plhs, nrhs, prhs);
+    }
     else if (action == "DAQmxWriteDigitalLines") {
         WriteDigitalLines(action, nlhs, plhs, nrhs, prhs);
     }
+    else if (action == "DAQmxWriteDigitalU32") {
+        WriteDigitalU32(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "PackDigitalLines") {
+        PackDigitalLines(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "BindOnDemandDO") {
+        BindOnDemandDO(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "UnbindOnDemandDO") {
+        UnbindOnDemandDO(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "GetOnDemandDOLatencyHistogram") {
+        GetOnDemandDOLatencyHistogram(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "ResetOnDemandDOLatencyHistogram") {
+        ResetOnDemandDOLatencyHistogram(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "StartClosedLoop") {
+        StartClosedLoop(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "StopClosedLoop") {
+        StopClosedLoop(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "GetClosedLoopEvents") {
+        GetClosedLoopEvents(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "StartOutputStream") {
+        StartOutputStream(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "WriteToOutputStream") {
+        WriteToOutputStream(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "GetOutputStreamStatus") {
+        GetOutputStreamStatus(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "StopOutputStream") {
+        StopOutputStream(action, nlhs, plhs, nrhs, prhs);
+    }
     else if (action == "DAQmxIsTaskDone") {
         IsTaskDone(action, nlhs, plhs, nrhs, prhs);
     }
@@ -2444,6 +5009,9 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
     else if (action == "DAQmxDisableStartTrig") {
         DisableStartTrig(action, nlhs, plhs, nrhs, prhs);
     }
+    else if ( action == "DAQmxGetAODevScalingCoeffs" )  {
+        GetAODevScalingCoeffs(action, nlhs, plhs, nrhs, prhs) ;
+    }
     else if ( action == "DAQmxGetAIDevScalingCoeffs" )  {
         GetAIDevScalingCoeffs(action, nlhs, plhs, nrhs, prhs) ;
     }
@@ -2501,6 +5069,15 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
     else if (action == "DAQmxCfgImplicitTiming") {
         CfgImplicitTiming(action, nlhs, plhs, nrhs, prhs);
     }
+    else if (action == "DAQmxWriteCtrFreqScalar") {
+        WriteCtrFreqScalar(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "ReconfigureCOPulseTrain") {
+        ReconfigureCOPulseTrain(action, nlhs, plhs, nrhs, prhs);
+    }
+    else if (action == "GetTaskConfigurationFingerprint") {
+        GetTaskConfigurationFingerprint(action, nlhs, plhs, nrhs, prhs);
+    }
     else if (action == "DAQmxExportSignal") {
         ExportSignal(action, nlhs, plhs, nrhs, prhs);
     }
@@ -2520,6 +5097,11 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
                           errorMessage.c_str()) ;
     }
 
+    // If we get here, the action succeeded, so if it changed a task's configuration, note that
+    if (isConfigurationAction(action))  {
+        noteConfigurationCall(action, nrhs, prhs) ;
+    }
+
     //mexPrintf("About to exit\n");
 }
 // end of function
@@ -0,0 +1,854 @@
+// ws.reader: the native engine that reads slices of the scans in WaveSurfer's HDF5 data
+// files, for ws.DataFileReader.
+//
+// ws.loadDataFile() reads every sweep of a file into memory, and scales them all, before
+// returning anything, which for a multi-GB file takes minutes, and all of RAM.  Here the
+// file is opened once, and nothing is read until a slice of one sweep's scans is asked
+// for, and then only that slice is read.  If a sweep's analogScans dataset is contiguous
+// in the file, as h5create() lays out fixed-size datasets, the slice is copied straight
+// out of a read-only memory map of the file.  If it's chunked, as ws.logger lays them out,
+// the slice is read through HDF5, a chunk-row at a time, with a chunk cache big enough
+// that reading the next channel doesn't read (or decompress) the same chunks again.  Every
+// HDF5 call is made holding the lock ws.logger's background threads hold (see ../hdf5Lock),
+// so other files can be read while a run is being logged.
+// Datasets ws.logger compressed with the filter in ../scanFilter are decompressed as
+// they're read.  The scans come back raw; ws.DataFileReader scales them.
+//
+// Usage, from ws.DataFileReader:
+//
+//   dataFile = ws.reader('OpenFile', fileName)
+//   sweepIndices = ws.reader('GetSweepIndices', dataFile)
+//   [scanCount, analogChannelCount, digitalClassName, timestamp, isMapped] = ws.reader('GetSweepInfo', dataFile, sweepIndex)
+//   rawAnalogData = ws.reader('ReadAnalogScans', dataFile, sweepIndex, channelIndices, firstScanIndex, scanCount)
+//   rawDigitalData = ws.reader('ReadDigitalScans', dataFile, sweepIndex, firstScanIndex, scanCount)
+//   ws.reader('CloseFile', dataFile)
+//
+// Sweeps are the /sweep_%04d groups (or /trial_%04d, in files from old versions), and
+// their datasets are as ws.logger writes them: see there.  Indices are one-based, as in
+// Matlab.  Everything but mexFunction() is static, so that ws.reader can be linked
+// alongside ws.logger, whose helpers have the same names.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <mutex>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "hdf5.h"
+#include "mex.h"
+#include "matrix.h"
+#include "scanFilter.h"
+#include "hdf5Lock.h"
+
+
+
+// The chunk cache of each chunked scans dataset read.  A read goes a row of chunks at a
+// time, channel by channel, so this only has to hold one row of chunks for the chunks to
+// be read only once, but a bigger one means rereading nearby scans is cheap.  The slot
+// count is a prime about 100 times the number of 4 MiB chunks that fit, as HDF5 suggests.
+#define CHUNK_CACHE_BYTE_COUNT (64*1024*1024)
+#define CHUNK_CACHE_SLOT_COUNT 1601
+
+
+
+// A sweep in the file.  Its datasets are only opened the first time it's asked about.  The
+// scans datasets are nChannels x nScans to HDF5, as ws.logger writes them, so a channel's
+// scans are contiguous in a contiguous dataset, and mappedAnalogScans, if not null, points
+// at the first scan of the first channel in the file's memory map.
+struct Sweep {
+    int sweepIndex ;
+    std::string groupName ;
+    bool isOpen ;
+    hid_t analogDatasetID ;  // negative if there's no analogScans dataset
+    hid_t digitalDatasetID ;  // negative if there's no digitalScans dataset
+    hsize_t scanCount ;
+    hsize_t analogChannelCount ;
+    hsize_t chunkScanCount ;  // the scans in each chunk of analogScans, or all of them if it's not chunked
+    mxClassID digitalClassID ;  // mxUNKNOWN_CLASS if there's no digitalScans dataset
+    hid_t digitalMemoryTypeID ;  // not owned, one of the H5T_NATIVE_* types
+    double timestamp ;
+    const int16_t * mappedAnalogScans ;
+} ;
+
+#ifdef _WIN32
+typedef HANDLE MappedFileHandle ;
+#define INVALID_MAPPED_FILE_HANDLE INVALID_HANDLE_VALUE
+#else
+typedef int MappedFileHandle ;
+#define INVALID_MAPPED_FILE_HANDLE (-1)
+#endif
+
+// An open data file.  The file is memory-mapped, read-only, the first time a contiguous
+// dataset is found.  mappingByteCount is zero if it hasn't been mapped, and mappingBytes
+// is null if it couldn't be, in which case everything is read through HDF5.
+struct DataFile {
+    std::string fileName ;
+    hid_t fileID ;
+    std::vector<Sweep> sweeps ;  // in order of sweep index
+    bool didTryToMap ;
+    MappedFileHandle mappedFileHandle ;
+#ifdef _WIN32
+    HANDLE mappingHandle ;
+#endif
+    const char * mappingBytes ;
+    uint64_t mappingByteCount ;
+} ;
+
+// The open data files.  The dataFile ID handed to Matlab is the index into this, plus one.
+// Closed files leave a null, so IDs are never reused.
+static std::vector<DataFile *> DATA_FILES ;
+
+// Held for every HDF5 call, and released before erroring out
+static std::mutex & HDF5_MUTEX = hdf5Mutex() ;
+
+
+
+// Error out if an HDF5 call failed.  HDF5 calls return a negative value on failure.
+static void
+checkHDF5(hid_t idOrStatus, const char * whatFailed, const std::string & fileName)  {
+    if (idOrStatus < 0)  {
+        mexErrMsgIdAndTxt("ws:reader:hdf5Error", "Unable to %s in data file %s", whatFailed, fileName.c_str()) ;
+    }
+}
+
+
+
+// Map the whole file into memory, read-only.  Returns false if that can't be done.
+static bool
+mapFile(DataFile & dataFile)  {
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(dataFile.fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL) ;
+    if (handle == INVALID_HANDLE_VALUE)  {
+        return false ;
+    }
+    LARGE_INTEGER size ;
+    if ( !GetFileSizeEx(handle, &size) || size.QuadPart == 0 )  {
+        CloseHandle(handle) ;
+        return false ;
+    }
+    HANDLE mappingHandle = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL) ;
+    if (!mappingHandle)  {
+        CloseHandle(handle) ;
+        return false ;
+    }
+    const char * bytes = (const char *)(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0)) ;
+    if (!bytes)  {
+        CloseHandle(mappingHandle) ;
+        CloseHandle(handle) ;
+        return false ;
+    }
+    dataFile.mappingHandle = mappingHandle ;
+    dataFile.mappingByteCount = (uint64_t)(size.QuadPart) ;
+#else
+    int handle = open(dataFile.fileName.c_str(), O_RDONLY) ;
+    if (handle < 0)  {
+        return false ;
+    }
+    struct stat status ;
+    if ( fstat(handle, &status) != 0 || status.st_size == 0 )  {
+        close(handle) ;
+        return false ;
+    }
+    void * bytes = mmap(NULL, (size_t)(status.st_size), PROT_READ, MAP_SHARED, handle, 0) ;
+    if (bytes == MAP_FAILED)  {
+        close(handle) ;
+        return false ;
+    }
+    dataFile.mappingByteCount = (uint64_t)(status.st_size) ;
+#endif
+    dataFile.mappedFileHandle = handle ;
+    dataFile.mappingBytes = (const char *)(bytes) ;
+    return true ;
+}
+
+
+
+// Undo mapFile(), if it was done
+static void
+unmapFile(DataFile & dataFile)  {
+    if (dataFile.mappingBytes)  {
+#ifdef _WIN32
+        UnmapViewOfFile(dataFile.mappingBytes) ;
+        CloseHandle(dataFile.mappingHandle) ;
+        CloseHandle(dataFile.mappedFileHandle) ;
+#else
+        munmap((void *)(dataFile.mappingBytes), (size_t)(dataFile.mappingByteCount)) ;
+        close(dataFile.mappedFileHandle) ;
+#endif
+        dataFile.mappingBytes = (const char *)(0) ;
+        dataFile.mappedFileHandle = INVALID_MAPPED_FILE_HANDLE ;
+    }
+}
+
+
+
+// Get the channel count and scan count of an open scans dataset.  Old files may have 1-D
+// datasets for single channels.  Returns false if the dataset isn't 1-D or 2-D.
+static bool
+getScansDatasetSize(hid_t datasetID, hsize_t & channelCount, hsize_t & scanCount)  {
+    hid_t spaceID = H5Dget_space(datasetID) ;
+    if (spaceID < 0)  {
+        return false ;
+    }
+    hsize_t dims[2] = { 0, 0 } ;
+    int rank = H5Sget_simple_extent_ndims(spaceID) ;
+    bool isValid = (rank == 1 || rank == 2) && H5Sget_simple_extent_dims(spaceID, dims, NULL) >= 0 ;
+    H5Sclose(spaceID) ;
+    if (!isValid)  {
+        return false ;
+    }
+    channelCount = (rank == 1) ? 1 : dims[0] ;
+    scanCount = (rank == 1) ? dims[0] : dims[1] ;
+    return true ;
+}
+
+
+
+// If the analogScans dataset of the sweep is contiguous, allocated, stored as native
+// int16s, and inside the file's memory map, set sweep.mappedAnalogScans to point at it.
+// Maps the file, if that hasn't been tried yet.
+static void
+mapAnalogScans(DataFile & dataFile, Sweep & sweep)  {
+    hid_t createPropertyListID = H5Dget_create_plist(sweep.analogDatasetID) ;
+    if (createPropertyListID < 0)  {
+        return ;
+    }
+    H5D_layout_t layout = H5Pget_layout(createPropertyListID) ;
+    if (layout == H5D_CHUNKED)  {
+        hsize_t chunkDims[2] = { 0, 0 } ;
+        int rank = H5Pget_chunk(createPropertyListID, 2, chunkDims) ;
+        if (rank == 2 && chunkDims[1] > 0)  {
+            sweep.chunkScanCount = chunkDims[1] ;
+        }
+        else if (rank == 1 && chunkDims[0] > 0)  {
+            sweep.chunkScanCount = chunkDims[0] ;
+        }
+    }
+    H5Pclose(createPropertyListID) ;
+    if (layout != H5D_CONTIGUOUS)  {
+        return ;
+    }
+    hid_t typeID = H5Dget_type(sweep.analogDatasetID) ;
+    bool isNativeInt16 = (typeID >= 0) && (H5Tequal(typeID, H5T_NATIVE_INT16) > 0) ;
+    if (typeID >= 0)  {
+        H5Tclose(typeID) ;
+    }
+    haddr_t offset = H5Dget_offset(sweep.analogDatasetID) ;
+    if ( !isNativeInt16 || offset == HADDR_UNDEF )  {
+        return ;
+    }
+    if (!dataFile.didTryToMap)  {
+        dataFile.didTryToMap = true ;
+        mapFile(dataFile) ;  // If this fails, all datasets are read through HDF5
+    }
+    uint64_t byteCount = (uint64_t)(sweep.analogChannelCount) * sweep.scanCount * sizeof(int16_t) ;
+    if ( dataFile.mappingBytes && (uint64_t)(offset) + byteCount <= dataFile.mappingByteCount )  {
+        sweep.mappedAnalogScans = (const int16_t *)(dataFile.mappingBytes + offset) ;
+    }
+}
+
+
+
+// Close the datasets of the sweep, if they're open, so that it's as if it had never been
+// opened
+static void
+closeSweep(Sweep & sweep)  {
+    if (sweep.analogDatasetID >= 0)  {
+        H5Dclose(sweep.analogDatasetID) ;
+    }
+    if (sweep.digitalDatasetID >= 0)  {
+        H5Dclose(sweep.digitalDatasetID) ;
+    }
+    sweep.isOpen = false ;
+    sweep.analogDatasetID = -1 ;
+    sweep.digitalDatasetID = -1 ;
+    sweep.scanCount = 0 ;
+    sweep.analogChannelCount = 0 ;
+    sweep.chunkScanCount = 0 ;
+    sweep.digitalClassID = mxUNKNOWN_CLASS ;
+    sweep.digitalMemoryTypeID = -1 ;
+    sweep.timestamp = mxGetNaN() ;
+    sweep.mappedAnalogScans = (const int16_t *)(0) ;
+}
+
+
+
+// Open the datasets of the sweep, and read its size and timestamp.  Caller must hold
+// HDF5_MUTEX.  Returns a negative value, and sets whatFailed, if that fails.
+static herr_t
+openSweepDatasets(DataFile & dataFile, Sweep & sweep, const char ** whatFailed)  {
+    hid_t groupID = H5Gopen2(dataFile.fileID, sweep.groupName.c_str(), H5P_DEFAULT) ;
+    if (groupID < 0)  {
+        *whatFailed = "open a sweep group" ;
+        return -1 ;
+    }
+
+    // The timestamp, which old files lack
+    if (H5Lexists(groupID, "timestamp", H5P_DEFAULT) > 0)  {
+        hid_t timestampID = H5Dopen2(groupID, "timestamp", H5P_DEFAULT) ;
+        if ( timestampID < 0 || H5Dread(timestampID, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &sweep.timestamp) < 0 )  {
+            sweep.timestamp = mxGetNaN() ;
+        }
+        if (timestampID >= 0)  {
+            H5Dclose(timestampID) ;
+        }
+    }
+
+    // The analog scans
+    hsize_t channelCount = 0 ;
+    hsize_t scanCount = 0 ;
+    bool isValid = true ;
+    if (H5Lexists(groupID, "analogScans", H5P_DEFAULT) > 0)  {
+        hid_t accessPropertyListID = H5Pcreate(H5P_DATASET_ACCESS) ;
+        H5Pset_chunk_cache(accessPropertyListID, CHUNK_CACHE_SLOT_COUNT, CHUNK_CACHE_BYTE_COUNT, 0.75) ;
+        sweep.analogDatasetID = H5Dopen2(groupID, "analogScans", accessPropertyListID) ;
+        H5Pclose(accessPropertyListID) ;
+        isValid = (sweep.analogDatasetID >= 0) && getScansDatasetSize(sweep.analogDatasetID, channelCount, scanCount) ;
+        sweep.analogChannelCount = channelCount ;
+        sweep.scanCount = scanCount ;
+    }
+
+    // The digital scans
+    if ( isValid && H5Lexists(groupID, "digitalScans", H5P_DEFAULT) > 0 )  {
+        sweep.digitalDatasetID = H5Dopen2(groupID, "digitalScans", H5P_DEFAULT) ;
+        isValid = (sweep.digitalDatasetID >= 0) && getScansDatasetSize(sweep.digitalDatasetID, channelCount, scanCount) ;
+        if (isValid)  {
+            if (sweep.analogDatasetID < 0)  {
+                sweep.scanCount = scanCount ;
+            }
+            hid_t typeID = H5Dget_type(sweep.digitalDatasetID) ;
+            size_t byteCount = (typeID < 0) ? 0 : H5Tget_size(typeID) ;
+            if (typeID >= 0)  {
+                H5Tclose(typeID) ;
+            }
+            if (byteCount == 1)  {
+                sweep.digitalClassID = mxUINT8_CLASS ;
+                sweep.digitalMemoryTypeID = H5T_NATIVE_UINT8 ;
+            }
+            else if (byteCount == 2)  {
+                sweep.digitalClassID = mxUINT16_CLASS ;
+                sweep.digitalMemoryTypeID = H5T_NATIVE_UINT16 ;
+            }
+            else if (byteCount == 4)  {
+                sweep.digitalClassID = mxUINT32_CLASS ;
+                sweep.digitalMemoryTypeID = H5T_NATIVE_UINT32 ;
+            }
+            else  {
+                isValid = false ;
+            }
+        }
+    }
+    H5Gclose(groupID) ;
+    if (!isValid)  {
+        closeSweep(sweep) ;
+        *whatFailed = "read the size of a sweep's scans" ;
+        return -1 ;
+    }
+
+    // Map the analog scans, if possible
+    sweep.chunkScanCount = sweep.scanCount ;
+    if (sweep.analogDatasetID >= 0)  {
+        mapAnalogScans(dataFile, sweep) ;
+    }
+    sweep.isOpen = true ;
+    return 0 ;
+}
+
+
+
+// Open the datasets of the sweep, if that hasn't been done, and read its size and
+// timestamp.  Errors if that fails.
+static void
+openSweep(DataFile & dataFile, Sweep & sweep)  {
+    if (sweep.isOpen)  {
+        return ;
+    }
+    herr_t status ;
+    const char * whatFailed = "" ;
+    {
+        std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+        status = openSweepDatasets(dataFile, sweep, &whatFailed) ;
+    }
+    checkHDF5(status, whatFailed, dataFile.fileName) ;
+}
+
+
+
+// Close the data file and forget about it
+static void
+closeDataFile(uint32_t dataFileID)  {
+    DataFile * dataFile = DATA_FILES[dataFileID-1] ;
+    DATA_FILES[dataFileID-1] = (DataFile *)(0) ;
+    {
+        std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+        for (size_t i = 0; i < dataFile->sweeps.size(); ++i)  {
+            closeSweep(dataFile->sweeps[i]) ;
+        }
+        H5Fclose(dataFile->fileID) ;
+    }
+    unmapFile(*dataFile) ;
+    delete dataFile ;
+}
+
+
+
+// This will be registered with mexAtExit()
+static void finalize(void)  {
+    // Close all the open files, so the handles and maps aren't leaked
+    for (size_t i = 0; i < DATA_FILES.size(); ++i)  {
+        if (DATA_FILES[i])  {
+            closeDataFile((uint32_t)(i+1)) ;
+        }
+    }
+
+    // It's now safe to clear the DLL from memory
+    mexUnlock() ;
+}
+// end of function
+
+
+
+// This is called if the entry point is unlocked
+static void
+initialize(void)  {
+    mexLock() ;
+        // Don't clear the DLL on exit, to preserve the open files
+    mexAtExit(&finalize) ;
+        // Makes it so if this mex function gets cleared, all the files get closed
+    std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+    H5Eset_auto2(H5E_DEFAULT, NULL, NULL) ;
+        // We report HDF5 errors ourselves, so don't have HDF5 print its error stack
+}
+
+
+
+// Read the string at prhs[index], which must be a nonempty char array
+static std::string
+readStringArgument(int nrhs, const mxArray *prhs[], int index, const char * argumentName)  {
+    if ( (nrhs>index) && mxIsChar(prhs[index]) && !mxIsEmpty(prhs[index]) )  {
+        char * valueAsCharPtr = mxArrayToString(prhs[index]) ;
+        std::string result(valueAsCharPtr) ;
+        mxFree(valueAsCharPtr) ;
+        return result ;
+    }
+    mexErrMsgIdAndTxt("ws:reader:badArgument", "%s must be a nonempty string", argumentName) ;
+    return std::string() ;  // never get here
+}
+
+
+
+// Read the scalar at prhs[index], which must be an integer between minimumValue and maximumValue
+static double
+readIntegerArgument(int nrhs, const mxArray *prhs[], int index, const char * argumentName, double minimumValue, double maximumValue)  {
+    if ( (nrhs>index) && mxIsScalar(prhs[index]) && mxIsNumeric(prhs[index]) && !mxIsComplex(prhs[index]) )  {
+        double value = mxGetScalar(prhs[index]) ;
+        if ( value>=minimumValue && value<=maximumValue && value==floor(value) )  {
+            return value ;
+        }
+    }
+    mexErrMsgIdAndTxt("ws:reader:badArgument", "%s must be an integer between %g and %g", argumentName, minimumValue, maximumValue) ;
+    return 0 ;  // never get here
+}
+
+
+
+// Read the ID of the data file given by the uint32 scalar at prhs[index].  Errors if it's
+// not open.
+static uint32_t
+readDataFileIDArgument(int nrhs, const mxArray *prhs[], int index)  {
+    if ( (nrhs>index) && mxGetClassID(prhs[index])==mxUINT32_CLASS && mxGetNumberOfElements(prhs[index])==1 )  {
+        uint32_t dataFileID = *((uint32_t *)mxGetData(prhs[index])) ;
+        if ( dataFileID>0 && dataFileID<=DATA_FILES.size() && DATA_FILES[dataFileID-1] )  {
+            return dataFileID ;
+        }
+    }
+    mexErrMsgIdAndTxt("ws:reader:badDataFile", "The data file is not valid") ;
+    return 0 ;  // never get here
+}
+
+// Look up the data file given by the uint32 scalar at prhs[index].  Errors if it's not open.
+static DataFile &
+readDataFileArgument(int nrhs, const mxArray *prhs[], int index)  {
+    return *(DATA_FILES[readDataFileIDArgument(nrhs, prhs, index)-1]) ;
+}
+
+
+
+// Look up the sweep whose index is at prhs[index], and open it.  Errors if the file has no
+// such sweep.
+static Sweep &
+readSweepArgument(DataFile & dataFile, int nrhs, const mxArray *prhs[], int index)  {
+    int sweepIndex = (int)readIntegerArgument(nrhs, prhs, index, "sweepIndex", 0, 1e9) ;
+    for (size_t i = 0; i < dataFile.sweeps.size(); ++i)  {
+        if (dataFile.sweeps[i].sweepIndex == sweepIndex)  {
+            openSweep(dataFile, dataFile.sweeps[i]) ;
+            return dataFile.sweeps[i] ;
+        }
+    }
+    mexErrMsgIdAndTxt("ws:reader:noSuchSweep", "Data file %s has no sweep %d", dataFile.fileName.c_str(), sweepIndex) ;
+    return dataFile.sweeps[0] ;  // never get here
+}
+
+
+
+// Read the one-based first scan index and scan count at prhs[index] and prhs[index+1], and
+// check they're within the sweep.  Returns the zero-based first scan index.
+static hsize_t
+readScanRangeArguments(const Sweep & sweep, int nrhs, const mxArray *prhs[], int index, hsize_t & scanCount)  {
+    hsize_t firstScanIndex = (hsize_t)readIntegerArgument(nrhs, prhs, index, "firstScanIndex", 1, 1e15) ;
+    scanCount = (hsize_t)readIntegerArgument(nrhs, prhs, index+1, "scanCount", 0, 1e15) ;
+    if (firstScanIndex-1+scanCount > sweep.scanCount)  {
+        mexErrMsgIdAndTxt("ws:reader:badArgument", "Scans %g to %g are past the end of sweep %d, which has %g scans",
+                          (double)(firstScanIndex), (double)(firstScanIndex-1+scanCount), sweep.sweepIndex, (double)(sweep.scanCount)) ;
+    }
+    return firstScanIndex - 1 ;
+}
+
+
+
+// Read scanCount scans of one channel of a scans dataset, starting at firstScanIndex
+// (zero-based), into scans.  Returns a negative value if that fails.
+static herr_t
+readChannelScans(hid_t datasetID, hid_t memoryTypeID, hsize_t channelIndex, hsize_t firstScanIndex, hsize_t scanCount, void * scans)  {
+    hid_t fileSpaceID = H5Dget_space(datasetID) ;
+    if (fileSpaceID < 0)  {
+        return -1 ;
+    }
+    herr_t status ;
+    if (H5Sget_simple_extent_ndims(fileSpaceID) == 1)  {
+        hsize_t start[1] = { firstScanIndex } ;
+        hsize_t count[1] = { scanCount } ;
+        status = H5Sselect_hyperslab(fileSpaceID, H5S_SELECT_SET, start, NULL, count, NULL) ;
+    }
+    else  {
+        hsize_t start[2] = { channelIndex, firstScanIndex } ;
+        hsize_t count[2] = { 1, scanCount } ;
+        status = H5Sselect_hyperslab(fileSpaceID, H5S_SELECT_SET, start, NULL, count, NULL) ;
+    }
+    hsize_t memoryDims[1] = { scanCount } ;
+    hid_t memorySpaceID = H5Screate_simple(1, memoryDims, NULL) ;
+    if ( status >= 0 && memorySpaceID >= 0 )  {
+        status = H5Dread(datasetID, memoryTypeID, memorySpaceID, fileSpaceID, H5P_DEFAULT, scans) ;
+    }
+    else  {
+        status = -1 ;
+    }
+    if (memorySpaceID >= 0)  {
+        H5Sclose(memorySpaceID) ;
+    }
+    H5Sclose(fileSpaceID) ;
+    return status ;
+}
+
+
+
+// Append the sweep index encoded in the link name, if it's a sweep group, to the
+// vector<Sweep> pointed to by data.  For H5Literate().
+static herr_t
+addSweepFromLink(hid_t /*groupID*/, const char * name, const H5L_info_t * /*info*/, void * data)  {
+    const char * digits = (const char *)(0) ;
+    if (strncmp(name, "sweep_", 6) == 0)  {
+        digits = name + 6 ;
+    }
+    else if (strncmp(name, "trial_", 6) == 0)  {
+        digits = name + 6 ;
+    }
+    if ( !digits || *digits == '\0' || strspn(digits, "0123456789") != strlen(digits) )  {
+        return 0 ;
+    }
+    Sweep sweep ;
+    sweep.sweepIndex = atoi(digits) ;
+    sweep.groupName = name ;
+    sweep.analogDatasetID = -1 ;
+    sweep.digitalDatasetID = -1 ;
+    closeSweep(sweep) ;
+    ((std::vector<Sweep> *)(data))->push_back(sweep) ;
+    return 0 ;
+}
+
+static bool
+isEarlierSweep(const Sweep & sweep, const Sweep & otherSweep)  {
+    return sweep.sweepIndex < otherSweep.sweepIndex ;
+}
+
+
+
+// dataFile = OpenFile(fileName)
+//
+// Open a data file for reading.  dataFile is a uint32 scalar.  Only the names of the sweep
+// groups are read; each sweep's datasets are opened the first time it's asked about.
+static void
+OpenFile(int /*nlhs*/, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: fileName
+    std::string fileName = readStringArgument(nrhs, prhs, 1, "fileName") ;
+
+    // Open it, and find the sweeps.  If registering the filter fails, reading compressed
+    // datasets will fail, and say so.
+    hid_t fileID ;
+    herr_t status = 0 ;
+    std::vector<Sweep> sweeps ;
+    {
+        std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+        registerScanFilter() ;
+        fileID = H5Fopen(fileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) ;
+        if (fileID >= 0)  {
+            status = H5Literate(fileID, H5_INDEX_NAME, H5_ITER_NATIVE, NULL, &addSweepFromLink, &sweeps) ;
+            if (status < 0)  {
+                H5Fclose(fileID) ;
+            }
+        }
+    }
+    checkHDF5(fileID, "open the file", fileName) ;
+    checkHDF5(status, "list the sweeps", fileName) ;
+    std::sort(sweeps.begin(), sweeps.end(), isEarlierSweep) ;
+
+    // Record it
+    DataFile * dataFile = new DataFile() ;
+    dataFile->fileName = fileName ;
+    dataFile->fileID = fileID ;
+    dataFile->sweeps = sweeps ;
+    dataFile->didTryToMap = false ;
+    dataFile->mappedFileHandle = INVALID_MAPPED_FILE_HANDLE ;
+    dataFile->mappingBytes = (const char *)(0) ;
+    dataFile->mappingByteCount = 0 ;
+    DATA_FILES.push_back(dataFile) ;
+
+    // Return the ID
+    plhs[0] = mxCreateNumericMatrix(1, 1, mxUINT32_CLASS, mxREAL) ;
+    *((uint32_t *)mxGetData(plhs[0])) = (uint32_t)(DATA_FILES.size()) ;
+}
+// end of function
+
+
+
+// sweepIndices = GetSweepIndices(dataFile)
+//
+// The indices of the sweeps in the file, as a row vector of doubles, in increasing order
+static void
+GetSweepIndices(int /*nlhs*/, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: dataFile
+    DataFile & dataFile = readDataFileArgument(nrhs, prhs, 1) ;
+
+    plhs[0] = mxCreateDoubleMatrix(1, dataFile.sweeps.size(), mxREAL) ;
+    double * sweepIndices = mxGetPr(plhs[0]) ;
+    for (size_t i = 0; i < dataFile.sweeps.size(); ++i)  {
+        sweepIndices[i] = (double)(dataFile.sweeps[i].sweepIndex) ;
+    }
+}
+// end of function
+
+
+
+// [scanCount, analogChannelCount, digitalClassName, timestamp, isMapped] = GetSweepInfo(dataFile, sweepIndex)
+//
+// The size of the sweep.  digitalClassName is the class of the digital scans, or empty if
+// the sweep has none.  timestamp is NaN if the file doesn't have one.  isMapped is true if
+// the analog scans are read from the file's memory map, false if through HDF5.
+static void
+GetSweepInfo(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: dataFile
+    DataFile & dataFile = readDataFileArgument(nrhs, prhs, 1) ;
+
+    // prhs[2]: sweepIndex
+    Sweep & sweep = readSweepArgument(dataFile, nrhs, prhs, 2) ;
+
+    plhs[0] = mxCreateDoubleScalar((double)(sweep.scanCount)) ;
+    if (nlhs>1)  {
+        plhs[1] = mxCreateDoubleScalar((double)(sweep.analogChannelCount)) ;
+    }
+    if (nlhs>2)  {
+        const char * className = (sweep.digitalClassID == mxUINT8_CLASS) ? "uint8" :
+                                 ( (sweep.digitalClassID == mxUINT16_CLASS) ? "uint16" :
+                                   ( (sweep.digitalClassID == mxUINT32_CLASS) ? "uint32" : "" ) ) ;
+        plhs[2] = mxCreateString(className) ;
+    }
+    if (nlhs>3)  {
+        plhs[3] = mxCreateDoubleScalar(sweep.timestamp) ;
+    }
+    if (nlhs>4)  {
+        plhs[4] = mxCreateLogicalScalar(sweep.mappedAnalogScans ? true : false) ;
+    }
+}
+// end of function
+
+
+
+// rawAnalogData = ReadAnalogScans(dataFile, sweepIndex, channelIndices, firstScanIndex, scanCount)
+//
+// Read scanCount scans of the given analog channels of the sweep, starting at
+// firstScanIndex.  channelIndices is a vector of one-based channel indices, in any order;
+// if empty, all the channels are read.  rawAnalogData is scanCount x nChannels int16.
+static void
+ReadAnalogScans(int /*nlhs*/, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: dataFile
+    DataFile & dataFile = readDataFileArgument(nrhs, prhs, 1) ;
+
+    // prhs[2]: sweepIndex
+    Sweep & sweep = readSweepArgument(dataFile, nrhs, prhs, 2) ;
+
+    // prhs[3]: channelIndices
+    if ( nrhs<=3 || !mxIsDouble(prhs[3]) || mxIsComplex(prhs[3]) )  {
+        mexErrMsgIdAndTxt("ws:reader:badArgument", "channelIndices must be a vector of doubles") ;
+    }
+    std::vector<hsize_t> channelIndices ;
+    size_t channelIndexCount = mxGetNumberOfElements(prhs[3]) ;
+    if (channelIndexCount == 0)  {
+        for (hsize_t j = 0; j < sweep.analogChannelCount; ++j)  {
+            channelIndices.push_back(j) ;
+        }
+    }
+    else  {
+        const double * channelIndicesAsDoubles = mxGetPr(prhs[3]) ;
+        for (size_t k = 0; k < channelIndexCount; ++k)  {
+            double channelIndex = channelIndicesAsDoubles[k] ;
+            if ( channelIndex < 1 || channelIndex > (double)(sweep.analogChannelCount) || channelIndex != floor(channelIndex) )  {
+                mexErrMsgIdAndTxt("ws:reader:badArgument", "Sweep %d has no analog channel %g", sweep.sweepIndex, channelIndex) ;
+            }
+            channelIndices.push_back((hsize_t)(channelIndex) - 1) ;
+        }
+    }
+
+    // prhs[4], prhs[5]: firstScanIndex, scanCount
+    hsize_t scanCount ;
+    hsize_t firstScanIndex = readScanRangeArguments(sweep, nrhs, prhs, 4, scanCount) ;
+
+    // Read the scans
+    plhs[0] = mxCreateNumericMatrix((mwSize)(scanCount), (mwSize)(channelIndices.size()), mxINT16_CLASS, mxREAL) ;
+    int16_t * scans = (int16_t *)(mxGetData(plhs[0])) ;
+    if ( scanCount == 0 || channelIndices.empty() )  {
+        return ;
+    }
+    if (sweep.mappedAnalogScans)  {
+        // Each channel's scans are contiguous in the map
+        for (size_t k = 0; k < channelIndices.size(); ++k)  {
+            memcpy(scans + k*scanCount, sweep.mappedAnalogScans + channelIndices[k]*sweep.scanCount + firstScanIndex,
+                   (size_t)(scanCount) * sizeof(int16_t)) ;
+        }
+    }
+    else  {
+        // Go a row of chunks at a time, so that each chunk is read from disk once, and is still
+        // in the cache when the next channel is read from it
+        hsize_t endScanIndex = firstScanIndex + scanCount ;
+        hsize_t chunkScanCount = std::max<hsize_t>(1, sweep.chunkScanCount) ;
+        for (hsize_t blockStart = firstScanIndex; blockStart < endScanIndex; )  {
+            hsize_t blockEnd = std::min(endScanIndex, (blockStart/chunkScanCount + 1) * chunkScanCount) ;
+            herr_t status = 0 ;
+            {
+                std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+                for (size_t k = 0; k < channelIndices.size() && status >= 0; ++k)  {
+                    status = readChannelScans(sweep.analogDatasetID, H5T_NATIVE_INT16, channelIndices[k], blockStart, blockEnd-blockStart,
+                                              scans + k*scanCount + (blockStart-firstScanIndex)) ;
+                }
+            }
+            checkHDF5(status, "read analog scans", dataFile.fileName) ;
+            blockStart = blockEnd ;
+        }
+    }
+}
+// end of function
+
+
+
+// rawDigitalData = ReadDigitalScans(dataFile, sweepIndex, firstScanIndex, scanCount)
+//
+// Read scanCount scans of the sweep's packed digital channels, starting at firstScanIndex.
+// rawDigitalData is scanCount x 1, of the class GetSweepInfo gives, or scanCount x 0 uint8
+// if the sweep has no digital channels.
+static void
+ReadDigitalScans(int /*nlhs*/, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: dataFile
+    DataFile & dataFile = readDataFileArgument(nrhs, prhs, 1) ;
+
+    // prhs[2]: sweepIndex
+    Sweep & sweep = readSweepArgument(dataFile, nrhs, prhs, 2) ;
+
+    // prhs[3], prhs[4]: firstScanIndex, scanCount
+    hsize_t scanCount ;
+    hsize_t firstScanIndex = readScanRangeArguments(sweep, nrhs, prhs, 3, scanCount) ;
+
+    // Read the scans
+    if (sweep.digitalDatasetID < 0)  {
+        plhs[0] = mxCreateNumericMatrix((mwSize)(scanCount), 0, mxUINT8_CLASS, mxREAL) ;
+        return ;
+    }
+    plhs[0] = mxCreateNumericMatrix((mwSize)(scanCount), 1, sweep.digitalClassID, mxREAL) ;
+    if (scanCount > 0)  {
+        herr_t status ;
+        {
+            std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+            status = readChannelScans(sweep.digitalDatasetID, sweep.digitalMemoryTypeID, 0, firstScanIndex, scanCount, mxGetData(plhs[0])) ;
+        }
+        checkHDF5(status, "read digital scans", dataFile.fileName) ;
+    }
+}
+// end of function
+
+
+
+// CloseFile(dataFile)
+//
+// Close the file, and unmap it.  The dataFile is no longer valid after.
+static void
+CloseFile(int /*nlhs*/, mxArray * /*plhs*/[], int nrhs, const mxArray *prhs[])  {
+    // prhs[1]: dataFile
+    closeDataFile(readDataFileIDArgument(nrhs, prhs, 1)) ;
+}
+// end of function
+
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // Dispatch on the 'method' name
+    if ( nrhs<1 || !mxIsChar(prhs[0]) )  {
+        mexErrMsgIdAndTxt("ws:reader:argNotAString",
+                          "First argument to ws.reader() must be a string.") ;
+    }
+
+    // Keep the DLL in memory after exit, so that this function acts as a poor man's
+    // Singleton object, and we can keep the files open
+    if (!mexIsLocked())  {
+        initialize() ;
+    }
+
+    char* actionAsCharPtr = mxArrayToString(prhs[0]) ;
+    std::string action(actionAsCharPtr) ;
+    mxFree(actionAsCharPtr) ;
+
+    if (action == "ReadAnalogScans")  {
+        ReadAnalogScans(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "ReadDigitalScans")  {
+        ReadDigitalScans(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "GetSweepInfo")  {
+        GetSweepInfo(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "GetSweepIndices")  {
+        GetSweepIndices(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "OpenFile")  {
+        OpenFile(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "CloseFile")  {
+        CloseFile(nlhs, plhs, nrhs, prhs) ;
+    }
+    else  {
+        // Doesn't match anything, so error
+        mexErrMsgIdAndTxt("ws:reader:noSuchMethod",
+                          "ws.reader() doesn't recognize method name %s", action.c_str()) ;
+    }
+}
+// end of function
@@ -0,0 +1,1049 @@
+// The engine of ws.rescaler and wsRescale.  See batchScaling.h.
+//
+// ws.addScalingToHDF5FilesRecursivelyGivenCoeffs() and
+// ws.verifyScalingOfHDF5FilesRecursivelyGivenCoeffs() do one file at a time, with an
+// h5read() or h5write() per dataset, each of which opens and closes the file, so an
+// archive of 100k files takes days.  Here the source tree is walked once, on the calling
+// thread, which also makes the target folders, and then a pool of worker threads takes the
+// .h5 files one at a time.
+//
+// Adding the coefficients copies the file to <target>.partial, adds the
+// /header/Acquisition/AnalogScalingCoefficients dataset to the copy if the source lacks
+// it, and renames the copy into place, so a run that's interrupted can just be run again:
+// files whose target is there already are skipped, and a half-copied one never is.
+//
+// Verifying checks the coefficients as the Matlab function does, and then streams each
+// sweep's analogScans from both files, a block of scans at a time, checking that the
+// target's are the same as the source's, and passing the target's through the scaling
+// polynomial, as scaledDoubleAnalogDataFromRawMex does, to check that the coefficients
+// give finite values for the scans actually in the file.
+//
+// The HDF5 library Matlab ships isn't built thread-safe, so every HDF5 call is made holding
+// HDF5_MUTEX.  What the workers do in parallel is everything else: copying files, reading
+// contiguous analogScans datasets straight from the file, as ws.reader does, comparing
+// scans, and scaling them.  Chunked datasets, as ws.logger writes them, are read through
+// HDF5 a whole row of chunks at a time, so the lock is taken once per block.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "hdf5.h"
+#include "scanFilter.h"
+#include "hdf5Lock.h"
+#include "batchScaling.h"
+
+
+
+// Files are copied this many bytes at a time
+#define COPY_BUFFER_BYTE_COUNT (4*1024*1024)
+
+// Scans are compared and scaled about this many samples at a time
+#define SCAN_BLOCK_SAMPLE_COUNT (1024*1024)
+
+// How often, in seconds, reportProgress is called
+#define PROGRESS_INTERVAL 1.0
+
+#ifdef _WIN32
+#define PATH_SEPARATOR "\\"
+#else
+#define PATH_SEPARATOR "/"
+#endif
+
+#define SCALING_COEFFICIENTS_PATH "/header/Acquisition/AnalogScalingCoefficients"
+
+// Held for every HDF5 call.  It's shared with ws.logger, whose writer thread may still be
+// writing a data file while this runs.
+static std::mutex & HDF5_MUTEX = hdf5Mutex() ;
+
+
+
+// A .h5 file in the source tree, and what happened to it.  messages are to be printed,
+// and include the problems.
+struct FileTask {
+    std::string sourceFilePath ;
+    std::string targetFilePath ;
+    bool wasSkipped ;
+    std::vector<std::string> messages ;
+    std::vector<std::string> problems ;
+} ;
+
+// The state the workers share.  The members after mutex are guarded by it.
+struct BatchState {
+    const BatchScalingJob * job ;
+    std::vector<FileTask> tasks ;
+    std::atomic<size_t> nextTaskIndex ;
+    std::mutex mutex ;
+    std::condition_variable didFinishTask ;
+    size_t doneTaskCount ;
+    std::vector<std::string> pendingMessages ;  // yet to be printed, on the calling thread
+} ;
+
+// A sweep's analogScans dataset, being streamed.  The scans are channelCount x scanCount
+// to HDF5, or just scanCount for single channels in old files.  If the dataset is
+// contiguous native int16s, contiguousOffset is where it starts in the file, and it's
+// read straight from file, with no HDF5 calls.
+struct ScansDataset {
+    std::string fileName ;
+    hid_t datasetID ;  // negative if there's no analogScans dataset
+    int rank ;
+    hsize_t channelCount ;
+    hsize_t scanCount ;
+    hsize_t chunkScanCount ;  // zero if not chunked
+    bool isContiguous ;
+    uint64_t contiguousOffset ;
+    FILE * file ;  // for contiguous reads, opened when first needed
+} ;
+
+
+
+//
+// Files and folders
+//
+
+enum PathKind { NO_PATH, FILE_PATH, FOLDER_PATH } ;
+
+static PathKind
+pathKind(const std::string & path)  {
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path.c_str()) ;
+    if (attributes == INVALID_FILE_ATTRIBUTES)  {
+        return NO_PATH ;
+    }
+    return (attributes & FILE_ATTRIBUTE_DIRECTORY) ? FOLDER_PATH : FILE_PATH ;
+#else
+    struct stat status ;
+    if (stat(path.c_str(), &status) != 0)  {
+        return NO_PATH ;
+    }
+    return S_ISDIR(status.st_mode) ? FOLDER_PATH : FILE_PATH ;
+#endif
+}
+
+
+
+static std::string
+joinPath(const std::string & folderPath, const std::string & name)  {
+    if ( folderPath.empty() || folderPath.back() == '/' || folderPath.back() == '\\' )  {
+        return folderPath + name ;
+    }
+    return folderPath + PATH_SEPARATOR + name ;
+}
+
+
+
+// The path with forward slashes, and without trailing ones, for comparing paths
+static std::string
+normalizedPath(const std::string & path)  {
+    std::string result(path) ;
+    std::replace(result.begin(), result.end(), '\\', '/') ;
+    while ( result.size() > 1 && result.back() == '/' )  {
+        result.pop_back() ;
+    }
+    return result ;
+}
+
+
+
+static bool
+isDataFileName(const std::string & name)  {
+    return name.size() >= 3 && name.compare(name.size()-3, 3, ".h5") == 0 ;
+}
+
+
+
+// Get the names of the files and folders in the folder, in sorted order.  Returns false if
+// the folder can't be read.
+static bool
+listFolder(const std::string & folderPath, std::vector<std::string> & fileNames, std::vector<std::string> & folderNames)  {
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry ;
+    HANDLE handle = FindFirstFileA(joinPath(folderPath, "*").c_str(), &entry) ;
+    if (handle == INVALID_HANDLE_VALUE)  {
+        return false ;
+    }
+    do  {
+        std::string name(entry.cFileName) ;
+        if ( name != "." && name != ".." )  {
+            ((entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? folderNames : fileNames).push_back(name) ;
+        }
+    } while (FindNextFileA(handle, &entry)) ;
+    FindClose(handle) ;
+#else
+    DIR * folder = opendir(folderPath.c_str()) ;
+    if (!folder)  {
+        return false ;
+    }
+    while (struct dirent * entry = readdir(folder))  {
+        std::string name(entry->d_name) ;
+        if ( name != "." && name != ".." )  {
+            ((pathKind(joinPath(folderPath, name)) == FOLDER_PATH) ? folderNames : fileNames).push_back(name) ;
+        }
+    }
+    closedir(folder) ;
+#endif
+    std::sort(fileNames.begin(), fileNames.end()) ;
+    std::sort(folderNames.begin(), folderNames.end()) ;
+    return true ;
+}
+
+
+
+static bool
+makeFolder(const std::string & folderPath)  {
+#ifdef _WIN32
+    return _mkdir(folderPath.c_str()) == 0 ;
+#else
+    return mkdir(folderPath.c_str(), 0777) == 0 ;
+#endif
+}
+
+
+
+// Copy the file, replacing newFileName if it exists.  Returns false if that fails.
+static bool
+copyFile(const std::string & fileName, const std::string & newFileName)  {
+#ifdef _WIN32
+    return CopyFileA(fileName.c_str(), newFileName.c_str(), FALSE) != 0 ;
+#else
+    FILE * source = fopen(fileName.c_str(), "rb") ;
+    if (!source)  {
+        return false ;
+    }
+    FILE * target = fopen(newFileName.c_str(), "wb") ;
+    if (!target)  {
+        fclose(source) ;
+        return false ;
+    }
+    std::vector<char> buffer(COPY_BUFFER_BYTE_COUNT) ;
+    bool isOK = true ;
+    size_t byteCount ;
+    while ( isOK && (byteCount = fread(buffer.data(), 1, buffer.size(), source)) > 0 )  {
+        isOK = (fwrite(buffer.data(), 1, byteCount, target) == byteCount) ;
+    }
+    isOK = isOK && !ferror(source) ;
+    fclose(source) ;
+    isOK = (fclose(target) == 0) && isOK ;
+    return isOK ;
+#endif
+}
+
+
+
+// Rename the file, replacing newFileName if it exists.  Returns false if that fails.
+static bool
+replaceFile(const std::string & fileName, const std::string & newFileName)  {
+#ifdef _WIN32
+    return MoveFileExA(fileName.c_str(), newFileName.c_str(), MOVEFILE_REPLACE_EXISTING) != 0 ;
+#else
+    return rename(fileName.c_str(), newFileName.c_str()) == 0 ;
+#endif
+}
+
+
+
+// Read byteCount bytes at offset from the file.  Returns false if that fails.
+static bool
+readFileAt(FILE * file, uint64_t offset, char * bytes, size_t byteCount)  {
+#ifdef _WIN32
+    if (_fseeki64(file, (__int64)(offset), SEEK_SET) != 0)  {
+#else
+    if (fseeko(file, (off_t)(offset), SEEK_SET) != 0)  {
+#endif
+        return false ;
+    }
+    return fread(bytes, 1, byteCount, file) == byteCount ;
+}
+
+
+
+//
+// Walking the source tree
+//
+
+static void
+printMessage(const BatchScalingJob & job, const std::string & message)  {
+    if (job.printMessage)  {
+        job.printMessage(message) ;
+    }
+}
+
+
+
+static void
+addProblem(const BatchScalingJob & job, BatchScalingResult & result, const std::string & problem)  {
+    result.problems.push_back(problem) ;
+    printMessage(job, problem) ;
+}
+
+
+
+// Add a task for each .h5 file in the source folder, and the folders under it, making the
+// target folders as needed.  As ws.addScalingToHDF5FilesRecursivelyGivenCoeffs() does,
+// for ADD_SCALING the target folder is made even if there are no .h5 files under it.  As
+// ws.verifyScalingOfHDF5FilesRecursivelyGivenCoeffs() does, for VERIFY_SCALING the files
+// that aren't .h5 files mustn't have been copied, and the target folders must exist.
+static void
+addTasksFromFolder(const BatchScalingJob & job, const std::string & sourceFolderPath, const std::string & targetFolderPath,
+                   std::vector<FileTask> & tasks, BatchScalingResult & result)  {
+    // Make the target folder, if needed
+    if (job.mode == ADD_SCALING)  {
+        PathKind kind = pathKind(targetFolderPath) ;
+        if (kind == FILE_PATH)  {
+            addProblem(job, result, "Target folder " + targetFolderPath + " exists already, but is a regular file, not a folder --- skipping") ;
+            return ;
+        }
+        else if (kind == NO_PATH)  {
+            if (job.isDryRun)  {
+                printMessage(job, "Would have created folder " + targetFolderPath) ;
+            }
+            else if (!makeFolder(targetFolderPath))  {
+                addProblem(job, result, "Unable to create target folder " + targetFolderPath + " --- skipping") ;
+                return ;
+            }
+        }
+    }
+
+    // Get the files and folders in the source folder
+    std::vector<std::string> fileNames ;
+    std::vector<std::string> folderNames ;
+    if (!listFolder(sourceFolderPath, fileNames, folderNames))  {
+        addProblem(job, result, "Unable to read source folder " + sourceFolderPath + " --- skipping") ;
+        return ;
+    }
+
+    // The files
+    for (size_t i = 0; i < fileNames.size(); ++i)  {
+        std::string targetFilePath = joinPath(targetFolderPath, fileNames[i]) ;
+        if (isDataFileName(fileNames[i]))  {
+            FileTask task ;
+            task.sourceFilePath = joinPath(sourceFolderPath, fileNames[i]) ;
+            task.targetFilePath = targetFilePath ;
+            task.wasSkipped = false ;
+            tasks.push_back(task) ;
+        }
+        else if ( job.mode == VERIFY_SCALING && pathKind(targetFilePath) != NO_PATH )  {
+            addProblem(job, result, "Problem: target file " + targetFilePath + " exists, even though it shouldn't") ;
+        }
+    }
+
+    // The folders
+    for (size_t i = 0; i < folderNames.size(); ++i)  {
+        std::string targetChildFolderPath = joinPath(targetFolderPath, folderNames[i]) ;
+        if (job.mode == VERIFY_SCALING)  {
+            PathKind kind = pathKind(targetChildFolderPath) ;
+            if (kind == FILE_PATH)  {
+                addProblem(job, result, "Problem: target folder " + targetChildFolderPath + " exists, but is a regular file, not a folder") ;
+                continue ;
+            }
+            else if (kind == NO_PATH)  {
+                addProblem(job, result, "Problem: target folder " + targetChildFolderPath + " does not exist!") ;
+                continue ;
+            }
+        }
+        addTasksFromFolder(job, joinPath(sourceFolderPath, folderNames[i]), targetChildFolderPath, tasks, result) ;
+    }
+}
+
+
+
+//
+// Reading and writing data files.  Caller must hold HDF5_MUTEX for all of these.
+//
+
+// Whether the object at the absolute path exists, along with the groups it's in
+static bool
+doesObjectExist(hid_t fileID, const std::string & path)  {
+    size_t position = 0 ;
+    while ( (position = path.find('/', position+1)) != std::string::npos )  {
+        if (H5Lexists(fileID, path.substr(0, position).c_str(), H5P_DEFAULT) <= 0)  {
+            return false ;
+        }
+    }
+    return H5Lexists(fileID, path.c_str(), H5P_DEFAULT) > 0 ;
+}
+
+
+
+// Read the numeric dataset at path as doubles.  Returns false if it doesn't exist, or
+// can't be read.
+static bool
+readDoubleDataset(hid_t fileID, const std::string & path, std::vector<hsize_t> & dims, std::vector<double> & values)  {
+    if (!doesObjectExist(fileID, path))  {
+        return false ;
+    }
+    hid_t datasetID = H5Dopen2(fileID, path.c_str(), H5P_DEFAULT) ;
+    if (datasetID < 0)  {
+        return false ;
+    }
+    hid_t spaceID = H5Dget_space(datasetID) ;
+    int rank = (spaceID < 0) ? -1 : H5Sget_simple_extent_ndims(spaceID) ;
+    bool isOK = (rank >= 0 && rank <= H5S_MAX_RANK) ;
+    if (isOK)  {
+        dims.resize((size_t)(rank)) ;
+        isOK = (H5Sget_simple_extent_dims(spaceID, dims.data(), NULL) >= 0) ;
+    }
+    if (isOK)  {
+        values.resize((size_t)(H5Sget_simple_extent_npoints(spaceID))) ;
+        isOK = values.empty() || (H5Dread(datasetID, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, values.data()) >= 0) ;
+    }
+    if (spaceID >= 0)  {
+        H5Sclose(spaceID) ;
+    }
+    H5Dclose(datasetID) ;
+    return isOK ;
+}
+
+
+
+// Read the AI terminal IDs of the file, which old files call channel IDs.  Returns false
+// if it has neither.
+static bool
+readAnalogTerminalIDs(hid_t fileID, std::vector<hsize_t> & dims, std::vector<double> & terminalIDs)  {
+    return readDoubleDataset(fileID, "/header/Acquisition/AnalogTerminalIDs", dims, terminalIDs) ||
+           readDoubleDataset(fileID, "/header/Acquisition/AnalogChannelIDs", dims, terminalIDs) ;
+}
+
+
+
+// Get the coefficients of each of the terminals, from the device's, as
+// coefficientCount x terminalIDs.size(), column-major.  Returns false if a terminal ID
+// isn't one of the device's.
+static bool
+coefficientsForTerminals(const BatchScalingJob & job, const std::vector<double> & terminalIDs, std::vector<double> & coefficients)  {
+    coefficients.clear() ;
+    for (size_t i = 0; i < terminalIDs.size(); ++i)  {
+        double terminalID = terminalIDs[i] ;
+        if ( !(terminalID >= 0) || terminalID >= (double)(job.terminalCount) || terminalID != std::floor(terminalID) )  {
+            return false ;
+        }
+        const double * terminalCoefficients = job.coefficients.data() + (size_t)(terminalID) * job.coefficientCount ;
+        coefficients.insert(coefficients.end(), terminalCoefficients, terminalCoefficients + job.coefficientCount) ;
+    }
+    return true ;
+}
+
+
+
+// Add the scaling coefficients dataset to the file.  coefficients is coefficientCount x
+// terminalCount, column-major, and it's written as h5create() and h5write() would write
+// it from Matlab.  Returns false if that fails.
+static bool
+writeScalingCoefficients(const std::string & fileName, hsize_t coefficientCount, hsize_t terminalCount, const std::vector<double> & coefficients)  {
+    hid_t fileID = H5Fopen(fileName.c_str(), H5F_ACC_RDWR, H5P_DEFAULT) ;
+    if (fileID < 0)  {
+        return false ;
+    }
+    hid_t linkCreatePropertyListID = H5Pcreate(H5P_LINK_CREATE) ;
+    H5Pset_create_intermediate_group(linkCreatePropertyListID, 1) ;
+    hsize_t dims[2] = { terminalCount, coefficientCount } ;
+    hid_t spaceID = H5Screate_simple(2, dims, NULL) ;
+    hid_t datasetID = H5Dcreate2(fileID, SCALING_COEFFICIENTS_PATH, H5T_IEEE_F64LE, spaceID, linkCreatePropertyListID,
+                                 H5P_DEFAULT, H5P_DEFAULT) ;
+    bool isOK = (datasetID >= 0) &&
+                ( coefficients.empty() || H5Dwrite(datasetID, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, coefficients.data()) >= 0 ) ;
+    if (datasetID >= 0)  {
+        H5Dclose(datasetID) ;
+    }
+    H5Sclose(spaceID) ;
+    H5Pclose(linkCreatePropertyListID) ;
+    isOK = (H5Fclose(fileID) >= 0) && isOK ;
+    return isOK ;
+}
+
+
+
+// Append the name of the link, if it's a sweep group, to the vector<std::string> pointed
+// to by data.  For H5Literate().
+static herr_t
+addSweepNameFromLink(hid_t /*groupID*/, const char * name, const H5L_info_t * /*info*/, void * data)  {
+    if ( strncmp(name, "sweep_", 6) != 0 && strncmp(name, "trial_", 6) != 0 )  {
+        return 0 ;
+    }
+    const char * digits = name + 6 ;
+    if ( *digits != '\0' && strspn(digits, "0123456789") == strlen(digits) )  {
+        ((std::vector<std::string> *)(data))->push_back(name) ;
+    }
+    return 0 ;
+}
+
+
+
+// Get the names of the sweep groups in the file, in sorted order.  Returns false if that
+// fails.
+static bool
+readSweepNames(hid_t fileID, std::vector<std::string> & sweepNames)  {
+    hsize_t index = 0 ;
+    if (H5Literate(fileID, H5_INDEX_NAME, H5_ITER_INC, &index, &addSweepNameFromLink, &sweepNames) < 0)  {
+        return false ;
+    }
+    std::sort(sweepNames.begin(), sweepNames.end()) ;
+    return true ;
+}
+
+
+
+// Open the analogScans dataset of the sweep, if it has one.  Returns false if it has one,
+// and it can't be opened, or isn't 1-D or 2-D.
+static bool
+openScansDataset(hid_t fileID, const std::string & fileName, const std::string & sweepName, ScansDataset & dataset)  {
+    dataset.fileName = fileName ;
+    dataset.datasetID = -1 ;
+    dataset.rank = 0 ;
+    dataset.channelCount = 0 ;
+    dataset.scanCount = 0 ;
+    dataset.chunkScanCount = 0 ;
+    dataset.isContiguous = false ;
+    dataset.contiguousOffset = 0 ;
+    dataset.file = (FILE *)(0) ;
+    std::string path = "/" + sweepName + "/analogScans" ;
+    if (H5Lexists(fileID, path.c_str(), H5P_DEFAULT) <= 0)  {
+        return true ;
+    }
+    dataset.datasetID = H5Dopen2(fileID, path.c_str(), H5P_DEFAULT) ;
+    if (dataset.datasetID < 0)  {
+        return false ;
+    }
+    hid_t spaceID = H5Dget_space(dataset.datasetID) ;
+    hsize_t dims[2] = { 0, 0 } ;
+    dataset.rank = (spaceID < 0) ? -1 : H5Sget_simple_extent_ndims(spaceID) ;
+    bool isOK = (dataset.rank == 1 || dataset.rank == 2) && H5Sget_simple_extent_dims(spaceID, dims, NULL) >= 0 ;
+    if (spaceID >= 0)  {
+        H5Sclose(spaceID) ;
+    }
+    if (!isOK)  {
+        return false ;
+    }
+    dataset.channelCount = (dataset.rank == 1) ? 1 : dims[0] ;
+    dataset.scanCount = (dataset.rank == 1) ? dims[0] : dims[1] ;
+
+    // The layout
+    hid_t createPropertyListID = H5Dget_create_plist(dataset.datasetID) ;
+    if (createPropertyListID >= 0)  {
+        H5D_layout_t layout = H5Pget_layout(createPropertyListID) ;
+        if (layout == H5D_CHUNKED)  {
+            hsize_t chunkDims[2] = { 0, 0 } ;
+            int rank = H5Pget_chunk(createPropertyListID, 2, chunkDims) ;
+            dataset.chunkScanCount = (rank == 2) ? chunkDims[1] : (rank == 1) ? chunkDims[0] : 0 ;
+        }
+        else if (layout == H5D_CONTIGUOUS)  {
+            hid_t typeID = H5Dget_type(dataset.datasetID) ;
+            haddr_t offset = H5Dget_offset(dataset.datasetID) ;
+            dataset.isContiguous = (typeID >= 0) && (H5Tequal(typeID, H5T_NATIVE_INT16) > 0) && (offset != HADDR_UNDEF) ;
+            dataset.contiguousOffset = (uint64_t)(offset) ;
+            if (typeID >= 0)  {
+                H5Tclose(typeID) ;
+            }
+        }
+        H5Pclose(createPropertyListID) ;
+    }
+    return true ;
+}
+
+
+
+static void
+closeScansDataset(ScansDataset & dataset)  {
+    if (dataset.datasetID >= 0)  {
+        H5Dclose(dataset.datasetID) ;
+        dataset.datasetID = -1 ;
+    }
+    if (dataset.file)  {
+        fclose(dataset.file) ;
+        dataset.file = (FILE *)(0) ;
+    }
+}
+
+
+
+//
+// Streaming scans.  Caller must not hold HDF5_MUTEX.
+//
+
+// Read scanCount scans of every channel, starting at firstScanIndex, into scans, channel
+// by channel.  Returns false if that fails.
+static bool
+readScansBlock(ScansDataset & dataset, hsize_t firstScanIndex, hsize_t scanCount, int16_t * scans)  {
+    if (dataset.isContiguous)  {
+        if (!dataset.file)  {
+            dataset.file = fopen(dataset.fileName.c_str(), "rb") ;
+            if (!dataset.file)  {
+                return false ;
+            }
+        }
+        for (hsize_t channelIndex = 0; channelIndex < dataset.channelCount; ++channelIndex)  {
+            uint64_t offset = dataset.contiguousOffset + (channelIndex*dataset.scanCount + firstScanIndex) * sizeof(int16_t) ;
+            if (!readFileAt(dataset.file, offset, (char *)(scans + channelIndex*scanCount), (size_t)(scanCount) * sizeof(int16_t)))  {
+                return false ;
+            }
+        }
+        return true ;
+    }
+    std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+    hid_t fileSpaceID = H5Dget_space(dataset.datasetID) ;
+    if (fileSpaceID < 0)  {
+        return false ;
+    }
+    hsize_t start[2] = { 0, firstScanIndex } ;
+    hsize_t count[2] = { dataset.channelCount, scanCount } ;
+    herr_t status = (dataset.rank == 1) ? H5Sselect_hyperslab(fileSpaceID, H5S_SELECT_SET, start+1, NULL, count+1, NULL)
+                                        : H5Sselect_hyperslab(fileSpaceID, H5S_SELECT_SET, start, NULL, count, NULL) ;
+    hid_t memorySpaceID = H5Screate_simple(2, count, NULL) ;
+    if ( status >= 0 && memorySpaceID >= 0 )  {
+        status = H5Dread(dataset.datasetID, H5T_NATIVE_INT16, memorySpaceID, fileSpaceID, H5P_DEFAULT, scans) ;
+    }
+    else  {
+        status = -1 ;
+    }
+    if (memorySpaceID >= 0)  {
+        H5Sclose(memorySpaceID) ;
+    }
+    H5Sclose(fileSpaceID) ;
+    return status >= 0 ;
+}
+
+
+
+// Pass the scans of each channel, scanCount of them, through the channel's scaling
+// polynomial, as scaledDoubleAnalogDataFromRawMex does.  Returns false if any come out
+// NaN or infinite.
+static bool
+areScaledScansFinite(const int16_t * scans, hsize_t scanCount, const std::vector<const double *> & channelCoefficients,
+                     size_t coefficientCount)  {
+    if (coefficientCount == 0)  {
+        return true ;
+    }
+    double check = 0.0 ;  // becomes NaN if any scaled scan isn't finite
+    for (size_t channelIndex = 0; channelIndex < channelCoefficients.size(); ++channelIndex)  {
+        const double * coefficients = channelCoefficients[channelIndex] ;
+        const int16_t * channelScans = scans + channelIndex*scanCount ;
+        for (hsize_t i = 0; i < scanCount; ++i)  {
+            const double x = (double)(channelScans[i]) ;
+            double y = coefficients[coefficientCount-1] ;
+            for (size_t k = coefficientCount-1; k > 0; --k)  {
+                y = coefficients[k-1] + x*y ;
+            }
+            check += 0.0*y ;
+        }
+    }
+    return check == 0.0 ;
+}
+
+
+
+//
+// The work on each file
+//
+
+static void
+addTaskProblem(FileTask & task, const std::string & problem)  {
+    task.problems.push_back(problem) ;
+    task.messages.push_back(problem) ;
+}
+
+
+
+// Copy the source file to the target, adding the scaling coefficients if the source lacks
+// them, as ws.appendCalibrationCoefficientsToCopyOfDataFile() does
+static void
+addScalingToFile(const BatchScalingJob & job, FileTask & task)  {
+    if (pathKind(task.targetFilePath) != NO_PATH)  {
+        task.wasSkipped = true ;
+        return ;
+    }
+    if (job.isDryRun)  {
+        task.messages.push_back("Would have converted " + task.sourceFilePath + ", outputting to " + task.targetFilePath) ;
+        return ;
+    }
+
+    // Get the coefficients of the file's terminals, unless it has them already
+    bool hasCoefficients = false ;
+    std::vector<hsize_t> dims ;
+    std::vector<double> terminalIDs ;
+    std::vector<double> coefficients ;
+    const char * whatFailed = "" ;
+    {
+        std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+        hid_t fileID = H5Fopen(task.sourceFilePath.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) ;
+        if (fileID < 0)  {
+            whatFailed = "Unable to open it" ;
+        }
+        else  {
+            hasCoefficients = doesObjectExist(fileID, SCALING_COEFFICIENTS_PATH) ;
+            if ( !hasCoefficients && !readAnalogTerminalIDs(fileID, dims, terminalIDs) )  {
+                whatFailed = "Unable to read analog terminal IDs" ;
+            }
+            H5Fclose(fileID) ;
+        }
+    }
+    if ( *whatFailed == '\0' && !hasCoefficients && !coefficientsForTerminals(job, terminalIDs, coefficients) )  {
+        whatFailed = "Its analog terminal IDs aren't all terminals of the device" ;
+    }
+
+    // Copy it, and add them
+    std::string partialFilePath = task.targetFilePath + ".partial" ;
+    if ( *whatFailed == '\0' && !copyFile(task.sourceFilePath, partialFilePath) )  {
+        whatFailed = "Unable to copy it" ;
+    }
+    if ( *whatFailed == '\0' && !hasCoefficients )  {
+        std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+        if (!writeScalingCoefficients(partialFilePath, job.coefficientCount, terminalIDs.size(), coefficients))  {
+            whatFailed = "Unable to write the scaling coefficients to the copy" ;
+        }
+    }
+    if ( *whatFailed == '\0' && !replaceFile(partialFilePath, task.targetFilePath) )  {
+        whatFailed = "Unable to rename the copy" ;
+    }
+    if (*whatFailed != '\0')  {
+        remove(partialFilePath.c_str()) ;
+        addTaskProblem(task, "There was an issue with input file " + task.sourceFilePath + ": " + whatFailed) ;
+    }
+}
+
+
+
+// Check the coefficients in the target file, as
+// ws.verifyScalingOfHDF5FilesRecursivelyGivenCoeffs() does, and get them, for scaling the
+// scans.  Caller must hold HDF5_MUTEX.  Returns false if there's a problem.
+static bool
+checkScalingCoefficients(const BatchScalingJob & job, FileTask & task, hid_t sourceFileID, hid_t targetFileID,
+                         std::vector<hsize_t> & targetDims, std::vector<double> & targetCoefficients)  {
+    if (!readDoubleDataset(targetFileID, SCALING_COEFFICIENTS_PATH, targetDims, targetCoefficients))  {
+        addTaskProblem(task, "Problem: Unable to read scaling coefficients in target file " + task.targetFilePath) ;
+        return false ;
+    }
+    std::vector<hsize_t> sourceDims ;
+    std::vector<double> sourceCoefficients ;
+    if (readDoubleDataset(sourceFileID, SCALING_COEFFICIENTS_PATH, sourceDims, sourceCoefficients))  {
+        if ( sourceDims != targetDims || sourceCoefficients != targetCoefficients )  {
+            addTaskProblem(task, "Problem: Scaling coefficients in target file " + task.targetFilePath +
+                                 " don't match those in source file " + task.sourceFilePath) ;
+            return false ;
+        }
+        return true ;
+    }
+
+    // The source has no coefficients, so the target's should be the given ones
+    std::vector<hsize_t> sourceIDDims, targetIDDims ;
+    std::vector<double> sourceTerminalIDs, targetTerminalIDs ;
+    if (!readAnalogTerminalIDs(sourceFileID, sourceIDDims, sourceTerminalIDs))  {
+        addTaskProblem(task, "Problem: Unable to read AnalogTerminalIDs in source file " + task.sourceFilePath) ;
+        return false ;
+    }
+    if (!readAnalogTerminalIDs(targetFileID, targetIDDims, targetTerminalIDs))  {
+        addTaskProblem(task, "Problem: Unable to read AnalogTerminalIDs in target file " + task.targetFilePath) ;
+        return false ;
+    }
+    if ( sourceIDDims != targetIDDims || sourceTerminalIDs != targetTerminalIDs )  {
+        addTaskProblem(task, "Problem: AI terminal IDs in target file " + task.targetFilePath +
+                             " don't match those in source file " + task.sourceFilePath) ;
+        return false ;
+    }
+    std::vector<double> coefficients ;
+    std::vector<hsize_t> dims = { (hsize_t)(targetTerminalIDs.size()), (hsize_t)(job.coefficientCount) } ;
+    if ( !coefficientsForTerminals(job, targetTerminalIDs, coefficients) || targetDims != dims || targetCoefficients != coefficients )  {
+        addTaskProblem(task, "Problem: Scaling coefficients in target file " + task.targetFilePath +
+                             " don't match those in given scaling coefficients") ;
+        return false ;
+    }
+    return true ;
+}
+
+
+
+// Get which coefficients go with each of the channelCount channels in a sweep: the
+// coefficients are for all the channels, or just the active ones.  Returns false if that
+// can't be worked out.
+static bool
+getChannelCoefficients(const std::vector<hsize_t> & coefficientDims, const std::vector<double> & coefficients,
+                       const std::vector<double> & isChannelActive, hsize_t channelCount,
+                       std::vector<const double *> & channelCoefficients)  {
+    channelCoefficients.clear() ;
+    if (coefficientDims.size() != 2)  {
+        return false ;
+    }
+    hsize_t columnCount = coefficientDims[0] ;
+    hsize_t coefficientCount = coefficientDims[1] ;
+    for (hsize_t i = 0; i < columnCount; ++i)  {
+        if ( columnCount == channelCount || (isChannelActive.size() == columnCount && isChannelActive[i] != 0) )  {
+            channelCoefficients.push_back(coefficients.data() + i*coefficientCount) ;
+        }
+    }
+    return channelCoefficients.size() == channelCount ;
+}
+
+
+
+// Stream the analogScans of a sweep from both files, checking that they're the same, and
+// that they scale to finite values.  Returns false if there's a problem.
+static bool
+checkSweepScans(FileTask & task, const std::string & sweepName, ScansDataset & source, ScansDataset & target,
+                const std::vector<hsize_t> & coefficientDims, const std::vector<double> & coefficients,
+                const std::vector<double> & isChannelActive)  {
+    if ( source.channelCount != target.channelCount || source.scanCount != target.scanCount )  {
+        addTaskProblem(task, "Problem: The scans of " + sweepName + " in target file " + task.targetFilePath +
+                             " are a different size from those in source file " + task.sourceFilePath) ;
+        return false ;
+    }
+    if ( source.channelCount == 0 || source.scanCount == 0 )  {
+        return true ;
+    }
+    std::vector<const double *> channelCoefficients ;
+    if (!getChannelCoefficients(coefficientDims, coefficients, isChannelActive, target.channelCount, channelCoefficients))  {
+        addTaskProblem(task, "Problem: Unable to match the scaling coefficients in target file " + task.targetFilePath +
+                             " to the channels of " + sweepName) ;
+        return false ;
+    }
+
+    // Whole rows of chunks at a time, if chunked, so each chunk is only read once
+    hsize_t blockScanCount = std::max<hsize_t>(1, SCAN_BLOCK_SAMPLE_COUNT / source.channelCount) ;
+    hsize_t chunkScanCount = std::max(source.chunkScanCount, target.chunkScanCount) ;
+    if (chunkScanCount > 0)  {
+        blockScanCount = std::max(chunkScanCount, blockScanCount - blockScanCount % chunkScanCount) ;
+    }
+    std::vector<int16_t> sourceScans((size_t)(std::min(blockScanCount, source.scanCount) * source.channelCount)) ;
+    std::vector<int16_t> targetScans(sourceScans.size()) ;
+    for (hsize_t firstScanIndex = 0; firstScanIndex < source.scanCount; firstScanIndex += blockScanCount)  {
+        hsize_t scanCount = std::min(blockScanCount, source.scanCount - firstScanIndex) ;
+        if (!readScansBlock(source, firstScanIndex, scanCount, sourceScans.data()))  {
+            addTaskProblem(task, "Problem: Unable to read the scans of " + sweepName + " in source file " + task.sourceFilePath) ;
+            return false ;
+        }
+        if (!readScansBlock(target, firstScanIndex, scanCount, targetScans.data()))  {
+            addTaskProblem(task, "Problem: Unable to read the scans of " + sweepName + " in target file " + task.targetFilePath) ;
+            return false ;
+        }
+        size_t byteCount = (size_t)(scanCount * source.channelCount) * sizeof(int16_t) ;
+        if (memcmp(sourceScans.data(), targetScans.data(), byteCount) != 0)  {
+            addTaskProblem(task, "Problem: The scans of " + sweepName + " in target file " + task.targetFilePath +
+                                 " don't match those in source file " + task.sourceFilePath) ;
+            return false ;
+        }
+        if (!areScaledScansFinite(targetScans.data(), scanCount, channelCoefficients, (size_t)(coefficientDims[1])))  {
+            addTaskProblem(task, "Problem: Scaling coefficients in target file " + task.targetFilePath +
+                                 " give non-finite values for the scans of " + sweepName) ;
+            return false ;
+        }
+    }
+    return true ;
+}
+
+
+
+// Check the target file's coefficients, and its scans, against the source file's, as
+// ws.verifyScalingOfHDF5FilesRecursivelyGivenCoeffs() does, and more
+static void
+verifyScalingOfFile(const BatchScalingJob & job, FileTask & task)  {
+    PathKind kind = pathKind(task.targetFilePath) ;
+    if (kind == NO_PATH)  {
+        addTaskProblem(task, "Problem: Target file " + task.targetFilePath + " is missing!") ;
+        return ;
+    }
+    else if (kind == FOLDER_PATH)  {
+        addTaskProblem(task, "Target file " + task.targetFilePath + " exists, but is a folder!") ;
+        return ;
+    }
+
+    // Check the coefficients, and open the sweeps' scans
+    hid_t sourceFileID = -1 ;
+    hid_t targetFileID = -1 ;
+    std::vector<hsize_t> coefficientDims ;
+    std::vector<double> coefficients ;
+    std::vector<double> isChannelActive ;
+    std::vector<std::string> sweepNames ;
+    std::vector<ScansDataset> sourceDatasets ;
+    std::vector<ScansDataset> targetDatasets ;
+    bool isOK = true ;
+    {
+        std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+        sourceFileID = H5Fopen(task.sourceFilePath.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) ;
+        if (sourceFileID < 0)  {
+            addTaskProblem(task, "Problem: Unable to open source file " + task.sourceFilePath) ;
+            isOK = false ;
+        }
+        if (isOK)  {
+            targetFileID = H5Fopen(task.targetFilePath.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) ;
+            if (targetFileID < 0)  {
+                addTaskProblem(task, "Problem: Unable to open target file " + task.targetFilePath) ;
+                isOK = false ;
+            }
+        }
+        isOK = isOK && checkScalingCoefficients(job, task, sourceFileID, targetFileID, coefficientDims, coefficients) ;
+        if (isOK)  {
+            std::vector<hsize_t> dims ;
+            if (!readDoubleDataset(targetFileID, "/header/Acquisition/IsAnalogChannelActive", dims, isChannelActive))  {
+                readDoubleDataset(targetFileID, "/header/IsAIChannelActive", dims, isChannelActive) ;
+            }
+            std::vector<std::string> targetSweepNames ;
+            if ( !readSweepNames(sourceFileID, sweepNames) || !readSweepNames(targetFileID, targetSweepNames) || sweepNames != targetSweepNames )  {
+                addTaskProblem(task, "Problem: Sweeps in target file " + task.targetFilePath + " don't match those in source file " +
+                                     task.sourceFilePath) ;
+                isOK = false ;
+            }
+        }
+        for (size_t i = 0; isOK && i < sweepNames.size(); ++i)  {
+            sourceDatasets.push_back(ScansDataset()) ;
+            targetDatasets.push_back(ScansDataset()) ;
+            if ( !openScansDataset(sourceFileID, task.sourceFilePath, sweepNames[i], sourceDatasets.back()) ||
+                 !openScansDataset(targetFileID, task.targetFilePath, sweepNames[i], targetDatasets.back()) )  {
+                addTaskProblem(task, "Problem: Unable to open the scans of " + sweepNames[i] + " in source file " +
+                                     task.sourceFilePath + " or target file " + task.targetFilePath) ;
+                isOK = false ;
+            }
+        }
+    }
+
+    // Stream the scans
+    for (size_t i = 0; isOK && i < sweepNames.size(); ++i)  {
+        isOK = checkSweepScans(task, sweepNames[i], sourceDatasets[i], targetDatasets[i], coefficientDims, coefficients, isChannelActive) ;
+    }
+
+    // Close everything
+    std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+    for (size_t i = 0; i < sourceDatasets.size(); ++i)  {
+        closeScansDataset(sourceDatasets[i]) ;
+        closeScansDataset(targetDatasets[i]) ;
+    }
+    if (targetFileID >= 0)  {
+        H5Fclose(targetFileID) ;
+    }
+    if (sourceFileID >= 0)  {
+        H5Fclose(sourceFileID) ;
+    }
+}
+
+
+
+// The worker threads take the next file to do until there are none left
+static void
+runWorker(BatchState * state)  {
+    const BatchScalingJob & job = *(state->job) ;
+    for (;;)  {
+        size_t taskIndex = state->nextTaskIndex++ ;
+        if (taskIndex >= state->tasks.size())  {
+            return ;
+        }
+        FileTask & task = state->tasks[taskIndex] ;
+        if (job.mode == ADD_SCALING)  {
+            addScalingToFile(job, task) ;
+        }
+        else  {
+            verifyScalingOfFile(job, task) ;
+        }
+        {
+            std::lock_guard<std::mutex> lock(state->mutex) ;
+            state->pendingMessages.insert(state->pendingMessages.end(), task.messages.begin(), task.messages.end()) ;
+            ++(state->doneTaskCount) ;
+        }
+        state->didFinishTask.notify_one() ;
+    }
+}
+// end of function
+
+
+
+bool
+runBatchScaling(const BatchScalingJob & job, BatchScalingResult & result, std::string & errorMessage)  {
+    result.fileCount = 0 ;
+    result.skippedFileCount = 0 ;
+    result.problems.clear() ;
+
+    // Check the folders
+    if (pathKind(job.sourceFolderPath) != FOLDER_PATH)  {
+        errorMessage = "Source folder '" + job.sourceFolderPath + "' does not exist" ;
+        return false ;
+    }
+    std::string sourceFolderPath = normalizedPath(job.sourceFolderPath) ;
+    std::string targetFolderPath = normalizedPath(job.targetFolderPath) ;
+    if ( targetFolderPath == sourceFolderPath || targetFolderPath.compare(0, sourceFolderPath.size()+1, sourceFolderPath + "/") == 0 )  {
+        errorMessage = "Cannot have target folder '" + job.targetFolderPath + "' in source folder '" + job.sourceFolderPath + "'" ;
+        return false ;
+    }
+    if ( job.mode == VERIFY_SCALING && pathKind(job.targetFolderPath) != FOLDER_PATH )  {
+        errorMessage = "Target folder '" + job.targetFolderPath + "' does not exist" ;
+        return false ;
+    }
+    if ( job.coefficients.size() != job.coefficientCount * job.terminalCount )  {
+        errorMessage = "The scaling coefficients are the wrong size" ;
+        return false ;
+    }
+    {
+        std::lock_guard<std::mutex> hdf5Lock(HDF5_MUTEX) ;
+        H5Eset_auto2(H5E_DEFAULT, NULL, NULL) ;
+            // Problems are reported per file, so don't have HDF5 print its error stack
+        if (registerScanFilter() < 0)  {
+            errorMessage = "Unable to register the scan filter with HDF5" ;
+            return false ;
+        }
+    }
+
+    // Find the files
+    BatchState state ;
+    state.job = &job ;
+    state.nextTaskIndex = 0 ;
+    state.doneTaskCount = 0 ;
+    addTasksFromFolder(job, job.sourceFolderPath, job.targetFolderPath, state.tasks, result) ;
+    result.fileCount = state.tasks.size() ;
+
+    // Do them, printing the messages and reporting progress as they're done
+    unsigned workerCount = (job.workerCount > 0) ? job.workerCount : std::max(1u, std::thread::hardware_concurrency()) ;
+    workerCount = (unsigned)(std::min<size_t>(workerCount, state.tasks.size())) ;
+    std::vector<std::thread> workers ;
+    for (unsigned i = 0; i < workerCount; ++i)  {
+        workers.push_back(std::thread(&runWorker, &state)) ;
+    }
+    std::chrono::steady_clock::time_point lastProgressTime = std::chrono::steady_clock::now() ;
+    size_t doneTaskCount = 0 ;
+    do  {
+        std::vector<std::string> messages ;
+        {
+            std::unique_lock<std::mutex> lock(state.mutex) ;
+            state.didFinishTask.wait_for(lock, std::chrono::duration<double>(PROGRESS_INTERVAL), [&state] ()  {
+                return !state.pendingMessages.empty() || state.doneTaskCount == state.tasks.size() ;
+            }) ;
+            messages.swap(state.pendingMessages) ;
+            doneTaskCount = state.doneTaskCount ;
+        }
+        for (size_t i = 0; i < messages.size(); ++i)  {
+            printMessage(job, messages[i]) ;
+        }
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now() ;
+        if ( job.reportProgress &&
+             ( doneTaskCount == state.tasks.size() || std::chrono::duration<double>(now - lastProgressTime).count() >= PROGRESS_INTERVAL ) )  {
+            job.reportProgress(doneTaskCount, state.tasks.size()) ;
+            lastProgressTime = now ;
+        }
+    } while (doneTaskCount < state.tasks.size()) ;
+    for (size_t i = 0; i < workers.size(); ++i)  {
+        workers[i].join() ;
+    }
+
+    // Gather up what happened
+    for (size_t i = 0; i < state.tasks.size(); ++i)  {
+        const FileTask & task = state.tasks[i] ;
+        result.problems.insert(result.problems.end(), task.problems.begin(), task.problems.end()) ;
+        if (task.wasSkipped)  {
+            ++result.skippedFileCount ;
+        }
+    }
+    return true ;
+}
+// end of function
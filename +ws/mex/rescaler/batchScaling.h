@@ -0,0 +1,51 @@
+// The engine of ws.rescaler and wsRescale, which add analog scaling coefficients to a tree
+// of WaveSurfer data files, or check that they were added right, several files at a time.
+// See batchScaling.cpp.
+
+#ifndef WS_BATCH_SCALING_H
+#define WS_BATCH_SCALING_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+enum BatchScalingMode {
+    ADD_SCALING,  // as ws.addScalingToHDF5FilesRecursivelyGivenCoeffs()
+    VERIFY_SCALING  // as ws.verifyScalingOfHDF5FilesRecursivelyGivenCoeffs()
+} ;
+
+// What to do.  The coefficients are those of every AI terminal of the device, as from
+// ws.queryDeviceForAllScalingCoefficients(): coefficientCount x terminalCount, in
+// column-major order, as in Matlab, so that terminal i's coefficients start at
+// coefficients[i*coefficientCount].  printMessage and reportProgress, if set, are only
+// called on the thread that called runBatchScaling().
+struct BatchScalingJob {
+    BatchScalingMode mode ;
+    std::string sourceFolderPath ;
+    std::string targetFolderPath ;
+    size_t coefficientCount ;
+    size_t terminalCount ;
+    std::vector<double> coefficients ;
+    bool isDryRun ;  // for ADD_SCALING, just print what would be done
+    unsigned workerCount ;  // the files done at once, or zero for one per processor
+    std::function<void (const std::string & message)> printMessage ;
+    std::function<void (size_t doneFileCount, size_t fileCount)> reportProgress ;
+} ;
+
+// What happened.  problems has one line for each thing that went wrong: those with the
+// folders first, then those with each file, in the order the files were found.  They're
+// printed as they happen too.  For VERIFY_SCALING, all is well if there are none.
+struct BatchScalingResult {
+    size_t fileCount ;  // the .h5 files in the source tree
+    size_t skippedFileCount ;  // for ADD_SCALING, the ones whose target was there already
+    std::vector<std::string> problems ;
+} ;
+
+// Walk the source tree, and add scaling coefficients to a copy of each .h5 file in it, in
+// the same place in the target tree, or verify that that was done.  Returns false, setting
+// errorMessage, if the job can't be started at all, as when the source folder doesn't
+// exist.  Problems with particular files don't stop the others being done.
+bool runBatchScaling(const BatchScalingJob & job, BatchScalingResult & result, std::string & errorMessage) ;
+
+#endif
@@ -0,0 +1,224 @@
+// ws.rescaler: adds analog scaling coefficients to a tree of WaveSurfer data files, or
+// verifies that they were added right, several files at a time.  The work is done by
+// batchScaling.cpp, which wsRescale, the command-line version, shares.
+//
+// Usage, from ws.addScalingToHDF5FilesRecursivelyGivenCoeffs() and
+// ws.verifyScalingOfHDF5FilesRecursivelyGivenCoeffs():
+//
+//   [problems, fileCount, skippedFileCount] = ws.rescaler('AddScaling', sourceFolderPath, scalingCoefficients, targetFolderPath, isDryRun[, workerCount])
+//   [isAllWell, problems, fileCount] = ws.rescaler('VerifyScaling', sourceFolderPath, scalingCoefficients, targetFolderPath[, workerCount])
+//
+// scalingCoefficients are those of every AI terminal of the device, nCoefficients x
+// nTerminals, as from ws.queryDeviceForAllScalingCoefficients().  problems is a cell array
+// of strings, one for each thing that went wrong; each is also printed as it happens,
+// along with the progress, once a second.  workerCount is the number of files done at
+// once, and defaults to one per processor.
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include "mex.h"
+#include "matrix.h"
+#include "batchScaling.h"
+
+
+
+// Read the string at prhs[index], which must be a nonempty char array
+static std::string
+readStringArgument(int nrhs, const mxArray *prhs[], int index, const char * argumentName)  {
+    if ( (nrhs>index) && mxIsChar(prhs[index]) && !mxIsEmpty(prhs[index]) )  {
+        char * valueAsCharPtr = mxArrayToString(prhs[index]) ;
+        std::string result(valueAsCharPtr) ;
+        mxFree(valueAsCharPtr) ;
+        return result ;
+    }
+    mexErrMsgIdAndTxt("ws:rescaler:badArgument", "%s must be a nonempty string", argumentName) ;
+    return std::string() ;  // never get here
+}
+
+
+
+// Read the scaling coefficients at prhs[index] into job
+static void
+readScalingCoefficientsArgument(int nrhs, const mxArray *prhs[], int index, BatchScalingJob & job)  {
+    if ( (nrhs<=index) || !mxIsDouble(prhs[index]) || mxIsComplex(prhs[index]) || mxGetNumberOfDimensions(prhs[index])!=2 )  {
+        mexErrMsgIdAndTxt("ws:rescaler:badArgument", "scalingCoefficients must be a non-complex double matrix") ;
+    }
+    job.coefficientCount = mxGetM(prhs[index]) ;
+    job.terminalCount = mxGetN(prhs[index]) ;
+    const double * coefficients = mxGetPr(prhs[index]) ;
+    job.coefficients.assign(coefficients, coefficients + job.coefficientCount*job.terminalCount) ;
+}
+
+
+
+// Read the optional worker count at prhs[index], which is zero, for one per processor,
+// if not given
+static unsigned
+readWorkerCountArgument(int nrhs, const mxArray *prhs[], int index)  {
+    if ( nrhs<=index || mxIsEmpty(prhs[index]) )  {
+        return 0 ;
+    }
+    if ( mxIsScalar(prhs[index]) && mxIsNumeric(prhs[index]) && !mxIsComplex(prhs[index]) )  {
+        double value = mxGetScalar(prhs[index]) ;
+        if ( value>=1 && value<=1024 && value==floor(value) )  {
+            return (unsigned)(value) ;
+        }
+    }
+    mexErrMsgIdAndTxt("ws:rescaler:badArgument", "workerCount must be an integer between 1 and 1024") ;
+    return 0 ;  // never get here
+}
+
+
+
+// Print the messages and progress in the command window as they come
+static void
+setUpPrinting(BatchScalingJob & job)  {
+    job.printMessage = [] (const std::string & message)  {
+        mexPrintf("%s\n", message.c_str()) ;
+        mexEvalString("drawnow;") ;  // So it's seen now, not when we're done
+    } ;
+    job.reportProgress = [] (size_t doneFileCount, size_t fileCount)  {
+        mexPrintf("Done %u of %u files\n", (unsigned)(doneFileCount), (unsigned)(fileCount)) ;
+        mexEvalString("drawnow;") ;
+    } ;
+}
+
+
+
+// Run the job, erroring if it can't be started
+static void
+runJob(const BatchScalingJob & job, BatchScalingResult & result)  {
+    std::string errorMessage ;
+    if (!runBatchScaling(job, result, errorMessage))  {
+        mexErrMsgIdAndTxt("ws:rescaler:unableToStart", "%s", errorMessage.c_str()) ;
+    }
+}
+
+
+
+static mxArray *
+cellArrayFromStrings(const std::vector<std::string> & strings)  {
+    mxArray * result = mxCreateCellMatrix(strings.size(), 1) ;
+    for (size_t i = 0; i < strings.size(); ++i)  {
+        mxSetCell(result, i, mxCreateString(strings[i].c_str())) ;
+    }
+    return result ;
+}
+
+
+
+// [problems, fileCount, skippedFileCount] = AddScaling(sourceFolderPath, scalingCoefficients, targetFolderPath, isDryRun[, workerCount])
+//
+// Copy each .h5 file under sourceFolderPath to the same place under targetFolderPath,
+// adding the scaling coefficients of its AI terminals if it lacks them, as
+// ws.addScalingToHDF5FilesRecursivelyGivenCoeffs() does.  Files whose target exists
+// already are skipped, and counted in skippedFileCount.  If isDryRun is true, just prints
+// what would be done.
+static void
+AddScaling(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    BatchScalingJob job ;
+    job.mode = ADD_SCALING ;
+
+    // prhs[1]: sourceFolderPath
+    job.sourceFolderPath = readStringArgument(nrhs, prhs, 1, "sourceFolderPath") ;
+
+    // prhs[2]: scalingCoefficients
+    readScalingCoefficientsArgument(nrhs, prhs, 2, job) ;
+
+    // prhs[3]: targetFolderPath
+    job.targetFolderPath = readStringArgument(nrhs, prhs, 3, "targetFolderPath") ;
+
+    // prhs[4]: isDryRun
+    if ( nrhs<=4 || !mxIsScalar(prhs[4]) || !(mxIsLogical(prhs[4]) || mxIsNumeric(prhs[4])) )  {
+        mexErrMsgIdAndTxt("ws:rescaler:badArgument", "isDryRun must be a logical scalar") ;
+    }
+    job.isDryRun = (mxGetScalar(prhs[4]) != 0) ;
+
+    // prhs[5]: workerCount, optional
+    job.workerCount = readWorkerCountArgument(nrhs, prhs, 5) ;
+
+    // Do it
+    setUpPrinting(job) ;
+    BatchScalingResult result ;
+    runJob(job, result) ;
+
+    // Return output data
+    plhs[0] = cellArrayFromStrings(result.problems) ;
+    if (nlhs>1)  {
+        plhs[1] = mxCreateDoubleScalar((double)(result.fileCount)) ;
+    }
+    if (nlhs>2)  {
+        plhs[2] = mxCreateDoubleScalar((double)(result.skippedFileCount)) ;
+    }
+}
+// end of function
+
+
+
+// [isAllWell, problems, fileCount] = VerifyScaling(sourceFolderPath, scalingCoefficients, targetFolderPath[, workerCount])
+//
+// Check that each .h5 file under sourceFolderPath was copied to the same place under
+// targetFolderPath, with the right scaling coefficients, as
+// ws.verifyScalingOfHDF5FilesRecursivelyGivenCoeffs() does, and that the analog scans of
+// the copy are the same, and scale to finite values.
+static void
+VerifyScaling(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    BatchScalingJob job ;
+    job.mode = VERIFY_SCALING ;
+    job.isDryRun = false ;
+
+    // prhs[1]: sourceFolderPath
+    job.sourceFolderPath = readStringArgument(nrhs, prhs, 1, "sourceFolderPath") ;
+
+    // prhs[2]: scalingCoefficients
+    readScalingCoefficientsArgument(nrhs, prhs, 2, job) ;
+
+    // prhs[3]: targetFolderPath
+    job.targetFolderPath = readStringArgument(nrhs, prhs, 3, "targetFolderPath") ;
+
+    // prhs[4]: workerCount, optional
+    job.workerCount = readWorkerCountArgument(nrhs, prhs, 4) ;
+
+    // Do it
+    setUpPrinting(job) ;
+    BatchScalingResult result ;
+    runJob(job, result) ;
+
+    // Return output data
+    plhs[0] = mxCreateLogicalScalar(result.problems.empty()) ;
+    if (nlhs>1)  {
+        plhs[1] = cellArrayFromStrings(result.problems) ;
+    }
+    if (nlhs>2)  {
+        plhs[2] = mxCreateDoubleScalar((double)(result.fileCount)) ;
+    }
+}
+// end of function
+
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])  {
+    // Dispatch on the 'method' name
+    if ( nrhs<1 || !mxIsChar(prhs[0]) )  {
+        mexErrMsgIdAndTxt("ws:rescaler:argNotAString",
+                          "First argument to ws.rescaler() must be a string.") ;
+    }
+
+    char* actionAsCharPtr = mxArrayToString(prhs[0]) ;
+    std::string action(actionAsCharPtr) ;
+    mxFree(actionAsCharPtr) ;
+
+    if (action == "AddScaling")  {
+        AddScaling(nlhs, plhs, nrhs, prhs) ;
+    }
+    else if (action == "VerifyScaling")  {
+        VerifyScaling(nlhs, plhs, nrhs, prhs) ;
+    }
+    else  {
+        // Doesn't match anything, so error
+        mexErrMsgIdAndTxt("ws:rescaler:noSuchMethod",
+                          "ws.rescaler() doesn't recognize method name %s", action.c_str()) ;
+    }
+}
+// end of function
@@ -0,0 +1,196 @@
+// wsRescale: the command-line version of ws.rescaler, for running over an archive of
+// WaveSurfer data files without Matlab.
+//
+//   wsRescale add [--dry-run] [--workers N] sourceFolder coefficientsFile targetFolder
+//   wsRescale verify [--workers N] sourceFolder coefficientsFile targetFolder
+//
+// add copies each .h5 file under sourceFolder to the same place under targetFolder,
+// adding the analog scaling coefficients of its AI terminals if it lacks them, as
+// ws.addScalingToHDF5FilesRecursively() does; verify checks that that was done right.  See
+// batchScaling.cpp.  coefficientsFile holds the coefficients of every AI terminal of the
+// device, nCoefficients x nTerminals, either as the scalingCoefficients variable in a .mat
+// file saved with -v7.3, which is HDF5, or as text, a row per coefficient, a column per
+// terminal, separated by spaces or commas.  Problems are printed on stdout, progress on
+// stderr.  Exits with status 0 if all went well, 1 if there were problems with some files,
+// and 2 if it couldn't start.
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "hdf5.h"
+#include "batchScaling.h"
+
+
+
+static void
+printUsage(void)  {
+    fprintf(stderr,
+            "Usage: wsRescale add [--dry-run] [--workers N] sourceFolder coefficientsFile targetFolder\n"
+            "       wsRescale verify [--workers N] sourceFolder coefficientsFile targetFolder\n") ;
+}
+
+
+
+// Read the scalingCoefficients variable of a .mat file saved with -v7.3.  Matlab stores
+// an m x n matrix as an n x m HDF5 dataset, so the values come out column-major, as they
+// should.  Returns false if that fails.
+static bool
+readCoefficientsFromMatFile(const std::string & fileName, BatchScalingJob & job)  {
+    H5Eset_auto2(H5E_DEFAULT, NULL, NULL) ;
+    hid_t fileID = H5Fopen(fileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) ;
+    if (fileID < 0)  {
+        return false ;
+    }
+    bool isOK = false ;
+    hid_t datasetID = H5Dopen2(fileID, "/scalingCoefficients", H5P_DEFAULT) ;
+    if (datasetID >= 0)  {
+        hid_t spaceID = H5Dget_space(datasetID) ;
+        hsize_t dims[2] = { 0, 0 } ;
+        if ( spaceID >= 0 && H5Sget_simple_extent_ndims(spaceID) == 2 && H5Sget_simple_extent_dims(spaceID, dims, NULL) >= 0 )  {
+            job.terminalCount = (size_t)(dims[0]) ;
+            job.coefficientCount = (size_t)(dims[1]) ;
+            job.coefficients.resize(job.terminalCount*job.coefficientCount) ;
+            isOK = job.coefficients.empty() ||
+                   H5Dread(datasetID, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, job.coefficients.data()) >= 0 ;
+        }
+        if (spaceID >= 0)  {
+            H5Sclose(spaceID) ;
+        }
+        H5Dclose(datasetID) ;
+    }
+    H5Fclose(fileID) ;
+    return isOK ;
+}
+
+
+
+// Read the coefficients from a text file, a row per coefficient.  Returns false if that
+// fails, or the rows aren't all the same length.
+static bool
+readCoefficientsFromTextFile(const std::string & fileName, BatchScalingJob & job)  {
+    FILE * file = fopen(fileName.c_str(), "r") ;
+    if (!file)  {
+        return false ;
+    }
+    std::vector<std::vector<double> > rows ;
+    bool isOK = true ;
+    char line[65536] ;
+    while ( isOK && fgets(line, sizeof(line), file) )  {
+        std::vector<double> row ;
+        char * position = line ;
+        for (;;)  {
+            position += strspn(position, " \t,\r\n") ;
+            if (*position == '\0')  {
+                break ;
+            }
+            char * end ;
+            double value = strtod(position, &end) ;
+            if (end == position)  {
+                isOK = false ;
+                break ;
+            }
+            row.push_back(value) ;
+            position = end ;
+        }
+        if (!row.empty())  {
+            rows.push_back(row) ;
+        }
+    }
+    fclose(file) ;
+    if ( !isOK || rows.empty() )  {
+        return false ;
+    }
+    job.coefficientCount = rows.size() ;
+    job.terminalCount = rows[0].size() ;
+    job.coefficients.resize(job.coefficientCount*job.terminalCount) ;
+    for (size_t i = 0; i < rows.size(); ++i)  {
+        if (rows[i].size() != job.terminalCount)  {
+            return false ;
+        }
+        for (size_t j = 0; j < job.terminalCount; ++j)  {
+            job.coefficients[j*job.coefficientCount + i] = rows[i][j] ;
+        }
+    }
+    return true ;
+}
+
+
+
+int
+main(int argc, char * argv[])  {
+    // Parse the arguments
+    BatchScalingJob job ;
+    job.isDryRun = false ;
+    job.workerCount = 0 ;
+    std::vector<std::string> paths ;
+    if (argc < 2)  {
+        printUsage() ;
+        return 2 ;
+    }
+    std::string command(argv[1]) ;
+    if (command == "add")  {
+        job.mode = ADD_SCALING ;
+    }
+    else if (command == "verify")  {
+        job.mode = VERIFY_SCALING ;
+    }
+    else  {
+        printUsage() ;
+        return 2 ;
+    }
+    for (int i = 2; i < argc; ++i)  {
+        std::string argument(argv[i]) ;
+        if ( argument == "--dry-run" && job.mode == ADD_SCALING )  {
+            job.isDryRun = true ;
+        }
+        else if ( argument == "--workers" && i+1 < argc )  {
+            int workerCount = atoi(argv[++i]) ;
+            if ( workerCount < 1 || workerCount > 1024 )  {
+                printUsage() ;
+                return 2 ;
+            }
+            job.workerCount = (unsigned)(workerCount) ;
+        }
+        else if ( argument.compare(0, 2, "--") == 0 )  {
+            printUsage() ;
+            return 2 ;
+        }
+        else  {
+            paths.push_back(argument) ;
+        }
+    }
+    if (paths.size() != 3)  {
+        printUsage() ;
+        return 2 ;
+    }
+    job.sourceFolderPath = paths[0] ;
+    job.targetFolderPath = paths[2] ;
+
+    // Read the coefficients
+    bool isHDF5 = (H5Fis_hdf5(paths[1].c_str()) > 0) ;
+    if ( isHDF5 ? !readCoefficientsFromMatFile(paths[1], job) : !readCoefficientsFromTextFile(paths[1], job) )  {
+        fprintf(stderr, "Unable to read scaling coefficients from %s%s\n", paths[1].c_str(),
+                isHDF5 ? "" : " (a .mat file must be saved with -v7.3)") ;
+        return 2 ;
+    }
+
+    // Do it
+    job.printMessage = [] (const std::string & message)  {
+        printf("%s\n", message.c_str()) ;
+        fflush(stdout) ;
+    } ;
+    job.reportProgress = [] (size_t doneFileCount, size_t fileCount)  {
+        fprintf(stderr, "Done %u of %u files\n", (unsigned)(doneFileCount), (unsigned)(fileCount)) ;
+    } ;
+    BatchScalingResult result ;
+    std::string errorMessage ;
+    if (!runBatchScaling(job, result, errorMessage))  {
+        fprintf(stderr, "%s\n", errorMessage.c_str()) ;
+        return 2 ;
+    }
+    fprintf(stderr, "%u files, %u skipped because their target exists already, %u problems\n", (unsigned)(result.fileCount),
+            (unsigned)(result.skippedFileCount), (unsigned)(result.problems.size())) ;
+    return result.problems.empty() ? 0 : 1 ;
+}
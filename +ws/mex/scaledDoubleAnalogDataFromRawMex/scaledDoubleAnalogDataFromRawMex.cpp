@@ -1,7 +1,11 @@
 #include <math.h>
 #include "mex.h"
 
+#if defined(_MSC_VER) && _MSC_VER < 1600
 typedef __int16  int16_t ;   // Map MS type to now-standard-C++ type
+#else
+#include <stdint.h>
+#endif
 
 /*
 inline 
@@ -0,0 +1,611 @@
+// The HDF5 filter WaveSurfer compresses scans datasets with.
+//
+// Electrophysiology scans change little from one scan to the next, so each chunk is
+// encoded in three steps, each cheap enough that the whole thing runs much faster than any
+// acquisition rate on one core:
+//
+//   1. Delta: each row of the chunk, which is one channel's scans (see setScanFilter()), is
+//      replaced by the differences between successive scans, zigzag-coded so that small
+//      negative differences, like small positive ones, have all-zero high bits.
+//   2. Bitshuffle: the bytes are regrouped by their place in the element, all the low
+//      bytes, then all the next bytes, and so on, and then within each of those byte
+//      planes, the bits are regrouped by their place in the byte, 8 bytes at a time.  The
+//      mostly-zero high bits then form long runs of zero bytes, and the noisy low bits,
+//      which don't compress, are kept apart from them.
+//   3. LZ4: the result is compressed with LZ4's block format, implemented here.  It skips
+//      quickly over the bytes holding noisy low bits, since they rarely match.
+//
+// If LZ4 doesn't make the shuffled bytes smaller, they're stored as they are.  An encoded
+// chunk is a 16-byte header, then the bytes:
+//
+//   byte 0       format version, 1
+//   byte 1       0 if the shuffled bytes are stored as they are, 1 if they're LZ4-compressed
+//   byte 2       element size in bytes, 1, 2 or 4
+//   byte 3       0
+//   bytes 4-7    row length, in elements, little-endian
+//   bytes 8-15   byte count of the decoded chunk, little-endian
+//
+// Matlab's own HDF5 library doesn't have this filter, so h5read() can't read datasets that
+// use it; ws.loadDataFile() reads them through ws.reader instead.
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include "scanFilter.h"
+
+// For the SSE2 the bitshuffle uses
+#if defined(_M_X64) || defined(__x86_64__)
+#define WS_IS_X64
+#include <emmintrin.h>
+#endif
+
+
+
+#define HEADER_BYTE_COUNT 16
+#define FORMAT_VERSION 1
+#define METHOD_STORED 0
+#define METHOD_LZ4 1
+
+// LZ4 block format constants.  A match is at least MINIMUM_MATCH_LENGTH bytes, the last
+// LAST_LITERAL_COUNT bytes of a block are always literals, and the last match has to start
+// at least MATCH_START_MARGIN bytes before the end of the block.
+#define MINIMUM_MATCH_LENGTH 4
+#define LAST_LITERAL_COUNT 5
+#define MATCH_START_MARGIN 12
+#define MAXIMUM_OFFSET 65535
+#define HASH_BIT_COUNT 16
+
+// The bitshuffle collects this many groups of 8 elements before writing them out, so that
+// it writes whole cache lines of each bit plane.  (The planes are often a power of two
+// bytes apart, so writing them a byte at a time has them evict each other from the cache.)
+#define TILE_GROUP_COUNT 64
+
+
+
+// HDF5 frees the buffers a filter is given, and the ones it returns, so they have to come
+// from HDF5's allocator, which on Windows may not be ours.  HDF5 only exports it from 1.8.15
+// on.
+#if H5_VERS_MAJOR > 1 || (H5_VERS_MAJOR == 1 && (H5_VERS_MINOR > 8 || (H5_VERS_MINOR == 8 && H5_VERS_RELEASE >= 15)))
+static void * allocateFilterBuffer(size_t byteCount)  { return H5allocate_memory(byteCount, false) ; }
+static void freeFilterBuffer(void * buffer)  { H5free_memory(buffer) ; }
+#else
+static void * allocateFilterBuffer(size_t byteCount)  { return malloc(byteCount) ; }
+static void freeFilterBuffer(void * buffer)  { free(buffer) ; }
+#endif
+
+
+
+static inline uint32_t
+read32(const uint8_t * bytes)  {
+    uint32_t result ;
+    memcpy(&result, bytes, sizeof(result)) ;
+    return result ;
+}
+
+static inline uint64_t
+read64(const uint8_t * bytes)  {
+    uint64_t result ;
+    memcpy(&result, bytes, sizeof(result)) ;
+    return result ;
+}
+
+static inline void
+writeLittleEndian(uint8_t * bytes, uint64_t value, int byteCount)  {
+    for (int i = 0; i < byteCount; ++i)  {
+        bytes[i] = (uint8_t)(value >> (8*i)) ;
+    }
+}
+
+static inline uint64_t
+readLittleEndian(const uint8_t * bytes, int byteCount)  {
+    uint64_t result = 0 ;
+    for (int i = 0; i < byteCount; ++i)  {
+        result |= ((uint64_t)(bytes[i])) << (8*i) ;
+    }
+    return result ;
+}
+
+// The number of trailing zero bits in a nonzero value
+static inline int
+trailingZeroCount(uint64_t value)  {
+#if defined(_MSC_VER)
+    unsigned long index ;
+    _BitScanForward64(&index, value) ;
+    return (int)(index) ;
+#else
+    return __builtin_ctzll(value) ;
+#endif
+}
+
+
+
+//
+// LZ4
+//
+
+static inline uint32_t
+hashOfSequence(uint32_t sequence)  {
+    return (sequence * 2654435761U) >> (32 - HASH_BIT_COUNT) ;
+}
+
+// Write the part of a literal or match length that doesn't fit in the token
+static inline uint8_t *
+writeLengthRemainder(uint8_t * output, size_t length)  {
+    length -= 15 ;
+    while (length >= 255)  {
+        *output++ = 255 ;
+        length -= 255 ;
+    }
+    *output++ = (uint8_t)(length) ;
+    return output ;
+}
+
+// Write a sequence: literalCount literals from literals, then, if matchLength is nonzero,
+// a match of that length at offset bytes back
+static inline uint8_t *
+writeSequence(uint8_t * output, const uint8_t * literals, size_t literalCount, size_t offset, size_t matchLength)  {
+    uint8_t * token = output++ ;
+    *token = (uint8_t)(std::min<size_t>(literalCount, 15) << 4) ;
+    if (literalCount >= 15)  {
+        output = writeLengthRemainder(output, literalCount) ;
+    }
+    memcpy(output, literals, literalCount) ;
+    output += literalCount ;
+    if (matchLength > 0)  {
+        writeLittleEndian(output, offset, 2) ;
+        output += 2 ;
+        size_t matchLengthCode = matchLength - MINIMUM_MATCH_LENGTH ;
+        *token |= (uint8_t)(std::min<size_t>(matchLengthCode, 15)) ;
+        if (matchLengthCode >= 15)  {
+            output = writeLengthRemainder(output, matchLengthCode) ;
+        }
+    }
+    return output ;
+}
+
+// The length of the match between the bytes at position and at candidate, which are
+// known to match for MINIMUM_MATCH_LENGTH bytes, not going past matchEndLimit.  Compares 8
+// bytes at a time while it can.
+static inline size_t
+matchLengthAt(const uint8_t * input, size_t position, size_t candidate, size_t matchEndLimit)  {
+    size_t matchLength = MINIMUM_MATCH_LENGTH ;
+    while (position + matchLength + 8 <= matchEndLimit)  {
+        uint64_t difference = read64(input + position + matchLength) ^ read64(input + candidate + matchLength) ;
+        if (difference)  {
+            return matchLength + trailingZeroCount(difference) / 8 ;  // little-endian
+        }
+        matchLength += 8 ;
+    }
+    while ( position + matchLength < matchEndLimit && input[position + matchLength] == input[candidate + matchLength] )  {
+        ++matchLength ;
+    }
+    return matchLength ;
+}
+
+// Compress byteCount bytes into output, which must have room for
+// byteCount + byteCount/255 + 16 bytes, in LZ4's block format.  Greedy, with a hash table
+// of the last place each 4-byte sequence was seen, skipping ahead faster the longer it
+// goes without a match, as LZ4's own fast mode does.  Returns the compressed byte count.
+static size_t
+compressLZ4(const uint8_t * input, size_t byteCount, uint8_t * output)  {
+    uint8_t * outputStart = output ;
+    size_t anchor = 0 ;  // the first byte not yet written
+    if (byteCount > MATCH_START_MARGIN)  {
+        std::vector<uint32_t> lastPositionOfHash((size_t)(1) << HASH_BIT_COUNT, 0) ;
+        const size_t matchStartLimit = byteCount - MATCH_START_MARGIN ;
+        const size_t matchEndLimit = byteCount - LAST_LITERAL_COUNT ;
+        size_t position = 0 ;
+        unsigned missCount = 0 ;
+        while (position <= matchStartLimit)  {
+            uint32_t sequence = read32(input + position) ;
+            uint32_t hash = hashOfSequence(sequence) ;
+            size_t candidate = lastPositionOfHash[hash] ;
+            lastPositionOfHash[hash] = (uint32_t)(position) ;
+            if ( candidate < position && position - candidate <= MAXIMUM_OFFSET && read32(input + candidate) == sequence )  {
+                // Extend the match forward, then backward, into the literals
+                size_t matchLength = matchLengthAt(input, position, candidate, matchEndLimit) ;
+                while ( position > anchor && candidate > 0 && input[position-1] == input[candidate-1] )  {
+                    --position ;
+                    --candidate ;
+                    ++matchLength ;
+                }
+                output = writeSequence(output, input + anchor, position - anchor, position - candidate, matchLength) ;
+                position += matchLength ;
+                anchor = position ;
+                missCount = 0 ;
+                if (position - 2 <= matchStartLimit)  {
+                    lastPositionOfHash[hashOfSequence(read32(input + position - 2))] = (uint32_t)(position - 2) ;
+                }
+            }
+            else  {
+                position += 1 + (missCount++ >> 6) ;
+            }
+        }
+    }
+    output = writeSequence(output, input + anchor, byteCount - anchor, 0, 0) ;
+    return (size_t)(output - outputStart) ;
+}
+
+// Read the rest of a literal or match length whose token part was 15.  Returns false if it
+// runs past the end of the input.
+static inline bool
+readLengthRemainder(const uint8_t * & input, const uint8_t * inputEnd, size_t & length)  {
+    uint8_t byte ;
+    do  {
+        if (input >= inputEnd)  {
+            return false ;
+        }
+        byte = *input++ ;
+        length += byte ;
+    } while (byte == 255) ;
+    return true ;
+}
+
+// Decompress LZ4 block-format input into exactly byteCount bytes of output.  Returns false
+// if the input is corrupt, or doesn't decompress to byteCount bytes.
+static bool
+decompressLZ4(const uint8_t * input, size_t inputByteCount, uint8_t * output, size_t byteCount)  {
+    const uint8_t * inputEnd = input + inputByteCount ;
+    uint8_t * outputStart = output ;
+    uint8_t * outputEnd = output + byteCount ;
+    while (input < inputEnd)  {
+        uint8_t token = *input++ ;
+        size_t literalCount = token >> 4 ;
+        if ( literalCount == 15 && !readLengthRemainder(input, inputEnd, literalCount) )  {
+            return false ;
+        }
+        if ( literalCount > (size_t)(inputEnd - input) || literalCount > (size_t)(outputEnd - output) )  {
+            return false ;
+        }
+        memcpy(output, input, literalCount) ;
+        input += literalCount ;
+        output += literalCount ;
+        if (input == inputEnd)  {
+            break ;  // the last sequence has no match
+        }
+        if (inputEnd - input < 2)  {
+            return false ;
+        }
+        size_t offset = (size_t)(readLittleEndian(input, 2)) ;
+        input += 2 ;
+        size_t matchLength = token & 15 ;
+        if ( matchLength == 15 && !readLengthRemainder(input, inputEnd, matchLength) )  {
+            return false ;
+        }
+        matchLength += MINIMUM_MATCH_LENGTH ;
+        if ( offset == 0 || offset > (size_t)(output - outputStart) || matchLength > (size_t)(outputEnd - output) )  {
+            return false ;
+        }
+        const uint8_t * match = output - offset ;
+        if (offset >= matchLength)  {
+            memcpy(output, match, matchLength) ;
+            output += matchLength ;
+        }
+        else  {
+            // The match overlaps what it's producing, e.g. a run of one byte
+            for (size_t i = 0; i < matchLength; ++i)  {
+                *output++ = *match++ ;
+            }
+        }
+    }
+    return output == outputEnd ;
+}
+
+
+
+//
+// Delta and bitshuffle
+//
+
+// Delta-code, zigzag-code and shuffle elementCount elements of type T (unsigned), in rows
+// of rowLength, from chunk into shuffled: sizeof(T) byte planes of elementCount bytes, one
+// for each byte of the element, low byte first
+template <typename T>
+static void
+deltaAndShuffle(const uint8_t * chunk, size_t elementCount, size_t rowLength, uint8_t * shuffled)  {
+    const int bitCount = 8 * sizeof(T) ;
+    for (size_t rowStart = 0; rowStart < elementCount; rowStart += rowLength)  {
+        size_t rowEnd = std::min(elementCount, rowStart + rowLength) ;
+        T previous = 0 ;
+        for (size_t i = rowStart; i < rowEnd; ++i)  {
+            T element ;
+            memcpy(&element, chunk + i*sizeof(T), sizeof(T)) ;
+            T difference = (T)(element - previous) ;
+            previous = element ;
+            T signMask = (T)(0) - (T)(difference >> (bitCount-1)) ;  // all ones if negative as signed
+            T zigzag = (T)((T)(difference << 1) ^ signMask) ;
+            for (size_t b = 0; b < sizeof(T); ++b)  {
+                shuffled[b*elementCount + i] = (uint8_t)(zigzag >> (8*b)) ;
+            }
+        }
+    }
+}
+
+// Undo deltaAndShuffle()
+template <typename T>
+static void
+unshuffleAndUndelta(const uint8_t * shuffled, size_t elementCount, size_t rowLength, uint8_t * chunk)  {
+    for (size_t rowStart = 0; rowStart < elementCount; rowStart += rowLength)  {
+        size_t rowEnd = std::min(elementCount, rowStart + rowLength) ;
+        T previous = 0 ;
+        for (size_t i = rowStart; i < rowEnd; ++i)  {
+            T zigzag = 0 ;
+            for (size_t b = 0; b < sizeof(T); ++b)  {
+                zigzag |= (T)((T)(shuffled[b*elementCount + i]) << (8*b)) ;
+            }
+            T difference = (T)((T)(zigzag >> 1) ^ (T)((T)(0) - (T)(zigzag & 1))) ;
+            T element = (T)(previous + difference) ;
+            previous = element ;
+            memcpy(chunk + i*sizeof(T), &element, sizeof(T)) ;
+        }
+    }
+}
+
+// Transpose an 8 x 8 matrix of bits, byte i of x (little-endian) being row i.  Its own
+// inverse.
+static inline uint64_t
+transposeBits(uint64_t x)  {
+    uint64_t t ;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL ;
+    x = x ^ t ^ (t << 7) ;
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL ;
+    x = x ^ t ^ (t << 14) ;
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL ;
+    x = x ^ t ^ (t << 28) ;
+    return x ;
+}
+
+// Shuffle the bits of each of planeCount byte planes of planeLength bytes from bytes into
+// bits: each group of 8 bytes is transposed into 8 bytes each holding one bit of all 8,
+// and those are regrouped by bit, all the bit 0s of the plane first.  Bytes past the last
+// whole group are left as they are.
+static void
+shuffleBits(const uint8_t * bytes, size_t planeCount, size_t planeLength, uint8_t * bits)  {
+    const size_t groupCount = planeLength / 8 ;
+    uint8_t tile[8][TILE_GROUP_COUNT] ;  // the bit planes of the groups not yet written
+    for (size_t plane = 0; plane < planeCount; ++plane)  {
+        const uint8_t * planeBytes = bytes + plane*planeLength ;
+        uint8_t * planeBits = bits + plane*planeLength ;
+        for (size_t tileStart = 0; tileStart < groupCount; tileStart += TILE_GROUP_COUNT)  {
+            size_t tileGroupCount = std::min<size_t>(TILE_GROUP_COUNT, groupCount - tileStart) ;
+            size_t group = 0 ;
+#if defined(WS_IS_X64)
+            // SSE2 is always there on x64.  Do two groups at a time, gathering the top bit of
+            // each of their 16 bytes, then shifting the next bit up.
+            for ( ; group+2 <= tileGroupCount; group += 2)  {
+                __m128i groupBytes = _mm_loadu_si128((const __m128i *)(planeBytes + 8*(tileStart + group))) ;
+                for (int bit = 7; bit >= 0; --bit)  {
+                    int topBits = _mm_movemask_epi8(groupBytes) ;
+                    tile[bit][group] = (uint8_t)(topBits) ;
+                    tile[bit][group+1] = (uint8_t)(topBits >> 8) ;
+                    groupBytes = _mm_add_epi8(groupBytes, groupBytes) ;
+                }
+            }
+#endif
+            for ( ; group < tileGroupCount; ++group)  {
+                uint64_t transposed = transposeBits(read64(planeBytes + 8*(tileStart + group))) ;
+                for (size_t bit = 0; bit < 8; ++bit)  {
+                    tile[bit][group] = (uint8_t)(transposed >> (8*bit)) ;
+                }
+            }
+            for (size_t bit = 0; bit < 8; ++bit)  {
+                memcpy(planeBits + bit*groupCount + tileStart, tile[bit], tileGroupCount) ;
+            }
+        }
+        memcpy(planeBits + 8*groupCount, planeBytes + 8*groupCount, planeLength - 8*groupCount) ;
+    }
+}
+
+// Undo shuffleBits()
+static void
+unshuffleBits(const uint8_t * bits, size_t planeCount, size_t planeLength, uint8_t * bytes)  {
+    const size_t groupCount = planeLength / 8 ;
+    uint8_t tile[8][TILE_GROUP_COUNT] ;  // the bit planes of the groups being read
+    for (size_t plane = 0; plane < planeCount; ++plane)  {
+        const uint8_t * planeBits = bits + plane*planeLength ;
+        uint8_t * planeBytes = bytes + plane*planeLength ;
+        for (size_t tileStart = 0; tileStart < groupCount; tileStart += TILE_GROUP_COUNT)  {
+            size_t tileGroupCount = std::min<size_t>(TILE_GROUP_COUNT, groupCount - tileStart) ;
+            for (size_t bit = 0; bit < 8; ++bit)  {
+                memcpy(tile[bit], planeBits + bit*groupCount + tileStart, tileGroupCount) ;
+            }
+            for (size_t group = 0; group < tileGroupCount; ++group)  {
+                uint64_t transposed = 0 ;
+                for (size_t bit = 0; bit < 8; ++bit)  {
+                    transposed |= (uint64_t)(tile[bit][group]) << (8*bit) ;
+                }
+                writeLittleEndian(planeBytes + 8*(tileStart + group), transposeBits(transposed), 8) ;
+            }
+        }
+        memcpy(planeBytes + 8*groupCount, planeBits + 8*groupCount, planeLength - 8*groupCount) ;
+    }
+}
+
+
+
+//
+// Chunks
+//
+
+size_t
+maximumEncodedScanChunkByteCount(size_t byteCount)  {
+    return HEADER_BYTE_COUNT + byteCount + byteCount/255 + 16 ;
+}
+
+
+
+size_t
+encodeScanChunk(const void * chunk, size_t byteCount, size_t elementSize, size_t rowLength, uint8_t * encoded)  {
+    // Delta-code and bitshuffle.  Elements of other sizes are delta-coded as bytes.  Any bytes
+    // past the last whole element are left as they are.
+    const uint8_t * chunkBytes = (const uint8_t *)(chunk) ;
+    if ( elementSize != 2 && elementSize != 4 )  {
+        elementSize = 1 ;
+    }
+    size_t elementCount = byteCount / elementSize ;
+    std::vector<uint8_t> shuffled(byteCount) ;
+    rowLength = std::max<size_t>(1, rowLength) ;
+    if (elementSize == 2)  {
+        deltaAndShuffle<uint16_t>(chunkBytes, elementCount, rowLength, shuffled.data()) ;
+    }
+    else if (elementSize == 4)  {
+        deltaAndShuffle<uint32_t>(chunkBytes, elementCount, rowLength, shuffled.data()) ;
+    }
+    else  {
+        deltaAndShuffle<uint8_t>(chunkBytes, elementCount, rowLength, shuffled.data()) ;
+    }
+    std::vector<uint8_t> bitShuffled(byteCount) ;
+    shuffleBits(shuffled.data(), elementSize, elementCount, bitShuffled.data()) ;
+    memcpy(bitShuffled.data() + elementCount*elementSize, chunkBytes + elementCount*elementSize, byteCount - elementCount*elementSize) ;
+
+    // Compress, unless that doesn't help
+    encoded[0] = FORMAT_VERSION ;
+    encoded[2] = (uint8_t)(elementSize) ;
+    encoded[3] = 0 ;
+    writeLittleEndian(encoded + 4, rowLength, 4) ;
+    writeLittleEndian(encoded + 8, byteCount, 8) ;
+    size_t compressedByteCount = compressLZ4(bitShuffled.data(), byteCount, encoded + HEADER_BYTE_COUNT) ;
+    if (compressedByteCount < byteCount)  {
+        encoded[1] = METHOD_LZ4 ;
+        return HEADER_BYTE_COUNT + compressedByteCount ;
+    }
+    encoded[1] = METHOD_STORED ;
+    memcpy(encoded + HEADER_BYTE_COUNT, bitShuffled.data(), byteCount) ;
+    return HEADER_BYTE_COUNT + byteCount ;
+}
+
+
+
+size_t
+decodedScanChunkByteCount(const uint8_t * encoded, size_t encodedByteCount)  {
+    if ( encodedByteCount < HEADER_BYTE_COUNT || encoded[0] != FORMAT_VERSION )  {
+        return 0 ;
+    }
+    // LZ4 can't compress by more than 255:1, so anything claiming more is corrupt
+    uint64_t byteCount = readLittleEndian(encoded + 8, 8) ;
+    if ( byteCount > 255 * (uint64_t)(encodedByteCount - HEADER_BYTE_COUNT) + 16 )  {
+        return 0 ;
+    }
+    return (size_t)(byteCount) ;
+}
+
+
+
+bool
+decodeScanChunk(const uint8_t * encoded, size_t encodedByteCount, void * chunk, size_t chunkByteCount)  {
+    // Check the header.  encodeScanChunk() only ever writes element sizes of 1, 2 and 4, so
+    // anything else means the chunk is corrupt, or isn't one of ours.
+    size_t byteCount = decodedScanChunkByteCount(encoded, encodedByteCount) ;
+    if ( byteCount == 0 || byteCount != chunkByteCount )  {
+        return false ;
+    }
+    size_t elementSize = encoded[2] ;
+    size_t rowLength = (size_t)(readLittleEndian(encoded + 4, 4)) ;
+    if ( (elementSize != 1 && elementSize != 2 && elementSize != 4) || encoded[3] != 0 || rowLength == 0 )  {
+        return false ;
+    }
+
+    // Decompress
+    const uint8_t * payload = encoded + HEADER_BYTE_COUNT ;
+    size_t payloadByteCount = encodedByteCount - HEADER_BYTE_COUNT ;
+    std::vector<uint8_t> bitShuffled(byteCount) ;
+    if (encoded[1] == METHOD_LZ4)  {
+        if (!decompressLZ4(payload, payloadByteCount, bitShuffled.data(), byteCount))  {
+            return false ;
+        }
+    }
+    else if ( encoded[1] == METHOD_STORED && payloadByteCount == byteCount )  {
+        memcpy(bitShuffled.data(), payload, byteCount) ;
+    }
+    else  {
+        return false ;
+    }
+
+    // Unshuffle and undo the delta-coding
+    uint8_t * chunkBytes = (uint8_t *)(chunk) ;
+    size_t elementCount = byteCount / elementSize ;
+    std::vector<uint8_t> shuffled(elementCount*elementSize) ;
+    unshuffleBits(bitShuffled.data(), elementSize, elementCount, shuffled.data()) ;
+    if (elementSize == 2)  {
+        unshuffleAndUndelta<uint16_t>(shuffled.data(), elementCount, rowLength, chunkBytes) ;
+    }
+    else if (elementSize == 4)  {
+        unshuffleAndUndelta<uint32_t>(shuffled.data(), elementCount, rowLength, chunkBytes) ;
+    }
+    else  {
+        unshuffleAndUndelta<uint8_t>(shuffled.data(), elementCount, rowLength, chunkBytes) ;
+    }
+    memcpy(chunkBytes + elementCount*elementSize, bitShuffled.data() + elementCount*elementSize, byteCount - elementCount*elementSize) ;
+    return true ;
+}
+
+
+
+//
+// The HDF5 filter
+//
+
+// The filter function.  On the way to the file, cd_values are the element size and the
+// row length; on the way back, everything needed is in the encoded chunk's header.
+// Returns the new byte count of *buffer, or zero if that fails.
+static size_t
+scanFilter(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[], size_t byteCount, size_t * bufferByteCount, void ** buffer)  {
+    const uint8_t * input = (const uint8_t *)(*buffer) ;
+    void * output ;
+    size_t outputByteCount ;
+    if (flags & H5Z_FLAG_REVERSE)  {
+        outputByteCount = decodedScanChunkByteCount(input, byteCount) ;
+        output = (outputByteCount > 0) ? allocateFilterBuffer(outputByteCount) : NULL ;
+        if (!output)  {
+            return 0 ;
+        }
+        if (!decodeScanChunk(input, byteCount, output, outputByteCount))  {
+            freeFilterBuffer(output) ;
+            return 0 ;
+        }
+    }
+    else  {
+        if ( cd_nelmts < 2 || cd_values[0] == 0 )  {
+            return 0 ;
+        }
+        output = allocateFilterBuffer(maximumEncodedScanChunkByteCount(byteCount)) ;
+        if (!output)  {
+            return 0 ;
+        }
+        outputByteCount = encodeScanChunk(input, byteCount, cd_values[0], cd_values[1], (uint8_t *)(output)) ;
+    }
+    freeFilterBuffer(*buffer) ;
+    *buffer = output ;
+    *bufferByteCount = outputByteCount ;
+    return outputByteCount ;
+}
+
+static const H5Z_class2_t SCAN_FILTER_CLASS = {
+    H5Z_CLASS_T_VERS,
+    (H5Z_filter_t)(WS_SCAN_FILTER_ID),
+    1,  // encoder present
+    1,  // decoder present
+    WS_SCAN_FILTER_NAME,
+    NULL,  // can_apply
+    NULL,  // set_local
+    (H5Z_func_t)(scanFilter)
+} ;
+
+
+
+herr_t
+registerScanFilter(void)  {
+    if (H5Zfilter_avail(WS_SCAN_FILTER_ID) > 0)  {
+        return 0 ;
+    }
+    return H5Zregister(&SCAN_FILTER_CLASS) ;
+}
+
+
+
+herr_t
+setScanFilter(hid_t createPropertyListID, size_t elementSize, hsize_t chunkScanCount)  {
+    unsigned int cd_values[2] = { (unsigned int)(elementSize), (unsigned int)(chunkScanCount) } ;
+    return H5Pset_filter(createPropertyListID, WS_SCAN_FILTER_ID, H5Z_FLAG_MANDATORY, 2, cd_values) ;
+}
@@ -0,0 +1,42 @@
+// The HDF5 filter WaveSurfer compresses scans datasets with, shared by ws.logger, which
+// writes them, and ws.reader, which reads them.  See scanFilter.cpp.
+
+#ifndef WS_SCAN_FILTER_H
+#define WS_SCAN_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hdf5.h"
+
+// The filter's ID and name, as recorded in the files.  The ID is from the range HDF5 sets
+// aside for filters that aren't registered with the HDF Group.
+#define WS_SCAN_FILTER_ID 310
+#define WS_SCAN_FILTER_NAME "ws.scanFilter (delta, bitshuffle, LZ4)"
+
+// Register the filter with the HDF5 library, so that datasets using it can be written and
+// read.  Safe to call more than once.  Returns a negative value if that fails.
+herr_t registerScanFilter(void) ;
+
+// Add the filter to a dataset creation property list.  The dataset's elements are
+// elementSize bytes, and it must be chunked, channelCount x chunkScanCount to HDF5, so
+// that each row of a chunk is chunkScanCount scans of one channel.  Returns a negative
+// value if that fails.
+herr_t setScanFilter(hid_t createPropertyListID, size_t elementSize, hsize_t chunkScanCount) ;
+
+// The most bytes encodeScanChunk() can produce from byteCount bytes
+size_t maximumEncodedScanChunkByteCount(size_t byteCount) ;
+
+// Encode a chunk of byteCount bytes, rows of rowLength elements of elementSize bytes, into
+// encoded, which must have room for maximumEncodedScanChunkByteCount(byteCount) bytes.
+// Returns the number of bytes encoded.
+size_t encodeScanChunk(const void * chunk, size_t byteCount, size_t elementSize, size_t rowLength, uint8_t * encoded) ;
+
+// The number of bytes the encoded chunk decodes to, or zero if it isn't a valid encoded
+// chunk
+size_t decodedScanChunkByteCount(const uint8_t * encoded, size_t encodedByteCount) ;
+
+// Decode an encoded chunk into chunk, which has room for chunkByteCount bytes.  Returns
+// false if the encoded chunk is corrupt, or doesn't decode to exactly chunkByteCount bytes.
+bool decodeScanChunk(const uint8_t * encoded, size_t encodedByteCount, void * chunk, size_t chunkByteCount) ;
+
+#endif
@@ -0,0 +1,229 @@
+// A stand-in for NI's NIDAQmx.h, declaring the subset of the DAQmx C API that ws.ni uses.  
+// The functions are implemented by simulatedDAQmx.cpp, which simulates NI devices in 
+// software.  To build ws.ni against the simulation instead of the real driver, put this 
+// directory on the include path in place of the NI one, and compile and link 
+// simulatedDAQmx.cpp instead of linking NIDAQmx.lib.
+//
+// The types, constant values, and function signatures are the same as in the real 
+// header, so code that compiles against this should compile against the real thing, 
+// and vice-versa.  See simulatedDAQmx.h for the functions that control the simulation.
+
+#ifndef ___nidaqmx_h___
+#define ___nidaqmx_h___
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+#if defined(_MSC_VER)
+#define CVICALLBACK __cdecl
+#else
+#define CVICALLBACK
+#endif
+
+typedef signed char        int8 ;
+typedef unsigned char      uInt8 ;
+typedef signed short       int16 ;
+typedef unsigned short     uInt16 ;
+typedef signed int         int32 ;
+typedef unsigned int       uInt32 ;
+typedef float              float32 ;
+typedef double             float64 ;
+#if defined(_MSC_VER)
+typedef __int64            int64 ;
+typedef unsigned __int64   uInt64 ;
+#else
+typedef long long          int64 ;
+typedef unsigned long long uInt64 ;
+#endif
+typedef uInt32             bool32 ;
+typedef void *             TaskHandle ;
+
+typedef int32 (CVICALLBACK *DAQmxEveryNSamplesEventCallbackPtr)(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData) ;
+typedef int32 (CVICALLBACK *DAQmxDoneEventCallbackPtr)(TaskHandle taskHandle, int32 status, void *callbackData) ;
+
+// Values
+#define DAQmx_Val_Cfg_Default                     -1
+#define DAQmx_Val_Auto                            -1
+#define DAQmx_Val_WaitInfinitely                  -1.0
+
+#define DAQmx_Val_Task_Start                      0
+#define DAQmx_Val_Task_Stop                       1
+#define DAQmx_Val_Task_Verify                     2
+#define DAQmx_Val_Task_Commit                     3
+#define DAQmx_Val_Task_Reserve                    4
+#define DAQmx_Val_Task_Unreserve                  5
+#define DAQmx_Val_Task_Abort                      6
+
+#define DAQmx_Val_SynchronousEventCallbacks       (1<<0)
+
+#define DAQmx_Val_Acquired_Into_Buffer            1
+#define DAQmx_Val_Transferred_From_Buffer         2
+
+#define DAQmx_Val_GroupByChannel                  0
+#define DAQmx_Val_GroupByScanNumber               1
+
+#define DAQmx_Val_ChanPerLine                     0
+#define DAQmx_Val_ChanForAllLines                 1
+
+#define DAQmx_Val_FiniteSamps                     10178
+#define DAQmx_Val_ContSamps                       10123
+#define DAQmx_Val_HWTimedSinglePoint              12522
+
+#define DAQmx_Val_SampClk                         10388
+#define DAQmx_Val_Implicit                        10451
+#define DAQmx_Val_OnDemand                        10390
+
+#define DAQmx_Val_Rising                          10280
+#define DAQmx_Val_Falling                         10171
+
+#define DAQmx_Val_RSE                             10083
+#define DAQmx_Val_NRSE                            10078
+#define DAQmx_Val_Diff                            10106
+#define DAQmx_Val_PseudoDiff                      12529
+
+#define DAQmx_Val_Volts                           10348
+#define DAQmx_Val_Hz                              10373
+
+#define DAQmx_Val_High                            10192
+#define DAQmx_Val_Low                             10214
+
+#define DAQmx_Val_CounterOutputEvent              12494
+
+#define DAQmx_Val_AllowRegen                      10097
+#define DAQmx_Val_DoNotAllowRegen                 10158
+
+#define DAQmx_Val_CurrWritePos                    10430
+#define DAQmx_Val_FirstSample                     10424
+
+#define DAQmx_Val_PCI                             12582
+#define DAQmx_Val_PCIe                            13612
+#define DAQmx_Val_PXI                             12583
+#define DAQmx_Val_PXIe                            14706
+#define DAQmx_Val_SCXI                            12584
+#define DAQmx_Val_SCC                             14707
+#define DAQmx_Val_PCCard                          12589
+#define DAQmx_Val_USB                             12586
+#define DAQmx_Val_CompactDAQ                      14637
+#define DAQmx_Val_CompactRIO                      16143
+#define DAQmx_Val_TCPIP                           14828
+#define DAQmx_Val_SwitchBlock                     15870
+#define DAQmx_Val_Unknown                         12588
+
+// Error codes.  Only the ones the simulation can return.
+#define DAQmxSuccess                                      0
+#define DAQmxFailed(error)                                ((error)<0)
+#define DAQmxErrorInvalidAttributeValue                   (-200077)
+#define DAQmxErrorInvalidTask                             (-200088)
+#define DAQmxErrorDuplicateTask                           (-200089)
+#define DAQmxErrorPhysicalChanDoesNotExist                (-200170)
+#define DAQmxErrorInvalidDeviceID                         (-200220)
+#define DAQmxErrorBufferTooSmallForString                 (-200228)
+#define DAQmxErrorReadBufferTooSmall                      (-200229)
+#define DAQmxErrorSamplesWillNeverBeAvailable             (-200278)
+#define DAQmxErrorSamplesNoLongerAvailable                (-200279)
+#define DAQmxErrorSamplesNotYetAvailable                  (-200284)
+#define DAQmxErrorGenStoppedToPreventRegenOfOldSamples    (-200290)
+#define DAQmxErrorSamplesCanNotYetBeWritten               (-200292)
+#define DAQmxErrorAttributeNotSupportedInTaskContext      (-200452)
+#define DAQmxErrorNoDataInBuffer                          (-200462)
+#define DAQmxErrorNoChansInTask                           (-200478)
+#define DAQmxErrorOpNotAllowedWhileTaskRunning            (-200479)
+#define DAQmxErrorWaitUntilDoneDoesNotIndicateDone        (-200560)
+#define DAQmxErrorEveryNSampsEventAlreadyRegistered       (-200960)
+
+// Task configuration and control
+int32 DAQmxCreateTask(const char taskName[], TaskHandle *taskHandle) ;
+int32 DAQmxStartTask(TaskHandle taskHandle) ;
+int32 DAQmxStopTask(TaskHandle taskHandle) ;
+int32 DAQmxClearTask(TaskHandle taskHandle) ;
+int32 DAQmxTaskControl(TaskHandle taskHandle, int32 action) ;
+int32 DAQmxIsTaskDone(TaskHandle taskHandle, bool32 *isTaskDone) ;
+int32 DAQmxWaitUntilTaskDone(TaskHandle taskHandle, float64 timeToWait) ;
+int32 DAQmxGetTaskChannels(TaskHandle taskHandle, char *data, uInt32 bufferSize) ;
+
+// Events
+int32 DAQmxRegisterEveryNSamplesEvent(TaskHandle task, int32 everyNsamplesEventType, uInt32 nSamples, uInt32 options, DAQmxEveryNSamplesEventCallbackPtr callbackFunction, void *callbackData) ;
+int32 DAQmxRegisterDoneEvent(TaskHandle task, uInt32 options, DAQmxDoneEventCallbackPtr callbackFunction, void *callbackData) ;
+
+// Channels
+int32 DAQmxCreateAIVoltageChan(TaskHandle taskHandle, const char physicalChannel[], const char nameToAssignToChannel[], int32 terminalConfig, float64 minVal, float64 maxVal, int32 units, const char customScaleName[]) ;
+int32 DAQmxCreateAOVoltageChan(TaskHandle taskHandle, const char physicalChannel[], const char nameToAssignToChannel[], float64 minVal, float64 maxVal, int32 units, const char customScaleName[]) ;
+int32 DAQmxCreateDIChan(TaskHandle taskHandle, const char lines[], const char nameToAssignToLines[], int32 lineGrouping) ;
+int32 DAQmxCreateDOChan(TaskHandle taskHandle, const char lines[], const char nameToAssignToLines[], int32 lineGrouping) ;
+int32 DAQmxCreateCOPulseChanFreq(TaskHandle taskHandle, const char counter[], const char nameToAssignToChannel[], int32 units, int32 idleState, float64 initialDelay, float64 freq, float64 dutyCycle) ;
+
+// Timing and triggering
+int32 DAQmxCfgSampClkTiming(TaskHandle taskHandle, const char source[], float64 rate, int32 activeEdge, int32 sampleMode, uInt64 sampsPerChan) ;
+int32 DAQmxCfgImplicitTiming(TaskHandle taskHandle, int32 sampleMode, uInt64 sampsPerChan) ;
+int32 DAQmxCfgDigEdgeStartTrig(TaskHandle taskHandle, const char triggerSource[], int32 triggerEdge) ;
+int32 DAQmxDisableStartTrig(TaskHandle taskHandle) ;
+int32 DAQmxExportSignal(TaskHandle taskHandle, int32 signalID, const char outputTerminal[]) ;
+
+// Buffers
+int32 DAQmxCfgInputBuffer(TaskHandle taskHandle, uInt32 numSampsPerChan) ;
+int32 DAQmxCfgOutputBuffer(TaskHandle taskHandle, uInt32 numSampsPerChan) ;
+
+// Reading
+int32 DAQmxReadAnalogF64(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout, bool32 fillMode, float64 readArray[], uInt32 arraySizeInSamps, int32 *sampsPerChanRead, bool32 *reserved) ;
+int32 DAQmxReadBinaryI16(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout, bool32 fillMode, int16 readArray[], uInt32 arraySizeInSamps, int32 *sampsPerChanRead, bool32 *reserved) ;
+int32 DAQmxReadDigitalU32(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout, bool32 fillMode, uInt32 readArray[], uInt32 arraySizeInSamps, int32 *sampsPerChanRead, bool32 *reserved) ;
+int32 DAQmxReadDigitalLines(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout, bool32 fillMode, uInt8 readArray[], uInt32 arraySizeInBytes, int32 *sampsPerChanRead, int32 *numBytesPerSamp, bool32 *reserved) ;
+
+// Writing
+int32 DAQmxWriteAnalogF64(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart, float64 timeout, bool32 dataLayout, const float64 writeArray[], int32 *sampsPerChanWritten, bool32 *reserved) ;
+int32 DAQmxWriteBinaryI16(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart, float64 timeout, bool32 dataLayout, const int16 writeArray[], int32 *sampsPerChanWritten, bool32 *reserved) ;
+int32 DAQmxWriteDigitalU32(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart, float64 timeout, bool32 dataLayout, const uInt32 writeArray[], int32 *sampsPerChanWritten, bool32 *reserved) ;
+int32 DAQmxWriteDigitalLines(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart, float64 timeout, bool32 dataLayout, const uInt8 writeArray[], int32 *sampsPerChanWritten, bool32 *reserved) ;
+int32 DAQmxWriteCtrFreqScalar(TaskHandle taskHandle, bool32 autoStart, float64 timeout, float64 frequency, float64 dutyCycle, bool32 *reserved) ;
+
+// Errors
+int32 DAQmxGetErrorString(int32 errorCode, char errorString[], uInt32 bufferSize) ;
+
+// System and device properties
+int32 DAQmxGetSysDevNames(char *data, uInt32 bufferSize) ;
+int32 DAQmxGetDevAIPhysicalChans(const char device[], char *data, uInt32 bufferSize) ;
+int32 DAQmxGetDevAOPhysicalChans(const char device[], char *data, uInt32 bufferSize) ;
+int32 DAQmxGetDevDILines(const char device[], char *data, uInt32 bufferSize) ;
+int32 DAQmxGetDevCOPhysicalChans(const char device[], char *data, uInt32 bufferSize) ;
+int32 DAQmxGetDevBusType(const char device[], int32 *data) ;
+
+// Channel properties
+int32 DAQmxGetAIDevScalingCoeff(TaskHandle taskHandle, const char channel[], float64 *data, uInt32 arraySizeInElements) ;
+int32 DAQmxGetAODevScalingCoeff(TaskHandle taskHandle, const char channel[], float64 *data, uInt32 arraySizeInElements) ;
+int32 DAQmxSetCOPulseFreq(TaskHandle taskHandle, const char channel[], float64 data) ;
+int32 DAQmxSetCOPulseDutyCyc(TaskHandle taskHandle, const char channel[], float64 data) ;
+
+// Timing properties
+int32 DAQmxGetSampClkRate(TaskHandle taskHandle, float64 *data) ;
+int32 DAQmxGetSampTimingType(TaskHandle taskHandle, int32 *data) ;
+int32 DAQmxGetSampQuantSampMode(TaskHandle taskHandle, int32 *data) ;
+int32 DAQmxGetSampQuantSampPerChan(TaskHandle taskHandle, uInt64 *data) ;
+int32 DAQmxSetSampQuantSampPerChan(TaskHandle taskHandle, uInt64 data) ;
+int32 DAQmxGetRefClkSrc(TaskHandle taskHandle, char *data, uInt32 bufferSize) ;
+int32 DAQmxSetRefClkSrc(TaskHandle taskHandle, const char *data) ;
+int32 DAQmxGetRefClkRate(TaskHandle taskHandle, float64 *data) ;
+int32 DAQmxSetRefClkRate(TaskHandle taskHandle, float64 data) ;
+
+// Buffer properties
+int32 DAQmxGetBufOutputBufSize(TaskHandle taskHandle, uInt32 *data) ;
+
+// Read properties
+int32 DAQmxGetReadAvailSampPerChan(TaskHandle taskHandle, uInt32 *data) ;
+int32 DAQmxGetReadNumChans(TaskHandle taskHandle, uInt32 *data) ;
+int32 DAQmxGetReadCurrReadPos(TaskHandle taskHandle, uInt64 *data) ;
+int32 DAQmxGetReadTotalSampPerChanAcquired(TaskHandle taskHandle, uInt64 *data) ;
+
+// Write properties
+int32 DAQmxGetWriteNumChans(TaskHandle taskHandle, uInt32 *data) ;
+int32 DAQmxGetWriteSpaceAvail(TaskHandle taskHandle, uInt32 *data) ;
+int32 DAQmxGetWriteRegenMode(TaskHandle taskHandle, int32 *data) ;
+int32 DAQmxSetWriteRegenMode(TaskHandle taskHandle, int32 data) ;
+int32 DAQmxResetWriteRelativeTo(TaskHandle taskHandle) ;
+int32 DAQmxResetWriteOffset(TaskHandle taskHandle) ;
+
+#ifdef __cplusplus
+    }
+#endif
+
+#endif // ___nidaqmx_h___
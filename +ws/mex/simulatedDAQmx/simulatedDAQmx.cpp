@@ -0,0 +1,2145 @@
+// A simulated implementation of the subset of the NI DAQmx C API declared in the
+// NIDAQmx.h in this directory, so that ws.ni can be built, exercised, and benchmarked
+// on a machine with no NI hardware or drivers.  See simulatedDAQmx.h for a description
+// of the simulated devices, and for the functions that control the simulation.
+//
+// All the simulation state is protected by a single mutex.  Callbacks are always called
+// with the mutex unlocked, since they generally call back into DAQmx.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "simulatedDAQmx.h"
+
+
+
+// Everything up to the API itself is internal to this file
+namespace  {
+
+
+
+//
+// Simulated devices
+//
+
+const int SIMULATED_DEVICE_COUNT = 2 ;
+const uInt32 AI_CHANNEL_COUNT_PER_DEVICE = 32 ;
+const uInt32 AO_CHANNEL_COUNT_PER_DEVICE = 4 ;
+const uInt32 DIO_LINE_COUNT_PER_DEVICE = 32 ;  // all on port0
+const uInt32 PFI_LINE_COUNT_PER_DEVICE = 16 ;
+const uInt32 COUNTER_COUNT_PER_DEVICE = 4 ;
+
+// The AI and AO converters are 16-bit, with a range of +-10 V
+const float64 VOLTS_PER_COUNT = 20.0/65536.0 ;
+
+// AI channel k reads SINE_TABLE[(k+1)*sampleIndex mod SINE_TABLE_LENGTH]
+const uInt32 SINE_TABLE_LENGTH = 4096 ;
+const float64 SINE_AMPLITUDE_IN_COUNTS = 16384.0 ;
+
+// Added to a sample count computed from a time, so that a count computed from the
+// time at which that count is reached is not one short due to rounding
+const float64 SAMPLE_COUNT_FUDGE = 1e-6 ;
+
+std::string
+simulatedDeviceName(int deviceIndex)  {
+    char buffer[32] ;
+    sprintf(buffer, "Dev%d", deviceIndex+1) ;
+    return std::string(buffer) ;
+}
+
+// Returns -1 if not a simulated device
+int
+simulatedDeviceIndexFromName(const std::string & deviceName)  {
+    for (int deviceIndex = 0; deviceIndex < SIMULATED_DEVICE_COUNT; ++deviceIndex)  {
+        if (deviceName == simulatedDeviceName(deviceIndex))  {
+            return deviceIndex ;
+        }
+    }
+    return -1 ;
+}
+
+
+
+//
+// Simulated tasks
+//
+
+enum SimulatedChannelType { AI_CHANNEL, AO_CHANNEL, DI_CHANNEL, DO_CHANNEL, CO_CHANNEL } ;
+
+struct SimulatedChannel  {
+    SimulatedChannelType type ;
+    std::string name ;
+    int deviceIndex ;
+    uInt32 physicalIndex ;  // AI, AO, CO: the channel index on the device
+    bool isPFI ;  // DI, DO: true if the lines are PFI lines, false if port0 lines
+    uInt32 lineMask ;  // DI, DO: the lines in the channel
+    float64 frequency ;  // CO only
+    float64 dutyCycle ;  // CO only
+} ;
+
+struct EveryNSamplesEventRegistration  {
+    bool isRegistered ;
+    int32 eventType ;
+    uInt32 nSamples ;
+    uInt32 options ;
+    DAQmxEveryNSamplesEventCallbackPtr callbackFunction ;
+    void * callbackData ;
+    std::thread::id registeringThreadID ;
+    uInt64 eventCountDelivered ;
+} ;
+
+struct DoneEventRegistration  {
+    bool isRegistered ;
+    uInt32 options ;
+    DAQmxDoneEventCallbackPtr callbackFunction ;
+    void * callbackData ;
+    std::thread::id registeringThreadID ;
+    bool wasDelivered ;
+} ;
+
+struct SimulatedTask  {
+    TaskHandle taskHandle ;
+    std::string name ;
+    std::vector<SimulatedChannel> channels ;
+
+    // Timing
+    int32 timingType ;  // DAQmx_Val_OnDemand, DAQmx_Val_SampClk, or DAQmx_Val_Implicit
+    float64 sampleRate ;
+    int32 sampleMode ;
+    uInt64 sampsPerChan ;
+    std::string startTriggerSource ;  // empty if no start trigger
+    std::string refClkSrc ;
+    float64 refClkRate ;
+
+    // Buffers
+    uInt32 inputBufferSizeIfSet ;  // zero means use the default
+    uInt32 outputBufferSizeIfSet ;  // zero means set by the first write
+    uInt32 outputBufferScanCount ;
+    std::vector<float64> analogOutputBuffer ;  // scan-major
+    std::vector<uInt32> digitalOutputBuffer ;  // scan-major
+    uInt64 writePosition ;  // scans written to the output buffer since it was allocated, or the task was started
+    int32 regenMode ;
+
+    // Run state.  While running, the sample count is countAtLastRateChange plus the
+    // sample rate times the time since timeOfLastRateChange.
+    bool isRunning ;
+    int32 errorStatus ;  // if nonzero, an error that stopped the acquisition or generation
+    float64 timeOfLastRateChange ;
+    uInt64 countAtLastRateChange ;
+    uInt64 countWhenStopped ;
+    uInt64 readPosition ;
+
+    // Events
+    EveryNSamplesEventRegistration everyNSamples ;
+    DoneEventRegistration done ;
+} ;
+
+struct PendingEvent  {
+    bool isDoneEvent ;
+    TaskHandle taskHandle ;
+    int32 eventTypeOrStatus ;
+    uInt32 nSamples ;
+    DAQmxEveryNSamplesEventCallbackPtr everyNSamplesCallback ;
+    DAQmxDoneEventCallbackPtr doneCallback ;
+    void * callbackData ;
+} ;
+
+
+
+//
+// Global state
+//
+
+struct SimulationState  {
+    std::mutex mutex ;
+    std::condition_variable stateChanged ;  // notified whenever the simulated clock jumps, or a task changes state
+
+    // The simulated clock
+    float64 timeScale ;
+    std::chrono::steady_clock::time_point wallTimeAtLastRebase ;
+    float64 simulatedTimeAtLastRebase ;
+
+    // Tasks, in order of creation
+    std::vector<SimulatedTask *> tasks ;
+    uInt64 nextTaskID ;
+    uInt64 nextUnnamedTaskIndex ;
+
+    // Output state of the on-demand outputs, for each device
+    std::vector<uInt32> port0StatePerDevice ;
+    std::vector<uInt32> pfiStatePerDevice ;
+    float64 timeOfLastOutputStateChange ;  // simulated time, or -1.0 if none yet
+
+    // The thread that delivers callbacks not registered with DAQmx_Val_SynchronousEventCallbacks.
+    // It exits when there are no such registrations, and is restarted as needed.
+    std::mutex eventThreadMutex ;  // protects eventThread, never locked while mutex is
+    std::thread eventThread ;
+    std::atomic<bool> hasEventThreadExited ;
+    bool shouldEventThreadExit ;  // protected by mutex
+
+    std::vector<int16> sineTable ;
+
+    SimulationState() :
+        timeScale(1.0),
+        wallTimeAtLastRebase(std::chrono::steady_clock::now()),
+        simulatedTimeAtLastRebase(0.0),
+        nextTaskID(1),
+        nextUnnamedTaskIndex(0),
+        port0StatePerDevice(SIMULATED_DEVICE_COUNT, 0),
+        pfiStatePerDevice(SIMULATED_DEVICE_COUNT, 0),
+        timeOfLastOutputStateChange(-1.0),
+        hasEventThreadExited(true),
+        shouldEventThreadExit(false),
+        sineTable(SINE_TABLE_LENGTH)  {
+        const char * timeScaleAsString = getenv("WS_SIMULATED_DAQMX_TIME_SCALE") ;
+        if (timeScaleAsString)  {
+            float64 timeScaleFromEnvironment = atof(timeScaleAsString) ;
+            if (timeScaleFromEnvironment >= 0)  {
+                timeScale = timeScaleFromEnvironment ;
+            }
+        }
+        const float64 pi = 3.14159265358979323846 ;
+        for (uInt32 i = 0; i < SINE_TABLE_LENGTH; ++i)  {
+            sineTable[i] = (int16)(floor(SINE_AMPLITUDE_IN_COUNTS*sin(2*pi*i/SINE_TABLE_LENGTH) + 0.5)) ;
+        }
+    }
+
+    ~SimulationState()  {
+        // Stop the event thread, if it's running
+        {
+            std::lock_guard<std::mutex> lock(mutex) ;
+            shouldEventThreadExit = true ;
+        }
+        stateChanged.notify_all() ;
+        if (eventThread.joinable())  {
+            eventThread.join() ;
+        }
+        for (size_t i = 0; i < tasks.size(); ++i)  {
+            delete tasks[i] ;
+        }
+    }
+} ;
+
+SimulationState &
+theState()  {
+    static SimulationState state ;
+    return state ;
+}
+
+
+
+//
+// The simulated clock.  All these assume the caller holds the mutex.
+//
+
+float64
+simulatedNow(SimulationState & state)  {
+    if (state.timeScale <= 0)  {
+        return state.simulatedTimeAtLastRebase ;
+    }
+    std::chrono::duration<double> wallTimeSinceRebase = std::chrono::steady_clock::now() - state.wallTimeAtLastRebase ;
+    return state.simulatedTimeAtLastRebase + state.timeScale*wallTimeSinceRebase.count() ;
+}
+
+// Wait until the simulated time is targetTime, or until the simulation state changes, whichever
+// comes first.  When the time scale is zero, this just advances the simulated clock to
+// targetTime.  Caller should check the state again after this returns.
+void
+waitForSimulatedTime(SimulationState & state, std::unique_lock<std::mutex> & lock, float64 targetTime)  {
+    if (state.timeScale <= 0)  {
+        if (targetTime > state.simulatedTimeAtLastRebase && targetTime < std::numeric_limits<float64>::infinity())  {
+            state.simulatedTimeAtLastRebase = targetTime ;
+            state.stateChanged.notify_all() ;
+        }
+        else if ( !(targetTime < std::numeric_limits<float64>::infinity()) )  {
+            // Waiting for a time that will never come, so wait for something to change
+            state.stateChanged.wait(lock) ;
+        }
+        return ;
+    }
+    if ( !(targetTime < std::numeric_limits<float64>::infinity()) )  {
+        state.stateChanged.wait(lock) ;
+        return ;
+    }
+    float64 wallTimeToWait = (targetTime - simulatedNow(state))/state.timeScale ;
+    if (wallTimeToWait > 0)  {
+        state.stateChanged.wait_for(lock, std::chrono::duration<double>(wallTimeToWait)) ;
+    }
+}
+
+// The simulated time at which a wait with the given timeout should give up.  A negative
+// timeout means wait forever.
+float64
+deadlineFromTimeout(SimulationState & state, float64 timeout)  {
+    if (timeout < 0)  {
+        return std::numeric_limits<float64>::infinity() ;
+    }
+    return simulatedNow(state) + timeout ;
+}
+
+
+
+//
+// Task helpers.  All these assume the caller holds the mutex.
+//
+
+SimulatedTask *
+findTask(SimulationState & state, TaskHandle taskHandle)  {
+    for (size_t i = 0; i < state.tasks.size(); ++i)  {
+        if (state.tasks[i]->taskHandle == taskHandle)  {
+            return state.tasks[i] ;
+        }
+    }
+    return NULL ;
+}
+
+bool
+isInputTask(const SimulatedTask & task)  {
+    return !task.channels.empty() && (task.channels[0].type == AI_CHANNEL || task.channels[0].type == DI_CHANNEL) ;
+}
+
+bool
+isOutputTask(const SimulatedTask & task)  {
+    return !task.channels.empty() && (task.channels[0].type == AO_CHANNEL || task.channels[0].type == DO_CHANNEL) ;
+}
+
+bool
+isFinite(const SimulatedTask & task)  {
+    return task.timingType != DAQmx_Val_OnDemand && task.sampleMode == DAQmx_Val_FiniteSamps ;
+}
+
+// The number of samples acquired or generated since the task was started, at simulated time now.
+// For a CO task, the number of pulses generated.
+uInt64
+sampleCountAt(const SimulatedTask & task, float64 now)  {
+    if (!task.isRunning || task.errorStatus != 0)  {
+        return task.countWhenStopped ;
+    }
+    if (task.timingType == DAQmx_Val_OnDemand)  {
+        return 0 ;
+    }
+    float64 timeSinceRateChange = now - task.timeOfLastRateChange ;
+    uInt64 count = task.countAtLastRateChange ;
+    if (timeSinceRateChange > 0)  {
+        count += (uInt64)(floor(timeSinceRateChange*task.sampleRate + SAMPLE_COUNT_FUDGE)) ;
+    }
+    if (isFinite(task))  {
+        count = std::min(count, task.sampsPerChan) ;
+    }
+    return count ;
+}
+
+// The simulated time at which the sample count reaches count, for a running task
+float64
+timeOfSampleCount(const SimulatedTask & task, uInt64 count)  {
+    if (task.timingType == DAQmx_Val_OnDemand || task.sampleRate <= 0)  {
+        return std::numeric_limits<float64>::infinity() ;
+    }
+    if (count <= task.countAtLastRateChange)  {
+        return task.timeOfLastRateChange ;
+    }
+    return task.timeOfLastRateChange + ((float64)(count - task.countAtLastRateChange))/task.sampleRate ;
+}
+
+// Change the sample rate of a running task, without a discontinuity in the sample count
+void
+changeSampleRate(SimulatedTask & task, float64 now, float64 newRate)  {
+    if (task.isRunning && task.errorStatus == 0)  {
+        task.countAtLastRateChange = sampleCountAt(task, now) ;
+        task.timeOfLastRateChange = now ;
+    }
+    task.sampleRate = newRate ;
+}
+
+uInt32
+inputBufferScanCount(const SimulatedTask & task)  {
+    if (task.inputBufferSizeIfSet > 0)  {
+        return task.inputBufferSizeIfSet ;
+    }
+    // Use the same defaults as the real driver
+    if (task.sampleMode == DAQmx_Val_FiniteSamps)  {
+        return (uInt32)(task.sampsPerChan) ;
+    }
+    uInt32 defaultSize = (task.sampleRate <= 100) ? 1000 : (task.sampleRate <= 10000) ? 10000 : (task.sampleRate <= 1000000) ? 100000 : 1000000 ;
+    return (uInt32)(std::max((uInt64)(defaultSize), task.sampsPerChan)) ;
+}
+
+// Check for underflow of a non-regenerating output, or overflow of an input buffer, and
+// stop the task with an error if so.
+void
+checkForBufferErrors(SimulatedTask & task, float64 now)  {
+    if (!task.isRunning || task.errorStatus != 0 || task.timingType != DAQmx_Val_SampClk)  {
+        return ;
+    }
+    uInt64 count = sampleCountAt(task, now) ;
+    if (isInputTask(task))  {
+        if (count - task.readPosition > inputBufferScanCount(task))  {
+            task.countWhenStopped = count ;
+            task.errorStatus = DAQmxErrorSamplesNoLongerAvailable ;
+        }
+    }
+    else if (isOutputTask(task) && task.regenMode == DAQmx_Val_DoNotAllowRegen)  {
+        if (count > task.writePosition)  {
+            task.countWhenStopped = task.writePosition ;
+            task.errorStatus = DAQmxErrorGenStoppedToPreventRegenOfOldSamples ;
+        }
+    }
+}
+
+bool
+isTaskDoneAt(SimulatedTask & task, float64 now)  {
+    if (!task.isRunning || task.errorStatus != 0)  {
+        return true ;
+    }
+    return isFinite(task) && sampleCountAt(task, now) >= task.sampsPerChan ;
+}
+
+int32
+startTask(SimulationState & state, SimulatedTask & task)  {
+    if (task.channels.empty())  {
+        return DAQmxErrorNoChansInTask ;
+    }
+    if (task.isRunning)  {
+        // Includes a finite task that's done, but hasn't been stopped
+        return DAQmxErrorOpNotAllowedWhileTaskRunning ;
+    }
+    if (isOutputTask(task) && task.timingType == DAQmx_Val_SampClk && task.writePosition == 0)  {
+        return DAQmxErrorNoDataInBuffer ;
+    }
+    float64 now = simulatedNow(state) ;
+    task.isRunning = true ;
+    task.errorStatus = 0 ;
+    task.timeOfLastRateChange = now ;
+    task.countAtLastRateChange = 0 ;
+    task.countWhenStopped = 0 ;
+    task.readPosition = 0 ;
+    task.everyNSamples.eventCountDelivered = 0 ;
+    task.done.wasDelivered = false ;
+    if (task.channels[0].type == CO_CHANNEL)  {
+        task.sampleRate = task.channels[0].frequency ;
+    }
+    state.stateChanged.notify_all() ;
+    return 0 ;
+}
+
+void
+stopTask(SimulationState & state, SimulatedTask & task)  {
+    if (task.isRunning)  {
+        float64 now = simulatedNow(state) ;
+        task.countWhenStopped = sampleCountAt(task, now) ;
+        task.isRunning = false ;
+        task.errorStatus = 0 ;
+        // The next start generates from the start of the buffer
+        if (task.regenMode == DAQmx_Val_AllowRegen)  {
+            task.writePosition = std::min(task.writePosition, (uInt64)(task.outputBufferScanCount)) ;
+        }
+        else  {
+            task.writePosition = 0 ;
+        }
+        state.stateChanged.notify_all() ;
+    }
+}
+
+// Copy a string into a caller-supplied buffer, DAQmx-style.  If the buffer is null or
+// of size zero, returns the size needed, including the terminating null.
+int32
+copyStringToBuffer(const std::string & source, char * buffer, uInt32 bufferSize)  {
+    if ( !buffer || bufferSize == 0 )  {
+        return (int32)(source.size() + 1) ;
+    }
+    size_t nCharsToCopy = std::min(source.size(), (size_t)(bufferSize - 1)) ;
+    memcpy(buffer, source.data(), nCharsToCopy) ;
+    buffer[nCharsToCopy] = '\0' ;
+    return (source.size() + 1 > bufferSize) ? DAQmxErrorBufferTooSmallForString : 0 ;
+}
+
+std::string
+trim(const std::string & s)  {
+    size_t first = s.find_first_not_of(" \t") ;
+    if (first == std::string::npos)  {
+        return std::string() ;
+    }
+    size_t last = s.find_last_not_of(" \t") ;
+    return s.substr(first, last-first+1) ;
+}
+
+std::vector<std::string>
+splitCommaSeparatedList(const std::string & list)  {
+    std::vector<std::string> result ;
+    size_t start = 0 ;
+    while (start <= list.size())  {
+        size_t end = list.find(',', start) ;
+        if (end == std::string::npos)  {
+            end = list.size() ;
+        }
+        std::string item = trim(list.substr(start, end-start)) ;
+        if (!item.empty())  {
+            result.push_back(item) ;
+        }
+        start = end + 1 ;
+    }
+    return result ;
+}
+
+// Parse something like "3" or "0:7" or "7:0" into a list of indices.  Returns false if
+// it can't be parsed, or if any index is >= indexCount.
+bool
+parseIndexRange(const std::string & s, uInt32 indexCount, std::vector<uInt32> & indices)  {
+    if (s.empty())  {
+        return false ;
+    }
+    size_t colonIndex = s.find(':') ;
+    std::string firstAsString = (colonIndex == std::string::npos) ? s : s.substr(0, colonIndex) ;
+    std::string lastAsString = (colonIndex == std::string::npos) ? s : s.substr(colonIndex+1) ;
+    if ( firstAsString.empty() || lastAsString.empty() ||
+         firstAsString.find_first_not_of("0123456789") != std::string::npos ||
+         lastAsString.find_first_not_of("0123456789") != std::string::npos )  {
+        return false ;
+    }
+    uInt32 first = (uInt32)(atoi(firstAsString.c_str())) ;
+    uInt32 last = (uInt32)(atoi(lastAsString.c_str())) ;
+    if (first >= indexCount || last >= indexCount)  {
+        return false ;
+    }
+    if (first <= last)  {
+        for (uInt32 i = first; i <= last; ++i)  {
+            indices.push_back(i) ;
+        }
+    }
+    else  {
+        for (uInt32 i = first+1; i > last; --i)  {
+            indices.push_back(i-1) ;
+        }
+    }
+    return true ;
+}
+
+// Split a physical channel name like "/Dev1/ai0:3" into a device index and the rest
+// ("ai0:3").  Returns DAQmxErrorInvalidDeviceID if the device doesn't exist.
+int32
+splitPhysicalChannelName(const std::string & physicalChannelName, int & deviceIndex, std::string & rest)  {
+    std::string name = (!physicalChannelName.empty() && physicalChannelName[0] == '/') ? physicalChannelName.substr(1) : physicalChannelName ;
+    size_t slashIndex = name.find('/') ;
+    if (slashIndex == std::string::npos)  {
+        return DAQmxErrorPhysicalChanDoesNotExist ;
+    }
+    deviceIndex = simulatedDeviceIndexFromName(name.substr(0, slashIndex)) ;
+    if (deviceIndex < 0)  {
+        return DAQmxErrorInvalidDeviceID ;
+    }
+    rest = name.substr(slashIndex+1) ;
+    return 0 ;
+}
+
+// Add AI, AO, or CO channels for a list like "Dev1/ai0:3, Dev2/ai0"
+int32
+addIndexedChannels(SimulatedTask & task, const std::string & physicalChannelList, SimulatedChannelType type, const std::string & prefix, uInt32 channelCountPerDevice)  {
+    std::vector<SimulatedChannel> newChannels ;
+    std::vector<std::string> items = splitCommaSeparatedList(physicalChannelList) ;
+    if (items.empty())  {
+        return DAQmxErrorPhysicalChanDoesNotExist ;
+    }
+    for (size_t itemIndex = 0; itemIndex < items.size(); ++itemIndex)  {
+        int deviceIndex ;
+        std::string rest ;
+        int32 status = splitPhysicalChannelName(items[itemIndex], deviceIndex, rest) ;
+        if (status < 0)  {
+            return status ;
+        }
+        std::vector<uInt32> indices ;
+        if ( rest.compare(0, prefix.size(), prefix) != 0 || !parseIndexRange(rest.substr(prefix.size()), channelCountPerDevice, indices) )  {
+            return DAQmxErrorPhysicalChanDoesNotExist ;
+        }
+        for (size_t i = 0; i < indices.size(); ++i)  {
+            SimulatedChannel channel = SimulatedChannel() ;
+            channel.type = type ;
+            char nameBuffer[64] ;
+            sprintf(nameBuffer, "%s/%s%u", simulatedDeviceName(deviceIndex).c_str(), prefix.c_str(), indices[i]) ;
+            channel.name = nameBuffer ;
+            channel.deviceIndex = deviceIndex ;
+            channel.physicalIndex = indices[i] ;
+            newChannels.push_back(channel) ;
+        }
+    }
+    task.channels.insert(task.channels.end(), newChannels.begin(), newChannels.end()) ;
+    return 0 ;
+}
+
+// Add DI or DO channels for a list like "Dev1/port0/line0:7, Dev1/pfi3".  As in DAQmx, 
+// DAQmx_Val_ChanForAllLines makes a single channel for the whole list, which here has to 
+// be all port0 lines or all PFI lines of one device.
+int32
+addDigitalChannels(SimulatedTask & task, const std::string & lineList, SimulatedChannelType type, int32 lineGrouping)  {
+    std::vector<SimulatedChannel> newChannels ;
+    SimulatedChannel channelForAllLines = SimulatedChannel() ;
+    std::vector<std::string> items = splitCommaSeparatedList(lineList) ;
+    if (items.empty())  {
+        return DAQmxErrorPhysicalChanDoesNotExist ;
+    }
+    for (size_t itemIndex = 0; itemIndex < items.size(); ++itemIndex)  {
+        int deviceIndex ;
+        std::string rest ;
+        int32 status = splitPhysicalChannelName(items[itemIndex], deviceIndex, rest) ;
+        if (status < 0)  {
+            return status ;
+        }
+        bool isPFI = false ;
+        std::vector<uInt32> lineIndices ;
+        bool isValid ;
+        if (rest == "port0")  {
+            isValid = parseIndexRange("0:31", DIO_LINE_COUNT_PER_DEVICE, lineIndices) ;
+        }
+        else if (rest.compare(0, 10, "port0/line") == 0)  {
+            isValid = parseIndexRange(rest.substr(10), DIO_LINE_COUNT_PER_DEVICE, lineIndices) ;
+        }
+        else if (rest.compare(0, 4, "line") == 0)  {
+            isValid = parseIndexRange(rest.substr(4), DIO_LINE_COUNT_PER_DEVICE, lineIndices) ;
+        }
+        else if (rest.compare(0, 3, "pfi") == 0)  {
+            isPFI = true ;
+            isValid = parseIndexRange(rest.substr(3), PFI_LINE_COUNT_PER_DEVICE, lineIndices) ;
+        }
+        else  {
+            isValid = false ;
+        }
+        if (!isValid)  {
+            return DAQmxErrorPhysicalChanDoesNotExist ;
+        }
+        std::string deviceName = simulatedDeviceName(deviceIndex) ;
+        if (lineGrouping == DAQmx_Val_ChanForAllLines)  {
+            SimulatedChannel & channel = channelForAllLines ;
+            if (itemIndex == 0)  {
+                channel.type = type ;
+                channel.name = deviceName + "/" + rest ;  // named after the first item, for simplicity
+                channel.deviceIndex = deviceIndex ;
+                channel.isPFI = isPFI ;
+            }
+            else if (channel.deviceIndex != deviceIndex || channel.isPFI != isPFI)  {
+                return DAQmxErrorPhysicalChanDoesNotExist ;
+            }
+            for (size_t i = 0; i < lineIndices.size(); ++i)  {
+                channel.lineMask |= ((uInt32)1) << lineIndices[i] ;
+            }
+        }
+        else  {
+            for (size_t i = 0; i < lineIndices.size(); ++i)  {
+                SimulatedChannel channel = SimulatedChannel() ;
+                channel.type = type ;
+                char nameBuffer[64] ;
+                sprintf(nameBuffer, isPFI ? "%s/pfi%u" : "%s/port0/line%u", deviceName.c_str(), lineIndices[i]) ;
+                channel.name = nameBuffer ;
+                channel.deviceIndex = deviceIndex ;
+                channel.isPFI = isPFI ;
+                channel.lineMask = ((uInt32)1) << lineIndices[i] ;
+                newChannels.push_back(channel) ;
+            }
+        }
+    }
+    if (lineGrouping == DAQmx_Val_ChanForAllLines)  {
+        newChannels.push_back(channelForAllLines) ;
+    }
+    task.channels.insert(task.channels.end(), newChannels.begin(), newChannels.end()) ;
+    return 0 ;
+}
+
+int32
+addChannels(SimulationState & state, TaskHandle taskHandle, SimulatedChannelType type, const char * physicalChannelList, int32 lineGrouping)  {
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if ( !task->channels.empty() && task->channels[0].type != type )  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    if (task->isRunning)  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    std::string list(physicalChannelList ? physicalChannelList : "") ;
+    switch (type)  {
+        case AI_CHANNEL:
+            return addIndexedChannels(*task, list, type, "ai", AI_CHANNEL_COUNT_PER_DEVICE) ;
+        case AO_CHANNEL:
+            return addIndexedChannels(*task, list, type, "ao", AO_CHANNEL_COUNT_PER_DEVICE) ;
+        case CO_CHANNEL:
+            return addIndexedChannels(*task, list, type, "ctr", COUNTER_COUNT_PER_DEVICE) ;
+        default:
+            return addDigitalChannels(*task, list, type, lineGrouping) ;
+    }
+}
+
+int
+lineCount(uInt32 lineMask)  {
+    int result = 0 ;
+    for (; lineMask; lineMask &= lineMask-1)  {
+        ++result ;
+    }
+    return result ;
+}
+
+
+
+//
+// Events
+//
+
+bool
+isSynchronous(uInt32 options)  {
+    return (options & DAQmx_Val_SynchronousEventCallbacks) != 0 ;
+}
+
+// Collect the events that are due.  If isForEventThread is true, collects the events for
+// asynchronous registrations, otherwise collects the events for synchronous registrations
+// made by the calling thread.  Marks the collected events as delivered.  Caller holds the
+// mutex.
+std::vector<PendingEvent>
+collectDueEvents(SimulationState & state, bool isForEventThread)  {
+    std::vector<PendingEvent> result ;
+    std::thread::id thisThreadID = std::this_thread::get_id() ;
+    float64 now = simulatedNow(state) ;
+    for (size_t taskIndex = 0; taskIndex < state.tasks.size(); ++taskIndex)  {
+        SimulatedTask & task = *(state.tasks[taskIndex]) ;
+        checkForBufferErrors(task, now) ;
+        EveryNSamplesEventRegistration & everyN = task.everyNSamples ;
+        if ( everyN.isRegistered && task.isRunning &&
+             ( isForEventThread ? !isSynchronous(everyN.options) : (isSynchronous(everyN.options) && everyN.registeringThreadID == thisThreadID) ) )  {
+            uInt64 eventCountDue = sampleCountAt(task, now) / everyN.nSamples ;
+            for (; everyN.eventCountDelivered < eventCountDue; ++everyN.eventCountDelivered)  {
+                PendingEvent event = PendingEvent() ;
+                event.isDoneEvent = false ;
+                event.taskHandle = task.taskHandle ;
+                event.eventTypeOrStatus = everyN.eventType ;
+                event.nSamples = everyN.nSamples ;
+                event.everyNSamplesCallback = everyN.callbackFunction ;
+                event.callbackData = everyN.callbackData ;
+                result.push_back(event) ;
+            }
+        }
+        DoneEventRegistration & done = task.done ;
+        if ( done.isRegistered && task.isRunning && !done.wasDelivered && isTaskDoneAt(task, now) &&
+             ( isForEventThread ? !isSynchronous(done.options) : (isSynchronous(done.options) && done.registeringThreadID == thisThreadID) ) )  {
+            done.wasDelivered = true ;
+            PendingEvent event = PendingEvent() ;
+            event.isDoneEvent = true ;
+            event.taskHandle = task.taskHandle ;
+            event.eventTypeOrStatus = task.errorStatus ;
+            event.doneCallback = done.callbackFunction ;
+            event.callbackData = done.callbackData ;
+            result.push_back(event) ;
+        }
+    }
+    return result ;
+}
+
+// The simulated time of the next event due for an asynchronous registration.  Caller holds the mutex.
+float64
+timeOfNextAsynchronousEvent(SimulationState & state, bool & areThereAnyAsynchronousRegistrations)  {
+    float64 result = std::numeric_limits<float64>::infinity() ;
+    areThereAnyAsynchronousRegistrations = false ;
+    for (size_t taskIndex = 0; taskIndex < state.tasks.size(); ++taskIndex)  {
+        SimulatedTask & task = *(state.tasks[taskIndex]) ;
+        if (task.everyNSamples.isRegistered && !isSynchronous(task.everyNSamples.options))  {
+            areThereAnyAsynchronousRegistrations = true ;
+            if (task.isRunning && task.errorStatus == 0)  {
+                uInt64 countOfNextEvent = (task.everyNSamples.eventCountDelivered+1) * task.everyNSamples.nSamples ;
+                result = std::min(result, timeOfSampleCount(task, countOfNextEvent)) ;
+            }
+        }
+        if (task.done.isRegistered && !isSynchronous(task.done.options))  {
+            areThereAnyAsynchronousRegistrations = true ;
+            if (task.isRunning && task.errorStatus == 0 && isFinite(task) && !task.done.wasDelivered)  {
+                result = std::min(result, timeOfSampleCount(task, task.sampsPerChan)) ;
+            }
+        }
+    }
+    return result ;
+}
+
+void
+deliverEvents(const std::vector<PendingEvent> & events)  {
+    for (size_t i = 0; i < events.size(); ++i)  {
+        const PendingEvent & event = events[i] ;
+        if (event.isDoneEvent)  {
+            event.doneCallback(event.taskHandle, event.eventTypeOrStatus, event.callbackData) ;
+        }
+        else  {
+            event.everyNSamplesCallback(event.taskHandle, event.eventTypeOrStatus, event.nSamples, event.callbackData) ;
+        }
+    }
+}
+
+void
+eventThreadMain()  {
+    SimulationState & state = theState() ;
+    std::unique_lock<std::mutex> lock(state.mutex) ;
+    while (!state.shouldEventThreadExit)  {
+        std::vector<PendingEvent> dueEvents = collectDueEvents(state, true) ;
+        if (!dueEvents.empty())  {
+            lock.unlock() ;
+            deliverEvents(dueEvents) ;
+            lock.lock() ;
+            continue ;
+        }
+        bool areThereAnyAsynchronousRegistrations ;
+        float64 timeOfNextEvent = timeOfNextAsynchronousEvent(state, areThereAnyAsynchronousRegistrations) ;
+        if (!areThereAnyAsynchronousRegistrations)  {
+            break ;
+        }
+        if (state.timeScale <= 0)  {
+            // The clock only moves when someone waits on it, and they notify when it does
+            state.stateChanged.wait(lock) ;
+        }
+        else  {
+            waitForSimulatedTime(state, lock, timeOfNextEvent) ;
+        }
+    }
+    state.hasEventThreadExited = true ;
+}
+
+// Start the event thread if it's not running.  Caller must not hold the mutex.
+void
+ensureEventThreadIsRunning(SimulationState & state)  {
+    std::lock_guard<std::mutex> eventThreadLock(state.eventThreadMutex) ;
+    if (state.eventThread.joinable() && state.hasEventThreadExited)  {
+        state.eventThread.join() ;
+    }
+    if (!state.eventThread.joinable())  {
+        state.hasEventThreadExited = false ;
+        state.eventThread = std::thread(eventThreadMain) ;
+    }
+}
+
+// Deliver any due synchronous events registered by this thread.  Caller must not hold the mutex.
+void
+deliverSynchronousEvents(SimulationState & state)  {
+    std::vector<PendingEvent> dueEvents ;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex) ;
+        dueEvents = collectDueEvents(state, false) ;
+    }
+    deliverEvents(dueEvents) ;
+}
+
+// Every API entry point does this first.  Delivers pending synchronous events, as the
+// driver's message loop would, then locks the simulation state.
+class APICall  {
+public:
+    explicit APICall(SimulationState & state) : state_(state), lock_(state.mutex, std::defer_lock)  {
+        deliverSynchronousEvents(state) ;
+        lock_.lock() ;
+    }
+    std::unique_lock<std::mutex> & lock()  { return lock_ ; }
+private:
+    SimulationState & state_ ;
+    std::unique_lock<std::mutex> lock_ ;
+} ;
+
+
+
+//
+// Reading
+//
+
+// Wait until numSampsPerChan samples are available to read, or the timeout expires, or
+// no more samples can arrive.  Handles DAQmx_Val_Auto.  Sets *numSampsToRead to the number
+// of samples that should be read, and returns zero, or an error code.
+int32
+waitForSamplesToRead(SimulationState & state, std::unique_lock<std::mutex> & lock, TaskHandle taskHandle,
+                     int32 numSampsPerChan, float64 timeout, uInt32 * numSampsToRead)  {
+    *numSampsToRead = 0 ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (!isInputTask(*task))  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    if (task->timingType == DAQmx_Val_OnDemand)  {
+        *numSampsToRead = (numSampsPerChan < 0) ? 1 : (uInt32)(numSampsPerChan) ;
+        return 0 ;
+    }
+    if (!task->isRunning)  {
+        // Reading a task that isn't running starts it, as with the real driver
+        int32 status = startTask(state, *task) ;
+        if (status < 0)  {
+            return status ;
+        }
+    }
+
+    // Figure out how many samples we want
+    uInt64 wantedCount ;  // the sample count we're waiting for
+    if (numSampsPerChan < 0)  {
+        if (isFinite(*task))  {
+            wantedCount = task->sampsPerChan ;
+        }
+        else  {
+            wantedCount = std::max(sampleCountAt(*task, simulatedNow(state)), task->readPosition) ;
+        }
+    }
+    else  {
+        wantedCount = task->readPosition + (uInt64)(numSampsPerChan) ;
+        if (isFinite(*task) && wantedCount > task->sampsPerChan)  {
+            return DAQmxErrorSamplesWillNeverBeAvailable ;
+        }
+    }
+
+    // Wait for them
+    float64 deadline = deadlineFromTimeout(state, timeout) ;
+    for (;;)  {
+        // Have to look the task up again after waiting, since it might have been cleared
+        task = findTask(state, taskHandle) ;
+        if (!task)  {
+            return DAQmxErrorInvalidTask ;
+        }
+        float64 now = simulatedNow(state) ;
+        checkForBufferErrors(*task, now) ;
+        if (task->errorStatus != 0)  {
+            return task->errorStatus ;
+        }
+        uInt64 count = sampleCountAt(*task, now) ;
+        if (count >= wantedCount)  {
+            *numSampsToRead = (uInt32)(wantedCount - task->readPosition) ;
+            return 0 ;
+        }
+        if (!task->isRunning || now >= deadline)  {
+            // Read what's there
+            *numSampsToRead = (uInt32)(count - task->readPosition) ;
+            return task->isRunning ? DAQmxErrorSamplesNotYetAvailable : DAQmxErrorSamplesWillNeverBeAvailable ;
+        }
+        waitForSimulatedTime(state, lock, std::min(timeOfSampleCount(*task, wantedCount), deadline)) ;
+    }
+}
+
+// The simulated value of DI port0 or the PFI lines, at the given sample
+uInt32
+digitalInputWordAt(SimulationState & state, const SimulatedTask & task, const SimulatedChannel & channel, uInt64 sampleIndex)  {
+    if (task.timingType == DAQmx_Val_OnDemand)  {
+        // Read back whatever the on-demand outputs are set to
+        return channel.isPFI ? state.pfiStatePerDevice[channel.deviceIndex] : state.port0StatePerDevice[channel.deviceIndex] ;
+    }
+    return (uInt32)(sampleIndex) ;
+}
+
+int16
+analogInputCountsAt(SimulationState & state, const SimulatedChannel & channel, uInt64 sampleIndex)  {
+    return state.sineTable[ (size_t)( (sampleIndex * (channel.physicalIndex+1)) % SINE_TABLE_LENGTH ) ] ;
+}
+
+// Does the common work of the Read functions.  sampleFunction(channel, sampleIndex, destination)
+// writes the sample for the given channel and sample index to destination, which points to
+// elementsPerSample elements.
+template<typename T, typename SampleFunction>
+int32
+readSamples(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout, bool32 fillMode,
+            T readArray[], uInt32 arraySizeInElements, int32 * sampsPerChanRead,
+            SimulatedChannelType requiredType, uInt32 elementsPerSample, SampleFunction sampleFunction)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    if (sampsPerChanRead)  {
+        *sampsPerChanRead = 0 ;
+    }
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (task->channels.empty() || task->channels[0].type != requiredType)  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    uInt32 numSampsToRead ;
+    int32 waitStatus = waitForSamplesToRead(state, call.lock(), taskHandle, numSampsPerChan, timeout, &numSampsToRead) ;
+    if (waitStatus < 0 && waitStatus != DAQmxErrorSamplesNotYetAvailable && waitStatus != DAQmxErrorSamplesWillNeverBeAvailable)  {
+        return waitStatus ;
+    }
+    task = findTask(state, taskHandle) ;
+    size_t channelCount = task->channels.size() ;
+    // The data is laid out as if all the requested samples had been read
+    uInt32 numSampsPerChanInLayout = (numSampsPerChan < 0) ? numSampsToRead : (uInt32)(numSampsPerChan) ;
+    if ( (uInt64)(numSampsPerChanInLayout) * channelCount * elementsPerSample > (uInt64)(arraySizeInElements) )  {
+        return DAQmxErrorReadBufferTooSmall ;
+    }
+    for (size_t channelIndex = 0; channelIndex < channelCount; ++channelIndex)  {
+        const SimulatedChannel & channel = task->channels[channelIndex] ;
+        for (uInt32 i = 0; i < numSampsToRead; ++i)  {
+            size_t elementIndex = (fillMode == DAQmx_Val_GroupByScanNumber) ?
+                ((size_t)(i)*channelCount + channelIndex)*elementsPerSample :
+                (channelIndex*numSampsPerChanInLayout + i)*elementsPerSample ;
+            sampleFunction(*task, channel, task->readPosition + i, readArray + elementIndex) ;
+        }
+    }
+    if (task->timingType != DAQmx_Val_OnDemand)  {
+        task->readPosition += numSampsToRead ;
+    }
+    if (sampsPerChanRead)  {
+        *sampsPerChanRead = (int32)(numSampsToRead) ;
+    }
+    return waitStatus ;
+}
+
+
+
+//
+// Writing
+//
+
+// Does the common work of the Write functions.  storeFunction(task, channelIndex, source, scanIndexInBuffer)
+// stores the sample at source into the output buffer.  applyFunction(channel, source)
+// applies a sample immediately, for on-demand tasks.
+template<typename T, typename StoreFunction, typename ApplyFunction>
+int32
+writeSamples(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart, float64 timeout, bool32 dataLayout,
+             const T writeArray[], int32 * sampsPerChanWritten, SimulatedChannelType requiredType, uInt32 elementsPerSample,
+             StoreFunction storeFunction, ApplyFunction applyFunction)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    if (sampsPerChanWritten)  {
+        *sampsPerChanWritten = 0 ;
+    }
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (task->channels.empty() || task->channels[0].type != requiredType)  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    if (numSampsPerChan < 0)  {
+        return DAQmxErrorInvalidAttributeValue ;
+    }
+    size_t channelCount = task->channels.size() ;
+    uInt32 numSamps = (uInt32)(numSampsPerChan) ;
+
+    // On-demand tasks just set the outputs
+    if (task->timingType == DAQmx_Val_OnDemand)  {
+        if (numSamps > 0)  {
+            // Only the last sample matters
+            for (size_t channelIndex = 0; channelIndex < channelCount; ++channelIndex)  {
+                size_t elementIndex = (dataLayout == DAQmx_Val_GroupByScanNumber) ?
+                    ((size_t)(numSamps-1)*channelCount + channelIndex)*elementsPerSample :
+                    (channelIndex*numSamps + numSamps-1)*elementsPerSample ;
+                applyFunction(task->channels[channelIndex], writeArray + elementIndex) ;
+            }
+        }
+        if (!task->isRunning && autoStart)  {
+            startTask(state, *task) ;
+        }
+        if (sampsPerChanWritten)  {
+            *sampsPerChanWritten = numSampsPerChan ;
+        }
+        return 0 ;
+    }
+
+    // Allocate the buffer if needed
+    if (task->outputBufferScanCount == 0)  {
+        task->outputBufferScanCount = (task->outputBufferSizeIfSet > 0) ? task->outputBufferSizeIfSet : numSamps ;
+        task->writePosition = 0 ;
+        if (requiredType == AO_CHANNEL)  {
+            task->analogOutputBuffer.assign((size_t)(task->outputBufferScanCount)*channelCount, 0.0) ;
+        }
+        else  {
+            task->digitalOutputBuffer.assign((size_t)(task->outputBufferScanCount)*channelCount, 0) ;
+        }
+    }
+    uInt32 bufferScanCount = task->outputBufferScanCount ;
+    if (bufferScanCount == 0)  {
+        return DAQmxErrorSamplesCanNotYetBeWritten ;
+    }
+
+    // Write the samples, waiting for space if needed
+    int32 status = 0 ;
+    float64 deadline = deadlineFromTimeout(state, timeout) ;
+    uInt32 nScansWritten = 0 ;
+    while (nScansWritten < numSamps)  {
+        task = findTask(state, taskHandle) ;
+        if (!task)  {
+            return DAQmxErrorInvalidTask ;
+        }
+        float64 now = simulatedNow(state) ;
+        checkForBufferErrors(*task, now) ;
+        if (task->errorStatus != 0)  {
+            status = task->errorStatus ;
+            break ;
+        }
+        uInt64 nScansGenerated = sampleCountAt(*task, now) ;
+        uInt64 nScansSpaceAvailable ;
+        if (task->isRunning && task->regenMode == DAQmx_Val_AllowRegen)  {
+            // Just overwrite whatever's there
+            nScansSpaceAvailable = numSamps - nScansWritten ;
+        }
+        else  {
+            uInt64 nScansInBuffer = task->writePosition - std::min(nScansGenerated, task->writePosition) ;
+            nScansSpaceAvailable = (nScansInBuffer < bufferScanCount) ? bufferScanCount - nScansInBuffer : 0 ;
+            if ( !task->isRunning && task->regenMode == DAQmx_Val_AllowRegen )  {
+                // Before starting, can wrap around and overwrite
+                nScansSpaceAvailable = numSamps - nScansWritten ;
+            }
+        }
+        uInt32 nScansThisTime = (uInt32)(std::min((uInt64)(numSamps - nScansWritten), nScansSpaceAvailable)) ;
+        for (uInt32 i = 0; i < nScansThisTime; ++i)  {
+            uInt32 scanIndexInBuffer = (uInt32)((task->writePosition + i) % bufferScanCount) ;
+            for (size_t channelIndex = 0; channelIndex < channelCount; ++channelIndex)  {
+                uInt32 scanIndexInSource = nScansWritten + i ;
+                size_t elementIndex = (dataLayout == DAQmx_Val_GroupByScanNumber) ?
+                    ((size_t)(scanIndexInSource)*channelCount + channelIndex)*elementsPerSample :
+                    (channelIndex*numSamps + scanIndexInSource)*elementsPerSample ;
+                storeFunction(*task, channelIndex, writeArray + elementIndex, scanIndexInBuffer) ;
+            }
+        }
+        task->writePosition += nScansThisTime ;
+        nScansWritten += nScansThisTime ;
+        if (nScansWritten >= numSamps)  {
+            break ;
+        }
+        // Need to wait for the generation to make space
+        if (!task->isRunning || now >= deadline)  {
+            status = DAQmxErrorSamplesCanNotYetBeWritten ;
+            break ;
+        }
+        uInt64 countNeeded = task->writePosition + 1 - bufferScanCount ;
+        waitForSimulatedTime(state, call.lock(), std::min(timeOfSampleCount(*task, countNeeded), deadline)) ;
+    }
+    task = findTask(state, taskHandle) ;
+    if (task && status == 0 && autoStart && !task->isRunning)  {
+        status = startTask(state, *task) ;
+    }
+    if (sampsPerChanWritten)  {
+        *sampsPerChanWritten = (int32)(nScansWritten) ;
+    }
+    return status ;
+}
+
+// Convert the lines of a DO channel, one byte per line, into a port word
+uInt32
+portWordFromLines(const SimulatedChannel & channel, const uInt8 * lines)  {
+    uInt32 result = 0 ;
+    int lineIndexInChannel = 0 ;
+    for (uInt32 lineMask = channel.lineMask; lineMask; lineMask &= lineMask-1)  {
+        uInt32 lowestLine = lineMask & (~lineMask + 1) ;
+        if (lines[lineIndexInChannel])  {
+            result |= lowestLine ;
+        }
+        ++lineIndexInChannel ;
+    }
+    return result ;
+}
+
+void
+setDigitalOutputState(SimulationState & state, const SimulatedChannel & channel, uInt32 portWord)  {
+    uInt32 & outputState = channel.isPFI ? state.pfiStatePerDevice[channel.deviceIndex] : state.port0StatePerDevice[channel.deviceIndex] ;
+    uInt32 newOutputState = (outputState & ~channel.lineMask) | (portWord & channel.lineMask) ;
+    if (newOutputState != outputState)  {
+        outputState = newOutputState ;
+        state.timeOfLastOutputStateChange = simulatedNow(state) ;
+    }
+}
+
+}  // namespace
+
+
+
+//
+// The API
+//
+
+extern "C" {
+
+int32 DAQmxCreateTask(const char taskName[], TaskHandle *taskHandle)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    std::string name(taskName ? taskName : "") ;
+    if (name.empty())  {
+        char nameBuffer[64] ;
+        sprintf(nameBuffer, "_unnamedTask<%llu>", (unsigned long long)(state.nextUnnamedTaskIndex++)) ;
+        name = nameBuffer ;
+    }
+    for (size_t i = 0; i < state.tasks.size(); ++i)  {
+        if (state.tasks[i]->name == name)  {
+            return DAQmxErrorDuplicateTask ;
+        }
+    }
+    SimulatedTask * task = new SimulatedTask() ;
+    task->taskHandle = (TaskHandle)(size_t)(state.nextTaskID++) ;
+    task->name = name ;
+    task->timingType = DAQmx_Val_OnDemand ;
+    task->sampleMode = DAQmx_Val_FiniteSamps ;
+    task->regenMode = DAQmx_Val_AllowRegen ;
+    task->refClkSrc = "" ;
+    task->refClkRate = 10e6 ;
+    state.tasks.push_back(task) ;
+    *taskHandle = task->taskHandle ;
+    return 0 ;
+}
+
+int32 DAQmxStartTask(TaskHandle taskHandle)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    return startTask(state, *task) ;
+}
+
+int32 DAQmxStopTask(TaskHandle taskHandle)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    stopTask(state, *task) ;
+    return 0 ;
+}
+
+int32 DAQmxClearTask(TaskHandle taskHandle)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    for (size_t i = 0; i < state.tasks.size(); ++i)  {
+        if (state.tasks[i]->taskHandle == taskHandle)  {
+            stopTask(state, *(state.tasks[i])) ;
+            delete state.tasks[i] ;
+            state.tasks.erase(state.tasks.begin() + i) ;
+            state.stateChanged.notify_all() ;
+            return 0 ;
+        }
+    }
+    return DAQmxErrorInvalidTask ;
+}
+
+int32 DAQmxTaskControl(TaskHandle taskHandle, int32 action)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    switch (action)  {
+        case DAQmx_Val_Task_Start:
+            return startTask(state, *task) ;
+        case DAQmx_Val_Task_Stop:
+        case DAQmx_Val_Task_Abort:
+        case DAQmx_Val_Task_Unreserve:
+            stopTask(state, *task) ;
+            return 0 ;
+        case DAQmx_Val_Task_Verify:
+        case DAQmx_Val_Task_Commit:
+        case DAQmx_Val_Task_Reserve:
+            return task->channels.empty() ? DAQmxErrorNoChansInTask : 0 ;
+        default:
+            return DAQmxErrorInvalidAttributeValue ;
+    }
+}
+
+int32 DAQmxIsTaskDone(TaskHandle taskHandle, bool32 *isTaskDone)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    float64 now = simulatedNow(state) ;
+    checkForBufferErrors(*task, now) ;
+    *isTaskDone = isTaskDoneAt(*task, now) ? 1 : 0 ;
+    return task->errorStatus ;
+}
+
+int32 DAQmxWaitUntilTaskDone(TaskHandle taskHandle, float64 timeToWait)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    float64 deadline = deadlineFromTimeout(state, timeToWait) ;
+    for (;;)  {
+        SimulatedTask * task = findTask(state, taskHandle) ;
+        if (!task)  {
+            return DAQmxErrorInvalidTask ;
+        }
+        float64 now = simulatedNow(state) ;
+        checkForBufferErrors(*task, now) ;
+        if (isTaskDoneAt(*task, now))  {
+            return task->errorStatus ;
+        }
+        if (now >= deadline)  {
+            return DAQmxErrorWaitUntilDoneDoesNotIndicateDone ;
+        }
+        float64 timeWhenDone = isFinite(*task) ? timeOfSampleCount(*task, task->sampsPerChan) : std::numeric_limits<float64>::infinity() ;
+        waitForSimulatedTime(state, call.lock(), std::min(timeWhenDone, deadline)) ;
+    }
+}
+
+int32 DAQmxGetTaskChannels(TaskHandle taskHandle, char *data, uInt32 bufferSize)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    std::string result ;
+    for (size_t i = 0; i < task->channels.size(); ++i)  {
+        if (i > 0)  {
+            result += ", " ;
+        }
+        result += task->channels[i].name ;
+    }
+    return copyStringToBuffer(result, data, bufferSize) ;
+}
+
+int32 DAQmxRegisterEveryNSamplesEvent(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, uInt32 options,
+                                      DAQmxEveryNSamplesEventCallbackPtr callbackFunction, void *callbackData)  {
+    SimulationState & state = theState() ;
+    bool isAsynchronous = false ;
+    {
+        APICall call(state) ;
+        SimulatedTask * task = findTask(state, taskHandle) ;
+        if (!task)  {
+            return DAQmxErrorInvalidTask ;
+        }
+        EveryNSamplesEventRegistration & registration = task->everyNSamples ;
+        if (!callbackFunction)  {
+            // Unregister
+            registration = EveryNSamplesEventRegistration() ;
+            state.stateChanged.notify_all() ;
+            return 0 ;
+        }
+        if (registration.isRegistered)  {
+            return DAQmxErrorEveryNSampsEventAlreadyRegistered ;
+        }
+        if (nSamples == 0)  {
+            return DAQmxErrorInvalidAttributeValue ;
+        }
+        registration.isRegistered = true ;
+        registration.eventType = everyNsamplesEventType ;
+        registration.nSamples = nSamples ;
+        registration.options = options ;
+        registration.callbackFunction = callbackFunction ;
+        registration.callbackData = callbackData ;
+        registration.registeringThreadID = std::this_thread::get_id() ;
+        registration.eventCountDelivered = task->isRunning ? sampleCountAt(*task, simulatedNow(state))/nSamples : 0 ;
+        isAsynchronous = !isSynchronous(options) ;
+        state.stateChanged.notify_all() ;
+    }
+    if (isAsynchronous)  {
+        ensureEventThreadIsRunning(state) ;
+    }
+    return 0 ;
+}
+
+int32 DAQmxRegisterDoneEvent(TaskHandle taskHandle, uInt32 options, DAQmxDoneEventCallbackPtr callbackFunction, void *callbackData)  {
+    SimulationState & state = theState() ;
+    bool isAsynchronous = false ;
+    {
+        APICall call(state) ;
+        SimulatedTask * task = findTask(state, taskHandle) ;
+        if (!task)  {
+            return DAQmxErrorInvalidTask ;
+        }
+        DoneEventRegistration & registration = task->done ;
+        if (!callbackFunction)  {
+            registration = DoneEventRegistration() ;
+            state.stateChanged.notify_all() ;
+            return 0 ;
+        }
+        registration.isRegistered = true ;
+        registration.options = options ;
+        registration.callbackFunction = callbackFunction ;
+        registration.callbackData = callbackData ;
+        registration.registeringThreadID = std::this_thread::get_id() ;
+        registration.wasDelivered = false ;
+        isAsynchronous = !isSynchronous(options) ;
+        state.stateChanged.notify_all() ;
+    }
+    if (isAsynchronous)  {
+        ensureEventThreadIsRunning(state) ;
+    }
+    return 0 ;
+}
+
+int32 DAQmxCreateAIVoltageChan(TaskHandle taskHandle, const char physicalChannel[], const char /*nameToAssignToChannel*/[], int32 /*terminalConfig*/,
+                               float64 /*minVal*/, float64 /*maxVal*/, int32 /*units*/, const char /*customScaleName*/[])  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    return addChannels(state, taskHandle, AI_CHANNEL, physicalChannel, 0) ;
+}
+
+int32 DAQmxCreateAOVoltageChan(TaskHandle taskHandle, const char physicalChannel[], const char /*nameToAssignToChannel*/[],
+                               float64 /*minVal*/, float64 /*maxVal*/, int32 /*units*/, const char /*customScaleName*/[])  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    return addChannels(state, taskHandle, AO_CHANNEL, physicalChannel, 0) ;
+}
+
+int32 DAQmxCreateDIChan(TaskHandle taskHandle, const char lines[], const char /*nameToAssignToLines*/[], int32 lineGrouping)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    return addChannels(state, taskHandle, DI_CHANNEL, lines, lineGrouping) ;
+}
+
+int32 DAQmxCreateDOChan(TaskHandle taskHandle, const char lines[], const char /*nameToAssignToLines*/[], int32 lineGrouping)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    return addChannels(state, taskHandle, DO_CHANNEL, lines, lineGrouping) ;
+}
+
+int32 DAQmxCreateCOPulseChanFreq(TaskHandle taskHandle, const char counter[], const char /*nameToAssignToChannel*/[], int32 /*units*/,
+                                 int32 /*idleState*/, float64 /*initialDelay*/, float64 freq, float64 dutyCycle)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    if ( !(freq > 0) || !(dutyCycle > 0 && dutyCycle < 1) )  {
+        return DAQmxErrorInvalidAttributeValue ;
+    }
+    int32 status = addChannels(state, taskHandle, CO_CHANNEL, counter, 0) ;
+    if (status < 0)  {
+        return status ;
+    }
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    for (size_t i = 0; i < task->channels.size(); ++i)  {
+        if (task->channels[i].frequency == 0)  {
+            task->channels[i].frequency = freq ;
+            task->channels[i].dutyCycle = dutyCycle ;
+        }
+    }
+    return 0 ;
+}
+
+int32 DAQmxCfgSampClkTiming(TaskHandle taskHandle, const char /*source*/[], float64 rate, int32 /*activeEdge*/, int32 sampleMode, uInt64 sampsPerChan)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (task->channels.empty())  {
+        return DAQmxErrorNoChansInTask ;
+    }
+    if ( !(rate > 0) || (sampleMode != DAQmx_Val_FiniteSamps && sampleMode != DAQmx_Val_ContSamps) ||
+         (sampleMode == DAQmx_Val_FiniteSamps && sampsPerChan < 2) )  {
+        return DAQmxErrorInvalidAttributeValue ;
+    }
+    task->timingType = DAQmx_Val_SampClk ;
+    task->sampleRate = rate ;
+    task->sampleMode = sampleMode ;
+    task->sampsPerChan = sampsPerChan ;
+    return 0 ;
+}
+
+int32 DAQmxCfgImplicitTiming(TaskHandle taskHandle, int32 sampleMode, uInt64 sampsPerChan)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (task->channels.empty() || task->channels[0].type != CO_CHANNEL)  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    if (sampleMode != DAQmx_Val_FiniteSamps && sampleMode != DAQmx_Val_ContSamps)  {
+        return DAQmxErrorInvalidAttributeValue ;
+    }
+    if (task->isRunning)  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    task->timingType = DAQmx_Val_Implicit ;
+    task->sampleRate = task->channels[0].frequency ;
+    task->sampleMode = sampleMode ;
+    task->sampsPerChan = sampsPerChan ;
+    return 0 ;
+}
+
+int32 DAQmxCfgDigEdgeStartTrig(TaskHandle taskHandle, const char triggerSource[], int32 triggerEdge)  {
+    // The simulated trigger always arrives as soon as the task starts
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (triggerEdge != DAQmx_Val_Rising && triggerEdge != DAQmx_Val_Falling)  {
+        return DAQmxErrorInvalidAttributeValue ;
+    }
+    task->startTriggerSource = triggerSource ? triggerSource : "" ;
+    return 0 ;
+}
+
+int32 DAQmxDisableStartTrig(TaskHandle taskHandle)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    task->startTriggerSource = "" ;
+    return 0 ;
+}
+
+int32 DAQmxExportSignal(TaskHandle taskHandle, int32 /*signalID*/, const char /*outputTerminal*/[])  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    return findTask(state, taskHandle) ? 0 : DAQmxErrorInvalidTask ;
+}
+
+int32 DAQmxCfgInputBuffer(TaskHandle taskHandle, uInt32 numSampsPerChan)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    task->inputBufferSizeIfSet = numSampsPerChan ;
+    return 0 ;
+}
+
+int32 DAQmxCfgOutputBuffer(TaskHandle taskHandle, uInt32 numSampsPerChan)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (task->isRunning)  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    task->outputBufferSizeIfSet = numSampsPerChan ;
+    task->outputBufferScanCount = 0 ;  // reallocated on the next write
+    task->analogOutputBuffer.clear() ;
+    task->digitalOutputBuffer.clear() ;
+    task->writePosition = 0 ;
+    return 0 ;
+}
+
+int32 DAQmxReadAnalogF64(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout, bool32 fillMode, float64 readArray[],
+                         uInt32 arraySizeInSamps, int32 *sampsPerChanRead, bool32 * /*reserved*/)  {
+    SimulationState & state = theState() ;
+    return readSamples(taskHandle, numSampsPerChan, timeout, fillMode, readArray, arraySizeInSamps, sampsPerChanRead, AI_CHANNEL, 1,
+                       [&state](const SimulatedTask & /*task*/, const SimulatedChannel & channel, uInt64 sampleIndex, float64 * destination)  {
+                           *destination = VOLTS_PER_COUNT * analogInputCountsAt(state, channel, sampleIndex) ;
+                       }) ;
+}
+
+int32 DAQmxReadBinaryI16(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout, bool32 fillMode, int16 readArray[],
+                         uInt32 arraySizeInSamps, int32 *sampsPerChanRead, bool32 * /*reserved*/)  {
+    SimulationState & state = theState() ;
+    return readSamples(taskHandle, numSampsPerChan, timeout, fillMode, readArray, arraySizeInSamps, sampsPerChanRead, AI_CHANNEL, 1,
+                       [&state](const SimulatedTask & /*task*/, const SimulatedChannel & channel, uInt64 sampleIndex, int16 * destination)  {
+                           *destination = analogInputCountsAt(state, channel, sampleIndex) ;
+                       }) ;
+}
+
+int32 DAQmxReadDigitalU32(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout, bool32 fillMode, uInt32 readArray[],
+                          uInt32 arraySizeInSamps, int32 *sampsPerChanRead, bool32 * /*reserved*/)  {
+    SimulationState & state = theState() ;
+    return readSamples(taskHandle, numSampsPerChan, timeout, fillMode, readArray, arraySizeInSamps, sampsPerChanRead, DI_CHANNEL, 1,
+                       [&state](const SimulatedTask & task, const SimulatedChannel & channel, uInt64 sampleIndex, uInt32 * destination)  {
+                           *destination = digitalInputWordAt(state, task, channel, sampleIndex) & channel.lineMask ;
+                       }) ;
+}
+
+int32 DAQmxReadDigitalLines(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout, bool32 fillMode, uInt8 readArray[],
+                            uInt32 arraySizeInBytes, int32 *sampsPerChanRead, int32 *numBytesPerSamp, bool32 * /*reserved*/)  {
+    SimulationState & state = theState() ;
+    // Each sample takes as many bytes as the channel with the most lines
+    uInt32 bytesPerSample = 1 ;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex) ;
+        SimulatedTask * task = findTask(state, taskHandle) ;
+        if (task)  {
+            for (size_t i = 0; i < task->channels.size(); ++i)  {
+                bytesPerSample = std::max(bytesPerSample, (uInt32)(lineCount(task->channels[i].lineMask))) ;
+            }
+        }
+    }
+    if (numBytesPerSamp)  {
+        *numBytesPerSamp = (int32)(bytesPerSample) ;
+    }
+    return readSamples(taskHandle, numSampsPerChan, timeout, fillMode, readArray, arraySizeInBytes, sampsPerChanRead, DI_CHANNEL, bytesPerSample,
+                       [&state, bytesPerSample](const SimulatedTask & task, const SimulatedChannel & channel, uInt64 sampleIndex, uInt8 * destination)  {
+                           uInt32 word = digitalInputWordAt(state, task, channel, sampleIndex) ;
+                           uInt32 lineIndexInChannel = 0 ;
+                           for (uInt32 lineMask = channel.lineMask; lineMask; lineMask &= lineMask-1)  {
+                               uInt32 lowestLine = lineMask & (~lineMask + 1) ;
+                               destination[lineIndexInChannel++] = (word & lowestLine) ? 1 : 0 ;
+                           }
+                           for (; lineIndexInChannel < bytesPerSample; ++lineIndexInChannel)  {
+                               destination[lineIndexInChannel] = 0 ;
+                           }
+                       }) ;
+}
+
+int32 DAQmxWriteAnalogF64(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart, float64 timeout, bool32 dataLayout,
+                          const float64 writeArray[], int32 *sampsPerChanWritten, bool32 * /*reserved*/)  {
+    return writeSamples(taskHandle, numSampsPerChan, autoStart, timeout, dataLayout, writeArray, sampsPerChanWritten, AO_CHANNEL, 1,
+                        [](SimulatedTask & task, size_t channelIndex, const float64 * source, uInt32 scanIndexInBuffer)  {
+                            task.analogOutputBuffer[(size_t)(scanIndexInBuffer)*task.channels.size() + channelIndex] = *source ;
+                        },
+                        [](const SimulatedChannel & /*channel*/, const float64 * /*source*/)  {}) ;
+}
+
+int32 DAQmxWriteBinaryI16(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart, float64 timeout, bool32 dataLayout,
+                          const int16 writeArray[], int32 *sampsPerChanWritten, bool32 * /*reserved*/)  {
+    return writeSamples(taskHandle, numSampsPerChan, autoStart, timeout, dataLayout, writeArray, sampsPerChanWritten, AO_CHANNEL, 1,
+                        [](SimulatedTask & task, size_t channelIndex, const int16 * source, uInt32 scanIndexInBuffer)  {
+                            task.analogOutputBuffer[(size_t)(scanIndexInBuffer)*task.channels.size() + channelIndex] = VOLTS_PER_COUNT * (*source) ;
+                        },
+                        [](const SimulatedChannel & /*channel*/, const int16 * /*source*/)  {}) ;
+}
+
+int32 DAQmxWriteDigitalU32(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart, float64 timeout, bool32 dataLayout,
+                           const uInt32 writeArray[], int32 *sampsPerChanWritten, bool32 * /*reserved*/)  {
+    SimulationState & state = theState() ;
+    return writeSamples(taskHandle, numSampsPerChan, autoStart, timeout, dataLayout, writeArray, sampsPerChanWritten, DO_CHANNEL, 1,
+                        [](SimulatedTask & task, size_t channelIndex, const uInt32 * source, uInt32 scanIndexInBuffer)  {
+                            task.digitalOutputBuffer[(size_t)(scanIndexInBuffer)*task.channels.size() + channelIndex] =
+                                (*source) & task.channels[channelIndex].lineMask ;
+                        },
+                        [&state](const SimulatedChannel & channel, const uInt32 * source)  {
+                            setDigitalOutputState(state, channel, *source) ;
+                        }) ;
+}
+
+int32 DAQmxWriteDigitalLines(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart, float64 timeout, bool32 dataLayout,
+                             const uInt8 writeArray[], int32 *sampsPerChanWritten, bool32 * /*reserved*/)  {
+    SimulationState & state = theState() ;
+    // Each sample takes as many bytes as the channel with the most lines
+    uInt32 bytesPerSample = 1 ;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex) ;
+        SimulatedTask * task = findTask(state, taskHandle) ;
+        if (task)  {
+            for (size_t i = 0; i < task->channels.size(); ++i)  {
+                bytesPerSample = std::max(bytesPerSample, (uInt32)(lineCount(task->channels[i].lineMask))) ;
+            }
+        }
+    }
+    return writeSamples(taskHandle, numSampsPerChan, autoStart, timeout, dataLayout, writeArray, sampsPerChanWritten, DO_CHANNEL, bytesPerSample,
+                        [](SimulatedTask & task, size_t channelIndex, const uInt8 * source, uInt32 scanIndexInBuffer)  {
+                            task.digitalOutputBuffer[(size_t)(scanIndexInBuffer)*task.channels.size() + channelIndex] =
+                                portWordFromLines(task.channels[channelIndex], source) ;
+                        },
+                        [&state](const SimulatedChannel & channel, const uInt8 * source)  {
+                            setDigitalOutputState(state, channel, portWordFromLines(channel, source)) ;
+                        }) ;
+}
+
+int32 DAQmxWriteCtrFreqScalar(TaskHandle taskHandle, bool32 autoStart, float64 /*timeout*/, float64 frequency, float64 dutyCycle, bool32 * /*reserved*/)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (task->channels.empty() || task->channels[0].type != CO_CHANNEL)  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    if ( !(frequency > 0) || !(dutyCycle > 0 && dutyCycle < 1) )  {
+        return DAQmxErrorInvalidAttributeValue ;
+    }
+    for (size_t i = 0; i < task->channels.size(); ++i)  {
+        task->channels[i].frequency = frequency ;
+        task->channels[i].dutyCycle = dutyCycle ;
+    }
+    changeSampleRate(*task, simulatedNow(state), frequency) ;
+    state.stateChanged.notify_all() ;
+    if (autoStart && !task->isRunning)  {
+        return startTask(state, *task) ;
+    }
+    return 0 ;
+}
+
+int32 DAQmxGetErrorString(int32 errorCode, char errorString[], uInt32 bufferSize)  {
+    const char * message ;
+    switch (errorCode)  {
+        case 0: message = "" ; break ;
+        case DAQmxErrorInvalidAttributeValue: message = "Requested value is not a supported value for this property." ; break ;
+        case DAQmxErrorInvalidTask: message = "Task specified is invalid or does not exist." ; break ;
+        case DAQmxErrorDuplicateTask: message = "Task name specified conflicts with an existing task name." ; break ;
+        case DAQmxErrorPhysicalChanDoesNotExist: message = "Physical channel specified does not exist on this device." ; break ;
+        case DAQmxErrorInvalidDeviceID: message = "Device identifier is invalid." ; break ;
+        case DAQmxErrorBufferTooSmallForString: message = "Buffer is too small to fit the string." ; break ;
+        case DAQmxErrorReadBufferTooSmall: message = "Buffer is too small to fit read data." ; break ;
+        case DAQmxErrorSamplesWillNeverBeAvailable: message = "Attempted to read a sample beyond the final sample acquired." ; break ;
+        case DAQmxErrorSamplesNoLongerAvailable:
+            message = "Attempted to read samples that are no longer available. The requested sample was previously available, but has since been overwritten." ;
+            break ;
+        case DAQmxErrorSamplesNotYetAvailable: message = "Some or all of the samples requested have not yet been acquired." ; break ;
+        case DAQmxErrorGenStoppedToPreventRegenOfOldSamples:
+            message = "Generation was stopped to prevent the regeneration of old samples. Your application was unable to write samples to the background buffer fast enough to prevent old samples from being regenerated." ;
+            break ;
+        case DAQmxErrorSamplesCanNotYetBeWritten: message = "Some or all of the samples to write could not be written to the buffer yet." ; break ;
+        case DAQmxErrorAttributeNotSupportedInTaskContext: message = "Specified property is not supported by the device or is not applicable to the task." ; break ;
+        case DAQmxErrorNoDataInBuffer: message = "Generation cannot be started because the output buffer is empty." ; break ;
+        case DAQmxErrorNoChansInTask: message = "Specified operation cannot be performed when there are no channels in the task." ; break ;
+        case DAQmxErrorOpNotAllowedWhileTaskRunning: message = "Specified operation cannot be performed while the task is running." ; break ;
+        case DAQmxErrorWaitUntilDoneDoesNotIndicateDone: message = "Wait Until Done did not indicate all samples were acquired/generated within the specified timeout." ; break ;
+        case DAQmxErrorEveryNSampsEventAlreadyRegistered: message = "Every N Samples Event is already registered for this task." ; break ;
+        default: message = "Unknown error." ; break ;
+    }
+    std::string messageAsString = std::string(message) + " (simulated DAQmx)" ;
+    return copyStringToBuffer(messageAsString, errorString, bufferSize) ;
+}
+
+int32 DAQmxGetSysDevNames(char *data, uInt32 bufferSize)  {
+    std::string result ;
+    for (int deviceIndex = 0; deviceIndex < SIMULATED_DEVICE_COUNT; ++deviceIndex)  {
+        if (deviceIndex > 0)  {
+            result += ", " ;
+        }
+        result += simulatedDeviceName(deviceIndex) ;
+    }
+    return copyStringToBuffer(result, data, bufferSize) ;
+}
+
+// Returns a string like "Dev1/ai0, Dev1/ai1"
+int32
+getDevicePhysicalChannels(const char device[], const char * format, uInt32 channelCount, char * data, uInt32 bufferSize)  {
+    std::string deviceName(device ? device : "") ;
+    if (simulatedDeviceIndexFromName(deviceName) < 0)  {
+        return DAQmxErrorInvalidDeviceID ;
+    }
+    std::string result ;
+    for (uInt32 i = 0; i < channelCount; ++i)  {
+        char channelName[64] ;
+        sprintf(channelName, format, deviceName.c_str(), i) ;
+        if (i > 0)  {
+            result += ", " ;
+        }
+        result += channelName ;
+    }
+    return copyStringToBuffer(result, data, bufferSize) ;
+}
+
+int32 DAQmxGetDevAIPhysicalChans(const char device[], char *data, uInt32 bufferSize)  {
+    return getDevicePhysicalChannels(device, "%s/ai%u", AI_CHANNEL_COUNT_PER_DEVICE, data, bufferSize) ;
+}
+
+int32 DAQmxGetDevAOPhysicalChans(const char device[], char *data, uInt32 bufferSize)  {
+    return getDevicePhysicalChannels(device, "%s/ao%u", AO_CHANNEL_COUNT_PER_DEVICE, data, bufferSize) ;
+}
+
+int32 DAQmxGetDevDILines(const char device[], char *data, uInt32 bufferSize)  {
+    return getDevicePhysicalChannels(device, "%s/port0/line%u", DIO_LINE_COUNT_PER_DEVICE, data, bufferSize) ;
+}
+
+int32 DAQmxGetDevCOPhysicalChans(const char device[], char *data, uInt32 bufferSize)  {
+    return getDevicePhysicalChannels(device, "%s/ctr%u", COUNTER_COUNT_PER_DEVICE, data, bufferSize) ;
+}
+
+int32 DAQmxGetDevBusType(const char device[], int32 *data)  {
+    if (simulatedDeviceIndexFromName(device ? device : "") < 0)  {
+        return DAQmxErrorInvalidDeviceID ;
+    }
+    *data = DAQmx_Val_PCIe ;
+    return 0 ;
+}
+
+// Find the channel in the task with the given name.  Caller holds the mutex.
+int32
+findChannel(SimulationState & state, TaskHandle taskHandle, const char channel[], SimulatedChannelType type, SimulatedTask ** taskPtr, SimulatedChannel ** channelPtr)  {
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    std::string channelName(channel ? channel : "") ;
+    for (size_t i = 0; i < task->channels.size(); ++i)  {
+        // An empty channel name means all the channels in the task, so use the first
+        if ( task->channels[i].type == type && (channelName.empty() || task->channels[i].name == channelName) )  {
+            *taskPtr = task ;
+            *channelPtr = &(task->channels[i]) ;
+            return 0 ;
+        }
+    }
+    return DAQmxErrorPhysicalChanDoesNotExist ;
+}
+
+int32
+getScalingCoefficients(TaskHandle taskHandle, const char channel[], SimulatedChannelType type, float64 * data, uInt32 arraySizeInElements)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task ;
+    SimulatedChannel * theChannel ;
+    int32 status = findChannel(state, taskHandle, channel, type, &task, &theChannel) ;
+    if (status < 0)  {
+        return status ;
+    }
+    // Like a simulated X series device, there are two coefficients
+    const float64 coefficients[2] = { 0.0, VOLTS_PER_COUNT } ;
+    for (uInt32 i = 0; i < arraySizeInElements; ++i)  {
+        data[i] = (i < 2) ? coefficients[i] : 0.0 ;
+    }
+    return 0 ;
+}
+
+int32 DAQmxGetAIDevScalingCoeff(TaskHandle taskHandle, const char channel[], float64 *data, uInt32 arraySizeInElements)  {
+    return getScalingCoefficients(taskHandle, channel, AI_CHANNEL, data, arraySizeInElements) ;
+}
+
+int32 DAQmxGetAODevScalingCoeff(TaskHandle taskHandle, const char channel[], float64 *data, uInt32 arraySizeInElements)  {
+    // For AO, the coefficients convert volts to DAC codes
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task ;
+    SimulatedChannel * theChannel ;
+    int32 status = findChannel(state, taskHandle, channel, AO_CHANNEL, &task, &theChannel) ;
+    if (status < 0)  {
+        return status ;
+    }
+    const float64 coefficients[2] = { 0.0, 1.0/VOLTS_PER_COUNT } ;
+    for (uInt32 i = 0; i < arraySizeInElements; ++i)  {
+        data[i] = (i < 2) ? coefficients[i] : 0.0 ;
+    }
+    return 0 ;
+}
+
+int32 DAQmxSetCOPulseFreq(TaskHandle taskHandle, const char channel[], float64 data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task ;
+    SimulatedChannel * theChannel ;
+    int32 status = findChannel(state, taskHandle, channel, CO_CHANNEL, &task, &theChannel) ;
+    if (status < 0)  {
+        return status ;
+    }
+    if ( !(data > 0) )  {
+        return DAQmxErrorInvalidAttributeValue ;
+    }
+    theChannel->frequency = data ;
+    if (theChannel == &(task->channels[0]))  {
+        changeSampleRate(*task, simulatedNow(state), data) ;
+        state.stateChanged.notify_all() ;
+    }
+    return 0 ;
+}
+
+int32 DAQmxSetCOPulseDutyCyc(TaskHandle taskHandle, const char channel[], float64 data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task ;
+    SimulatedChannel * theChannel ;
+    int32 status = findChannel(state, taskHandle, channel, CO_CHANNEL, &task, &theChannel) ;
+    if (status < 0)  {
+        return status ;
+    }
+    if ( !(data > 0 && data < 1) )  {
+        return DAQmxErrorInvalidAttributeValue ;
+    }
+    theChannel->dutyCycle = data ;
+    return 0 ;
+}
+
+int32 DAQmxGetSampClkRate(TaskHandle taskHandle, float64 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (task->timingType != DAQmx_Val_SampClk)  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    *data = task->sampleRate ;
+    return 0 ;
+}
+
+int32 DAQmxGetSampTimingType(TaskHandle taskHandle, int32 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    *data = task->timingType ;
+    return 0 ;
+}
+
+int32 DAQmxGetSampQuantSampMode(TaskHandle taskHandle, int32 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    *data = (task->timingType == DAQmx_Val_OnDemand) ? DAQmx_Val_HWTimedSinglePoint : task->sampleMode ;
+    return 0 ;
+}
+
+int32 DAQmxGetSampQuantSampPerChan(TaskHandle taskHandle, uInt64 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    *data = task->sampsPerChan ;
+    return 0 ;
+}
+
+int32 DAQmxSetSampQuantSampPerChan(TaskHandle taskHandle, uInt64 data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (task->isRunning)  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    task->sampsPerChan = data ;
+    return 0 ;
+}
+
+int32 DAQmxGetRefClkSrc(TaskHandle taskHandle, char *data, uInt32 bufferSize)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    return copyStringToBuffer(task->refClkSrc, data, bufferSize) ;
+}
+
+int32 DAQmxSetRefClkSrc(TaskHandle taskHandle, const char *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    task->refClkSrc = data ? data : "" ;
+    return 0 ;
+}
+
+int32 DAQmxGetRefClkRate(TaskHandle taskHandle, float64 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    *data = task->refClkRate ;
+    return 0 ;
+}
+
+int32 DAQmxSetRefClkRate(TaskHandle taskHandle, float64 data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    task->refClkRate = data ;
+    return 0 ;
+}
+
+int32 DAQmxGetBufOutputBufSize(TaskHandle taskHandle, uInt32 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    *data = (task->outputBufferScanCount > 0) ? task->outputBufferScanCount : task->outputBufferSizeIfSet ;
+    return 0 ;
+}
+
+int32 DAQmxGetReadAvailSampPerChan(TaskHandle taskHandle, uInt32 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (!isInputTask(*task))  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    float64 now = simulatedNow(state) ;
+    checkForBufferErrors(*task, now) ;
+    if (task->errorStatus != 0)  {
+        return task->errorStatus ;
+    }
+    uInt64 count = sampleCountAt(*task, now) ;
+    *data = (count > task->readPosition) ? (uInt32)(count - task->readPosition) : 0 ;
+    return 0 ;
+}
+
+int32 DAQmxGetReadNumChans(TaskHandle taskHandle, uInt32 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (!isInputTask(*task))  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    *data = (uInt32)(task->channels.size()) ;
+    return 0 ;
+}
+
+int32 DAQmxGetReadCurrReadPos(TaskHandle taskHandle, uInt64 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    *data = task->readPosition ;
+    return 0 ;
+}
+
+int32 DAQmxGetReadTotalSampPerChanAcquired(TaskHandle taskHandle, uInt64 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    *data = sampleCountAt(*task, simulatedNow(state)) ;
+    return 0 ;
+}
+
+int32 DAQmxGetWriteNumChans(TaskHandle taskHandle, uInt32 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (!isOutputTask(*task))  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    *data = (uInt32)(task->channels.size()) ;
+    return 0 ;
+}
+
+int32 DAQmxGetWriteSpaceAvail(TaskHandle taskHandle, uInt32 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (!isOutputTask(*task))  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    float64 now = simulatedNow(state) ;
+    checkForBufferErrors(*task, now) ;
+    uInt64 nScansGenerated = sampleCountAt(*task, now) ;
+    uInt64 nScansInBuffer = task->writePosition - std::min(nScansGenerated, task->writePosition) ;
+    *data = (nScansInBuffer < task->outputBufferScanCount) ? (uInt32)(task->outputBufferScanCount - nScansInBuffer) : 0 ;
+    return task->errorStatus ;
+}
+
+int32 DAQmxGetWriteRegenMode(TaskHandle taskHandle, int32 *data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    *data = task->regenMode ;
+    return 0 ;
+}
+
+int32 DAQmxSetWriteRegenMode(TaskHandle taskHandle, int32 data)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    SimulatedTask * task = findTask(state, taskHandle) ;
+    if (!task)  {
+        return DAQmxErrorInvalidTask ;
+    }
+    if (data != DAQmx_Val_AllowRegen && data != DAQmx_Val_DoNotAllowRegen)  {
+        return DAQmxErrorInvalidAttributeValue ;
+    }
+    if (task->isRunning)  {
+        return DAQmxErrorAttributeNotSupportedInTaskContext ;
+    }
+    task->regenMode = data ;
+    return 0 ;
+}
+
+int32 DAQmxResetWriteRelativeTo(TaskHandle taskHandle)  {
+    // Writes are always relative to the current write position in the simulation
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    return findTask(state, taskHandle) ? 0 : DAQmxErrorInvalidTask ;
+}
+
+int32 DAQmxResetWriteOffset(TaskHandle taskHandle)  {
+    SimulationState & state = theState() ;
+    APICall call(state) ;
+    return findTask(state, taskHandle) ? 0 : DAQmxErrorInvalidTask ;
+}
+
+
+
+//
+// Simulation control
+//
+
+void WSSimulatedDAQmxSetTimeScale(float64 timeScale)  {
+    SimulationState & state = theState() ;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex) ;
+        // Rebase the clock, so the simulated time is continuous
+        state.simulatedTimeAtLastRebase = simulatedNow(state) ;
+        state.wallTimeAtLastRebase = std::chrono::steady_clock::now() ;
+        state.timeScale = (timeScale > 0) ? timeScale : 0.0 ;
+    }
+    state.stateChanged.notify_all() ;
+}
+
+float64 WSSimulatedDAQmxGetTimeScale(void)  {
+    SimulationState & state = theState() ;
+    std::lock_guard<std::mutex> lock(state.mutex) ;
+    return state.timeScale ;
+}
+
+float64 WSSimulatedDAQmxGetTime(void)  {
+    SimulationState & state = theState() ;
+    std::lock_guard<std::mutex> lock(state.mutex) ;
+    return simulatedNow(state) ;
+}
+
+float64 WSSimulatedDAQmxGetTimeOfLastOutputStateChange(void)  {
+    SimulationState & state = theState() ;
+    std::lock_guard<std::mutex> lock(state.mutex) ;
+    return state.timeOfLastOutputStateChange ;
+}
+
+void WSSimulatedDAQmxAdvanceTime(float64 dt)  {
+    SimulationState & state = theState() ;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex) ;
+        if (state.timeScale <= 0 && dt > 0)  {
+            state.simulatedTimeAtLastRebase += dt ;
+        }
+    }
+    state.stateChanged.notify_all() ;
+}
+
+void WSSimulatedDAQmxProcessEvents(void)  {
+    deliverSynchronousEvents(theState()) ;
+}
+
+void WSSimulatedDAQmxReset(void)  {
+    SimulationState & state = theState() ;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex) ;
+        for (size_t i = 0; i < state.tasks.size(); ++i)  {
+            delete state.tasks[i] ;
+        }
+        state.tasks.clear() ;
+        state.nextUnnamedTaskIndex = 0 ;
+        std::fill(state.port0StatePerDevice.begin(), state.port0StatePerDevice.end(), 0) ;
+        std::fill(state.pfiStatePerDevice.begin(), state.pfiStatePerDevice.end(), 0) ;
+        state.timeOfLastOutputStateChange = -1.0 ;
+        state.simulatedTimeAtLastRebase = 0.0 ;
+        state.wallTimeAtLastRebase = std::chrono::steady_clock::now() ;
+    }
+    state.stateChanged.notify_all() ;
+}
+
+}  // extern "C"
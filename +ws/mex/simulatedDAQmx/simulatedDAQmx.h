@@ -0,0 +1,58 @@
+// Functions for controlling the simulated DAQmx implementation in simulatedDAQmx.cpp.  
+// These are not part of the DAQmx API, so code that calls them will only build against 
+// the simulation.
+//
+// The simulation has two simulated devices, Dev1 and Dev2, each with 32 AI channels 
+// (ai0-ai31), 4 AO channels (ao0-ao3), 32 DIO lines (port0/line0-line31), 16 PFI lines 
+// (pfi0-pfi15), and 4 counters (ctr0-ctr3).  Sample-clocked tasks acquire and generate 
+// samples against a simulated clock, which runs at timeScale times real time.  
+// AI channel k reads a sine wave with k+1 cycles every 4096 samples, and DI lines read 
+// the sample index, with line i being bit i of it.  Reads block (in simulated time) until the 
+// requested samples have been acquired, and fail with DAQmxErrorSamplesNoLongerAvailable 
+// if the acquisition gets more than an input buffer ahead of the reads, as on a real 
+// device.
+
+#ifndef ___simulated_daqmx_h___
+#define ___simulated_daqmx_h___
+
+#include "NIDAQmx.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+// Set how fast the simulated clock runs relative to the wall clock.  1.0 is real time, 
+// 10.0 is ten times faster than real time.  0.0 means the simulated clock only advances 
+// when something waits on it, in which case it jumps straight to the time the waiter 
+// is waiting for, and so the simulation runs as fast as the code driving it.  
+// The initial value is taken from the environment variable 
+// WS_SIMULATED_DAQMX_TIME_SCALE, if set, otherwise it is 1.0.
+void WSSimulatedDAQmxSetTimeScale(float64 timeScale) ;
+float64 WSSimulatedDAQmxGetTimeScale(void) ;
+
+// The current simulated time, in seconds
+float64 WSSimulatedDAQmxGetTime(void) ;
+
+// The simulated time at which an on-demand write last changed the state of a digital 
+// output line, on any device, or -1.0 if none has yet
+float64 WSSimulatedDAQmxGetTimeOfLastOutputStateChange(void) ;
+
+// Advance the simulated clock by dt seconds.  Only has an effect when the time scale is 
+// zero.
+void WSSimulatedDAQmxAdvanceTime(float64 dt) ;
+
+// Call any pending callbacks registered with DAQmx_Val_SynchronousEventCallbacks on the 
+// calling thread.  Such callbacks are also delivered whenever the registering thread 
+// calls into the simulation, which stands in for the message loop that delivers them 
+// for the real driver.  Callbacks registered without that option are called from a 
+// simulation thread.
+void WSSimulatedDAQmxProcessEvents(void) ;
+
+// Clear all tasks, and set the simulated clock back to zero
+void WSSimulatedDAQmxReset(void) ;
+
+#ifdef __cplusplus
+    }
+#endif
+
+#endif // ___simulated_daqmx_h___
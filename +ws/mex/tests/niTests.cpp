@@ -0,0 +1,360 @@
+// Checks of ws.ni's behavior, built against the mex shim and the simulated DAQmx (see
+// ../CMakeLists.txt), for ctest.  Each test is a function that runs the kernel as Matlab
+// would, and CHECK()s what comes back.  A failed check is printed, and makes the program
+// exit nonzero.
+
+#include <cstdio>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "mex.h"
+#include "simulatedDAQmx.h"
+
+void mexFunction_ni(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) ;
+
+
+
+//
+// Helpers
+//
+
+static int FAILURE_COUNT = 0 ;
+
+#define CHECK(condition)  \
+    do  {  \
+        if (!(condition))  {  \
+            fprintf(stderr, "%s:%d: in %s: CHECK(%s) failed\n", __FILE__, __LINE__, __func__, #condition) ;  \
+            ++FAILURE_COUNT ;  \
+        }  \
+    } while (0)
+
+// Run a test, counting an error it raises as a failure
+static void runTest(void (*test)(void), const char * testName)  {
+    try  {
+        test() ;
+    }
+    catch (const MexShimError & e)  {
+        fprintf(stderr, "%s: error %s: %s\n", testName, e.identifier().c_str(), e.what()) ;
+        ++FAILURE_COUNT ;
+    }
+}
+
+// Call ws.ni, destroy the args, and return the outputs, of which there are nlhs
+static std::vector<mxArray *> callNi(int nlhs, std::vector<mxArray *> args)  {
+    std::vector<mxArray *> plhs(std::max(nlhs, 1), (mxArray *)(0)) ;
+    try  {
+        mexFunction_ni(nlhs, plhs.data(), (int)args.size(), (const mxArray **)(args.data())) ;
+    }
+    catch (...)  {
+        for (size_t i=0; i<args.size(); ++i)  {
+            mxDestroyArray(args[i]) ;
+        }
+        throw ;
+    }
+    for (size_t i=0; i<args.size(); ++i)  {
+        mxDestroyArray(args[i]) ;
+    }
+    plhs.resize(nlhs) ;
+    return plhs ;
+}
+
+// Call ws.ni for its side effects
+static void callNi(std::vector<mxArray *> args)  {
+    callNi(0, args) ;
+}
+
+// Call ws.ni, and return the identifier of the error it raises, or an empty string if none
+static std::string errorIdentifierFromCallingNi(std::vector<mxArray *> args)  {
+    try  {
+        callNi(0, args) ;
+    }
+    catch (const MexShimError & e)  {
+        return e.identifier() ;
+    }
+    return std::string() ;
+}
+
+static void destroyArrays(std::vector<mxArray *> arrays)  {
+    for (size_t i=0; i<arrays.size(); ++i)  {
+        mxDestroyArray(arrays[i]) ;
+    }
+}
+
+static mxArray * taskHandleArray(uint64_t taskHandle)  {
+    mxArray * result = mxCreateNumericMatrix(1, 1, mxUINT64_CLASS, mxREAL) ;
+    *((uint64_t *)mxGetData(result)) = taskHandle ;
+    return result ;
+}
+
+static uint64_t createTask(const char * taskName)  {
+    std::vector<mxArray *> outputs = callNi(1, { mxCreateString("DAQmxCreateTask"), mxCreateString(taskName) }) ;
+    uint64_t result = *((uint64_t *)mxGetData(outputs[0])) ;
+    destroyArrays(outputs) ;
+    return result ;
+}
+
+static void clearTask(uint64_t taskHandle)  {
+    callNi({ mxCreateString("DAQmxClearTask"), taskHandleArray(taskHandle) }) ;
+}
+
+static bool isTaskDone(uint64_t taskHandle)  {
+    std::vector<mxArray *> outputs = callNi(1, { mxCreateString("DAQmxIsTaskDone"), taskHandleArray(taskHandle) }) ;
+    bool result = (mxGetScalar(outputs[0]) != 0.0) ;
+    destroyArrays(outputs) ;
+    return result ;
+}
+
+// Make a finite AI task of nChannels channels and nScans scans at 10 kHz, start it, and
+// let it finish, without reading any of it
+static uint64_t createFinishedFiniteAITask(const char * taskName, int nChannels, double nScans)  {
+    uint64_t taskHandle = createTask(taskName) ;
+    std::string channels = "Dev1/ai0:" + std::to_string(nChannels-1) ;
+    callNi({ mxCreateString("DAQmxCreateAIVoltageChan"), taskHandleArray(taskHandle), mxCreateString(channels.c_str()),
+             mxCreateString("DAQmx_Val_Diff") }) ;
+    callNi({ mxCreateString("DAQmxCfgSampClkTiming"), taskHandleArray(taskHandle), mxCreateString(""), mxCreateDoubleScalar(10000.0),
+             mxCreateString("DAQmx_Val_Rising"), mxCreateString("DAQmx_Val_FiniteSamps"), mxCreateDoubleScalar(nScans) }) ;
+    callNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) }) ;
+    callNi({ mxCreateString("DAQmxWaitUntilTaskDone"), taskHandleArray(taskHandle), mxCreateDoubleScalar(-1.0) }) ;
+    return taskHandle ;
+}
+
+
+
+//
+// WaitForScans and WaitForPackedDigitalLines
+//
+
+// A finite task that's done, but not stopped, still has all its scans in the buffer, and
+// WaitForScans should return them, as AITask does at the end of a sweep
+static void testWaitForScansOnFinishedFiniteTask(void)  {
+    uint64_t taskHandle = createFinishedFiniteAITask("testWaitForScansOnFinishedFiniteTask", 2, 1000) ;
+    CHECK(isTaskDone(taskHandle)) ;
+    std::vector<mxArray *> outputs = callNi(2, { mxCreateString("WaitForScans"), taskHandleArray(taskHandle),
+                                                 mxCreateDoubleScalar(2147483647.0), mxCreateDoubleScalar(0.0) }) ;
+    CHECK(mxGetM(outputs[0]) == 1000) ;
+    CHECK(mxGetN(outputs[0]) == 2) ;
+    CHECK(mxGetScalar(outputs[1]) != 0.0) ;
+    destroyArrays(outputs) ;
+
+    // Once they've been read, there's nothing more
+    outputs = callNi(2, { mxCreateString("WaitForScans"), taskHandleArray(taskHandle),
+                          mxCreateDoubleScalar(2147483647.0), mxCreateDoubleScalar(0.0) }) ;
+    CHECK(mxGetM(outputs[0]) == 0) ;
+    CHECK(mxGetScalar(outputs[1]) != 0.0) ;
+    destroyArrays(outputs) ;
+    clearTask(taskHandle) ;
+}
+
+// Same, but having read some of the scans before the task finished, and asking for fewer
+// than are left
+static void testWaitForScansOnPartlyReadFinishedFiniteTask(void)  {
+    uint64_t taskHandle = createTask("testWaitForScansOnPartlyReadFinishedFiniteTask") ;
+    callNi({ mxCreateString("DAQmxCreateAIVoltageChan"), taskHandleArray(taskHandle), mxCreateString("Dev1/ai0"),
+             mxCreateString("DAQmx_Val_Diff") }) ;
+    callNi({ mxCreateString("DAQmxCfgSampClkTiming"), taskHandleArray(taskHandle), mxCreateString(""), mxCreateDoubleScalar(10000.0),
+             mxCreateString("DAQmx_Val_Rising"), mxCreateString("DAQmx_Val_FiniteSamps"), mxCreateDoubleScalar(1000.0) }) ;
+    callNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) }) ;
+    std::vector<mxArray *> outputs = callNi(2, { mxCreateString("WaitForScans"), taskHandleArray(taskHandle),
+                                                 mxCreateDoubleScalar(300.0), mxCreateDoubleScalar(-1.0) }) ;
+    CHECK(mxGetM(outputs[0]) == 300) ;
+    destroyArrays(outputs) ;
+    callNi({ mxCreateString("DAQmxWaitUntilTaskDone"), taskHandleArray(taskHandle), mxCreateDoubleScalar(-1.0) }) ;
+    outputs = callNi(2, { mxCreateString("WaitForScans"), taskHandleArray(taskHandle),
+                          mxCreateDoubleScalar(500.0), mxCreateDoubleScalar(0.0) }) ;
+    CHECK(mxGetM(outputs[0]) == 500) ;
+    destroyArrays(outputs) ;
+    outputs = callNi(2, { mxCreateString("WaitForScans"), taskHandleArray(taskHandle),
+                          mxCreateDoubleScalar(2147483647.0), mxCreateDoubleScalar(5.0) }) ;
+    CHECK(mxGetM(outputs[0]) == 200) ;
+    CHECK(mxGetScalar(outputs[1]) != 0.0) ;
+    destroyArrays(outputs) ;
+    clearTask(taskHandle) ;
+}
+
+// Waiting on a task that finishes during the wait gets all its scans
+static void testWaitForScansOnFiniteTaskThatFinishesDuringWait(void)  {
+    uint64_t taskHandle = createTask("testWaitForScansOnFiniteTaskThatFinishesDuringWait") ;
+    callNi({ mxCreateString("DAQmxCreateAIVoltageChan"), taskHandleArray(taskHandle), mxCreateString("Dev1/ai0:2"),
+             mxCreateString("DAQmx_Val_Diff") }) ;
+    callNi({ mxCreateString("DAQmxCfgSampClkTiming"), taskHandleArray(taskHandle), mxCreateString(""), mxCreateDoubleScalar(10000.0),
+             mxCreateString("DAQmx_Val_Rising"), mxCreateString("DAQmx_Val_FiniteSamps"), mxCreateDoubleScalar(2000.0) }) ;
+    callNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) }) ;
+    std::vector<mxArray *> outputs = callNi(2, { mxCreateString("WaitForScans"), taskHandleArray(taskHandle),
+                                                 mxCreateDoubleScalar(2147483647.0), mxCreateDoubleScalar(-1.0) }) ;
+    CHECK(mxGetM(outputs[0]) == 2000) ;
+    CHECK(mxGetN(outputs[0]) == 3) ;
+    CHECK(mxGetScalar(outputs[1]) != 0.0) ;
+    destroyArrays(outputs) ;
+    clearTask(taskHandle) ;
+}
+
+// The DI version, as DITask reads the end of a sweep
+static void testWaitForPackedDigitalLinesOnFinishedFiniteTask(void)  {
+    uint64_t taskHandle = createTask("testWaitForPackedDigitalLinesOnFinishedFiniteTask") ;
+    callNi({ mxCreateString("DAQmxCreateDIChan"), taskHandleArray(taskHandle), mxCreateString("Dev1/port0/line0:1"),
+             mxCreateString("DAQmx_Val_ChanForAllLines") }) ;
+    callNi({ mxCreateString("DAQmxCfgSampClkTiming"), taskHandleArray(taskHandle), mxCreateString(""), mxCreateDoubleScalar(10000.0),
+             mxCreateString("DAQmx_Val_Rising"), mxCreateString("DAQmx_Val_FiniteSamps"), mxCreateDoubleScalar(1000.0) }) ;
+    callNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) }) ;
+    callNi({ mxCreateString("DAQmxWaitUntilTaskDone"), taskHandleArray(taskHandle), mxCreateDoubleScalar(-1.0) }) ;
+    mxArray * terminalIDPerLine = mxCreateDoubleMatrix(1, 2, mxREAL) ;
+    mxGetPr(terminalIDPerLine)[0] = 0.0 ;
+    mxGetPr(terminalIDPerLine)[1] = 1.0 ;
+    std::vector<mxArray *> outputs = callNi(2, { mxCreateString("WaitForPackedDigitalLines"), taskHandleArray(taskHandle),
+                                                 mxCreateDoubleScalar(2147483647.0), mxCreateDoubleScalar(0.0), terminalIDPerLine }) ;
+    CHECK(mxGetM(outputs[0]) == 1000) ;
+    CHECK(mxGetScalar(outputs[1]) != 0.0) ;
+    destroyArrays(outputs) ;
+    clearTask(taskHandle) ;
+}
+
+
+//
+// The write cache
+//
+
+// Set a finite AO task's timing, then write data to it, as AOTask does at the start of 
+// each sweep, and return whether ws.ni skipped the write because the buffer held the data
+static bool wasWriteAfterSettingTimingSkipped(uint64_t taskHandle, double nScans, const mxArray * data)  {
+    callNi({ mxCreateString("DAQmxCfgSampClkTiming"), taskHandleArray(taskHandle), mxCreateString(""), mxCreateDoubleScalar(20000.0),
+             mxCreateString("DAQmx_Val_Rising"), mxCreateString("DAQmx_Val_FiniteSamps"), mxCreateDoubleScalar(nScans) }) ;
+    std::vector<mxArray *> outputs = callNi(2, { mxCreateString("DAQmxWriteAnalogF64"), taskHandleArray(taskHandle), mxCreateDoubleScalar(0.0),
+                                                 mxCreateDoubleScalar(-1.0), mxDuplicateArray(data) }) ;
+    bool result = (mxGetScalar(outputs[1]) != 0.0) ;
+    destroyArrays(outputs) ;
+    return result ;
+}
+
+// Setting the same timing again before writing the same data shouldn't stop the write 
+// from being skipped, but setting different timing should
+static void testWriteCacheSurvivesSettingTheSameTiming(void)  {
+    uint64_t taskHandle = createTask("testWriteCacheSurvivesSettingTheSameTiming") ;
+    callNi({ mxCreateString("DAQmxCreateAOVoltageChan"), taskHandleArray(taskHandle), mxCreateString("Dev1/ao0:1") }) ;
+    callNi({ mxCreateString("DAQmxCfgOutputBuffer"), taskHandleArray(taskHandle), mxCreateDoubleScalar(1000.0) }) ;
+    mxArray * data = mxCreateDoubleMatrix(1000, 2, mxREAL) ;
+    for (size_t i=0; i<2000; ++i)  {
+        mxGetPr(data)[i] = 0.001*i ;
+    }
+    CHECK(!wasWriteAfterSettingTimingSkipped(taskHandle, 1000.0, data)) ;
+    CHECK(wasWriteAfterSettingTimingSkipped(taskHandle, 1000.0, data)) ;
+    CHECK(!wasWriteAfterSettingTimingSkipped(taskHandle, 500.0, data)) ;
+    mxDestroyArray(data) ;
+    clearTask(taskHandle) ;
+}
+
+// Streaming turns off regeneration, and stopping the stream should turn it back on, so 
+// that later writes of the same data to the task can be skipped again
+static void testStopOutputStreamRestoresRegeneration(void)  {
+    uint64_t taskHandle = createTask("testStopOutputStreamRestoresRegeneration") ;
+    callNi({ mxCreateString("DAQmxCreateAOVoltageChan"), taskHandleArray(taskHandle), mxCreateString("Dev1/ao0:1") }) ;
+    callNi({ mxCreateString("DAQmxCfgOutputBuffer"), taskHandleArray(taskHandle), mxCreateDoubleScalar(1000.0) }) ;
+    mxArray * data = mxCreateDoubleMatrix(1000, 2, mxREAL) ;
+    for (size_t i=0; i<2000; ++i)  {
+        mxGetPr(data)[i] = 0.001*i ;
+    }
+    callNi({ mxCreateString("StartOutputStream"), taskHandleArray(taskHandle), mxCreateDoubleScalar(1000.0) }) ;
+    callNi({ mxCreateString("WriteToOutputStream"), taskHandleArray(taskHandle), mxCreateDoubleScalar(-1.0), mxDuplicateArray(data) }) ;
+    callNi({ mxCreateString("StopOutputStream"), taskHandleArray(taskHandle) }) ;
+    CHECK(!wasWriteAfterSettingTimingSkipped(taskHandle, 1000.0, data)) ;
+    CHECK(wasWriteAfterSettingTimingSkipped(taskHandle, 1000.0, data)) ;
+    mxDestroyArray(data) ;
+    clearTask(taskHandle) ;
+}
+
+
+
+//
+// ReconfigureCOPulseTrain
+//
+
+// Make a counter-output task of pulseCount pulses at frequency, committed, as Triggering does
+static uint64_t createCommittedCOPulseTrainTask(const char * taskName, double frequency, double pulseCount)  {
+    uint64_t taskHandle = createTask(taskName) ;
+    callNi({ mxCreateString("DAQmxCreateCOPulseChanFreq"), taskHandleArray(taskHandle), mxCreateString("Dev1/ctr0"),
+             mxCreateString("DAQmx_Val_Low"), mxCreateDoubleScalar(0.0), mxCreateDoubleScalar(frequency), mxCreateDoubleScalar(0.5) }) ;
+    callNi({ mxCreateString("DAQmxCfgImplicitTiming"), taskHandleArray(taskHandle), mxCreateString("DAQmx_Val_FiniteSamps"),
+             mxCreateDoubleScalar(pulseCount) }) ;
+    callNi({ mxCreateString("DAQmxTaskControl"), taskHandleArray(taskHandle), mxCreateString("DAQmx_Val_Task_Commit") }) ;
+    return taskHandle ;
+}
+
+// Whether the task is committed as it's now configured
+static bool isTaskCommittedAsConfigured(uint64_t taskHandle)  {
+    std::vector<mxArray *> outputs = callNi(2, { mxCreateString("GetTaskConfigurationFingerprint"), taskHandleArray(taskHandle) }) ;
+    bool result = (mxGetScalar(outputs[1]) != 0.0) ;
+    destroyArrays(outputs) ;
+    return result ;
+}
+
+// A finite counter task that's done, but was never stopped, as at the end of a run, 
+// should be stopped and then changed, and be ready to start again
+static void testReconfigureCOPulseTrainOfFinishedFiniteTask(void)  {
+    uint64_t taskHandle = createCommittedCOPulseTrainTask("testReconfigureCOPulseTrainOfFinishedFiniteTask", 1000.0, 5.0) ;
+    callNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) }) ;
+    callNi({ mxCreateString("DAQmxWaitUntilTaskDone"), taskHandleArray(taskHandle), mxCreateDoubleScalar(-1.0) }) ;
+    std::vector<mxArray *> outputs = callNi(1, { mxCreateString("ReconfigureCOPulseTrain"), taskHandleArray(taskHandle),
+                                                 mxCreateDoubleScalar(2000.0), mxCreateDoubleScalar(0.5), mxCreateDoubleScalar(10.0) }) ;
+    CHECK(mxGetScalar(outputs[0]) != 0.0) ;
+    destroyArrays(outputs) ;
+    CHECK(isTaskCommittedAsConfigured(taskHandle)) ;
+    callNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) }) ;
+    callNi({ mxCreateString("DAQmxWaitUntilTaskDone"), taskHandleArray(taskHandle), mxCreateDoubleScalar(-1.0) }) ;
+    callNi({ mxCreateString("DAQmxStopTask"), taskHandleArray(taskHandle) }) ;
+    clearTask(taskHandle) ;
+}
+
+// A running task gets stopped before it's changed
+static void testReconfigureCOPulseTrainOfRunningTask(void)  {
+    uint64_t taskHandle = createCommittedCOPulseTrainTask("testReconfigureCOPulseTrainOfRunningTask", 1000.0, 5.0) ;
+    callNi({ mxCreateString("ReconfigureCOPulseTrain"), taskHandleArray(taskHandle), mxCreateDoubleScalar(1000.0),
+             mxCreateDoubleScalar(0.5), mxCreateDoubleScalar(mxGetInf()) }) ;
+    callNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) }) ;
+    CHECK(!isTaskDone(taskHandle)) ;
+    callNi({ mxCreateString("ReconfigureCOPulseTrain"), taskHandleArray(taskHandle), mxCreateDoubleScalar(2000.0),
+             mxCreateDoubleScalar(0.5), mxCreateDoubleScalar(10.0) }) ;
+    CHECK(isTaskDone(taskHandle)) ;
+    CHECK(isTaskCommittedAsConfigured(taskHandle)) ;
+    clearTask(taskHandle) ;
+}
+
+
+
+
+//
+// Starting and stopping
+//
+
+// As with DAQmx, a finite task that's done, but not stopped, is still running, and 
+// can't be started again until it's stopped
+static void testStartingFinishedFiniteTaskNeedsAStop(void)  {
+    uint64_t taskHandle = createFinishedFiniteAITask("testStartingFinishedFiniteTaskNeedsAStop", 1, 100) ;
+    CHECK(errorIdentifierFromCallingNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) }) == "ws:ni:DAQmxError:n200479") ;
+    callNi({ mxCreateString("DAQmxStopTask"), taskHandleArray(taskHandle) }) ;
+    CHECK(errorIdentifierFromCallingNi({ mxCreateString("DAQmxStartTask"), taskHandleArray(taskHandle) }).empty()) ;
+    callNi({ mxCreateString("DAQmxStopTask"), taskHandleArray(taskHandle) }) ;
+    clearTask(taskHandle) ;
+}
+
+
+
+int main(void)  {
+    // Run the simulated clock as fast as possible
+    WSSimulatedDAQmxSetTimeScale(0.0) ;
+
+    runTest(testWaitForScansOnFinishedFiniteTask, "testWaitForScansOnFinishedFiniteTask") ;
+    runTest(testWaitForScansOnPartlyReadFinishedFiniteTask, "testWaitForScansOnPartlyReadFinishedFiniteTask") ;
+    runTest(testWaitForScansOnFiniteTaskThatFinishesDuringWait, "testWaitForScansOnFiniteTaskThatFinishesDuringWait") ;
+    runTest(testWaitForPackedDigitalLinesOnFinishedFiniteTask, "testWaitForPackedDigitalLinesOnFinishedFiniteTask") ;
+    runTest(testWriteCacheSurvivesSettingTheSameTiming, "testWriteCacheSurvivesSettingTheSameTiming") ;
+    runTest(testStopOutputStreamRestoresRegeneration, "testStopOutputStreamRestoresRegeneration") ;
+    runTest(testReconfigureCOPulseTrainOfFinishedFiniteTask, "testReconfigureCOPulseTrainOfFinishedFiniteTask") ;
+    runTest(testReconfigureCOPulseTrainOfRunningTask, "testReconfigureCOPulseTrainOfRunningTask") ;
+    runTest(testStartingFinishedFiniteTaskNeedsAStop, "testStartingFinishedFiniteTaskNeedsAStop") ;
+
+    if (FAILURE_COUNT > 0)  {
+        fprintf(stderr, "%d check(s) failed\n", FAILURE_COUNT) ;
+        return 1 ;
+    }
+    printf("All checks passed\n") ;
+    return 0 ;
+}
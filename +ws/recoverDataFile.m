@@ -0,0 +1,26 @@
+function [wasJournaled, sweepCount, wasComplete] = recoverDataFile(fileName, doCompress, doWriteOverviews)
+    % Rebuilds a WaveSurfer data file logged in the journal format from the
+    % .journal file next to it, writing the scans into the usual per-sweep
+    % datasets, then deletes the .journal file.  WaveSurfer does this itself
+    % at the end of each run, so this is only needed for files left over from
+    % a run that didn't finish normally, as when WaveSurfer or the computer
+    % crashed.  Everything that made it into the journal intact is recovered,
+    % which is all but at most the last second or so of scans.  Returns true
+    % in wasJournaled iff the file had a journal; files without one are left
+    % as-is.  sweepCount is the number of sweeps recovered, and wasComplete is
+    % false if the journal was cut short, in which case the last sweep may be
+    % missing some scans.  If doCompress is true, the scans are compressed
+    % with ws.logger's lossless filter.  If doWriteOverviews is true, each
+    % sweep gets min/max overviews of its analog scans, as when
+    % ws.Logging's DoWriteOverviews is true.  Both default to false.
+    if ~exist('doCompress', 'var') || isempty(doCompress) ,
+        doCompress = false ;
+    end
+    if ~exist('doWriteOverviews', 'var') || isempty(doWriteOverviews) ,
+        doWriteOverviews = false ;
+    end
+    if ~exist(fileName, 'file') && ~ws.isJournaledDataFile(fileName) ,
+        error('The file %s does not exist.', fileName) ;
+    end
+    [wasJournaled, sweepCount, wasComplete] = ws.logger('ReplayJournal', fileName, logical(doCompress), logical(doWriteOverviews)) ;
+end
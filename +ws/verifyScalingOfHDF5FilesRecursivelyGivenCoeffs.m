@@ -1,4 +1,11 @@
 function isAllWell = verifyScalingOfHDF5FilesRecursivelyGivenCoeffs(sourceFolderPath, scalingCoefficients, targetFolderPath)
+    % If ws.rescaler has been built, use it: it does the whole tree, several
+    % files at a time, and checks the scans of each target file too.
+    if exist('ws.rescaler','file')==3 ,
+        isAllWell = ws.rescaler('VerifyScaling', sourceFolderPath, scalingCoefficients, targetFolderPath) ;
+        return
+    end
+    
     % So far, everything is swell...
     isAllWell = true ;
     